@@ -0,0 +1,299 @@
+// -*- c-basic-offset: 4; indent-tabs-mode: nil -*-
+//
+// Micro-benchmarks of the simulator's own hot paths: the event list,
+// queues, pipes, the packet pools, fat tree FIB lookup and the
+// logfile writer.  Each one runs a fixed amount of work and reports
+// what it cost.
+//
+// usage: bench_micro [-scale X] [bench ...]
+//
+// -scale multiplies the amount of work every benchmark does.  With
+// no bench names, all of them run.  Output is one line per benchmark:
+//   bench=<name> ops=<n> wall_s=<x> ns_per_op=<x> events=<n>
+//     events_per_sec=<x> sim_ns_per_wall_s=<x> peak_rss_kb=<n>
+// events and the rates derived from them are 0 for benchmarks that
+// don't run the event list.
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <chrono>
+#include "config.h"
+#include "eventlist.h"
+#include "network.h"
+#include "route.h"
+#include "queue.h"
+#include "compositequeue.h"
+#include "pipe.h"
+#include "logfile.h"
+#include "ndppacket.h"
+#include "fat_tree_topology.h"
+#include "fat_tree_switch.h"
+
+static double scale = 1.0;
+
+static uint64_t scaled(uint64_t n) {
+    return (uint64_t)(n * scale) > 0 ? (uint64_t)(n * scale) : 1;
+}
+
+// a small LCG, so that the work done doesn't depend on the libc
+static uint32_t bench_rand() {
+    static uint64_t state = 1;
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return state >> 33;
+}
+
+class Timer {
+ public:
+    Timer() : _start(chrono::steady_clock::now()) {}
+    double elapsed() const {
+        return chrono::duration<double>(chrono::steady_clock::now() - _start).count();
+    }
+ private:
+    chrono::steady_clock::time_point _start;
+};
+
+static void report(const string& name, uint64_t ops, double wall, uint64_t events, simtime_picosec simtime) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    cout << "bench=" << name << " ops=" << ops << " wall_s=" << wall
+         << " ns_per_op=" << wall * 1e9 / ops
+         << " events=" << events
+         << " events_per_sec=" << (events ? events / wall : 0)
+         << " sim_ns_per_wall_s=" << (events ? timeAsNs(simtime) / wall : 0)
+         << " peak_rss_kb=" << usage.ru_maxrss << endl;
+}
+
+// frees whatever reaches the end of its route
+class DiscardSink : public PacketSink {
+ public:
+    DiscardSink() : _count(0), _nodename("discard") {}
+    virtual void receivePacket(Packet& pkt) {_count++; pkt.free();}
+    virtual const string& nodename() {return _nodename;}
+    uint64_t _count;
+ private:
+    string _nodename;
+};
+
+// reschedules itself a random time ahead, and optionally keeps a
+// timeout re-armed far in the future, as a transport's RTO would be
+class Ticker : public EventSource {
+ public:
+    Ticker(EventList& eventlist, bool use_timer)
+        : EventSource(eventlist, "ticker"), _timer(*this), _use_timer(use_timer) {}
+    void start() {
+        eventlist().sourceIsPendingRel(*this, 1 + bench_rand() % 1000000);
+    }
+    virtual void doNextEvent() {
+        if (_use_timer)
+            _timer.setRel(timeFromMs(1));
+        eventlist().sourceIsPendingRel(*this, 1 + bench_rand() % 1000000);
+    }
+ private:
+    EventTimer _timer;
+    bool _use_timer;
+};
+
+static void bench_eventlist(const string& name, EventList::scheduler_type type, bool use_timer) {
+    uint64_t events = scaled(5000000);
+    EventList eventlist;
+    eventlist.setScheduler(type);
+    vector<Ticker*> tickers;
+    for (int i = 0; i < 10000; i++) {
+        tickers.push_back(new Ticker(eventlist, use_timer));
+        tickers.back()->start();
+    }
+    Timer timer;
+    while (eventlist.eventCount() < events && eventlist.doNextEvent()) {}
+    double wall = timer.elapsed();
+    report(name, eventlist.eventCount(), wall, eventlist.eventCount(), eventlist.now());
+    for (size_t i = 0; i < tickers.size(); i++)
+        delete tickers[i];
+}
+
+// sends bursts of packets along a route at an average of line rate
+class Blaster : public EventSource {
+ public:
+    Blaster(EventList& eventlist, Route& route, linkspeed_bps rate, uint32_t burst, uint64_t packets)
+        : EventSource(eventlist, "blaster"), _flow(NULL), _route(route), _rate(rate),
+          _burst(burst), _left(packets), _seqno(1) {}
+    virtual void doNextEvent() {
+        mem_b bytes = 0;
+        for (uint32_t i = 0; i < _burst && _left > 0; i++, _left--) {
+            NdpPacket* p = NdpPacket::newpkt(_flow, _route, _seqno, 0, PKT_SIZE, false, 1, false);
+            _seqno += PKT_SIZE;
+            bytes += p->size();
+            p->sendOn();
+        }
+        if (_left > 0)
+            eventlist().sourceIsPendingRel(*this, (simtime_picosec)(bytes * 8 * 1e12 / _rate));
+    }
+    static const int PKT_SIZE = 4096;
+ private:
+    PacketFlow _flow;
+    Route& _route;
+    linkspeed_bps _rate;
+    uint32_t _burst;
+    uint64_t _left;
+    uint64_t _seqno;
+};
+
+// packets through a queue then a pipe, or through a pipe alone
+static void bench_path(const string& name, BaseQueue* queue, EventList& eventlist, uint64_t packets) {
+    DiscardSink sink;
+    Pipe pipe(timeFromUs(1.0), eventlist);
+    Route route;
+    if (queue)
+        route.push_back(queue);
+    route.push_back(&pipe);
+    route.push_back(&sink);
+    Blaster blaster(eventlist, route, speedFromGbps(100), 64, packets);
+    eventlist.sourceIsPending(blaster, 0);
+
+    Timer timer;
+    while (eventlist.doNextEvent()) {}
+    double wall = timer.elapsed();
+    report(name, sink._count, wall, eventlist.eventCount(), eventlist.now());
+}
+
+static void bench_queue() {
+    EventList eventlist;
+    Queue queue(speedFromGbps(100), memFromPkt(1000), eventlist, NULL);
+    bench_path("queue", &queue, eventlist, scaled(2000000));
+}
+
+static void bench_compositequeue() {
+    EventList eventlist;
+    CompositeQueue queue(speedFromGbps(100), memFromPkt(1000), eventlist, NULL);
+    bench_path("compositequeue", &queue, eventlist, scaled(2000000));
+}
+
+static void bench_pipe() {
+    EventList eventlist;
+    bench_path("pipe", NULL, eventlist, scaled(2000000));
+}
+
+static void bench_packetdb() {
+    uint64_t rounds = scaled(20000);
+    const int batch = 256;
+    PacketFlow flow(NULL);
+    NdpPacket* pkts[batch];
+    Timer timer;
+    for (uint64_t r = 0; r < rounds; r++) {
+        for (int i = 0; i < batch; i++)
+            pkts[i] = NdpPacket::newpkt(flow, r * batch + i, 0, 4096, false, false);
+        for (int i = 0; i < batch; i++)
+            pkts[i]->free();
+    }
+    double wall = timer.elapsed();
+    report("packetdb", rounds * batch, wall, 0, 0);
+}
+
+// next hop lookups at every switch of a 128 host, three tier fat tree
+static void bench_fib() {
+    uint64_t lookups = scaled(5000000);
+    EventList eventlist;
+    FatTreeTopology::set_tiers(3);
+    FatTreeSwitch::set_strategy(FatTreeSwitch::ECMP);
+    // keep the topology's chatter out of our output
+    streambuf* out = cout.rdbuf(cerr.rdbuf());
+    FatTreeTopology top(128, speedFromGbps(100), memFromPkt(64), NULL, &eventlist, NULL,
+                        COMPOSITE, timeFromUs(1.0), 0);
+    cout.rdbuf(out);
+    vector<FatTreeSwitch*> switches;
+    vector<Switch*>* tiers[] = {&top.switches_lp, &top.switches_up, &top.switches_c};
+    for (int t = 0; t < 3; t++)
+        for (size_t i = 0; i < tiers[t]->size(); i++)
+            switches.push_back(dynamic_cast<FatTreeSwitch*>((*tiers[t])[i]));
+
+    // a packet can't turn back up once it has gone down, so each lookup
+    // takes a fresh one from the pool; bench packetdb for that share
+    PacketFlow flow(NULL);
+    uint64_t done = 0;
+    Timer timer;
+    while (done < lookups) {
+        FatTreeSwitch* sw = switches[bench_rand() % switches.size()];
+        uint32_t dst = bench_rand() % top.no_of_nodes();
+        // hosts on a ToR's own ports need a transport registered
+        if (sw->getType() == FatTreeSwitch::TOR && top.HOST_POD_SWITCH(dst) == sw->getID())
+            continue;
+        NdpPacket* pkt = NdpPacket::newpkt(flow, 1, 0, 4096, false, false);
+        pkt->set_dst(dst);
+        pkt->set_pathid(bench_rand());
+        sw->getNextHop(*pkt, NULL);
+        pkt->free();
+        done++;
+    }
+    double wall = timer.elapsed();
+    report("fib", done, wall, 0, 0);
+}
+
+static void bench_logfile() {
+    uint64_t records = scaled(10000000);
+    EventList eventlist;
+    char filename[] = "/tmp/bench_logfile_XXXXXX";
+    int fd = mkstemp(filename);
+    close(fd);
+    Timer timer;
+    {
+        Logfile logfile(filename, eventlist);
+        logfile.setStartTime(0);
+        for (uint64_t i = 0; i < records; i++)
+            logfile.writeRecord(i % 16, i % 1024, i % 8, i, i * 0.5, 1.0);
+    }
+    double wall = timer.elapsed();
+    unlink(filename);
+    report("logfile", records, wall, 0, 0);
+}
+
+struct Bench {
+    const char* name;
+    void (*run)();
+};
+
+static void eventlist_heap() {bench_eventlist("eventlist_heap", EventList::HEAP, false);}
+static void eventlist_calendar() {bench_eventlist("eventlist_calendar", EventList::CALENDAR, false);}
+static void eventlist_cancel() {bench_eventlist("eventlist_cancel", EventList::HEAP, true);}
+
+static Bench benches[] = {
+    {"eventlist_heap", eventlist_heap},
+    {"eventlist_calendar", eventlist_calendar},
+    {"eventlist_cancel", eventlist_cancel},
+    {"queue", bench_queue},
+    {"compositequeue", bench_compositequeue},
+    {"pipe", bench_pipe},
+    {"packetdb", bench_packetdb},
+    {"fib", bench_fib},
+    {"logfile", bench_logfile},
+};
+
+int main(int argc, char** argv) {
+    vector<string> names;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-scale") && i + 1 < argc) {
+            scale = atof(argv[++i]);
+        } else if (argv[i][0] != '-') {
+            names.push_back(argv[i]);
+        } else {
+            cerr << "usage: " << argv[0] << " [-scale X] [bench ...]" << endl;
+            exit(1);
+        }
+    }
+
+    size_t count = sizeof(benches) / sizeof(benches[0]);
+    for (size_t n = 0; n < names.size(); n++) {
+        size_t b = 0;
+        while (b < count && names[n] != benches[b].name)
+            b++;
+        if (b == count) {
+            cerr << "unknown bench " << names[n] << endl;
+            exit(1);
+        }
+    }
+    for (size_t b = 0; b < count; b++) {
+        if (names.empty() || find(names.begin(), names.end(), benches[b].name) != names.end())
+            benches[b].run();
+    }
+    return 0;
+}
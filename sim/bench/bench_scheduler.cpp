@@ -0,0 +1,249 @@
+// -*- c-basic-offset: 4; indent-tabs-mode: nil -*-
+//
+// Per-packet cost of the host schedulers.  Each source keeps a
+// window of SWIFT packets queued at the scheduler and sends another
+// from send_callback(), so the scheduler always has every flow
+// backlogged, which is the case that matters at large flow counts.
+//
+// The map/list based schedulers that the current ones replaced are
+// kept here (MapFifoScheduler, MapFairScheduler) so that the two can
+// be compared on the same machine.
+//
+// usage: bench_scheduler [-packets N] [-window W] [-flows a,b,c...]
+//
+// Output is one line per run of the form
+//   bench=scheduler impl=<impl> flows=<n> packets=<n> ns_per_pkt=<x>
+
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <list>
+#include <map>
+#include <sstream>
+#include "config.h"
+#include "eventlist.h"
+#include "network.h"
+#include "route.h"
+#include "swiftpacket.h"
+#include "swift_scheduler.h"
+
+class MapBaseScheduler : public BaseQueue {
+ public:
+    MapBaseScheduler(linkspeed_bps bitrate, EventList &eventlist)
+        : BaseQueue(bitrate, eventlist, NULL), _pkt_count(0) {}
+    virtual void enqueue(Packet& pkt) = 0;
+    virtual Packet* dequeue() = 0;
+    virtual Packet* next_packet() = 0;
+    virtual void doNextEvent() {completeService();}
+
+    virtual void beginService() {
+        Packet* p = next_packet();
+        if (p->type() == SWIFT)
+            static_cast<SwiftPacket*>(p)->set_ts(eventlist().now());
+        eventlist().sourceIsPendingRel(*this, (simtime_picosec)(p->size() * _ps_per_byte));
+    }
+
+    virtual void completeService() {
+        Packet* pkt = dequeue();
+        int flow_id = pkt->flow_id();
+        packet_type ptype = pkt->type();
+        pkt->flow().logTraffic(*pkt, *this, TrafficLogger::PKT_DEPART);
+        pkt->sendOn();
+        if (_pkt_count > 0)
+            beginService();
+        if (ptype == SWIFT) {
+            _queue_counts[flow_id]--;
+            _srcs[flow_id]->send_callback();
+        }
+    }
+
+    virtual void receivePacket(Packet& pkt) {
+        int flow_id = pkt.flow_id();
+        if (pkt.type() == SWIFT)
+            _queue_counts[flow_id]++;
+        enqueue(pkt);
+        if (_pkt_count == 1)
+            beginService();
+    }
+
+    virtual mem_b queuesize() const {return _pkt_count;}
+    virtual mem_b maxsize() const {return 0;}
+    void add_src(int32_t flow_id, ScheduledSrc* src) {
+        _queue_counts[flow_id] = 0;
+        _srcs[flow_id] = src;
+    }
+ protected:
+    uint32_t _pkt_count;
+    map <flowid_t, int32_t> _queue_counts;
+    map <flowid_t, ScheduledSrc*> _srcs;
+};
+
+class MapFifoScheduler : public MapBaseScheduler {
+ public:
+    MapFifoScheduler(linkspeed_bps bitrate, EventList &eventlist)
+        : MapBaseScheduler(bitrate, eventlist) {}
+    virtual void enqueue(Packet& pkt) {
+        _queue.push_front(&pkt);
+        _pkt_count++;
+    }
+    virtual Packet* next_packet() {return _queue.back();}
+    virtual Packet* dequeue() {
+        Packet* packet = _queue.back();
+        _queue.pop_back();
+        _pkt_count--;
+        return packet;
+    }
+ protected:
+    list<Packet*> _queue;
+};
+
+class MapFairScheduler : public MapBaseScheduler {
+ public:
+    MapFairScheduler(linkspeed_bps bitrate, EventList &eventlist)
+        : MapBaseScheduler(bitrate, eventlist), _next_packet(NULL) {
+        _current_queue = _queue_map.begin();
+    }
+    virtual void enqueue(Packet& pkt) {
+        map<flowid_t, list<Packet*>*>::iterator i = _queue_map.find(pkt.flow_id());
+        list<Packet*>* pkt_queue;
+        if (i == _queue_map.end()) {
+            pkt_queue = new list<Packet*>;
+            _queue_map.insert(pair<int32_t, list<Packet*>*>(pkt.flow_id(), pkt_queue));
+        } else {
+            pkt_queue = i->second;
+        }
+        pkt_queue->push_front(&pkt);
+        _pkt_count++;
+    }
+    virtual Packet* next_packet() {
+        while (1) {
+            if (_current_queue == _queue_map.end())
+                _current_queue = _queue_map.begin();
+            list<Packet*>* pkt_queue = _current_queue->second;
+            _current_queue++;
+            if (!pkt_queue->empty()) {
+                _next_packet = pkt_queue->back();
+                pkt_queue->pop_back();
+                return _next_packet;
+            }
+        }
+    }
+    virtual Packet* dequeue() {
+        Packet* p = _next_packet;
+        _next_packet = NULL;
+        _pkt_count--;
+        return p;
+    }
+ protected:
+    map<flowid_t, list<Packet*>*> _queue_map;
+    map<flowid_t, list<Packet*>*>::iterator _current_queue;
+    Packet* _next_packet;
+};
+
+// frees whatever the scheduler sends on
+class DiscardSink : public PacketSink {
+ public:
+    DiscardSink() : _count(0), _nodename("discard") {}
+    virtual void receivePacket(Packet& pkt) {_count++; pkt.free();}
+    virtual const string& nodename() {return _nodename;}
+    uint64_t _count;
+ private:
+    string _nodename;
+};
+
+class BenchSrc : public ScheduledSrc {
+ public:
+    BenchSrc(PacketSink& sched, PacketSink& sink, uint64_t* budget)
+        : _flow(NULL), _seqno(1), _budget(budget) {
+        _route.push_back(&sched);
+        _route.push_back(&sink);
+    }
+    void send() {
+        if (*_budget == 0)
+            return;
+        (*_budget)--;
+        SwiftPacket* p = SwiftPacket::newpkt(_flow, _route, _seqno, _seqno, PKT_SIZE);
+        _seqno += PKT_SIZE;
+        p->sendOn();
+    }
+    virtual ~BenchSrc() {}
+    virtual void send_callback() {send();}
+    flowid_t flow_id() const {return _flow.flow_id();}
+    static const int PKT_SIZE = 4096;
+ private:
+    PacketFlow _flow;
+    Route _route;
+    uint64_t _seqno;
+    uint64_t* _budget;
+};
+
+template <class Sched>
+double run(uint32_t flows, uint64_t packets, uint32_t window) {
+    EventList eventlist;
+    Sched sched(speedFromGbps(100), eventlist);
+    DiscardSink sink;
+    uint64_t budget = packets;
+    vector<BenchSrc*> srcs;
+    for (uint32_t f = 0; f < flows; f++) {
+        srcs.push_back(new BenchSrc(sched, sink, &budget));
+        sched.add_src(srcs.back()->flow_id(), srcs.back());
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (uint32_t w = 0; w < window; w++)
+        for (uint32_t f = 0; f < flows; f++)
+            srcs[f]->send();
+    while (eventlist.doNextEvent()) {}
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+    assert(sink._count == packets);
+    for (uint32_t f = 0; f < flows; f++)
+        delete srcs[f];
+    return chrono::duration<double, nano>(end - start).count() / packets;
+}
+
+// the scheduler constructors differ only in the logger argument
+class FifoBench : public FifoScheduler {
+ public:
+    FifoBench(linkspeed_bps bitrate, EventList& eventlist) : FifoScheduler(bitrate, eventlist, NULL) {}
+};
+
+class FairBench : public FairScheduler {
+ public:
+    FairBench(linkspeed_bps bitrate, EventList& eventlist) : FairScheduler(bitrate, eventlist, NULL) {}
+};
+
+int main(int argc, char** argv) {
+    uint64_t packets = 2000000;
+    uint32_t window = 4;
+    vector<uint32_t> flow_counts = {1, 8, 64, 512};
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-packets") && i + 1 < argc) {
+            packets = strtoull(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-window") && i + 1 < argc) {
+            window = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-flows") && i + 1 < argc) {
+            flow_counts.clear();
+            stringstream ss(argv[++i]);
+            string n;
+            while (getline(ss, n, ','))
+                flow_counts.push_back(atoi(n.c_str()));
+        } else {
+            cerr << "usage: " << argv[0] << " [-packets N] [-window W] [-flows a,b,c...]" << endl;
+            exit(1);
+        }
+    }
+
+    for (uint32_t flows : flow_counts) {
+        cout << "bench=scheduler impl=fifo_map flows=" << flows << " packets=" << packets
+             << " ns_per_pkt=" << run<MapFifoScheduler>(flows, packets, window) << endl;
+        cout << "bench=scheduler impl=fifo flows=" << flows << " packets=" << packets
+             << " ns_per_pkt=" << run<FifoBench>(flows, packets, window) << endl;
+        cout << "bench=scheduler impl=fair_map flows=" << flows << " packets=" << packets
+             << " ns_per_pkt=" << run<MapFairScheduler>(flows, packets, window) << endl;
+        cout << "bench=scheduler impl=fair flows=" << flows << " packets=" << packets
+             << " ns_per_pkt=" << run<FairBench>(flows, packets, window) << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+
+# Macro-benchmarks: fixed htsim_eqds/htsim_ndp scenarios from
+# datacenter/connection_matrices, timed end to end.  Prints one line
+# per scenario in the same key=value form as bench_micro:
+#   bench=<name> events=<n> simtime_ps=<n> wall_s=<x> events_per_sec=<x>
+#     sim_ns_per_wall_s=<x> peak_rss_kb=<n>
+
+import os
+import re
+import sys
+import time
+import argparse
+import tempfile
+
+
+DC_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'datacenter')
+
+SCENARIOS = {
+	'eqds_perm_1024': ['htsim_eqds', '-nodes', '1024', '-tm', 'perm_1024n_1024c_0u_2000000b.cm',
+			'-strat', 'ecmp_host', '-paths', '16', '-end', '1000'],
+	'eqds_incast_128': ['htsim_eqds', '-nodes', '128', '-tm', 'incast_128.cm',
+			'-strat', 'ecmp_host', '-paths', '16', '-end', '1000'],
+	'ndp_perm_1024': ['htsim_ndp', '-nodes', '1024', '-tm', 'perm_1024n_1024c_0u_2000000b.cm',
+			'-strat', 'perm', '-end', '1000'],
+	'ndp_incast_128': ['htsim_ndp', '-nodes', '128', '-tm', 'incast_128.cm',
+			'-strat', 'perm', '-end', '1000'],
+}
+
+
+def run_scenario(name: str, args: list[str], verbose: bool = False):
+	logfile = tempfile.NamedTemporaryFile(prefix='bench_macro_', suffix='.log', delete=False)
+	logfile.close()
+	cmd = [os.path.join(DC_DIR, args[0])] + args[1:] + ['-o', logfile.name, '-sim_stats']
+	# the traffic matrix is looked up relative to the datacenter directory
+	tm = cmd.index('-tm') + 1
+	cmd[tm] = os.path.join(DC_DIR, 'connection_matrices', cmd[tm])
+
+	start = time.monotonic()
+	out_r, out_w = os.pipe()
+	pid = os.fork()
+	if pid == 0:
+		os.dup2(out_w, 1)
+		os.close(out_r)
+		os.close(out_w)
+		os.execv(cmd[0], cmd)
+	os.close(out_w)
+	with os.fdopen(out_r, 'r') as out:
+		output = out.read()
+	_, status, usage = os.wait4(pid, 0)
+	wall = time.monotonic() - start
+	os.unlink(logfile.name)
+
+	if verbose:
+		sys.stderr.write(output)
+	stats = re.search(r'sim_stats events=(\d+) simtime_ps=(\d+)', output)
+	if os.waitstatus_to_exitcode(status) != 0 or not stats:
+		print(f'bench={name} failed: exit status {os.waitstatus_to_exitcode(status)}')
+		return
+	events = int(stats.group(1))
+	simtime = int(stats.group(2))
+	print(f'bench={name} events={events} simtime_ps={simtime} wall_s={wall:.6g}'
+	      f' events_per_sec={events / wall:.6g} sim_ns_per_wall_s={simtime / 1000 / wall:.6g}'
+	      f' peak_rss_kb={usage.ru_maxrss}', flush=True)
+
+
+if __name__ == '__main__':
+	parser = argparse.ArgumentParser(description = 'Run the htsim macro-benchmarks')
+	parser.add_argument('scenarios', nargs = '*', help = 'scenarios to run (default: all)')
+	parser.add_argument('-v', '--verbose', action = 'store_true', help = 'show simulator output')
+	args = parser.parse_args()
+
+	for name in args.scenarios:
+		if name not in SCENARIOS:
+			sys.exit(f'unknown scenario {name}, expected one of {", ".join(SCENARIOS)}')
+	for name in SCENARIOS:
+		if not args.scenarios or name in args.scenarios:
+			run_scenario(name, SCENARIOS[name], args.verbose)
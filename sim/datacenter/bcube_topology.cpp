@@ -345,17 +345,25 @@ Route* BCubeTopology::alt_dc_routing(uint32_t src,uint32_t dest, uint32_t i,uint
 
 vector<const Route*>* BCubeTopology::get_paths(uint32_t src, uint32_t dest){
     vector<const Route*>* paths = new vector<const Route*>(); 
- 
-    for (int64_t i = _K; i != static_cast<uint32_t>(-1); i--){
-        uint32_t level = (uint32_t)i;
-        if (addresses(src, level) != addresses(dest, level))
-            paths->push_back(dc_routing(src, dest, level));
-        else 
-            paths->push_back(alt_dc_routing(src, dest, level, get_neighbour(src,level)));
-    }
+    uint32_t count = get_path_count(src, dest);
+    paths->reserve(count);
+    for (uint32_t k = 0; k < count; k++)
+        paths->push_back(get_path(src, dest, k, false));
     return paths;
 }
 
+// Path k corrects the address digits starting at level _K-k, so the
+// paths are listed from the top level down.  No reverse routes are
+// built, so reverse is ignored.
+const Route* BCubeTopology::get_path(uint32_t src, uint32_t dest, uint32_t k, bool reverse){
+    assert(k < get_path_count(src, dest));
+    uint32_t level = _K - k;
+    if (addresses(src, level) != addresses(dest, level))
+        return RouteStore::intern(dc_routing(src, dest, level));
+    else 
+        return RouteStore::intern(alt_dc_routing(src, dest, level, get_neighbour(src,level)));
+}
+
 void BCubeTopology::print_paths(std::ofstream & p,uint32_t src,vector<const Route*>* paths){
     for (uint32_t i=0; i<paths->size(); i++)
         print_path(p, src, paths->at(i));
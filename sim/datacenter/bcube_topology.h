@@ -47,6 +47,8 @@ public:
 
     void init_network();
     virtual vector<const Route*>* get_paths(uint32_t src, uint32_t dest);
+    virtual uint32_t get_path_count(uint32_t src, uint32_t dest) {return _K+1;}
+    virtual const Route* get_path(uint32_t src, uint32_t dest, uint32_t k, bool reverse);
  
 
     void count_queue(Queue*);
@@ -630,8 +630,9 @@ bool ConnectionMatrix::save(FILE* f){
         return false;
 
     for (uint32_t i = 0; i < conns->size(); i++){
-        if (fprintf(f,"%u->%u start %f size %u\n", conns->at(i)->src, conns->at(i)->dst,
-                    timeAsUs(conns->at(i)->start), conns->at(i)->size) < 0)
+        if (fprintf(f,"%u->%u start %f size %u%s\n", conns->at(i)->src, conns->at(i)->dst,
+                    timeAsUs(conns->at(i)->start), conns->at(i)->size,
+                    conns->at(i)->fluid ? " fluid" : "") < 0)
             return false;
     }
     fclose(f);
@@ -750,6 +751,7 @@ bool ConnectionMatrix::load(istream& file){
             c->start = NO_START;
 
             c->addOnTriggerSignal=false; // 
+            c->fluid = false;
 
             for (size_t i = 1; i < tokens.size(); i++) {
                 if (tokens[i] == "start") {
@@ -766,6 +768,8 @@ bool ConnectionMatrix::load(istream& file){
                         cerr << "Flow ID zero is not allowed\n";
                         exit(1);
                     }
+                } else if (tokens[i] == "fluid") {
+                    c->fluid = true;
                 } else if (tokens[i] == "addon") {
                     c->addOnTriggerSignal=true;  // 
                 } else if (tokens[i] == "trigger") {
@@ -812,6 +816,11 @@ bool ConnectionMatrix::load(istream& file){
                                 << linecount << endl;
                         exit(1);
             }
+            if (c->fluid && (c->trigger || c->send_done_trigger || c->recv_done_trigger)) {
+                        cerr << "Error: fluid flow at line " << linecount
+                                << " can't use triggers" << endl;
+                        exit(1);
+            }
             conns->push_back(c);
         } else if (tokens[0] == "trigger") {
             // we're parsing a trigger
@@ -22,6 +22,7 @@ struct connection{
     simtime_picosec start;
     int priority;
     bool addOnTriggerSignal; // 
+    bool fluid; // background load, simulated as a rate rather than as packets
 };
 
 typedef enum {UNSPECIFIED, SINGLE_SHOT, MULTI_SHOT, BARRIER} trigger_type;
@@ -0,0 +1,193 @@
+// -*- c-basic-offset: 4; indent-tabs-mode: nil -*-
+#include "dragon_fly_switch.h"
+#include "dragon_fly_topology.h"
+#include "fat_tree_switch.h"
+#include "routetable.h"
+#include "callback_pipe.h"
+
+thread_local DragonFlySwitch::routing_strategy DragonFlySwitch::_strategy = DragonFlySwitch::NIX;
+thread_local uint32_t DragonFlySwitch::_ugal_threshold = 0;
+thread_local uint64_t DragonFlySwitch::_minimal_routed = 0;
+thread_local uint64_t DragonFlySwitch::_valiant_routed = 0;
+
+DragonFlySwitch::DragonFlySwitch(EventList& eventlist, string s, uint32_t id, simtime_picosec delay, DragonFlyTopology* dt): Switch(eventlist, s), _egress(*this) {
+    _id = id;
+    _dt = dt;
+    _group = _dt->SWITCH_GROUP(id);
+    _pipe = new CallbackPipe(delay, eventlist, &_egress);
+    _fib = new RouteTable();
+    _routers.resize(_dt->routers_per_group(), NULL);
+    _groups.resize(_dt->no_of_groups(), NULL);
+}
+
+const string& DragonFlySwitchEgress::nodename() {
+    return _switch.nodename();
+}
+
+bool DragonFlySwitch::set_strategy(const string& name) {
+    if (name == "minimal")
+        _strategy = MINIMAL;
+    else if (name == "valiant")
+        _strategy = VALIANT;
+    else if (name == "ugal_l")
+        _strategy = UGAL_L;
+    else if (name == "ugal_g")
+        _strategy = UGAL_G;
+    else
+        return false;
+    return true;
+}
+
+void DragonFlySwitch::receivePacket(Packet& pkt) {
+    //ingress pipeline processing.
+    const Route* nh = getNextHop(pkt, NULL);
+    pkt.set_route(*nh);
+
+    //emulate the switching latency between ingress and packet arriving at the egress queue.
+    _pipe->receivePacket(pkt);
+}
+
+void DragonFlySwitch::addHostPort(int addr, int flowid, PacketSink* transport) {
+    Route* rt = new Route();
+    rt->push_back(_dt->queues_switch_host[addr]);
+    rt->push_back(_dt->pipes_switch_host[addr]);
+    rt->push_back(transport);
+    _fib->addHostRoute(addr, rt, flowid);
+}
+
+Route* DragonFlySwitch::getNextHop(Packet& pkt, BaseQueue* ingress_port) {
+    uint32_t dst_switch = _dt->HOST_SWITCH(pkt.dst());
+    if (dst_switch == _id) {
+        //this host is directly connected!
+        HostFibEntry* fe = _fib->getHostRoute(pkt.dst(), pkt.flow_id());
+        assert(fe);
+        pkt.set_direction(DOWN);
+        return fe->getEgressPort();
+    }
+    uint32_t dst_group = _dt->SWITCH_GROUP(dst_switch);
+
+    if (pkt.get_direction() == NONE) {
+        // first router on the path, which decides for the rest of it
+        bool minimal = true;
+        // with fewer than three groups there is no intermediate group,
+        // so every strategy falls back to minimal
+        if (dst_group != _group && _strategy != MINIMAL && _dt->no_of_groups() > 2) {
+            assert(_strategy != NIX);
+            minimal = _strategy != VALIANT && take_minimal(dst_group, dst_switch, valiant_group(pkt, dst_group));
+        }
+        if (minimal) {
+            _minimal_routed++;
+            pkt.set_direction(DOWN);
+        } else {
+            _valiant_routed++;
+            pkt.set_direction(UP);
+        }
+    } else if (pkt.get_direction() == UP) {
+        // the route the packet arrived on starts at the previous hop's
+        // egress queue; if that was in another group, this is the
+        // intermediate group
+        BaseQueue* ingress = ingress_port ? ingress_port : dynamic_cast<BaseQueue*>(pkt.route()->at(0));
+        Switch* prev = ingress ? ingress->getSwitch() : NULL;
+        if (prev && _dt->SWITCH_GROUP(prev->getID()) != _group)
+            pkt.set_direction(DOWN);
+    }
+
+    if (pkt.get_direction() == UP)
+        return to_group(valiant_group(pkt, dst_group))->getEgressPort();
+    if (dst_group == _group)
+        return to_router(dst_switch)->getEgressPort();
+    return to_group(dst_group)->getEgressPort();
+}
+
+// The intermediate group for a Valiant path: any group but ours and
+// the destination's.  Only routers in the source group ask, so they all
+// agree.
+uint32_t DragonFlySwitch::valiant_group(Packet& pkt, uint32_t dst_group) {
+    assert(_dt->no_of_groups() > 2);
+    uint32_t group = freeBSDHash(pkt.flow_id(), pkt.pathid()) % (_dt->no_of_groups() - 2);
+    if (group >= min(_group, dst_group))
+        group++;
+    if (group >= max(_group, dst_group))
+        group++;
+    return group;
+}
+
+// the switches on the minimal path from switch from to switch to;
+// returns how many there are, both ends included
+uint32_t DragonFlySwitch::minimal_hops(uint32_t from, uint32_t to, uint32_t* hops) {
+    uint32_t count = 0;
+    uint32_t from_group = _dt->SWITCH_GROUP(from), to_group = _dt->SWITCH_GROUP(to);
+    hops[count++] = from;
+    if (from_group != to_group) {
+        uint32_t gateway = _dt->gateway(from_group, to_group);
+        uint32_t entry = _dt->gateway(to_group, from_group);
+        if (gateway != from)
+            hops[count++] = gateway;
+        hops[count++] = entry;
+    }
+    if (hops[count - 1] != to)
+        hops[count++] = to;
+    return count;
+}
+
+uint32_t DragonFlySwitch::path_cost(const uint32_t* hops, uint32_t count) {
+    uint32_t cost = 0;
+    for (uint32_t i = 0; i + 1 < count; i++)
+        cost += _dt->queues_switch_switch[hops[i]][hops[i + 1]]->quantized_queuesize();
+    return cost;
+}
+
+bool DragonFlySwitch::take_minimal(uint32_t dst_group, uint32_t dst_switch, uint32_t inter_group) {
+    uint32_t min_hops[4], val_hops[7];
+    uint32_t min_count = minimal_hops(_id, dst_switch, min_hops);
+    // to where the global link from our group lands, then on from there
+    uint32_t val_count = minimal_hops(_id, _dt->gateway(inter_group, _group), val_hops);
+    val_count += minimal_hops(val_hops[val_count - 1], dst_switch, val_hops + val_count - 1) - 1;
+
+    uint32_t min_cost, val_cost;
+    if (_strategy == UGAL_L) {
+        // only our own queues: the first hop's, weighted by path length
+        min_cost = path_cost(min_hops, 2) * (min_count - 1);
+        val_cost = path_cost(val_hops, 2) * (val_count - 1);
+    } else {
+        assert(_strategy == UGAL_G);
+        min_cost = path_cost(min_hops, min_count);
+        val_cost = path_cost(val_hops, val_count);
+    }
+    return min_cost <= val_cost + _ugal_threshold;
+}
+
+FibEntry* DragonFlySwitch::to_router(uint32_t sw) {
+    assert(_dt->SWITCH_GROUP(sw) == _group && sw != _id);
+    uint32_t pos = sw % _dt->routers_per_group();
+    if (!_routers[pos]) {
+        Route* r = new Route();
+        r->push_back(_dt->queues_switch_switch[_id][sw]);
+        assert(((BaseQueue*)r->at(0))->getSwitch() == this);
+        r->push_back(_dt->pipes_switch_switch[_id][sw]);
+        r->push_back(_dt->queues_switch_switch[_id][sw]->getRemoteEndpoint());
+        // the packet's direction is set by getNextHop, not the FIB
+        _routers[pos] = new FibEntry(r, 1, NONE);
+    }
+    return _routers[pos];
+}
+
+FibEntry* DragonFlySwitch::to_group(uint32_t group) {
+    assert(group != _group);
+    if (!_groups[group]) {
+        uint32_t gateway = _dt->gateway(_group, group);
+        if (gateway != _id) {
+            // the global link is on another router in our group
+            _groups[group] = to_router(gateway);
+        } else {
+            uint32_t entry = _dt->gateway(group, _group);
+            Route* r = new Route();
+            r->push_back(_dt->queues_switch_switch[_id][entry]);
+            assert(((BaseQueue*)r->at(0))->getSwitch() == this);
+            r->push_back(_dt->pipes_switch_switch[_id][entry]);
+            r->push_back(_dt->queues_switch_switch[_id][entry]->getRemoteEndpoint());
+            _groups[group] = new FibEntry(r, 1, NONE);
+        }
+    }
+    return _groups[group];
+}
@@ -0,0 +1,94 @@
+// -*- c-basic-offset: 4; indent-tabs-mode: nil -*-
+#ifndef _DRAGONFLYSWITCH_H
+#define _DRAGONFLYSWITCH_H
+
+#include "switch.h"
+#include "callback_pipe.h"
+
+class DragonFlyTopology;
+class DragonFlySwitch;
+
+// Egress side of a DragonFlySwitch, as for FatTreeSwitchEgress.
+class DragonFlySwitchEgress : public PacketSink {
+public:
+    DragonFlySwitchEgress(DragonFlySwitch& sw) : _switch(sw) {}
+    virtual void receivePacket(Packet& pkt) {pkt.sendOn();}
+    virtual const string& nodename();
+private:
+    DragonFlySwitch& _switch;
+};
+
+/*
+ * A dragonfly router that forwards on the packet's destination, so
+ * flows need no source routes.
+ *
+ * The FIB follows the group/router/host hierarchy: one entry per
+ * router in our group, one per other group (our global link to it, or
+ * the local link to the router in our group that has it), and host
+ * routes for our own hosts.  That is O(a + g) per router rather than
+ * O(N).
+ *
+ * The routing decision is made once, at the first router:
+ *
+ *  MINIMAL  local, global, local hop to the destination.
+ *  VALIANT  minimally to an intermediate group, then minimally on.
+ *  UGAL_L   minimal unless the queue to its first hop, times its hop
+ *           count, is longer than the Valiant path's.
+ *  UGAL_G   as UGAL_L, but over the queues of every switch to switch
+ *           link of both paths.
+ *
+ * Queue lengths are BaseQueue::quantized_queuesize(), as used by the
+ * fat tree's adaptive routing.  The packet's direction carries the
+ * decision on: UP while it heads for its intermediate group, DOWN
+ * once it is routed minimally.  The intermediate group is a hash of
+ * the flow and pathid, so every router in the source group finds the
+ * same one, and a packet arriving over a global link while UP has
+ * reached it.
+ *
+ * A dragonfly of fewer than three groups has no intermediate group,
+ * so there every strategy routes minimally.
+ *
+ * Only the queue types whose remote endpoint is free to point at the
+ * next switch are supported, i.e. not the lossless ones.
+ */
+class DragonFlySwitch : public Switch {
+public:
+    enum routing_strategy {
+        NIX = 0, MINIMAL = 1, VALIANT = 2, UGAL_L = 3, UGAL_G = 4
+    };
+
+    DragonFlySwitch(EventList& eventlist, string s, uint32_t id, simtime_picosec switch_delay, DragonFlyTopology* dt);
+
+    virtual void receivePacket(Packet& pkt);
+    virtual Route* getNextHop(Packet& pkt, BaseQueue* ingress_port);
+    virtual void addHostPort(int addr, int flowid, PacketSink* transport);
+
+    // sets the strategy from its name; returns false if name is unknown
+    static bool set_strategy(const string& name);
+
+    static thread_local routing_strategy _strategy;
+    // UGAL takes the minimal path unless it costs more than this over
+    // the Valiant path, in quantized queue size units
+    static thread_local uint32_t _ugal_threshold;
+    static thread_local uint64_t _minimal_routed;
+    static thread_local uint64_t _valiant_routed;
+
+private:
+    FibEntry* to_router(uint32_t sw);
+    FibEntry* to_group(uint32_t group);
+    uint32_t valiant_group(Packet& pkt, uint32_t dst_group);
+    bool take_minimal(uint32_t dst_group, uint32_t dst_switch, uint32_t inter_group);
+    uint32_t path_cost(const uint32_t* hops, uint32_t count);
+    uint32_t minimal_hops(uint32_t from, uint32_t to, uint32_t* hops);
+
+    Pipe* _pipe;
+    DragonFlySwitchEgress _egress;
+    DragonFlyTopology* _dt;
+    uint32_t _group;
+
+    // built the first time each is used
+    vector<FibEntry*> _routers; // by switch position in our group
+    vector<FibEntry*> _groups;  // by group
+};
+
+#endif
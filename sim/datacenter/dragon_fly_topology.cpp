@@ -13,17 +13,21 @@
 #include "queue_lossless_input.h"
 #include "queue_lossless_output.h"
 #include "ecnqueue.h"
+#include "dragon_fly_switch.h"
 #include "main.h"
 
 string ntoa(double n);
 string itoa(uint64_t n);
 
-DragonFlyTopology::DragonFlyTopology(uint32_t p, uint32_t a, uint32_t h, mem_b queuesize, Logfile* lg,EventList* ev,queue_type q,simtime_picosec rtt){
+DragonFlyTopology::DragonFlyTopology(uint32_t p, uint32_t a, uint32_t h, mem_b queuesize, Logfile* lg,EventList* ev,queue_type q,simtime_picosec rtt,
+                                     linkspeed_bps linkspeed, simtime_picosec switch_latency){
     _queuesize = queuesize;
     logfile = lg;
     _eventlist = ev;
     qt = q;
     _rtt = rtt;
+    _linkspeed = linkspeed;
+    _switch_latency = switch_latency;
  
     _p = p;
     _a = a;
@@ -38,12 +42,15 @@ DragonFlyTopology::DragonFlyTopology(uint32_t p, uint32_t a, uint32_t h, mem_b q
     init_network();
 }
 
-DragonFlyTopology::DragonFlyTopology(uint32_t no_of_nodes, mem_b queuesize, Logfile* lg,EventList* ev,queue_type q,simtime_picosec rtt){
+DragonFlyTopology::DragonFlyTopology(uint32_t no_of_nodes, mem_b queuesize, Logfile* lg,EventList* ev,queue_type q,simtime_picosec rtt,
+                                     linkspeed_bps linkspeed, simtime_picosec switch_latency){
     _queuesize = queuesize;
     logfile = lg;
     _eventlist = ev;
     qt = q;
     _rtt = rtt;
+    _linkspeed = linkspeed;
+    _switch_latency = switch_latency;
   
     set_params(no_of_nodes);
 
@@ -83,11 +90,11 @@ void DragonFlyTopology::set_params() {
 
     switches.resize(_no_of_switches,NULL);
 
-    pipes_host_switch.resize(_no_of_nodes, vector<Pipe*>(_no_of_switches));
-    queues_host_switch.resize(_no_of_nodes, vector<Queue*>(_no_of_switches));
+    pipes_host_switch.resize(_no_of_nodes, NULL);
+    queues_host_switch.resize(_no_of_nodes, NULL);
 
-    pipes_switch_host.resize(_no_of_switches, vector<Pipe*>(_no_of_nodes));
-    queues_switch_host.resize(_no_of_switches, vector<Queue*>(_no_of_nodes));
+    pipes_switch_host.resize(_no_of_nodes, NULL);
+    queues_switch_host.resize(_no_of_nodes, NULL);
 
     pipes_switch_switch.resize(_no_of_switches, vector<Pipe*>(_no_of_switches));
     queues_switch_switch.resize(_no_of_switches, vector<Queue*>(_no_of_switches));
@@ -95,13 +102,13 @@ void DragonFlyTopology::set_params() {
 }
 
 Queue* DragonFlyTopology::alloc_src_queue(QueueLogger* queueLogger){
-    return new FairPriorityQueue(speedFromMbps((uint64_t)HOST_NIC), memFromPkt(FEEDER_BUFFER), *_eventlist, queueLogger);
+    return new FairPriorityQueue(_linkspeed, memFromPkt(FEEDER_BUFFER), *_eventlist, queueLogger);
     //return new PriorityQueue(speedFromMbps((uint64_t)HOST_NIC), memFromPkt(FEEDER_BUFFER), *_eventlist, queueLogger);
     
 }
 
 Queue* DragonFlyTopology::alloc_queue(QueueLogger* queueLogger, mem_b queuesize, bool tor = false){
-    return alloc_queue(queueLogger, HOST_NIC, queuesize, tor);
+    return alloc_queue(queueLogger, _linkspeed / 1000000, queuesize, tor);
 }
 
 Queue* DragonFlyTopology::alloc_queue(QueueLogger* queueLogger, uint64_t speed, mem_b queuesize, bool tor){
@@ -136,20 +143,11 @@ void DragonFlyTopology::init_network(){
             queues_switch_switch[j][k] = NULL;
             pipes_switch_switch[j][k] = NULL;
         }
-      
-        for (uint32_t k=0;k<_no_of_nodes;k++){
-            queues_switch_host[j][k] = NULL;
-            pipes_switch_host[j][k] = NULL;
-            queues_host_switch[k][j] = NULL;
-            pipes_host_switch[k][j] = NULL;
-        }
     }
   
-    //create switches if we have lossless operation
-    if (qt==LOSSLESS)
-        for (uint32_t j=0;j<_no_of_switches;j++){
-            switches[j] = new Switch(*_eventlist, "Switch_"+ntoa(j));
-        }
+    for (uint32_t j=0;j<_no_of_switches;j++){
+        switches[j] = new DragonFlySwitch(*_eventlist, "Switch_"+ntoa(j), j, _switch_latency, this);
+    }
       
     // links from switches to server
     for (uint32_t j = 0; j < _no_of_switches; j++) {
@@ -160,32 +158,37 @@ void DragonFlyTopology::init_network(){
             //queueLogger = NULL;
             logfile->addLogger(*queueLogger);
           
-            queues_switch_host[j][k] = alloc_queue(queueLogger, _queuesize,true);
-            queues_switch_host[j][k]->setName("SW" + ntoa(j) + "->DST" +ntoa(k));
-            logfile->writeName(*(queues_switch_host[j][k]));
+            queues_switch_host[k] = alloc_queue(queueLogger, _queuesize,true);
+            queues_switch_host[k]->setName("SW" + ntoa(j) + "->DST" +ntoa(k));
+            logfile->writeName(*(queues_switch_host[k]));
           
-            pipes_switch_host[j][k] = new Pipe(_rtt, *_eventlist);
-            pipes_switch_host[j][k]->setName("Pipe-SW" + ntoa(j)  + "->DST" + ntoa(k));
-            logfile->writeName(*(pipes_switch_host[j][k]));
+            pipes_switch_host[k] = new Pipe(_rtt, *_eventlist);
+            pipes_switch_host[k]->setName("Pipe-SW" + ntoa(j)  + "->DST" + ntoa(k));
+            logfile->writeName(*(pipes_switch_host[k]));
           
             // Uplink
             queueLogger = new QueueLoggerSampling(timeFromMs(1000), *_eventlist);
             logfile->addLogger(*queueLogger);
-            queues_host_switch[k][j] = alloc_src_queue(queueLogger);
-            queues_host_switch[k][j]->setName("SRC" + ntoa(k) + "->SW" +ntoa(j));
-            logfile->writeName(*(queues_host_switch[k][j]));
+            queues_host_switch[k] = alloc_src_queue(queueLogger);
+            queues_host_switch[k]->setName("SRC" + ntoa(k) + "->SW" +ntoa(j));
+            logfile->writeName(*(queues_host_switch[k]));
 
             if (qt==LOSSLESS){
-                switches[j]->addPort(queues_switch_host[j][k]);
-                ((LosslessQueue*)queues_switch_host[j][k])->setRemoteEndpoint(queues_host_switch[k][j]);
+                switches[j]->addPort(queues_switch_host[k]);
+                ((LosslessQueue*)queues_switch_host[k])->setRemoteEndpoint(queues_host_switch[k]);
             }else if (qt==LOSSLESS_INPUT || qt == LOSSLESS_INPUT_ECN){
                 //no virtual queue needed at server
-                new LosslessInputQueue(*_eventlist,queues_host_switch[k][j]);
+                new LosslessInputQueue(*_eventlist,queues_host_switch[k]);
+            }else{
+                //lossless queues point their remote endpoints at their peers; the
+                //others point at the next switch, for DragonFlySwitch routing
+                switches[j]->addPort(queues_switch_host[k]);
+                queues_host_switch[k]->setRemoteEndpoint(switches[j]);
             }
           
-            pipes_host_switch[k][j] = new Pipe(_rtt, *_eventlist);
-            pipes_host_switch[k][j]->setName("Pipe-SRC" + ntoa(k) + "->SW" + ntoa(j));
-            logfile->writeName(*(pipes_host_switch[k][j]));
+            pipes_host_switch[k] = new Pipe(_rtt, *_eventlist);
+            pipes_host_switch[k]->setName("Pipe-SRC" + ntoa(k) + "->SW" + ntoa(j));
+            logfile->writeName(*(pipes_host_switch[k]));
         }
     }
 
@@ -222,6 +225,11 @@ void DragonFlyTopology::init_network(){
             }else if (qt==LOSSLESS_INPUT || qt == LOSSLESS_INPUT_ECN){            
                 new LosslessInputQueue(*_eventlist, queues_switch_switch[j][k]);
                 new LosslessInputQueue(*_eventlist, queues_switch_switch[k][j]);
+            }else{
+                switches[j]->addPort(queues_switch_switch[j][k]);
+                queues_switch_switch[j][k]->setRemoteEndpoint(switches[k]);
+                switches[k]->addPort(queues_switch_switch[k][j]);
+                queues_switch_switch[k][j]->setRemoteEndpoint(switches[j]);
             }
         
             pipes_switch_switch[j][k] = new Pipe(_rtt, *_eventlist);
@@ -269,6 +277,11 @@ void DragonFlyTopology::init_network(){
             }else if (qt==LOSSLESS_INPUT || qt == LOSSLESS_INPUT_ECN){            
                 new LosslessInputQueue(*_eventlist, queues_switch_switch[j][k]);
                 new LosslessInputQueue(*_eventlist, queues_switch_switch[k][j]);
+            }else{
+                switches[j]->addPort(queues_switch_switch[j][k]);
+                queues_switch_switch[j][k]->setRemoteEndpoint(switches[k]);
+                switches[k]->addPort(queues_switch_switch[k][j]);
+                queues_switch_switch[k][j]->setRemoteEndpoint(switches[j]);
             }
         
             pipes_switch_switch[j][k] = new Pipe(_rtt, *_eventlist);
@@ -284,42 +297,57 @@ void DragonFlyTopology::init_network(){
         }
 }
 
+uint32_t DragonFlyTopology::get_path_count(uint32_t src, uint32_t dest) {
+    if (HOST_GROUP(src)==HOST_GROUP(dest))
+        return 1;
+    // the minimal path, then one via each of the other groups
+    return _no_of_groups - 1;
+}
+
 vector<const Route*>* DragonFlyTopology::get_bidir_paths(uint32_t src, uint32_t dest, bool reverse){
     vector<const Route*>* paths = new vector<const Route*>();
+    uint32_t count = get_path_count(src, dest);
+    paths->reserve(count);
+    for (uint32_t k = 0; k < count; k++)
+        paths->push_back(get_path(src, dest, k, reverse));
+    return paths;
+}
+
+const Route* DragonFlyTopology::get_path(uint32_t src, uint32_t dest, uint32_t k, bool reverse){
+    assert(k < get_path_count(src, dest));
 
     route_t *routeout, *routeback;
   
     if (HOST_TOR(src)==HOST_TOR(dest)){
         // forward path
         routeout = new Route();
-        routeout->push_back(queues_host_switch[src][HOST_TOR(src)]);
-        routeout->push_back(pipes_host_switch[src][HOST_TOR(src)]);
+        routeout->push_back(queues_host_switch[src]);
+        routeout->push_back(pipes_host_switch[src]);
 
         if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
-            routeout->push_back(queues_host_switch[src][HOST_TOR(src)]->getRemoteEndpoint());
+            routeout->push_back(queues_host_switch[src]->getRemoteEndpoint());
 
-        routeout->push_back(queues_switch_host[HOST_TOR(dest)][dest]);
-        routeout->push_back(pipes_switch_host[HOST_TOR(dest)][dest]);
+        routeout->push_back(queues_switch_host[dest]);
+        routeout->push_back(pipes_switch_host[dest]);
 
         // reverse path for RTS packets
         routeback = new Route();
-        routeback->push_back(queues_host_switch[dest][HOST_TOR(dest)]);
-        routeback->push_back(pipes_host_switch[dest][HOST_TOR(dest)]);
+        routeback->push_back(queues_host_switch[dest]);
+        routeback->push_back(pipes_host_switch[dest]);
 
         if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
-            routeback->push_back(queues_host_switch[dest][HOST_TOR(dest)]->getRemoteEndpoint());
+            routeback->push_back(queues_host_switch[dest]->getRemoteEndpoint());
 
-        routeback->push_back(queues_switch_host[HOST_TOR(src)][src]);
-        routeback->push_back(pipes_switch_host[HOST_TOR(src)][src]);
+        routeback->push_back(queues_switch_host[src]);
+        routeback->push_back(pipes_switch_host[src]);
 
         routeout->set_reverse(routeback);
         routeback->set_reverse(routeout);
 
         //print_route(*routeout);
-        paths->push_back(routeout);
-
         check_non_null(routeout);
-        return paths;
+
+        return RouteStore::intern(routeout);
     }
     else if (HOST_GROUP(src)==HOST_GROUP(dest)){
         //don't go up the hierarchy, stay in the group only.
@@ -329,11 +357,11 @@ vector<const Route*>* DragonFlyTopology::get_bidir_paths(uint32_t src, uint32_t
 
         routeout = new Route();
     
-        routeout->push_back(queues_host_switch[src][HOST_TOR(src)]);
-        routeout->push_back(pipes_host_switch[src][HOST_TOR(src)]);
+        routeout->push_back(queues_host_switch[src]);
+        routeout->push_back(pipes_host_switch[src]);
     
         if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
-            routeout->push_back(queues_host_switch[src][HOST_TOR(src)]->getRemoteEndpoint());
+            routeout->push_back(queues_host_switch[src]->getRemoteEndpoint());
     
         routeout->push_back(queues_switch_switch[HOST_TOR(src)][HOST_TOR(dest)]);
         routeout->push_back(pipes_switch_switch[HOST_TOR(src)][HOST_TOR(dest)]);
@@ -341,17 +369,17 @@ vector<const Route*>* DragonFlyTopology::get_bidir_paths(uint32_t src, uint32_t
         if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
             routeout->push_back(queues_switch_switch[HOST_TOR(src)][HOST_TOR(dest)]->getRemoteEndpoint());
     
-        routeout->push_back(queues_switch_host[HOST_TOR(dest)][dest]);
-        routeout->push_back(pipes_switch_host[HOST_TOR(dest)][dest]);
+        routeout->push_back(queues_switch_host[dest]);
+        routeout->push_back(pipes_switch_host[dest]);
     
         // reverse path for RTS packets
         routeback = new Route();
     
-        routeback->push_back(queues_host_switch[dest][HOST_TOR(dest)]);
-        routeback->push_back(pipes_host_switch[dest][HOST_TOR(dest)]);
+        routeback->push_back(queues_host_switch[dest]);
+        routeback->push_back(pipes_host_switch[dest]);
     
         if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
-            routeback->push_back(queues_host_switch[dest][HOST_TOR(dest)]->getRemoteEndpoint());
+            routeback->push_back(queues_host_switch[dest]->getRemoteEndpoint());
     
         routeback->push_back(queues_switch_switch[HOST_TOR(dest)][HOST_TOR(src)]);
         routeback->push_back(pipes_switch_switch[HOST_TOR(dest)][HOST_TOR(src)]);
@@ -359,262 +387,260 @@ vector<const Route*>* DragonFlyTopology::get_bidir_paths(uint32_t src, uint32_t
         if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
             routeback->push_back(queues_switch_switch[HOST_TOR(dest)][HOST_TOR(src)]->getRemoteEndpoint());
     
-        routeback->push_back(queues_switch_host[HOST_TOR(src)][src]);
-        routeback->push_back(pipes_switch_host[HOST_TOR(src)][src]);
+        routeback->push_back(queues_switch_host[src]);
+        routeback->push_back(pipes_switch_host[src]);
     
         routeout->set_reverse(routeback);
         routeback->set_reverse(routeout);
     
         //print_route(*routeout);
-        paths->push_back(routeout);
         check_non_null(routeout);
-
-        return paths;
+        return RouteStore::intern(routeout);
     }
     else {
         uint32_t srcgroup = HOST_GROUP(src);
         uint32_t dstgroup = HOST_GROUP(dest);
 
-        //add lowest cost path first. add others if needed later. 
-        routeout = new Route();
+        if (k == 0) {
+            //add lowest cost path first. add others if needed later. 
+            routeout = new Route();
 
-        assert(queues_host_switch[src][HOST_TOR(src)]);
+            assert(queues_host_switch[src]);
     
-        routeout->push_back(queues_host_switch[src][HOST_TOR(src)]);
-        routeout->push_back(pipes_host_switch[src][HOST_TOR(src)]);
+            routeout->push_back(queues_host_switch[src]);
+            routeout->push_back(pipes_host_switch[src]);
 
-        //cout << "SRC " << src << " SW " << HOST_TOR(src) << " ";
+            //cout << "SRC " << src << " SW " << HOST_TOR(src) << " ";
     
-        if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
-            routeout->push_back(queues_host_switch[src][HOST_TOR(src)]->getRemoteEndpoint());
+            if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
+                routeout->push_back(queues_host_switch[src]->getRemoteEndpoint());
 
-        uint32_t srcswitch,dstswitch;
-        //find srcswitch from srcgroup which has a path to dstgroup and  dstswitch from dstgroup which has an incoming path from srcgroup.
+            uint32_t srcswitch,dstswitch;
+            //find srcswitch from srcgroup which has a path to dstgroup and  dstswitch from dstgroup which has an incoming path from srcgroup.
 
-        if (srcgroup<dstgroup){
-            srcswitch = srcgroup * _a + (dstgroup-1)/_h;
-            dstswitch =  dstgroup * _a + srcgroup/_h;
-        }
-        else {
-            srcswitch = srcgroup * _a + dstgroup/_h;
-            dstswitch =  dstgroup * _a + (srcgroup-1)/_h;
-        }
+            if (srcgroup<dstgroup){
+                srcswitch = srcgroup * _a + (dstgroup-1)/_h;
+                dstswitch =  dstgroup * _a + srcgroup/_h;
+            }
+            else {
+                srcswitch = srcgroup * _a + dstgroup/_h;
+                dstswitch =  dstgroup * _a + (srcgroup-1)/_h;
+            }
 
-        if (HOST_TOR(src)!=srcswitch){
-            /*When SRC HOST TOR does not have a direct path to destination group, take local path to the appropriate switch*/
+            if (HOST_TOR(src)!=srcswitch){
+                /*When SRC HOST TOR does not have a direct path to destination group, take local path to the appropriate switch*/
 
-            assert(queues_switch_switch[HOST_TOR(src)][srcswitch]);
-            routeout->push_back(queues_switch_switch[HOST_TOR(src)][srcswitch]);
-            routeout->push_back(pipes_switch_switch[HOST_TOR(src)][srcswitch]);
+                assert(queues_switch_switch[HOST_TOR(src)][srcswitch]);
+                routeout->push_back(queues_switch_switch[HOST_TOR(src)][srcswitch]);
+                routeout->push_back(pipes_switch_switch[HOST_TOR(src)][srcswitch]);
 
-            //cout << "SW " << srcswitch <<        " " ;
+                //cout << "SW " << srcswitch <<        " " ;
         
-            if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
-                routeout->push_back(queues_switch_switch[HOST_TOR(src)][srcswitch]->getRemoteEndpoint());
-        }
+                if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
+                    routeout->push_back(queues_switch_switch[HOST_TOR(src)][srcswitch]->getRemoteEndpoint());
+            }
 
-        /* path from source group to destination group*/
-        assert(queues_switch_switch[srcswitch][dstswitch]);
-        routeout->push_back(queues_switch_switch[srcswitch][dstswitch]);
-        routeout->push_back(pipes_switch_switch[srcswitch][dstswitch]);
+            /* path from source group to destination group*/
+            assert(queues_switch_switch[srcswitch][dstswitch]);
+            routeout->push_back(queues_switch_switch[srcswitch][dstswitch]);
+            routeout->push_back(pipes_switch_switch[srcswitch][dstswitch]);
 
-        //cout << "SW " << dstswitch <<        " ";    
+            //cout << "SW " << dstswitch <<        " ";    
 
-        if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
-            routeout->push_back(queues_host_switch[srcswitch][dstswitch]->getRemoteEndpoint());
+            if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
+                routeout->push_back(queues_switch_switch[srcswitch][dstswitch]->getRemoteEndpoint());
 
-        if (dstswitch!=HOST_TOR(dest)){
-            /*When dstswitch does not have a direct path to dest, take local path to the appropriate TOR switch*/
-            //cout << "SW " << HOST_TOR(dest) <<        " ";
-            assert(queues_switch_switch[dstswitch][HOST_TOR(dest)]);
+            if (dstswitch!=HOST_TOR(dest)){
+                /*When dstswitch does not have a direct path to dest, take local path to the appropriate TOR switch*/
+                //cout << "SW " << HOST_TOR(dest) <<        " ";
+                assert(queues_switch_switch[dstswitch][HOST_TOR(dest)]);
 
-            routeout->push_back(queues_switch_switch[dstswitch][HOST_TOR(dest)]);
-            routeout->push_back(pipes_switch_switch[dstswitch][HOST_TOR(dest)]);
+                routeout->push_back(queues_switch_switch[dstswitch][HOST_TOR(dest)]);
+                routeout->push_back(pipes_switch_switch[dstswitch][HOST_TOR(dest)]);
 
-            if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
-                routeout->push_back(queues_switch_switch[dstswitch][HOST_TOR(dest)]->getRemoteEndpoint());
-        }
-        //cout << "DEST " << dest <<        " " << endl;
-        assert(queues_switch_host[HOST_TOR(dest)][dest]);
+                if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
+                    routeout->push_back(queues_switch_switch[dstswitch][HOST_TOR(dest)]->getRemoteEndpoint());
+            }
+            //cout << "DEST " << dest <<        " " << endl;
+            assert(queues_switch_host[dest]);
 
-        routeout->push_back(queues_switch_host[HOST_TOR(dest)][dest]);
-        routeout->push_back(pipes_switch_host[HOST_TOR(dest)][dest]);
+            routeout->push_back(queues_switch_host[dest]);
+            routeout->push_back(pipes_switch_host[dest]);
 
-        // reverse path for RTS packets                                                                                        /*
-        //routeback = new Route();
+            // reverse path for RTS packets                                                                                        /*
+            //routeback = new Route();
 
-        /*routeback->push_back(queues_host_switch[dest][HOST_TOR(dest)]);
-          routeback->push_back(pipes_host_switch[dest][HOST_TOR(dest)]);
+            /*routeback->push_back(queues_host_switch[dest]);
+              routeback->push_back(pipes_host_switch[dest]);
 
-          if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
-          routeback->push_back(queues_host_switch[dest][HOST_TOR(dest)]->getRemoteEndpoint());
+              if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
+              routeback->push_back(queues_host_switch[dest]->getRemoteEndpoint());
 
 
-          if (dstswitch!=HOST_TOR(dest)){
-          routeback->push_back(queues_switch_host[HOST_TOR(dest)][dstswitch]);
-          routeback->push_back(pipes_switch_host[HOST_TOR(dest)][dstswitch]);
+              if (dstswitch!=HOST_TOR(dest)){
+              routeback->push_back(queues_switch_host[HOST_TOR(dest)][dstswitch]);
+              routeback->push_back(pipes_switch_host[HOST_TOR(dest)][dstswitch]);
 
-          if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
-          routeback->push_back(queues_host_switch[HOST_TOR(dest)][dstswitch]->getRemoteEndpoint());
-          }
+              if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
+              routeback->push_back(queues_host_switch[HOST_TOR(dest)][dstswitch]->getRemoteEndpoint());
+              }
     
-          routeback->push_back(queues_switch_host[dstswitch][srcswitch]);
-          routeback->push_back(pipes_switch_host[dstswitch][srcswitch]);
+              routeback->push_back(queues_switch_host[dstswitch][srcswitch]);
+              routeback->push_back(pipes_switch_host[dstswitch][srcswitch]);
 
-          if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
-          routeback->push_back(queues_host_switch[dstswitch][srcswitch]->getRemoteEndpoint());
+              if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
+              routeback->push_back(queues_host_switch[dstswitch][srcswitch]->getRemoteEndpoint());
 
-          if (HOST_TOR(src)!=srcswitch){
-          //When SRC HOST TOR does not have a direct path to destination group, take local path to the appropriate switch
+              if (HOST_TOR(src)!=srcswitch){
+              //When SRC HOST TOR does not have a direct path to destination group, take local path to the appropriate switch
 
-          routeback->push_back(queues_switch_host[srcswitch][HOST_TOR(src)]);
-          routeback->push_back(pipes_switch_host[srcswitch][HOST_TOR(src)]);
+              routeback->push_back(queues_switch_host[srcswitch][HOST_TOR(src)]);
+              routeback->push_back(pipes_switch_host[srcswitch][HOST_TOR(src)]);
 
-          if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
-          routeback->push_back(queues_host_switch[srcswitch][HOST_TOR(src)]->getRemoteEndpoint());
-          }
+              if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
+              routeback->push_back(queues_host_switch[srcswitch][HOST_TOR(src)]->getRemoteEndpoint());
+              }
     
-          routeback->push_back(queues_switch_host[HOST_TOR(src)][src]);
-          routeback->push_back(pipes_switch_host[HOST_TOR(src)][src]);
+              routeback->push_back(queues_switch_host[src]);
+              routeback->push_back(pipes_switch_host[src]);
 
-          routeout->set_reverse(routeback);
-          routeback->set_reverse(routeout);
-        */
+              routeout->set_reverse(routeback);
+              routeback->set_reverse(routeout);
+            */
 
-        //print_route(*routeout);                                                                                            
-        paths->push_back(routeout);
-        check_non_null(routeout);
+            //print_route(*routeout);                                                                                            
+            check_non_null(routeout);
+            return RouteStore::intern(routeout);
+        }
 
-        for (uint32_t p = 0;p < _no_of_groups; p++){
-            if (p==srcgroup || p==dstgroup)
-                continue;
-        
-            //add indirect paths via random group;
-            routeout = new Route();
+        //the other paths are indirect, path k via the k-th group that is neither ours nor the destination's
+        uint32_t p = k - 1;
+        if (p >= min(srcgroup, dstgroup))
+            p++;
+        if (p >= max(srcgroup, dstgroup))
+            p++;
 
-            assert(queues_host_switch[src][HOST_TOR(src)]);
+        routeout = new Route();
+
+        assert(queues_host_switch[src]);
         
-            routeout->push_back(queues_host_switch[src][HOST_TOR(src)]);
-            routeout->push_back(pipes_host_switch[src][HOST_TOR(src)]);
+        routeout->push_back(queues_host_switch[src]);
+        routeout->push_back(pipes_host_switch[src]);
         
-            //cout << "DPSRC " << src << " SW " << HOST_TOR(src) << " " << queues_host_switch[src][HOST_TOR(src)]  << " ";
+        //cout << "DPSRC " << src << " SW " << HOST_TOR(src) << " " << queues_host_switch[src]  << " ";
         
-            if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
-                routeout->push_back(queues_host_switch[src][HOST_TOR(src)]->getRemoteEndpoint());
+        if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
+            routeout->push_back(queues_host_switch[src]->getRemoteEndpoint());
         
-            uint32_t intergroup = p;
+        uint32_t intergroup = p;
         
-            while (intergroup==srcgroup || intergroup==dstgroup)
-                intergroup = rand()%_no_of_groups;
+        while (intergroup==srcgroup || intergroup==dstgroup)
+            intergroup = rand()%_no_of_groups;
 
-            //cout << "Groups " << srcgroup  << "  "  << intergroup << " " << dstgroup << endl;
+        //cout << "Groups " << srcgroup  << "  "  << intergroup << " " << dstgroup << endl;
         
-            uint32_t srcswitch,dstswitch,interswitch1,interswitch2;
-            //find srcswitch from srcgroup which has a path to intergroup and dstswitch from intergroup which has an incoming path from srcgroup.
+        uint32_t srcswitch,dstswitch,interswitch1,interswitch2;
+        //find srcswitch from srcgroup which has a path to intergroup and dstswitch from intergroup which has an incoming path from srcgroup.
 
-            if (srcgroup<intergroup){
-                srcswitch = srcgroup * _a + (intergroup-1)/_h;
-                interswitch1 =  intergroup * _a + srcgroup/_h;
-            }
-            else {
-                srcswitch = srcgroup * _a + intergroup/_h;
-                interswitch1 =  intergroup * _a + (srcgroup-1)/_h;
-            }
+        if (srcgroup<intergroup){
+            srcswitch = srcgroup * _a + (intergroup-1)/_h;
+            interswitch1 =  intergroup * _a + srcgroup/_h;
+        }
+        else {
+            srcswitch = srcgroup * _a + intergroup/_h;
+            interswitch1 =  intergroup * _a + (srcgroup-1)/_h;
+        }
         
-            if (HOST_TOR(src)!=srcswitch){
-                /*When SRC HOST TOR does not have a direct path to destination group, take local path to the appropriate switch*/
+        if (HOST_TOR(src)!=srcswitch){
+            /*When SRC HOST TOR does not have a direct path to destination group, take local path to the appropriate switch*/
             
-                assert(queues_switch_switch[HOST_TOR(src)][srcswitch]);
-                routeout->push_back(queues_switch_switch[HOST_TOR(src)][srcswitch]);
-                routeout->push_back(pipes_switch_switch[HOST_TOR(src)][srcswitch]);
+            assert(queues_switch_switch[HOST_TOR(src)][srcswitch]);
+            routeout->push_back(queues_switch_switch[HOST_TOR(src)][srcswitch]);
+            routeout->push_back(pipes_switch_switch[HOST_TOR(src)][srcswitch]);
             
-                //cout << "SW " << srcswitch <<        " " << queues_switch_switch[HOST_TOR(src)][srcswitch] << " ";
+            //cout << "SW " << srcswitch <<        " " << queues_switch_switch[HOST_TOR(src)][srcswitch] << " ";
             
-                if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
-                    routeout->push_back(queues_switch_switch[HOST_TOR(src)][srcswitch]->getRemoteEndpoint());
-            }
+            if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
+                routeout->push_back(queues_switch_switch[HOST_TOR(src)][srcswitch]->getRemoteEndpoint());
+        }
         
-            /* path from source group to inter group*/
-            assert(queues_switch_switch[srcswitch][interswitch1]);
-            routeout->push_back(queues_switch_switch[srcswitch][interswitch1]);
-            routeout->push_back(pipes_switch_switch[srcswitch][interswitch1]);
+        /* path from source group to inter group*/
+        assert(queues_switch_switch[srcswitch][interswitch1]);
+        routeout->push_back(queues_switch_switch[srcswitch][interswitch1]);
+        routeout->push_back(pipes_switch_switch[srcswitch][interswitch1]);
         
-            //cout << "SW " << interswitch1 <<        " ";    
+        //cout << "SW " << interswitch1 <<        " ";    
         
-            if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
-                routeout->push_back(queues_host_switch[srcswitch][interswitch1]->getRemoteEndpoint());
+        if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
+            routeout->push_back(queues_switch_switch[srcswitch][interswitch1]->getRemoteEndpoint());
         
-            //route from inter group to destination group.
-            if (intergroup<dstgroup){
-                interswitch2 = intergroup * _a + (dstgroup-1)/_h;
-                dstswitch =  dstgroup * _a + intergroup/_h;
-            }
-            else {
-                interswitch2 = intergroup * _a + dstgroup/_h;
-                dstswitch =  dstgroup * _a + (intergroup-1)/_h;
-            }
+        //route from inter group to destination group.
+        if (intergroup<dstgroup){
+            interswitch2 = intergroup * _a + (dstgroup-1)/_h;
+            dstswitch =  dstgroup * _a + intergroup/_h;
+        }
+        else {
+            interswitch2 = intergroup * _a + dstgroup/_h;
+            dstswitch =  dstgroup * _a + (intergroup-1)/_h;
+        }
 
-            if (interswitch1 != interswitch2){
-                /*When interswitch1 does not have a direct path to destination group, take local path to the appropriate switch*/
-                //cout << "SW " << interswitch2 <<      " ";
-                assert(queues_switch_switch[interswitch1][interswitch2]);
+        if (interswitch1 != interswitch2){
+            /*When interswitch1 does not have a direct path to destination group, take local path to the appropriate switch*/
+            //cout << "SW " << interswitch2 <<      " ";
+            assert(queues_switch_switch[interswitch1][interswitch2]);
             
-                routeout->push_back(queues_switch_switch[interswitch1][interswitch2]);
-                routeout->push_back(pipes_switch_switch[interswitch1][interswitch2]);
+            routeout->push_back(queues_switch_switch[interswitch1][interswitch2]);
+            routeout->push_back(pipes_switch_switch[interswitch1][interswitch2]);
             
-                if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
-                    routeout->push_back(queues_switch_switch[interswitch1][interswitch2]->getRemoteEndpoint());
-            }
+            if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
+                routeout->push_back(queues_switch_switch[interswitch1][interswitch2]->getRemoteEndpoint());
+        }
 
-            /* path from inter group to destgroup*/
-            assert(queues_switch_switch[interswitch2][dstswitch]);
-            routeout->push_back(queues_switch_switch[interswitch2][dstswitch]);
-            routeout->push_back(pipes_switch_switch[interswitch2][dstswitch]);
+        /* path from inter group to destgroup*/
+        assert(queues_switch_switch[interswitch2][dstswitch]);
+        routeout->push_back(queues_switch_switch[interswitch2][dstswitch]);
+        routeout->push_back(pipes_switch_switch[interswitch2][dstswitch]);
         
-            //cout << "SW " << dstswitch <<        " ";
+        //cout << "SW " << dstswitch <<        " ";
         
-            if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
-                routeout->push_back(queues_host_switch[interswitch2][dstswitch]->getRemoteEndpoint());
+        if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
+            routeout->push_back(queues_switch_switch[interswitch2][dstswitch]->getRemoteEndpoint());
         
-            if (dstswitch!=HOST_TOR(dest)){
-                /*When dstswitch does not have a direct path to dest, take local path to the appropriate TOR switch*/
-                //cout << "SW " << HOST_TOR(dest) <<        " ";
-                assert(queues_switch_switch[dstswitch][HOST_TOR(dest)]);
+        if (dstswitch!=HOST_TOR(dest)){
+            /*When dstswitch does not have a direct path to dest, take local path to the appropriate TOR switch*/
+            //cout << "SW " << HOST_TOR(dest) <<        " ";
+            assert(queues_switch_switch[dstswitch][HOST_TOR(dest)]);
             
-                routeout->push_back(queues_switch_switch[dstswitch][HOST_TOR(dest)]);
-                routeout->push_back(pipes_switch_switch[dstswitch][HOST_TOR(dest)]);
+            routeout->push_back(queues_switch_switch[dstswitch][HOST_TOR(dest)]);
+            routeout->push_back(pipes_switch_switch[dstswitch][HOST_TOR(dest)]);
             
-                if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
-                    routeout->push_back(queues_switch_switch[dstswitch][HOST_TOR(dest)]->getRemoteEndpoint());
-            }
+            if (qt==LOSSLESS_INPUT || qt==LOSSLESS_INPUT_ECN)
+                routeout->push_back(queues_switch_switch[dstswitch][HOST_TOR(dest)]->getRemoteEndpoint());
+        }
     
-            //cout << "DEST " << dest <<        " " << endl;
-            assert(queues_switch_host[HOST_TOR(dest)][dest]);
+        //cout << "DEST " << dest <<        " " << endl;
+        assert(queues_switch_host[dest]);
         
-            routeout->push_back(queues_switch_host[HOST_TOR(dest)][dest]);
-            routeout->push_back(pipes_switch_host[HOST_TOR(dest)][dest]);
+        routeout->push_back(queues_switch_host[dest]);
+        routeout->push_back(pipes_switch_host[dest]);
 
-            // reverse path for RTS packets                                                                                      
-            //routeback = new Route();
-            /*TODO*/
-            //routeout->set_reverse(routeback);
-            //routeback->set_reverse(routeout);
+        // reverse path for RTS packets                                                                                      
+        //routeback = new Route();
+        /*TODO*/
+        //routeout->set_reverse(routeback);
+        //routeback->set_reverse(routeout);
         
-            //print_route(*routeout);                                                                                            
-            paths->push_back(routeout);
-            check_non_null(routeout);
-        }
-    
-        return paths;
+        //print_route(*routeout);                                                                                            
+        check_non_null(routeout);
+        return RouteStore::intern(routeout);
     }
 }
 
 int64_t DragonFlyTopology::find_switch(Queue* queue){
     //first check host to switch
     for (uint32_t i=0;i<_no_of_nodes;i++)
-        for (uint32_t j = 0;j<_no_of_switches;j++)
-            if (queues_host_switch[i][j]==queue)
-                return j;
+        if (queues_host_switch[i]==queue)
+            return HOST_TOR(i);
 
     for (uint32_t i=0;i<_no_of_switches;i++)
         for (uint32_t j = 0;j<_no_of_switches;j++)
@@ -625,10 +651,9 @@ int64_t DragonFlyTopology::find_switch(Queue* queue){
 }
 
 int64_t DragonFlyTopology::find_destination(Queue* queue){
-    for (uint32_t i=0;i<_no_of_switches;i++)
-        for (uint32_t j = 0;j<_no_of_nodes;j++)
-            if (queues_switch_host[i][j]==queue)
-                return j;
+    for (uint32_t j = 0;j<_no_of_nodes;j++)
+        if (queues_switch_host[j]==queue)
+            return j;
 
     return -1;
 }
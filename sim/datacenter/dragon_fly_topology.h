@@ -34,32 +34,42 @@
 //#define HOST_GROUP_ID(src) src%NSRV
 #define HOST_GROUP(src) (src/(_a*_p))
 
+// must match fat_tree_topology.h, as the mains include both
 #ifndef QT
 #define QT
-typedef enum {RANDOM, ECN, COMPOSITE, CTRL_PRIO, LOSSLESS, LOSSLESS_INPUT, LOSSLESS_INPUT_ECN, COMPOSITE_ECN} queue_type;
+typedef enum {UNDEFINED, RANDOM, ECN, COMPOSITE, PRIORITY,
+              CTRL_PRIO, FAIR_PRIO, LOSSLESS, LOSSLESS_INPUT, LOSSLESS_INPUT_ECN,
+              COMPOSITE_ECN, COMPOSITE_ECN_LB, SWIFT_SCHEDULER, ECN_PRIO, AEOLUS, AEOLUS_ECN} queue_type;
 #endif
 
 class DragonFlyTopology: public Topology{
 public:
     vector <Switch*> switches;
 
-    vector< vector<Pipe*> > pipes_host_switch;
+    // each host has one link, to switch HOST_SWITCH(host), so the host
+    // links are indexed by host alone
+    vector<Pipe*> pipes_host_switch;
     vector< vector<Pipe*> > pipes_switch_switch;
-    vector< vector<Queue*> > queues_host_switch;
+    vector<Queue*> queues_host_switch;
     vector< vector<Queue*> > queues_switch_switch;
-    vector< vector<Pipe*> > pipes_switch_host;
-    vector< vector<Queue*> > queues_switch_host;
+    vector<Pipe*> pipes_switch_host;
+    vector<Queue*> queues_switch_host;
   
     Logfile* logfile;
     EventList* _eventlist;
     uint32_t failed_links;
     queue_type qt;
 
-    DragonFlyTopology(uint32_t p, uint32_t h, uint32_t a, mem_b queuesize, Logfile* log,EventList* ev,queue_type q,simtime_picosec rtt);
-    DragonFlyTopology(uint32_t no_of_nodes, mem_b queuesize, Logfile* log,EventList* ev,queue_type q, simtime_picosec rtt);
+    // switch_latency is only used when the switches route (see DragonFlySwitch)
+    DragonFlyTopology(uint32_t p, uint32_t h, uint32_t a, mem_b queuesize, Logfile* log,EventList* ev,queue_type q,simtime_picosec rtt,
+                      linkspeed_bps linkspeed = speedFromMbps((uint64_t)HOST_NIC), simtime_picosec switch_latency = 0);
+    DragonFlyTopology(uint32_t no_of_nodes, mem_b queuesize, Logfile* log,EventList* ev,queue_type q, simtime_picosec rtt,
+                      linkspeed_bps linkspeed = speedFromMbps((uint64_t)HOST_NIC), simtime_picosec switch_latency = 0);
 
     void init_network();
     virtual vector<const Route*>* get_bidir_paths(uint32_t src, uint32_t dest, bool reverse);
+    virtual uint32_t get_path_count(uint32_t src, uint32_t dest);
+    virtual const Route* get_path(uint32_t src, uint32_t dest, uint32_t k, bool reverse);
 
     Queue* alloc_src_queue(QueueLogger* q);
     Queue* alloc_queue(QueueLogger* q, mem_b queuesize, bool tor);
@@ -69,6 +79,19 @@ public:
     void print_path(std::ofstream& paths, uint32_t src, const Route* route);
     vector<uint32_t>* get_neighbours(uint32_t src) { return NULL;};
     uint32_t no_of_nodes() const {return _no_of_nodes;}
+    uint32_t no_of_groups() const {return _no_of_groups;}
+    uint32_t no_of_switches() const {return _no_of_switches;}
+    uint32_t routers_per_group() const {return _a;}
+
+    uint32_t HOST_SWITCH(uint32_t host) const {return HOST_TOR(host);}
+    uint32_t SWITCH_GROUP(uint32_t sw) const {return sw / _a;}
+    // the switch in group that has the global link to to_group
+    uint32_t gateway(uint32_t group, uint32_t to_group) const {
+        if (group < to_group)
+            return group * _a + (to_group - 1) / _h;
+        else
+            return group * _a + to_group / _h;
+    }
 private:
     int64_t find_switch(Queue* queue);
     int64_t find_destination(Queue* queue);
@@ -80,6 +103,8 @@ private:
     uint32_t _no_of_nodes;
     uint32_t _no_of_groups,_no_of_switches;
     simtime_picosec _rtt;
+    simtime_picosec _switch_latency;
+    linkspeed_bps _linkspeed;
     mem_b _queuesize;
 };
 
@@ -6,13 +6,12 @@
 #include "queue_lossless.h"
 #include "queue_lossless_output.h"
 
-unordered_map<BaseQueue*,uint32_t> FatTreeSwitch::_port_flow_counts;
+thread_local unordered_map<BaseQueue*,uint32_t> FatTreeSwitch::_port_flow_counts;
 
-FatTreeSwitch::FatTreeSwitch(EventList& eventlist, string s, switch_type t, uint32_t id,simtime_picosec delay, FatTreeTopology* ft): Switch(eventlist, s) {
+FatTreeSwitch::FatTreeSwitch(EventList& eventlist, string s, switch_type t, uint32_t id,simtime_picosec delay, FatTreeTopology* ft): Switch(eventlist, s), _egress(*this) {
     _id = id;
     _type = t;
-    _pipe = new CallbackPipe(delay,eventlist, this);
-    _uproutes = NULL;
+    _pipe = new CallbackPipe(delay,eventlist, &_egress);
     _ft = ft;
     _crt_route = 0;
     _hash_salt = random();
@@ -22,45 +21,30 @@ FatTreeSwitch::FatTreeSwitch(EventList& eventlist, string s, switch_type t, uint
 
 void FatTreeSwitch::receivePacket(Packet& pkt){
     if (pkt.type()==ETH_PAUSE){
-        EthPausePacket* p = (EthPausePacket*)&pkt;
         //I must be in lossless mode!
-        //find the egress queue that should process this, and pass it over for processing. 
-        for (size_t i = 0;i < _ports.size();i++){
-            LosslessQueue* q = (LosslessQueue*)_ports.at(i);
-            if (q->getRemoteEndpoint() && ((Switch*)q->getRemoteEndpoint())->getID() == p->senderID()){
-                q->receivePacket(pkt);
-                break;
-            }
-        }
-        
+        //the frame names our egress queue that should process it.
+        receivePause(pkt);
         return;
     }
 
-    if (_packets.find(&pkt)==_packets.end()){
-        //ingress pipeline processing.
-
-        _packets[&pkt] = true;
-
-        const Route * nh = getNextHop(pkt,NULL);
-        //set next hop which is peer switch.
-        pkt.set_route(*nh);
+    //ingress pipeline processing.
+    const Route * nh = getNextHop(pkt,NULL);
+    //set next hop which is peer switch.
+    pkt.set_route(*nh);
 
-        //emulate the switching latency between ingress and packet arriving at the egress queue.
-        _pipe->receivePacket(pkt); 
-    }
-    else {
-        _packets.erase(&pkt);
-        
-        //egress queue processing.
-        //cout << "Switch type " << _type <<  " id " << _id << " pkt dst " << pkt.dst() << " dir " << pkt.get_direction() << endl;
-        pkt.sendOn();
-    }
+    //emulate the switching latency between ingress and packet arriving at the egress queue.
+    //the pipe hands the packet to _egress, which sends it on.
+    _pipe->receivePacket(pkt); 
 };
 
+const string& FatTreeSwitchEgress::nodename() {
+    return _switch.nodename();
+}
+
 void FatTreeSwitch::addHostPort(int addr, int flowid, PacketSink* transport){
     Route* rt = new Route();
-    rt->push_back(_ft->queues_nlp_ns[_ft->HOST_POD_SWITCH(addr)][addr][0]);
-    rt->push_back(_ft->pipes_nlp_ns[_ft->HOST_POD_SWITCH(addr)][addr][0]);
+    rt->push_back(_ft->queues_nlp_ns(_ft->HOST_POD_SWITCH(addr), addr, 0));
+    rt->push_back(_ft->pipes_nlp_ns(_ft->HOST_POD_SWITCH(addr), addr, 0));
     rt->push_back(transport);
     _fib->addHostRoute(addr,rt,flowid);
 }
@@ -310,209 +294,242 @@ void FatTreeSwitch::permute_paths(vector<FibEntry *>* uproutes) {
     }
 }
 
-FatTreeSwitch::routing_strategy FatTreeSwitch::_strategy = FatTreeSwitch::NIX;
-uint16_t FatTreeSwitch::_ar_fraction = 0;
-uint16_t FatTreeSwitch::_ar_sticky = FatTreeSwitch::PER_PACKET;
-simtime_picosec FatTreeSwitch::_sticky_delta = timeFromUs((uint32_t)10);
-double FatTreeSwitch::_ecn_threshold_fraction = 1.0;
-double FatTreeSwitch::_speculative_threshold_fraction = 0.2;
+thread_local FatTreeSwitch::routing_strategy FatTreeSwitch::_strategy = FatTreeSwitch::NIX;
+thread_local uint16_t FatTreeSwitch::_ar_fraction = 0;
+thread_local uint16_t FatTreeSwitch::_ar_sticky = FatTreeSwitch::PER_PACKET;
+thread_local simtime_picosec FatTreeSwitch::_sticky_delta = timeFromUs((uint32_t)10);
+thread_local double FatTreeSwitch::_ecn_threshold_fraction = 1.0;
+thread_local double FatTreeSwitch::_speculative_threshold_fraction = 0.2;
 int8_t (*FatTreeSwitch::fn)(FibEntry*,FibEntry*)= &FatTreeSwitch::compare_queuesize;
 
+bool FatTreeSwitch::set_ar_method(const string& name){
+    if (name == "pause"){
+        cout << "Adaptive routing based on pause state " << endl;
+        fn = &FatTreeSwitch::compare_pause;
+    }
+    else if (name == "queue"){
+        cout << "Adaptive routing based on queue size " << endl;
+        fn = &FatTreeSwitch::compare_queuesize;
+    }
+    else if (name == "bandwidth"){
+        cout << "Adaptive routing based on bandwidth utilization " << endl;
+        fn = &FatTreeSwitch::compare_bandwidth;
+    }
+    else if (name == "pqb"){
+        cout << "Adaptive routing based on pause, queuesize and bandwidth utilization " << endl;
+        fn = &FatTreeSwitch::compare_pqb;
+    }
+    else if (name == "pq"){
+        cout << "Adaptive routing based on pause, queuesize" << endl;
+        fn = &FatTreeSwitch::compare_pq;
+    }
+    else if (name == "pb"){
+        cout << "Adaptive routing based on pause, bandwidth utilization" << endl;
+        fn = &FatTreeSwitch::compare_pb;
+    }
+    else if (name == "qb"){
+        cout << "Adaptive routing based on queuesize, bandwidth utilization" << endl;
+        fn = &FatTreeSwitch::compare_qb; 
+    }
+    else
+        return false;
+    return true;
+}
+
 Route* FatTreeSwitch::getNextHop(Packet& pkt, BaseQueue* ingress_port){
-    vector<FibEntry*> * available_hops = _fib->getRoutes(pkt.dst());
-
-    if (available_hops){
-        //implement a form of ECMP hashing; might need to revisit based on measured performance.
-        uint32_t ecmp_choice = 0;
-        if (available_hops->size()>1)
-            switch(_strategy){
-            case NIX:
-                abort();
-            case ECMP:
-                ecmp_choice = freeBSDHash(pkt.flow_id(),pkt.pathid(),_hash_salt) % available_hops->size();
-                break;
-            case ADAPTIVE_ROUTING:
-                if (_ar_sticky==FatTreeSwitch::PER_PACKET){
-                    ecmp_choice = adaptive_route(available_hops,fn); 
-                } 
-                else if (_ar_sticky==FatTreeSwitch::PER_FLOWLET){     
-                    if (_flowlet_maps.find(pkt.flow_id())!=_flowlet_maps.end()){
-                        FlowletInfo* f = _flowlet_maps[pkt.flow_id()];
-                        
-                        // only reroute an existing flow if its inter packet time is larger than _sticky_delta and
-                        // and
-                        // 50% chance happens. 
-                        // and (commented out) if the switch has not taken any other placement decision that we've not seen the effects of.
-                        if (eventlist().now() - f->_last > _sticky_delta && /*eventlist().now() - _last_choice > _pipe->delay() + BaseQueue::_update_period  &&*/ random()%2==0){ 
-                            //cout << "AR 1 " << timeAsUs(eventlist().now()) << endl;
-                            uint32_t new_route = adaptive_route(available_hops,fn); 
-                            if (fn(available_hops->at(f->_egress),available_hops->at(new_route)) < 0){
-                                f->_egress = new_route;
-                                _last_choice = eventlist().now();
-                                //cout << "Switch " << _type << ":" << _id << " choosing new path "<<  f->_egress << " for " << pkt.flow_id() << " at " << timeAsUs(eventlist().now()) << " last is " << timeAsUs(f->_last) << endl;
-                            }
-                        }
-                        ecmp_choice = f->_egress;
+    if (_type == TOR && _ft->HOST_POD_SWITCH(pkt.dst()) == _id) {
+        //this host is directly connected!
+        HostFibEntry* fe = _fib->getHostRoute(pkt.dst(),pkt.flow_id());
+        assert(fe);
+        pkt.set_direction(DOWN);
+        return fe->getEgressPort();
+    }
 
-                        f->_last = eventlist().now();
+    vector<FibEntry*> * available_hops = getNextHops(pkt.dst());
+
+    //implement a form of ECMP hashing; might need to revisit based on measured performance.
+    uint32_t ecmp_choice = 0;
+    if (available_hops->size()>1)
+        switch(_strategy){
+        case NIX:
+            abort();
+        case ECMP:
+            ecmp_choice = freeBSDHash(pkt.flow_id(),pkt.pathid(),_hash_salt) % available_hops->size();
+            break;
+        case ADAPTIVE_ROUTING:
+            if (_ar_sticky==FatTreeSwitch::PER_PACKET){
+                ecmp_choice = adaptive_route(available_hops,fn); 
+            } 
+            else if (_ar_sticky==FatTreeSwitch::PER_FLOWLET){     
+                if (_flowlet_maps.find(pkt.flow_id())!=_flowlet_maps.end()){
+                    FlowletInfo* f = _flowlet_maps[pkt.flow_id()];
+                    
+                    // only reroute an existing flow if its inter packet time is larger than _sticky_delta and
+                    // and
+                    // 50% chance happens. 
+                    // and (commented out) if the switch has not taken any other placement decision that we've not seen the effects of.
+                    if (eventlist().now() - f->_last > _sticky_delta && /*eventlist().now() - _last_choice > _pipe->delay() + BaseQueue::_update_period  &&*/ random()%2==0){ 
+                        //cout << "AR 1 " << timeAsUs(eventlist().now()) << endl;
+                        uint32_t new_route = adaptive_route(available_hops,fn); 
+                        if (fn(available_hops->at(f->_egress),available_hops->at(new_route)) < 0){
+                            f->_egress = new_route;
+                            _last_choice = eventlist().now();
+                            //cout << "Switch " << _type << ":" << _id << " choosing new path "<<  f->_egress << " for " << pkt.flow_id() << " at " << timeAsUs(eventlist().now()) << " last is " << timeAsUs(f->_last) << endl;
+                        }
                     }
-                    else {
-                        //cout << "AR 2 " << timeAsUs(eventlist().now()) << endl;
-                        ecmp_choice = adaptive_route(available_hops,fn); 
-                        _last_choice = eventlist().now();
+                    ecmp_choice = f->_egress;
 
-                        _flowlet_maps[pkt.flow_id()] = new FlowletInfo(ecmp_choice,eventlist().now());
-                    }
+                    f->_last = eventlist().now();
                 }
+                else {
+                    //cout << "AR 2 " << timeAsUs(eventlist().now()) << endl;
+                    ecmp_choice = adaptive_route(available_hops,fn); 
+                    _last_choice = eventlist().now();
+
+                    _flowlet_maps[pkt.flow_id()] = new FlowletInfo(ecmp_choice,eventlist().now());
+                }
+            }
 
-                break;
-            case ECMP_ADAPTIVE:
-                ecmp_choice = freeBSDHash(pkt.flow_id(),pkt.pathid(),_hash_salt) % available_hops->size();
-                if (random()%100 < 50)
-                    ecmp_choice = replace_worst_choice(available_hops,fn, ecmp_choice);
-                break;
-            case RR:
+            break;
+        case ECMP_ADAPTIVE:
+            ecmp_choice = freeBSDHash(pkt.flow_id(),pkt.pathid(),_hash_salt) % available_hops->size();
+            if (random()%100 < 50)
+                ecmp_choice = replace_worst_choice(available_hops,fn, ecmp_choice);
+            break;
+        case RR:
+            if (_crt_route>=5 * available_hops->size()){
+                _crt_route = 0;
+                permute_paths(available_hops);
+            }
+            ecmp_choice = _crt_route % available_hops->size();
+            _crt_route ++;
+            break;
+        case RR_ECMP:
+            if (_type == TOR){
                 if (_crt_route>=5 * available_hops->size()){
                     _crt_route = 0;
                     permute_paths(available_hops);
                 }
                 ecmp_choice = _crt_route % available_hops->size();
                 _crt_route ++;
-                break;
-            case RR_ECMP:
-                if (_type == TOR){
-                    if (_crt_route>=5 * available_hops->size()){
-                        _crt_route = 0;
-                        permute_paths(available_hops);
-                    }
-                    ecmp_choice = _crt_route % available_hops->size();
-                    _crt_route ++;
-                }
-                else ecmp_choice = freeBSDHash(pkt.flow_id(),pkt.pathid(),_hash_salt) % available_hops->size();
-                
-                break;
             }
-        
-        FibEntry* e = (*available_hops)[ecmp_choice];
-        pkt.set_direction(e->getDirection());
-        
-        return e->getEgressPort();
-    }
+            else ecmp_choice = freeBSDHash(pkt.flow_id(),pkt.pathid(),_hash_salt) % available_hops->size();
+            
+            break;
+        }
+    
+    FibEntry* e = (*available_hops)[ecmp_choice];
+    pkt.set_direction(e->getDirection());
+    
+    return e->getEgressPort();
+};
 
-    //no route table entries for this destination. Add them to FIB or fail. 
-    if (_type == TOR){
-        if ( _ft->HOST_POD_SWITCH(pkt.dst()) == _id) { 
-            //this host is directly connected!
-            HostFibEntry* fe = _fib->getHostRoute(pkt.dst(),pkt.flow_id());
-            assert(fe);
-            pkt.set_direction(DOWN);
-            return fe->getEgressPort();
+vector<FibEntry*>* FatTreeSwitch::getNextHops(uint32_t dst) {
+    if (_type == TOR) {
+        //route packet up!
+        if (_up_group.empty())
+            build_up_group();
+        return &_up_group;
+    } else if (_type == AGG) {
+        if (_ft->get_tiers()==2 || _ft->HOST_POD(dst) == _ft->AGG_SWITCH_POD_ID(_id)) {
+            //must go down!
+            uint32_t target_tor = _ft->HOST_POD_SWITCH(dst);
+            uint32_t ix = (_ft->get_tiers()==3) ? target_tor % _ft->tor_switches_per_pod() : target_tor;
+            if (ix >= _down_groups.size())
+                _down_groups.resize(ix + 1);
+            if (_down_groups[ix].empty())
+                build_down_group(_down_groups[ix], target_tor);
+            return &_down_groups[ix];
         } else {
-            //route packet up!
-            if (_uproutes)
-                _fib->setRoutes(pkt.dst(),_uproutes);
-            else {
-                uint32_t podid,agg_min,agg_max;
-
-                if (_ft->get_tiers()==3) {
-                    podid = _id / _ft->tor_switches_per_pod();
-                    agg_min = _ft->MIN_POD_AGG_SWITCH(podid);
-                    agg_max = _ft->MAX_POD_AGG_SWITCH(podid);
-                }
-                else {
-                    agg_min = 0;
-                    agg_max = _ft->getNAGG()-1;
-                }
-
-                for (uint32_t k=agg_min; k<=agg_max;k++){
-                    for (uint32_t b = 0; b < _ft->bundlesize(AGG_TIER); b++) {
-                        Route * r = new Route();
-                        r->push_back(_ft->queues_nlp_nup[_id][k][b]);
-                        assert(((BaseQueue*)r->at(0))->getSwitch() == this);
+            //go up!
+            if (_up_group.empty())
+                build_up_group();
+            return &_up_group;
+        }
+    } else if (_type == CORE) {
+        uint32_t pod = _ft->HOST_POD(dst);
+        if (pod >= _down_groups.size())
+            _down_groups.resize(pod + 1);
+        if (_down_groups[pod].empty()) {
+            uint32_t nup = _ft->MIN_POD_AGG_SWITCH(pod) + (_id % _ft->agg_switches_per_pod());
+            build_down_group(_down_groups[pod], nup);
+        }
+        return &_down_groups[pod];
+    }
+    cerr << "Route lookup on switch with no proper type: " << _type << endl;
+    abort();
+}
 
-                        r->push_back(_ft->pipes_nlp_nup[_id][k][b]);
-                        r->push_back(_ft->queues_nlp_nup[_id][k][b]->getRemoteEndpoint());
-                        _fib->addRoute(pkt.dst(),r,1,UP);
-                    }
+void FatTreeSwitch::build_up_group() {
+    assert(_up_group.empty());
+    if (_type == TOR) {
+        uint32_t podid,agg_min,agg_max;
 
-                    /*
-                      FatTreeSwitch* next = (FatTreeSwitch*)_ft->queues_nlp_nup[_id][k]->getRemoteEndpoint();
-                      assert (next->getType()==AGG && next->getID() == k);
-                    */
-                }
-                _uproutes = _fib->getRoutes(pkt.dst());
-                permute_paths(_uproutes);
-            }
+        if (_ft->get_tiers()==3) {
+            podid = _id / _ft->tor_switches_per_pod();
+            agg_min = _ft->MIN_POD_AGG_SWITCH(podid);
+            agg_max = _ft->MAX_POD_AGG_SWITCH(podid);
         }
-    } else if (_type == AGG) {
-        if ( _ft->get_tiers()==2 || _ft->HOST_POD(pkt.dst()) == _ft->AGG_SWITCH_POD_ID(_id)) {
-            //must go down!
-            //target NLP id is 2 * pkt.dst()/K
-            uint32_t target_tor = _ft->HOST_POD_SWITCH(pkt.dst());
+        else {
+            agg_min = 0;
+            agg_max = _ft->getNAGG()-1;
+        }
+
+        for (uint32_t k=agg_min; k<=agg_max;k++){
             for (uint32_t b = 0; b < _ft->bundlesize(AGG_TIER); b++) {
                 Route * r = new Route();
-                r->push_back(_ft->queues_nup_nlp[_id][target_tor][b]);
+                r->push_back(_ft->queues_nlp_nup(_id, k, b));
                 assert(((BaseQueue*)r->at(0))->getSwitch() == this);
 
-                r->push_back(_ft->pipes_nup_nlp[_id][target_tor][b]);          
-                r->push_back(_ft->queues_nup_nlp[_id][target_tor][b]->getRemoteEndpoint());
-
-                _fib->addRoute(pkt.dst(),r,1, DOWN);
+                r->push_back(_ft->pipes_nlp_nup(_id, k, b));
+                r->push_back(_ft->queues_nlp_nup(_id, k, b)->getRemoteEndpoint());
+                _up_group.push_back(new FibEntry(r,1,UP));
             }
-        } else {
-            //go up!
-            if (_uproutes)
-                _fib->setRoutes(pkt.dst(),_uproutes);
-            else {
-                uint32_t podpos = _id % _ft->agg_switches_per_pod();
-                uint32_t uplink_bundles = _ft->radix_up(AGG_TIER) / _ft->bundlesize(CORE_TIER);
-                for (uint32_t l = 0; l <  uplink_bundles ; l++) {
-                    uint32_t core = l * _ft->agg_switches_per_pod() + podpos;
-                    for (uint32_t b = 0; b < _ft->bundlesize(CORE_TIER); b++) {
-                        Route *r = new Route();
-                        r->push_back(_ft->queues_nup_nc[_id][core][b]);
-                        assert(((BaseQueue*)r->at(0))->getSwitch() == this);
-
-                        r->push_back(_ft->pipes_nup_nc[_id][core][b]);
-                        r->push_back(_ft->queues_nup_nc[_id][core][b]->getRemoteEndpoint());
-
-                        /*
-                          FatTreeSwitch* next = (FatTreeSwitch*)_ft->queues_nup_nc[_id][k]->getRemoteEndpoint();
-                          assert (next->getType()==CORE && next->getID() == k);
-                        */
-                    
-                        _fib->addRoute(pkt.dst(),r,1,UP);
+        }
+    } else {
+        assert(_type == AGG);
+        uint32_t podpos = _id % _ft->agg_switches_per_pod();
+        uint32_t uplink_bundles = _ft->radix_up(AGG_TIER) / _ft->bundlesize(CORE_TIER);
+        for (uint32_t l = 0; l <  uplink_bundles ; l++) {
+            uint32_t core = l * _ft->agg_switches_per_pod() + podpos;
+            for (uint32_t b = 0; b < _ft->bundlesize(CORE_TIER); b++) {
+                Route *r = new Route();
+                r->push_back(_ft->queues_nup_nc(_id, core, b));
+                assert(((BaseQueue*)r->at(0))->getSwitch() == this);
 
-                        //cout << "AGG switch " << _id << " adding route to " << pkt.dst() << " via CORE " << k << " bundle_id " << b << endl;
-                    }
-                }
-                //_uproutes = _fib->getRoutes(pkt.dst());
-                permute_paths(_fib->getRoutes(pkt.dst()));
+                r->push_back(_ft->pipes_nup_nc(_id, core, b));
+                r->push_back(_ft->queues_nup_nc(_id, core, b)->getRemoteEndpoint());
+                _up_group.push_back(new FibEntry(r,1,UP));
             }
         }
-    } else if (_type == CORE) {
-        uint32_t nup = _ft->MIN_POD_AGG_SWITCH(_ft->HOST_POD(pkt.dst())) + (_id % _ft->agg_switches_per_pod());
+    }
+    permute_paths(&_up_group);
+}
+
+void FatTreeSwitch::build_down_group(vector<FibEntry*>& group, uint32_t next) {
+    if (_type == AGG) {
+        for (uint32_t b = 0; b < _ft->bundlesize(AGG_TIER); b++) {
+            Route * r = new Route();
+            r->push_back(_ft->queues_nup_nlp(_id, next, b));
+            assert(((BaseQueue*)r->at(0))->getSwitch() == this);
+
+            r->push_back(_ft->pipes_nup_nlp(_id, next, b));
+            r->push_back(_ft->queues_nup_nlp(_id, next, b)->getRemoteEndpoint());
+            group.push_back(new FibEntry(r,1,DOWN));
+        }
+    } else {
+        assert(_type == CORE);
         for (uint32_t b = 0; b < _ft->bundlesize(CORE_TIER); b++) {
             Route *r = new Route();
-            //cout << "CORE switch " << _id << " adding route to " << pkt.dst() << " via AGG " << nup << endl;
-
-            assert (_ft->queues_nc_nup[_id][nup][b]);
-            r->push_back(_ft->queues_nc_nup[_id][nup][b]);
+            assert (_ft->queues_nc_nup(_id, next, b));
+            r->push_back(_ft->queues_nc_nup(_id, next, b));
             assert(((BaseQueue*)r->at(0))->getSwitch() == this);
 
-            assert (_ft->pipes_nc_nup[_id][nup][b]);
-            r->push_back(_ft->pipes_nc_nup[_id][nup][b]);
+            assert (_ft->pipes_nc_nup(_id, next, b));
+            r->push_back(_ft->pipes_nc_nup(_id, next, b));
 
-            r->push_back(_ft->queues_nc_nup[_id][nup][b]->getRemoteEndpoint());
-            _fib->addRoute(pkt.dst(),r,1,DOWN);
+            r->push_back(_ft->queues_nc_nup(_id, next, b)->getRemoteEndpoint());
+            group.push_back(new FibEntry(r,1,DOWN));
         }
     }
-    else {
-        cerr << "Route lookup on switch with no proper type: " << _type << endl;
-        abort();
-    }
-    assert(_fib->getRoutes(pkt.dst()));
-
-    //FIB has been filled in; return choice. 
-    return getNextHop(pkt, ingress_port);
-};
+}
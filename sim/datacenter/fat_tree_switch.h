@@ -81,6 +81,20 @@ public:
 
 };
 
+class FatTreeSwitch;
+
+// Egress side of a FatTreeSwitch: the switch's CallbackPipe delivers
+// here once the switching latency has passed, and the packet carries
+// on along the route chosen at ingress.
+class FatTreeSwitchEgress : public PacketSink {
+public:
+    FatTreeSwitchEgress(FatTreeSwitch& sw) : _switch(sw) {}
+    virtual void receivePacket(Packet& pkt) {pkt.sendOn();}
+    virtual const string& nodename();
+private:
+    FatTreeSwitch& _switch;
+};
+
 class FatTreeSwitch : public Switch {
 public:
     enum switch_type {
@@ -99,6 +113,8 @@ public:
   
     virtual void receivePacket(Packet& pkt);
     virtual Route* getNextHop(Packet& pkt, BaseQueue* ingress_port);
+    // the ECMP set for dst; dst must not be directly connected
+    vector<FibEntry*>* getNextHops(uint32_t dst);
     virtual uint32_t getType() {return _type;}
 
     uint32_t adaptive_route(vector<FibEntry*>* ecmp_set, int8_t (*cmp)(FibEntry*,FibEntry*));
@@ -115,6 +131,8 @@ public:
     static int8_t compare_qb(FibEntry* l, FibEntry* r);//compare pause, bandwidth
 
     static int8_t (*fn)(FibEntry*,FibEntry*);
+    // sets fn from its -ar_method name; returns false if name is unknown
+    static bool set_ar_method(const string& name);
 
     virtual void addHostPort(int addr, int flowid, PacketSink* transport);
 
@@ -123,29 +141,37 @@ public:
     static void set_strategy(routing_strategy s) { assert (_strategy==NIX); _strategy = s; }
     static void set_ar_fraction(uint16_t f) { assert(f>=1);_ar_fraction = f;} 
 
-    static routing_strategy _strategy;
-    static uint16_t _ar_fraction;
-    static uint16_t _ar_sticky;
-    static simtime_picosec _sticky_delta;
-    static double _ecn_threshold_fraction;
-    static double _speculative_threshold_fraction;
+    static thread_local routing_strategy _strategy;
+    static thread_local uint16_t _ar_fraction;
+    static thread_local uint16_t _ar_sticky;
+    static thread_local simtime_picosec _sticky_delta;
+    static thread_local double _ecn_threshold_fraction;
+    static thread_local double _speculative_threshold_fraction;
 private:
     switch_type _type;
     Pipe* _pipe;
+    FatTreeSwitchEgress _egress;
     FatTreeTopology* _ft;
     
+    void build_up_group();
+    void build_down_group(vector<FibEntry*>& group, uint32_t next);
+
+    // The FIB is keyed by prefix rather than by destination host: one
+    // ECMP group for everything routed up, and one per ToR (on AGG
+    // switches) or per pod (on CORE switches) below us.  Groups are
+    // built the first time they are needed and shared by every
+    // destination behind that prefix, so the FIB is O(ports).
     //CAREFUL: can't always have a single FIB for all up destinations when there are failures!
-    vector<FibEntry*>* _uproutes;
+    vector<FibEntry*> _up_group;
+    vector< vector<FibEntry*> > _down_groups;
 
     unordered_map<uint32_t,FlowletInfo*> _flowlet_maps;
 
-    static unordered_map<BaseQueue*,uint32_t> _port_flow_counts;
+    static thread_local unordered_map<BaseQueue*,uint32_t> _port_flow_counts;
 
     uint32_t _crt_route;
     uint32_t _hash_salt;
     simtime_picosec _last_choice;
-
-    unordered_map<Packet*,bool> _packets;
 };
 
 #endif
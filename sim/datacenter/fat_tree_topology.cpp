@@ -22,17 +22,17 @@
 extern void tokenize(string const &str, const char delim, vector<string> &out);
 
 // default to 3-tier topology.  Change this with set_tiers() before calling the constructor.
-uint32_t FatTreeTopology::_tiers = 3;
-simtime_picosec FatTreeTopology::_link_latencies[] = {0,0,0};
-simtime_picosec FatTreeTopology::_switch_latencies[] = {0,0,0};
-uint32_t FatTreeTopology::_hosts_per_pod = 0;
-uint32_t FatTreeTopology::_radix_up[] = {0,0};
-uint32_t FatTreeTopology::_radix_down[] = {0,0,0};
-mem_b FatTreeTopology::_queue_up[] = {0,0};
-mem_b FatTreeTopology::_queue_down[] = {0,0,0};
-uint32_t FatTreeTopology::_bundlesize[] = {1,1,1};
-uint32_t FatTreeTopology::_oversub[] = {1,1,1};
-linkspeed_bps FatTreeTopology::_downlink_speeds[] = {0,0,0};
+thread_local uint32_t FatTreeTopology::_tiers = 3;
+thread_local simtime_picosec FatTreeTopology::_link_latencies[] = {0,0,0};
+thread_local simtime_picosec FatTreeTopology::_switch_latencies[] = {0,0,0};
+thread_local uint32_t FatTreeTopology::_hosts_per_pod = 0;
+thread_local uint32_t FatTreeTopology::_radix_up[] = {0,0};
+thread_local uint32_t FatTreeTopology::_radix_down[] = {0,0,0};
+thread_local mem_b FatTreeTopology::_queue_up[] = {0,0};
+thread_local mem_b FatTreeTopology::_queue_down[] = {0,0,0};
+thread_local uint32_t FatTreeTopology::_bundlesize[] = {1,1,1};
+thread_local uint32_t FatTreeTopology::_oversub[] = {1,1,1};
+thread_local linkspeed_bps FatTreeTopology::_downlink_speeds[] = {0,0,0};
 
 void
 FatTreeTopology::set_tier_parameters(int tier, int radix_up, int radix_down, mem_b queue_up, mem_b queue_down, int bundlesize, linkspeed_bps linkspeed, int oversub) {
@@ -600,29 +600,24 @@ void FatTreeTopology::alloc_vectors() {
     switches_c.resize(NCORE,NULL);
 
 
-    // These vectors are sparse - we won't use all the entries
+    // Links are only stored where they exist, so this costs the
+    // number of switches and hosts, not NTOR*NSRV
     if (_tiers == 3) {
-        // resizing 3d vectors is scary magic
-        pipes_nc_nup.resize(NCORE, vector< vector<Pipe*> >(NAGG, vector<Pipe*>(_bundlesize[CORE_TIER])));
-        queues_nc_nup.resize(NCORE, vector< vector<BaseQueue*> >(NAGG, vector<BaseQueue*>(_bundlesize[CORE_TIER])));
+        pipes_nc_nup.init(NCORE, _bundlesize[CORE_TIER]);
+        queues_nc_nup.init(NCORE, _bundlesize[CORE_TIER]);
+        pipes_nup_nc.init(NAGG, _bundlesize[CORE_TIER]);
+        queues_nup_nc.init(NAGG, _bundlesize[CORE_TIER]);
     }
 
-    pipes_nup_nlp.resize(NAGG, vector< vector<Pipe*> >(NTOR, vector<Pipe*>(_bundlesize[AGG_TIER])));
-    queues_nup_nlp.resize(NAGG, vector< vector<BaseQueue*> >(NTOR, vector<BaseQueue*>(_bundlesize[AGG_TIER])));
+    pipes_nup_nlp.init(NAGG, _bundlesize[AGG_TIER]);
+    queues_nup_nlp.init(NAGG, _bundlesize[AGG_TIER]);
+    pipes_nlp_nup.init(NTOR, _bundlesize[AGG_TIER]);
+    queues_nlp_nup.init(NTOR, _bundlesize[AGG_TIER]);
 
-    pipes_nlp_ns.resize(NTOR, vector< vector<Pipe*> >(NSRV, vector<Pipe*>(_bundlesize[TOR_TIER])));
-    queues_nlp_ns.resize(NTOR, vector< vector<BaseQueue*> >(NSRV, vector<BaseQueue*>(_bundlesize[TOR_TIER])));
-
-
-    if (_tiers == 3) {
-        pipes_nup_nc.resize(NAGG, vector< vector<Pipe*> >(NCORE, vector<Pipe*>(_bundlesize[CORE_TIER])));
-        queues_nup_nc.resize(NAGG, vector< vector<BaseQueue*> >(NCORE, vector<BaseQueue*>(_bundlesize[CORE_TIER])));
-    }
-    
-    pipes_nlp_nup.resize(NTOR, vector< vector<Pipe*> >(NAGG, vector<Pipe*>(_bundlesize[AGG_TIER])));
-    pipes_ns_nlp.resize(NSRV, vector< vector<Pipe*> >(NTOR, vector<Pipe*>(_bundlesize[TOR_TIER])));
-    queues_nlp_nup.resize(NTOR, vector< vector<BaseQueue*> >(NAGG, vector<BaseQueue*>(_bundlesize[AGG_TIER])));
-    queues_ns_nlp.resize(NSRV, vector< vector<BaseQueue*> >(NTOR, vector<BaseQueue*>(_bundlesize[TOR_TIER])));
+    pipes_nlp_ns.init(NTOR, _bundlesize[TOR_TIER]);
+    queues_nlp_ns.init(NTOR, _bundlesize[TOR_TIER]);
+    pipes_ns_nlp.init(NSRV, _bundlesize[TOR_TIER]);
+    queues_ns_nlp.init(NSRV, _bundlesize[TOR_TIER]);
 }
 
 BaseQueue* FatTreeTopology::alloc_src_queue(QueueLogger* queueLogger){
@@ -702,42 +697,32 @@ FatTreeTopology::alloc_queue(QueueLogger* queueLogger, linkspeed_bps speed, mem_
     }
 }
 
-void FatTreeTopology::init_network(){
-    QueueLogger* queueLogger;
-    if (_tiers == 3) {
-        for (uint32_t j=0;j<NCORE;j++) {
-            for (uint32_t k=0;k<NAGG;k++) {
-                for (uint32_t b = 0; b < _bundlesize[CORE_TIER]; b++) {
-                    queues_nc_nup[j][k][b] = NULL;
-                    pipes_nc_nup[j][k][b] = NULL;
-                    queues_nup_nc[k][j][b] = NULL;
-                    pipes_nup_nc[k][j][b] = NULL;
+bool FatTreeTopology::set_ecn_threshold(double fraction){
+    if (_qt != COMPOSITE_ECN_LB && _qt != AEOLUS_ECN)
+        return false;
+    FatTreeSwitch::_ecn_threshold_fraction = fraction;
+    // the queues alloc_queue gave a threshold: all but ToR downlinks
+    LinkTable<BaseQueue*>* marking[] = {&queues_nlp_nup, &queues_nup_nlp, &queues_nup_nc, &queues_nc_nup};
+    for (LinkTable<BaseQueue*>* table : marking) {
+        for (uint32_t from = 0; from < table->size(); from++) {
+            for (uint32_t i = 0; i < table->degree(from); i++) {
+                for (uint32_t b = 0; b < table->bundlesize(); b++) {
+                    BaseQueue* q = table->link(from, i, b);
+                    if (!q)
+                        continue;
+                    if (_qt == COMPOSITE_ECN_LB)
+                        static_cast<CompositeQueue*>(q)->set_ecn_threshold(fraction * q->maxsize());
+                    else
+                        static_cast<AeolusQueue*>(q)->set_ecn_threshold(fraction * q->maxsize());
                 }
             }
         }
     }
-    
-    for (uint32_t j=0;j<NAGG;j++) {
-        for (uint32_t k=0;k<NTOR;k++) {
-            for (uint32_t b = 0; b < _bundlesize[AGG_TIER]; b++) {
-                queues_nup_nlp[j][k][b] = NULL;
-                pipes_nup_nlp[j][k][b] = NULL;
-                queues_nlp_nup[k][j][b] = NULL;
-                pipes_nlp_nup[k][j][b] = NULL;
-            }
-        }
-    }
-    
-    for (uint32_t j=0;j<NTOR;j++) {
-        for (uint32_t k=0;k<NSRV;k++) {
-            for (uint32_t b = 0; b < _bundlesize[TOR_TIER]; b++) { 
-                queues_nlp_ns[j][k][b] = NULL;
-                pipes_nlp_ns[j][k][b] = NULL;
-                queues_ns_nlp[k][j][b] = NULL;
-                pipes_ns_nlp[k][j][b] = NULL;
-            }
-        }
-    }
+    return true;
+}
+
+void FatTreeTopology::init_network(){
+    QueueLogger* queueLogger;
 
     //create switches if we have lossless operation
     //if (_qt==LOSSLESS)
@@ -768,12 +753,12 @@ void FatTreeTopology::init_network(){
                     queueLogger = NULL;
                 }
             
-                queues_nlp_ns[tor][srv][b] = alloc_queue(queueLogger, _queue_down[TOR_TIER], DOWNLINK, TOR_TIER, true);
-                queues_nlp_ns[tor][srv][b]->setName("LS" + ntoa(tor) + "->DST" +ntoa(srv) + "(" + ntoa(b) + ")");
+                queues_nlp_ns.set(tor, srv, b, alloc_queue(queueLogger, _queue_down[TOR_TIER], DOWNLINK, TOR_TIER, true));
+                queues_nlp_ns(tor, srv, b)->setName("LS" + ntoa(tor) + "->DST" +ntoa(srv) + "(" + ntoa(b) + ")");
                 //if (logfile) logfile->writeName(*(queues_nlp_ns[tor][srv]));
                 simtime_picosec hop_latency = (_hop_latency == 0) ? _link_latencies[TOR_TIER] : _hop_latency;
-                pipes_nlp_ns[tor][srv][b] = new Pipe(hop_latency, *_eventlist);
-                pipes_nlp_ns[tor][srv][b]->setName("Pipe-LS" + ntoa(tor)  + "->DST" + ntoa(srv) + "(" + ntoa(b) + ")");
+                pipes_nlp_ns.set(tor, srv, b, new Pipe(hop_latency, *_eventlist));
+                pipes_nlp_ns(tor, srv, b)->setName("Pipe-LS" + ntoa(tor)  + "->DST" + ntoa(srv) + "(" + ntoa(b) + ")");
                 //if (logfile) logfile->writeName(*(pipes_nlp_ns[tor][srv]));
             
                 // Uplink
@@ -782,27 +767,27 @@ void FatTreeTopology::init_network(){
                 } else {
                     queueLogger = NULL;
                 }
-                queues_ns_nlp[srv][tor][b] = alloc_src_queue(queueLogger);   
-                queues_ns_nlp[srv][tor][b]->setName("SRC" + ntoa(srv) + "->LS" +ntoa(tor) + "(" + ntoa(b) + ")");
-                //cout << queues_ns_nlp[srv][tor][b]->str() << endl;
+                queues_ns_nlp.set(srv, tor, b, alloc_src_queue(queueLogger));   
+                queues_ns_nlp(srv, tor, b)->setName("SRC" + ntoa(srv) + "->LS" +ntoa(tor) + "(" + ntoa(b) + ")");
+                //cout << queues_ns_nlp(srv, tor, b)->str() << endl;
                 //if (logfile) logfile->writeName(*(queues_ns_nlp[srv][tor]));
 
-                queues_ns_nlp[srv][tor][b]->setRemoteEndpoint(switches_lp[tor]);
+                queues_ns_nlp(srv, tor, b)->setRemoteEndpoint(switches_lp[tor]);
 
-                assert(switches_lp[tor]->addPort(queues_nlp_ns[tor][srv][b]) < 96);
+                assert(switches_lp[tor]->addPort(queues_nlp_ns(tor, srv, b)) < 96);
 
                 if (_qt==LOSSLESS_INPUT || _qt == LOSSLESS_INPUT_ECN){
                     //no virtual queue needed at server
-                    new LosslessInputQueue(*_eventlist, queues_ns_nlp[srv][tor][b], switches_lp[tor], _hop_latency);
+                    new LosslessInputQueue(*_eventlist, queues_ns_nlp(srv, tor, b), switches_lp[tor], _hop_latency);
                 }
         
-                pipes_ns_nlp[srv][tor][b] = new Pipe(hop_latency, *_eventlist);
-                pipes_ns_nlp[srv][tor][b]->setName("Pipe-SRC" + ntoa(srv) + "->LS" + ntoa(tor) + "(" + ntoa(b) + ")");
+                pipes_ns_nlp.set(srv, tor, b, new Pipe(hop_latency, *_eventlist));
+                pipes_ns_nlp(srv, tor, b)->setName("Pipe-SRC" + ntoa(srv) + "->LS" + ntoa(tor) + "(" + ntoa(b) + ")");
                 //if (logfile) logfile->writeName(*(pipes_ns_nlp[srv][tor]));
             
                 if (ff){
-                    ff->add_queue(queues_nlp_ns[tor][srv][b]);
-                    ff->add_queue(queues_ns_nlp[srv][tor][b]);
+                    ff->add_queue(queues_nlp_ns(tor, srv, b));
+                    ff->add_queue(queues_ns_nlp(srv, tor, b));
                 }
             }
         }
@@ -830,13 +815,13 @@ void FatTreeTopology::init_network(){
                 } else {
                     queueLogger = NULL;
                 }
-                queues_nup_nlp[agg][tor][b] = alloc_queue(queueLogger, _queue_down[AGG_TIER], DOWNLINK, AGG_TIER);
-                queues_nup_nlp[agg][tor][b]->setName("US" + ntoa(agg) + "->LS_" + ntoa(tor) + "(" + ntoa(b) + ")");
+                queues_nup_nlp.set(agg, tor, b, alloc_queue(queueLogger, _queue_down[AGG_TIER], DOWNLINK, AGG_TIER));
+                queues_nup_nlp(agg, tor, b)->setName("US" + ntoa(agg) + "->LS_" + ntoa(tor) + "(" + ntoa(b) + ")");
                 //if (logfile) logfile->writeName(*(queues_nup_nlp[agg][tor]));
             
                 simtime_picosec hop_latency = (_hop_latency == 0) ? _link_latencies[AGG_TIER] : _hop_latency;
-                pipes_nup_nlp[agg][tor][b] = new Pipe(hop_latency, *_eventlist);
-                pipes_nup_nlp[agg][tor][b]->setName("Pipe-US" + ntoa(agg) + "->LS" + ntoa(tor) + "(" + ntoa(b) + ")");
+                pipes_nup_nlp.set(agg, tor, b, new Pipe(hop_latency, *_eventlist));
+                pipes_nup_nlp(agg, tor, b)->setName("Pipe-US" + ntoa(agg) + "->LS" + ntoa(tor) + "(" + ntoa(b) + ")");
                 //if (logfile) logfile->writeName(*(pipes_nup_nlp[agg][tor]));
             
                 // Uplink
@@ -845,32 +830,32 @@ void FatTreeTopology::init_network(){
                 } else {
                     queueLogger = NULL;
                 }
-                queues_nlp_nup[tor][agg][b] = alloc_queue(queueLogger, _queue_up[TOR_TIER], UPLINK, TOR_TIER, true);
-                queues_nlp_nup[tor][agg][b]->setName("LS" + ntoa(tor) + "->US" + ntoa(agg) + "(" + ntoa(b) + ")");
-                //cout << queues_nlp_nup[tor][agg][b]->str() << endl;
+                queues_nlp_nup.set(tor, agg, b, alloc_queue(queueLogger, _queue_up[TOR_TIER], UPLINK, TOR_TIER, true));
+                queues_nlp_nup(tor, agg, b)->setName("LS" + ntoa(tor) + "->US" + ntoa(agg) + "(" + ntoa(b) + ")");
+                //cout << queues_nlp_nup(tor, agg, b)->str() << endl;
                 //if (logfile) logfile->writeName(*(queues_nlp_nup[tor][agg]));
 
-                assert(switches_lp[tor]->addPort(queues_nlp_nup[tor][agg][b]) < 96);
-                assert(switches_up[agg]->addPort(queues_nup_nlp[agg][tor][b]) < 64);
-                queues_nlp_nup[tor][agg][b]->setRemoteEndpoint(switches_up[agg]);
-                queues_nup_nlp[agg][tor][b]->setRemoteEndpoint(switches_lp[tor]);
+                assert(switches_lp[tor]->addPort(queues_nlp_nup(tor, agg, b)) < 96);
+                assert(switches_up[agg]->addPort(queues_nup_nlp(agg, tor, b)) < 64);
+                queues_nlp_nup(tor, agg, b)->setRemoteEndpoint(switches_up[agg]);
+                queues_nup_nlp(agg, tor, b)->setRemoteEndpoint(switches_lp[tor]);
 
                 /*if (_qt==LOSSLESS){
                   ((LosslessQueue*)queues_nlp_nup[tor][agg])->setRemoteEndpoint(queues_nup_nlp[agg][tor]);
                   ((LosslessQueue*)queues_nup_nlp[agg][tor])->setRemoteEndpoint(queues_nlp_nup[tor][agg]);
                   }else */
                 if (_qt==LOSSLESS_INPUT || _qt == LOSSLESS_INPUT_ECN){            
-                    new LosslessInputQueue(*_eventlist, queues_nlp_nup[tor][agg][b],switches_up[agg],_hop_latency);
-                    new LosslessInputQueue(*_eventlist, queues_nup_nlp[agg][tor][b],switches_lp[tor],_hop_latency);
+                    new LosslessInputQueue(*_eventlist, queues_nlp_nup(tor, agg, b),switches_up[agg],_hop_latency);
+                    new LosslessInputQueue(*_eventlist, queues_nup_nlp(agg, tor, b),switches_lp[tor],_hop_latency);
                 }
         
-                pipes_nlp_nup[tor][agg][b] = new Pipe(hop_latency, *_eventlist);
-                pipes_nlp_nup[tor][agg][b]->setName("Pipe-LS" + ntoa(tor) + "->US" + ntoa(agg) + "(" + ntoa(b) + ")");
+                pipes_nlp_nup.set(tor, agg, b, new Pipe(hop_latency, *_eventlist));
+                pipes_nlp_nup(tor, agg, b)->setName("Pipe-LS" + ntoa(tor) + "->US" + ntoa(agg) + "(" + ntoa(b) + ")");
                 //if (logfile) logfile->writeName(*(pipes_nlp_nup[tor][agg]));
         
                 if (ff){
-                    ff->add_queue(queues_nlp_nup[tor][agg][b]);
-                    ff->add_queue(queues_nup_nlp[agg][tor][b]);
+                    ff->add_queue(queues_nlp_nup(tor, agg, b));
+                    ff->add_queue(queues_nup_nlp(agg, tor, b));
                 }
             }
         }
@@ -898,15 +883,15 @@ void FatTreeTopology::init_network(){
                     } else {
                         queueLogger = NULL;
                     }
-                    assert(queues_nup_nc[agg][core][b] == NULL);
-                    queues_nup_nc[agg][core][b] = alloc_queue(queueLogger, _queue_up[AGG_TIER], UPLINK, AGG_TIER);
-                    queues_nup_nc[agg][core][b]->setName("US" + ntoa(agg) + "->CS" + ntoa(core) + "(" + ntoa(b) + ")");
-                    //cout << queues_nup_nc[agg][core][b]->str() << endl;
+                    assert(queues_nup_nc(agg, core, b) == NULL);
+                    queues_nup_nc.set(agg, core, b, alloc_queue(queueLogger, _queue_up[AGG_TIER], UPLINK, AGG_TIER));
+                    queues_nup_nc(agg, core, b)->setName("US" + ntoa(agg) + "->CS" + ntoa(core) + "(" + ntoa(b) + ")");
+                    //cout << queues_nup_nc(agg, core, b)->str() << endl;
                     //if (logfile) logfile->writeName(*(queues_nup_nc[agg][core]));
         
                     simtime_picosec hop_latency = (_hop_latency == 0) ? _link_latencies[CORE_TIER] : _hop_latency;
-                    pipes_nup_nc[agg][core][b] = new Pipe(hop_latency, *_eventlist);
-                    pipes_nup_nc[agg][core][b]->setName("Pipe-US" + ntoa(agg) + "->CS" + ntoa(core) + "(" + ntoa(b) + ")");
+                    pipes_nup_nc.set(agg, core, b, new Pipe(hop_latency, *_eventlist));
+                    pipes_nup_nc(agg, core, b)->setName("Pipe-US" + ntoa(agg) + "->CS" + ntoa(core) + "(" + ntoa(b) + ")");
                     //if (logfile) logfile->writeName(*(pipes_nup_nc[agg][core]));
         
                     // Uplink
@@ -917,19 +902,19 @@ void FatTreeTopology::init_network(){
                     }
         
                     if ((l+agg*_agg_switches_per_pod)<failed_links){
-                        queues_nc_nup[core][agg][b] = alloc_queue(queueLogger, _downlink_speeds[CORE_TIER]/10, _queue_down[CORE_TIER],
-                                                               DOWNLINK, CORE_TIER, false);
+                        queues_nc_nup.set(core, agg, b, alloc_queue(queueLogger, _downlink_speeds[CORE_TIER]/10, _queue_down[CORE_TIER],
+                                                               DOWNLINK, CORE_TIER, false));
                         cout << "Adding link failure for agg_sw " << ntoa(agg) << " l " << ntoa(l) << " b " << ntoa(b) << endl;
                     } else {
-                        queues_nc_nup[core][agg][b] = alloc_queue(queueLogger, _queue_down[CORE_TIER], DOWNLINK, CORE_TIER);
+                        queues_nc_nup.set(core, agg, b, alloc_queue(queueLogger, _queue_down[CORE_TIER], DOWNLINK, CORE_TIER));
                     }
         
-                    queues_nc_nup[core][agg][b]->setName("CS" + ntoa(core) + "->US" + ntoa(agg) + "(" + ntoa(b) + ")");
+                    queues_nc_nup(core, agg, b)->setName("CS" + ntoa(core) + "->US" + ntoa(agg) + "(" + ntoa(b) + ")");
 
-                    assert(switches_up[agg]->addPort(queues_nup_nc[agg][core][b]) < 64);
-                    assert(switches_c[core]->addPort(queues_nc_nup[core][agg][b]) < 64);
-                    queues_nup_nc[agg][core][b]->setRemoteEndpoint(switches_c[core]);
-                    queues_nc_nup[core][agg][b]->setRemoteEndpoint(switches_up[agg]);
+                    assert(switches_up[agg]->addPort(queues_nup_nc(agg, core, b)) < 64);
+                    assert(switches_c[core]->addPort(queues_nc_nup(core, agg, b)) < 64);
+                    queues_nup_nc(agg, core, b)->setRemoteEndpoint(switches_c[core]);
+                    queues_nc_nup(core, agg, b)->setRemoteEndpoint(switches_up[agg]);
 
                     /*if (_qt==LOSSLESS){
                       ((LosslessQueue*)queues_nup_nc[agg][core])->setRemoteEndpoint(queues_nc_nup[core][agg]);
@@ -937,18 +922,18 @@ void FatTreeTopology::init_network(){
                       }
                       else*/
                     if (_qt == LOSSLESS_INPUT || _qt == LOSSLESS_INPUT_ECN){
-                        new LosslessInputQueue(*_eventlist, queues_nup_nc[agg][core][b], switches_c[core], _hop_latency);
-                        new LosslessInputQueue(*_eventlist, queues_nc_nup[core][agg][b], switches_up[agg], _hop_latency);
+                        new LosslessInputQueue(*_eventlist, queues_nup_nc(agg, core, b), switches_c[core], _hop_latency);
+                        new LosslessInputQueue(*_eventlist, queues_nc_nup(core, agg, b), switches_up[agg], _hop_latency);
                     }
                     //if (logfile) logfile->writeName(*(queues_nc_nup[core][agg]));
             
-                    pipes_nc_nup[core][agg][b] = new Pipe(hop_latency, *_eventlist);
-                    pipes_nc_nup[core][agg][b]->setName("Pipe-CS" + ntoa(core) + "->US" + ntoa(agg) + "(" + ntoa(b) + ")");
+                    pipes_nc_nup.set(core, agg, b, new Pipe(hop_latency, *_eventlist));
+                    pipes_nc_nup(core, agg, b)->setName("Pipe-CS" + ntoa(core) + "->US" + ntoa(agg) + "(" + ntoa(b) + ")");
                     //if (logfile) logfile->writeName(*(pipes_nc_nup[core][agg]));
             
                     if (ff){
-                        ff->add_queue(queues_nup_nc[agg][core][b]);
-                        ff->add_queue(queues_nc_nup[core][agg][b]);
+                        ff->add_queue(queues_nup_nc(agg, core, b));
+                        ff->add_queue(queues_nc_nup(core, agg, b));
                     }
                 }
             }
@@ -986,21 +971,50 @@ void FatTreeTopology::add_failed_link(uint32_t type, uint32_t switch_id, uint32_
 
     // note: if bundlesize > 1, we only fail the first link in a bundle.
     
-    assert(queues_nup_nc[switch_id][k][0]!=NULL && queues_nc_nup[k][switch_id][0]!=NULL );
-    queues_nup_nc[switch_id][k][0] = NULL;
-    queues_nc_nup[k][switch_id][0] = NULL;
+    assert(queues_nup_nc(switch_id, k, 0)!=NULL && queues_nc_nup(k, switch_id, 0)!=NULL );
+    queues_nup_nc.set(switch_id, k, 0, NULL);
+    queues_nc_nup.set(k, switch_id, 0, NULL);
 
-    assert(pipes_nup_nc[switch_id][k][0]!=NULL && pipes_nc_nup[k][switch_id][0]);
-    pipes_nup_nc[switch_id][k][0] = NULL;
-    pipes_nc_nup[k][switch_id][0] = NULL;
+    assert(pipes_nup_nc(switch_id, k, 0)!=NULL && pipes_nc_nup(k, switch_id, 0));
+    pipes_nup_nc.set(switch_id, k, 0, NULL);
+    pipes_nc_nup.set(k, switch_id, 0, NULL);
 }
 
 
 vector<const Route*>* FatTreeTopology::get_bidir_paths(uint32_t src, uint32_t dest, bool reverse){
     vector<const Route*>* paths = new vector<const Route*>();
+    uint32_t count = get_path_count(src, dest);
+    paths->reserve(count);
+    for (uint32_t k = 0; k < count; k++)
+        paths->push_back(get_path(src, dest, k, reverse));
+
+    if (HOST_POD_SWITCH(src) != HOST_POD_SWITCH(dest))
+        cout << "pathcount " << paths->size() << endl;
+    return paths;
+}
+
+uint32_t FatTreeTopology::get_path_count(uint32_t src, uint32_t dest) {
+    if (HOST_POD_SWITCH(src)==HOST_POD_SWITCH(dest))
+        return 1;
+    uint32_t pod = HOST_POD(src);
+    uint32_t aggs = MAX_POD_AGG_SWITCH(pod) - MIN_POD_AGG_SWITCH(pod) + 1;
+    uint32_t count = aggs * _bundlesize[AGG_TIER] * _bundlesize[AGG_TIER];
+    if (HOST_POD(src)==HOST_POD(dest))
+        return count;
+    assert(_tiers == 3);
+    return count * (_radix_up[AGG_TIER]/_bundlesize[CORE_TIER]) * _bundlesize[CORE_TIER] * _bundlesize[CORE_TIER];
+}
+
+// Path k is numbered in the order get_bidir_paths has always listed
+// them: by agg switch, then core, then the link in each bundle on the
+// way up and down, with the last of these varying fastest.
+const Route* FatTreeTopology::get_path(uint32_t src, uint32_t dest, uint32_t k, bool reverse){
+    assert(k < get_path_count(src, dest));
+
+    // build the path in scratch routes, the store keeps its own copy
+    Route scratch_out, scratch_back;
+    route_t *routeout = &scratch_out, *routeback = &scratch_back;
 
-    route_t *routeout, *routeback;
-  
     //QueueLoggerSimple *simplequeuelogger = new QueueLoggerSimple();
     //QueueLoggerSimple *simplequeuelogger = 0;
     //logfile->addLogger(*simplequeuelogger);
@@ -1008,41 +1022,32 @@ vector<const Route*>* FatTreeTopology::get_bidir_paths(uint32_t src, uint32_t de
     //pqueue->setName("PQueue_" + ntoa(src) + "_" + ntoa(dest));
     //logfile->writeName(*pqueue);
     if (HOST_POD_SWITCH(src)==HOST_POD_SWITCH(dest)){
-  
+
         // forward path
-        routeout = new Route();
         //routeout->push_back(pqueue);
-        routeout->push_back(queues_ns_nlp[src][HOST_POD_SWITCH(src)][0]);
-        routeout->push_back(pipes_ns_nlp[src][HOST_POD_SWITCH(src)][0]);
+        routeout->push_back(queues_ns_nlp(src, HOST_POD_SWITCH(src), 0));
+        routeout->push_back(pipes_ns_nlp(src, HOST_POD_SWITCH(src), 0));
 
         if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
-            routeout->push_back(queues_ns_nlp[src][HOST_POD_SWITCH(src)][0]->getRemoteEndpoint());
+            routeout->push_back(queues_ns_nlp(src, HOST_POD_SWITCH(src), 0)->getRemoteEndpoint());
 
-        routeout->push_back(queues_nlp_ns[HOST_POD_SWITCH(dest)][dest][0]);
-        routeout->push_back(pipes_nlp_ns[HOST_POD_SWITCH(dest)][dest][0]);
+        routeout->push_back(queues_nlp_ns(HOST_POD_SWITCH(dest), dest, 0));
+        routeout->push_back(pipes_nlp_ns(HOST_POD_SWITCH(dest), dest, 0));
 
         if (reverse) {
             // reverse path for RTS packets
-            routeback = new Route();
-            routeback->push_back(queues_ns_nlp[dest][HOST_POD_SWITCH(dest)][0]);
-            routeback->push_back(pipes_ns_nlp[dest][HOST_POD_SWITCH(dest)][0]);
+            routeback->push_back(queues_ns_nlp(dest, HOST_POD_SWITCH(dest), 0));
+            routeback->push_back(pipes_ns_nlp(dest, HOST_POD_SWITCH(dest), 0));
 
             if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
-                routeback->push_back(queues_ns_nlp[dest][HOST_POD_SWITCH(dest)][0]->getRemoteEndpoint());
+                routeback->push_back(queues_ns_nlp(dest, HOST_POD_SWITCH(dest), 0)->getRemoteEndpoint());
 
-            routeback->push_back(queues_nlp_ns[HOST_POD_SWITCH(src)][src][0]);
-            routeback->push_back(pipes_nlp_ns[HOST_POD_SWITCH(src)][src][0]);
+            routeback->push_back(queues_nlp_ns(HOST_POD_SWITCH(src), src, 0));
+            routeback->push_back(pipes_nlp_ns(HOST_POD_SWITCH(src), src, 0));
 
             routeout->set_reverse(routeback);
             routeback->set_reverse(routeout);
         }
-
-        //print_route(*routeout);
-        paths->push_back(routeout);
-
-        check_non_null(routeout);
-        //cout << "pathcount " << paths->size() << endl;
-        return paths;
     }
     else if (HOST_POD(src)==HOST_POD(dest)){
         //don't go up the hierarchy, stay in the pod only.
@@ -1054,191 +1059,175 @@ vector<const Route*>* FatTreeTopology::get_bidir_paths(uint32_t src, uint32_t de
             assert(MIN_POD_AGG_SWITCH(pod) == 0);
             assert(MAX_POD_AGG_SWITCH(pod) == NAGG - 1);
         }
-        for (uint32_t upper = MIN_POD_AGG_SWITCH(pod);upper <= MAX_POD_AGG_SWITCH(pod); upper++){
-            for (uint32_t b_up = 0; b_up < _bundlesize[AGG_TIER]; b_up++) {
-                for (uint32_t b_down = 0; b_down < _bundlesize[AGG_TIER]; b_down++) {
-                    // b_up is link number in upgoing bundle, b_down is link number in downgoing bundle
-                    // note: no bundling supported between host and tor - just use link number 0
-                
-                    //upper is nup
-      
-                    routeout = new Route();
-      
-                    routeout->push_back(queues_ns_nlp[src][HOST_POD_SWITCH(src)][0]);
-                    routeout->push_back(pipes_ns_nlp[src][HOST_POD_SWITCH(src)][0]);
+        // b_up is link number in upgoing bundle, b_down is link number in downgoing bundle
+        // note: no bundling supported between host and tor - just use link number 0
+        uint32_t b_down = k % _bundlesize[AGG_TIER];
+        k /= _bundlesize[AGG_TIER];
+        uint32_t b_up = k % _bundlesize[AGG_TIER];
+        k /= _bundlesize[AGG_TIER];
+        uint32_t upper = MIN_POD_AGG_SWITCH(pod) + k;
 
-                    if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
-                        routeout->push_back(queues_ns_nlp[src][HOST_POD_SWITCH(src)][0]->getRemoteEndpoint());
+        //upper is nup
 
-                    routeout->push_back(queues_nlp_nup[HOST_POD_SWITCH(src)][upper][b_up]);
-                    routeout->push_back(pipes_nlp_nup[HOST_POD_SWITCH(src)][upper][b_up]);
+        routeout->push_back(queues_ns_nlp(src, HOST_POD_SWITCH(src), 0));
+        routeout->push_back(pipes_ns_nlp(src, HOST_POD_SWITCH(src), 0));
 
-                    if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
-                        routeout->push_back(queues_nlp_nup[HOST_POD_SWITCH(src)][upper][b_up]->getRemoteEndpoint());
+        if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
+            routeout->push_back(queues_ns_nlp(src, HOST_POD_SWITCH(src), 0)->getRemoteEndpoint());
 
-                    routeout->push_back(queues_nup_nlp[upper][HOST_POD_SWITCH(dest)][b_down]);
-                    routeout->push_back(pipes_nup_nlp[upper][HOST_POD_SWITCH(dest)][b_down]);
+        routeout->push_back(queues_nlp_nup(HOST_POD_SWITCH(src), upper, b_up));
+        routeout->push_back(pipes_nlp_nup(HOST_POD_SWITCH(src), upper, b_up));
 
-                    if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
-                        routeout->push_back(queues_nup_nlp[upper][HOST_POD_SWITCH(dest)][b_down]->getRemoteEndpoint());
+        if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
+            routeout->push_back(queues_nlp_nup(HOST_POD_SWITCH(src), upper, b_up)->getRemoteEndpoint());
 
-                    routeout->push_back(queues_nlp_ns[HOST_POD_SWITCH(dest)][dest][0]);
-                    routeout->push_back(pipes_nlp_ns[HOST_POD_SWITCH(dest)][dest][0]);
+        routeout->push_back(queues_nup_nlp(upper, HOST_POD_SWITCH(dest), b_down));
+        routeout->push_back(pipes_nup_nlp(upper, HOST_POD_SWITCH(dest), b_down));
 
-                    if (reverse) {
-                        // reverse path for RTS packets
-                        routeback = new Route();
-      
-                        routeback->push_back(queues_ns_nlp[dest][HOST_POD_SWITCH(dest)][0]);
-                        routeback->push_back(pipes_ns_nlp[dest][HOST_POD_SWITCH(dest)][0]);
+        if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
+            routeout->push_back(queues_nup_nlp(upper, HOST_POD_SWITCH(dest), b_down)->getRemoteEndpoint());
 
-                        if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
-                            routeback->push_back(queues_ns_nlp[dest][HOST_POD_SWITCH(dest)][0]->getRemoteEndpoint());
+        routeout->push_back(queues_nlp_ns(HOST_POD_SWITCH(dest), dest, 0));
+        routeout->push_back(pipes_nlp_ns(HOST_POD_SWITCH(dest), dest, 0));
 
-                        routeback->push_back(queues_nlp_nup[HOST_POD_SWITCH(dest)][upper][b_down]);
-                        routeback->push_back(pipes_nlp_nup[HOST_POD_SWITCH(dest)][upper][b_down]);
+        if (reverse) {
+            // reverse path for RTS packets
 
-                        if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
-                            routeback->push_back(queues_nlp_nup[HOST_POD_SWITCH(dest)][upper][b_down]->getRemoteEndpoint());
+            routeback->push_back(queues_ns_nlp(dest, HOST_POD_SWITCH(dest), 0));
+            routeback->push_back(pipes_ns_nlp(dest, HOST_POD_SWITCH(dest), 0));
 
-                        routeback->push_back(queues_nup_nlp[upper][HOST_POD_SWITCH(src)][b_up]);
-                        routeback->push_back(pipes_nup_nlp[upper][HOST_POD_SWITCH(src)][b_up]);
+            if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
+                routeback->push_back(queues_ns_nlp(dest, HOST_POD_SWITCH(dest), 0)->getRemoteEndpoint());
 
-                        if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
-                            routeback->push_back(queues_nup_nlp[upper][HOST_POD_SWITCH(src)][b_up]->getRemoteEndpoint());
-      
-                        routeback->push_back(queues_nlp_ns[HOST_POD_SWITCH(src)][src][0]);
-                        routeback->push_back(pipes_nlp_ns[HOST_POD_SWITCH(src)][src][0]);
+            routeback->push_back(queues_nlp_nup(HOST_POD_SWITCH(dest), upper, b_down));
+            routeback->push_back(pipes_nlp_nup(HOST_POD_SWITCH(dest), upper, b_down));
 
-                        routeout->set_reverse(routeback);
-                        routeback->set_reverse(routeout);
-                    }
-      
-                    //print_route(*routeout);
-                    paths->push_back(routeout);
-                    check_non_null(routeout);
-                }
-            }
+            if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
+                routeback->push_back(queues_nlp_nup(HOST_POD_SWITCH(dest), upper, b_down)->getRemoteEndpoint());
+
+            routeback->push_back(queues_nup_nlp(upper, HOST_POD_SWITCH(src), b_up));
+            routeback->push_back(pipes_nup_nlp(upper, HOST_POD_SWITCH(src), b_up));
+
+            if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
+                routeback->push_back(queues_nup_nlp(upper, HOST_POD_SWITCH(src), b_up)->getRemoteEndpoint());
+
+            routeback->push_back(queues_nlp_ns(HOST_POD_SWITCH(src), src, 0));
+            routeback->push_back(pipes_nlp_ns(HOST_POD_SWITCH(src), src, 0));
+
+            routeout->set_reverse(routeback);
+            routeback->set_reverse(routeout);
         }
-        cout << "pathcount " << paths->size() << endl;
-        return paths;
     } else {
         assert(_tiers == 3);
         uint32_t pod = HOST_POD(src);
 
-        for (uint32_t upper = MIN_POD_AGG_SWITCH(pod); upper <= MAX_POD_AGG_SWITCH(pod); upper++) {
-            uint32_t podpos = upper % _agg_switches_per_pod;
+        // b1_up is link number in upgoing bundle from tor to agg, b1_down is link number in downgoing bundle
+        // b2_up is link number in upgoing bundle from agg to core, b2_down is link number in downgoing bundle
+        // note: no bundling supported between host and tor - just use link number 0
+        uint32_t b2_down = k % _bundlesize[CORE_TIER];
+        k /= _bundlesize[CORE_TIER];
+        uint32_t b2_up = k % _bundlesize[CORE_TIER];
+        k /= _bundlesize[CORE_TIER];
+        uint32_t b1_down = k % _bundlesize[AGG_TIER];
+        k /= _bundlesize[AGG_TIER];
+        uint32_t b1_up = k % _bundlesize[AGG_TIER];
+        k /= _bundlesize[AGG_TIER];
+        uint32_t cores = _radix_up[AGG_TIER]/_bundlesize[CORE_TIER];
+        uint32_t l = k % cores;
+        k /= cores;
+        uint32_t upper = MIN_POD_AGG_SWITCH(pod) + k;
+        uint32_t podpos = upper % _agg_switches_per_pod;
+        uint32_t core = podpos +  _agg_switches_per_pod * l;
+
+        //upper is nup
 
-            for (uint32_t l = 0; l < _radix_up[AGG_TIER]/_bundlesize[CORE_TIER]; l++) {
-                uint32_t core = podpos +  _agg_switches_per_pod * l;
+        //routeout->push_back(pqueue);
 
-                for (uint32_t b1_up = 0; b1_up < _bundlesize[AGG_TIER]; b1_up++) {
-                    for (uint32_t b1_down = 0; b1_down < _bundlesize[AGG_TIER]; b1_down++) {
-                        // b1_up is link number in upgoing bundle from tor to agg, b1_down is link number in downgoing bundle
+        routeout->push_back(queues_ns_nlp(src, HOST_POD_SWITCH(src), 0));
+        routeout->push_back(pipes_ns_nlp(src, HOST_POD_SWITCH(src), 0));
 
-                        for (uint32_t b2_up = 0; b2_up < _bundlesize[CORE_TIER]; b2_up++) {
-                            for (uint32_t b2_down = 0; b2_down < _bundlesize[CORE_TIER]; b2_down++) {
-                                // b2_up is link number in upgoing bundle from agg to core, b2_down is link number in downgoing bundle
-                                // note: no bundling supported between host and tor - just use link number 0
-                                //upper is nup
-        
-                                routeout = new Route();
-                                //routeout->push_back(pqueue);
-        
-                                routeout->push_back(queues_ns_nlp[src][HOST_POD_SWITCH(src)][0]);
-                                routeout->push_back(pipes_ns_nlp[src][HOST_POD_SWITCH(src)][0]);
+        if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
+            routeout->push_back(queues_ns_nlp(src, HOST_POD_SWITCH(src), 0)->getRemoteEndpoint());
 
-                                if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
-                                    routeout->push_back(queues_ns_nlp[src][HOST_POD_SWITCH(src)][0]->getRemoteEndpoint());
-        
-                                routeout->push_back(queues_nlp_nup[HOST_POD_SWITCH(src)][upper][b1_up]);
-                                routeout->push_back(pipes_nlp_nup[HOST_POD_SWITCH(src)][upper][b1_up]);
+        routeout->push_back(queues_nlp_nup(HOST_POD_SWITCH(src), upper, b1_up));
+        routeout->push_back(pipes_nlp_nup(HOST_POD_SWITCH(src), upper, b1_up));
 
-                                if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
-                                    routeout->push_back(queues_nlp_nup[HOST_POD_SWITCH(src)][upper][b1_up]->getRemoteEndpoint());
-        
-                                routeout->push_back(queues_nup_nc[upper][core][b2_up]);
-                                routeout->push_back(pipes_nup_nc[upper][core][b2_up]);
+        if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
+            routeout->push_back(queues_nlp_nup(HOST_POD_SWITCH(src), upper, b1_up)->getRemoteEndpoint());
 
-                                if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
-                                    routeout->push_back(queues_nup_nc[upper][core][b2_up]->getRemoteEndpoint());
-        
-                                //now take the only link down to the destination server!
-        
-                                uint32_t upper2 = MIN_POD_AGG_SWITCH(HOST_POD(dest)) + core % _agg_switches_per_pod;
-                                //printf("K %d HOST_POD(%d) %d core %d upper2 %d\n",K,dest,HOST_POD(dest),core, upper2);
-        
-                                routeout->push_back(queues_nc_nup[core][upper2][b2_down]);
-                                routeout->push_back(pipes_nc_nup[core][upper2][b2_down]);
+        routeout->push_back(queues_nup_nc(upper, core, b2_up));
+        routeout->push_back(pipes_nup_nc(upper, core, b2_up));
 
-                                if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
-                                    routeout->push_back(queues_nc_nup[core][upper2][b2_down]->getRemoteEndpoint());        
+        if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
+            routeout->push_back(queues_nup_nc(upper, core, b2_up)->getRemoteEndpoint());
 
-                                routeout->push_back(queues_nup_nlp[upper2][HOST_POD_SWITCH(dest)][b1_down]);
-                                routeout->push_back(pipes_nup_nlp[upper2][HOST_POD_SWITCH(dest)][b1_down]);
+        //now take the only link down to the destination server!
 
-                                if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
-                                    routeout->push_back(queues_nup_nlp[upper2][HOST_POD_SWITCH(dest)][b1_down]->getRemoteEndpoint());
-        
-                                routeout->push_back(queues_nlp_ns[HOST_POD_SWITCH(dest)][dest][0]);
-                                routeout->push_back(pipes_nlp_ns[HOST_POD_SWITCH(dest)][dest][0]);
+        uint32_t upper2 = MIN_POD_AGG_SWITCH(HOST_POD(dest)) + core % _agg_switches_per_pod;
+        //printf("K %d HOST_POD(%d) %d core %d upper2 %d\n",K,dest,HOST_POD(dest),core, upper2);
 
-                                if (reverse) {
-                                    // reverse path for RTS packets
-                                    routeback = new Route();
-        
-                                    routeback->push_back(queues_ns_nlp[dest][HOST_POD_SWITCH(dest)][0]);
-                                    routeback->push_back(pipes_ns_nlp[dest][HOST_POD_SWITCH(dest)][0]);
+        routeout->push_back(queues_nc_nup(core, upper2, b2_down));
+        routeout->push_back(pipes_nc_nup(core, upper2, b2_down));
 
-                                    if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
-                                        routeback->push_back(queues_ns_nlp[dest][HOST_POD_SWITCH(dest)][0]->getRemoteEndpoint());
-        
-                                    routeback->push_back(queues_nlp_nup[HOST_POD_SWITCH(dest)][upper2][b1_down]);
-                                    routeback->push_back(pipes_nlp_nup[HOST_POD_SWITCH(dest)][upper2][b1_down]);
+        if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
+            routeout->push_back(queues_nc_nup(core, upper2, b2_down)->getRemoteEndpoint());
 
-                                    if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
-                                        routeback->push_back(queues_nlp_nup[HOST_POD_SWITCH(dest)][upper2][b1_down]->getRemoteEndpoint());
-        
-                                    routeback->push_back(queues_nup_nc[upper2][core][b2_down]);
-                                    routeback->push_back(pipes_nup_nc[upper2][core][b2_down]);
+        routeout->push_back(queues_nup_nlp(upper2, HOST_POD_SWITCH(dest), b1_down));
+        routeout->push_back(pipes_nup_nlp(upper2, HOST_POD_SWITCH(dest), b1_down));
 
-                                    if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
-                                        routeback->push_back(queues_nup_nc[upper2][core][b2_down]->getRemoteEndpoint());
-        
-                                    //now take the only link back down to the src server!
-        
-                                    routeback->push_back(queues_nc_nup[core][upper][b2_up]);
-                                    routeback->push_back(pipes_nc_nup[core][upper][b2_up]);
+        if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
+            routeout->push_back(queues_nup_nlp(upper2, HOST_POD_SWITCH(dest), b1_down)->getRemoteEndpoint());
 
-                                    if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
-                                        routeback->push_back(queues_nc_nup[core][upper][b2_up]->getRemoteEndpoint());
-        
-                                    routeback->push_back(queues_nup_nlp[upper][HOST_POD_SWITCH(src)][b1_up]);
-                                    routeback->push_back(pipes_nup_nlp[upper][HOST_POD_SWITCH(src)][b1_up]);
+        routeout->push_back(queues_nlp_ns(HOST_POD_SWITCH(dest), dest, 0));
+        routeout->push_back(pipes_nlp_ns(HOST_POD_SWITCH(dest), dest, 0));
 
-                                    if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
-                                        routeback->push_back(queues_nup_nlp[upper][HOST_POD_SWITCH(src)][b1_up]->getRemoteEndpoint());
-        
-                                    routeback->push_back(queues_nlp_ns[HOST_POD_SWITCH(src)][src][0]);
-                                    routeback->push_back(pipes_nlp_ns[HOST_POD_SWITCH(src)][src][0]);
+        if (reverse) {
+            // reverse path for RTS packets
 
+            routeback->push_back(queues_ns_nlp(dest, HOST_POD_SWITCH(dest), 0));
+            routeback->push_back(pipes_ns_nlp(dest, HOST_POD_SWITCH(dest), 0));
 
-                                    routeout->set_reverse(routeback);
-                                    routeback->set_reverse(routeout);
-                                }
-        
-                                //print_route(*routeout);
-                                paths->push_back(routeout);
-                                check_non_null(routeout);
-                            }
-                        }
-                    }
-                }
-            }
+            if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
+                routeback->push_back(queues_ns_nlp(dest, HOST_POD_SWITCH(dest), 0)->getRemoteEndpoint());
+
+            routeback->push_back(queues_nlp_nup(HOST_POD_SWITCH(dest), upper2, b1_down));
+            routeback->push_back(pipes_nlp_nup(HOST_POD_SWITCH(dest), upper2, b1_down));
+
+            if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
+                routeback->push_back(queues_nlp_nup(HOST_POD_SWITCH(dest), upper2, b1_down)->getRemoteEndpoint());
+
+            routeback->push_back(queues_nup_nc(upper2, core, b2_down));
+            routeback->push_back(pipes_nup_nc(upper2, core, b2_down));
+
+            if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
+                routeback->push_back(queues_nup_nc(upper2, core, b2_down)->getRemoteEndpoint());
+
+            //now take the only link back down to the src server!
+
+            routeback->push_back(queues_nc_nup(core, upper, b2_up));
+            routeback->push_back(pipes_nc_nup(core, upper, b2_up));
+
+            if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
+                routeback->push_back(queues_nc_nup(core, upper, b2_up)->getRemoteEndpoint());
+
+            routeback->push_back(queues_nup_nlp(upper, HOST_POD_SWITCH(src), b1_up));
+            routeback->push_back(pipes_nup_nlp(upper, HOST_POD_SWITCH(src), b1_up));
+
+            if (_qt==LOSSLESS_INPUT || _qt==LOSSLESS_INPUT_ECN)
+                routeback->push_back(queues_nup_nlp(upper, HOST_POD_SWITCH(src), b1_up)->getRemoteEndpoint());
+
+            routeback->push_back(queues_nlp_ns(HOST_POD_SWITCH(src), src, 0));
+            routeback->push_back(pipes_nlp_ns(HOST_POD_SWITCH(src), src, 0));
+
+
+            routeout->set_reverse(routeback);
+            routeback->set_reverse(routeout);
         }
-        cout << "pathcount " << paths->size() << endl;
-        return paths;
     }
+
+    //print_route(*routeout);
+    check_non_null(routeout);
+    return RouteStore::intern(*routeout);
 }
 
 void FatTreeTopology::count_queue(Queue* queue){
@@ -1249,68 +1238,54 @@ void FatTreeTopology::count_queue(Queue* queue){
     _link_usage[queue] = _link_usage[queue] + 1;
 }
 
+// returns the node queue links to in table, or -1 if it isn't there
+template<class T>
+static int64_t find_link_target(const LinkTable<T>& table, Queue* queue) {
+    for (uint32_t from = 0; from < table.size(); from++)
+        for (uint32_t i = 0; i < table.degree(from); i++)
+            for (uint32_t b = 0; b < table.bundlesize(); b++)
+                if (table.link(from, i, b) == queue)
+                    return table.neighbour(from, i);
+    return -1;
+}
+
 int64_t FatTreeTopology::find_lp_switch(Queue* queue){
     //first check ns_nlp
-    for (uint32_t srv=0;srv<NSRV;srv++)
-        for (uint32_t tor = 0; tor < NTOR; tor++)
-            if (queues_ns_nlp[srv][tor][0] == queue)
-                return tor;
+    int64_t tor = find_link_target(queues_ns_nlp, queue);
+    if (tor >= 0)
+        return tor;
 
     //only count nup to nlp
     count_queue(queue);
 
-    for (uint32_t agg = 0; agg < NAGG; agg++)
-        for (uint32_t tor = 0; tor < NTOR; tor++)
-            for (uint32_t b = 0; b < _bundlesize[AGG_TIER]; b++) {
-                if (queues_nup_nlp[agg][tor][b] == queue)
-                    return tor;
-            }
-
-    return -1;
+    return find_link_target(queues_nup_nlp, queue);
 }
 
 int64_t FatTreeTopology::find_up_switch(Queue* queue){
     count_queue(queue);
     //first check nc_nup
-    for (uint32_t core=0; core < NCORE; core++)
-        for (uint32_t agg = 0; agg < NAGG; agg++)
-            for (uint32_t b = 0; b < _bundlesize[CORE_TIER]; b++) {
-                if (queues_nc_nup[core][agg][b] == queue)
-                    return agg;
-            }
+    if (_tiers == 3) {
+        int64_t agg = find_link_target(queues_nc_nup, queue);
+        if (agg >= 0)
+            return agg;
+    }
 
     //check nlp_nup
-    for (uint32_t tor=0; tor < NTOR; tor++)
-        for (uint32_t agg = 0; agg < NAGG; agg++)
-            for (uint32_t b = 0; b < _bundlesize[AGG_TIER]; b++) {
-                if (queues_nlp_nup[tor][agg][b] == queue)
-                    return agg;
-            }
-
-    return -1;
+    return find_link_target(queues_nlp_nup, queue);
 }
 
 int64_t FatTreeTopology::find_core_switch(Queue* queue){
     count_queue(queue);
     //first check nup_nc
-    for (uint32_t agg=0;agg<NAGG;agg++)
-        for (uint32_t core = 0;core<NCORE;core++)
-            for (uint32_t b = 0; b < _bundlesize[CORE_TIER]; b++) {
-                if (queues_nup_nc[agg][core][b] == queue)
-                    return core;
-            }
+    if (_tiers == 3)
+        return find_link_target(queues_nup_nc, queue);
 
     return -1;
 }
 
 int64_t FatTreeTopology::find_destination(Queue* queue){
     //first check nlp_ns
-    for (uint32_t tor=0; tor<NTOR; tor++)
-        for (uint32_t srv = 0; srv<NSRV; srv++)
-            if (queues_nlp_ns[tor][srv][0]==queue)
-                return srv;
-
-    return -1;
+    return find_link_target(queues_nlp_ns, queue);
 }
 
 void FatTreeTopology::print_path(std::ofstream &paths,uint32_t src,const Route* route){
@@ -13,6 +13,7 @@
 #include "eventlist.h"
 #include "switch.h"
 #include <ostream>
+#include <algorithm>
 
 //#define N K*K*K/4
 
@@ -29,26 +30,91 @@ typedef enum {UPLINK, DOWNLINK} link_direction;
 #define AGG_TIER 1
 #define CORE_TIER 2
 
+// Links from each node in one tier to the nodes it connects to in the
+// next, looked up as (from, to, link number in bundle).  Fat trees are
+// sparse - a ToR connects to a few of the NSRV hosts, an agg switch to
+// the ToRs in its own pod - so rather than a dense from x to x bundle
+// array, each "from" node keeps a sorted list of the nodes it is
+// actually connected to and a bundle of links for each.  Memory and
+// build time scale with the number of links.
+template<class T>
+class LinkTable {
+public:
+    LinkTable() : _bundlesize(0), _links(0) {}
+
+    void init(uint32_t from_count, uint32_t bundlesize) {
+        _rows.assign(from_count, Row());
+        _bundlesize = bundlesize;
+        _links = 0;
+    }
+
+    // returns NULL if from is not connected to to
+    T operator()(uint32_t from, uint32_t to, uint32_t b) const {
+        assert(b < _bundlesize);
+        const Row& row = _rows.at(from);
+        vector<uint32_t>::const_iterator it = lower_bound(row.to.begin(), row.to.end(), to);
+        if (it == row.to.end() || *it != to)
+            return NULL;
+        return row.links[(it - row.to.begin()) * _bundlesize + b];
+    }
+
+    // connects from to to if they are not already
+    void set(uint32_t from, uint32_t to, uint32_t b, T link) {
+        assert(b < _bundlesize);
+        Row& row = _rows.at(from);
+        vector<uint32_t>::iterator it = lower_bound(row.to.begin(), row.to.end(), to);
+        size_t ix = it - row.to.begin();
+        if (it == row.to.end() || *it != to) {
+            row.to.insert(it, to);
+            row.links.insert(row.links.begin() + ix * _bundlesize, _bundlesize, (T)NULL);
+        }
+        T& slot = row.links[ix * _bundlesize + b];
+        if (slot == NULL && link != NULL)
+            _links++;
+        else if (slot != NULL && link == NULL)
+            _links--;
+        slot = link;
+    }
+
+    // iterate over the nodes connected to from
+    uint32_t degree(uint32_t from) const {return _rows.at(from).to.size();}
+    uint32_t neighbour(uint32_t from, uint32_t i) const {return _rows.at(from).to[i];}
+    T link(uint32_t from, uint32_t i, uint32_t b) const {return _rows.at(from).links[i * _bundlesize + b];}
+
+    uint32_t size() const {return _rows.size();}
+    uint32_t bundlesize() const {return _bundlesize;}
+    // number of non-NULL links
+    size_t links() const {return _links;}
+private:
+    struct Row {
+        vector<uint32_t> to;
+        vector<T> links;    // _bundlesize entries per element of to
+    };
+    vector<Row> _rows;
+    uint32_t _bundlesize;
+    size_t _links;
+};
+
 class FatTreeTopology: public Topology{
 public:
     vector <Switch*> switches_lp;
     vector <Switch*> switches_up;
     vector <Switch*> switches_c;
 
-    // 3rd index is link number in bundle
-    vector< vector< vector<Pipe*> > > pipes_nc_nup;
-    vector< vector< vector<Pipe*> > > pipes_nup_nlp;
-    vector< vector< vector<Pipe*> > > pipes_nlp_ns;
-    vector< vector< vector<BaseQueue*> > > queues_nc_nup;
-    vector< vector< vector<BaseQueue*> > > queues_nup_nlp;
-    vector< vector< vector<BaseQueue*> > > queues_nlp_ns;
-
-    vector< vector< vector<Pipe*> > > pipes_nup_nc;
-    vector< vector< vector<Pipe*> > > pipes_nlp_nup;
-    vector< vector< vector<Pipe*> > > pipes_ns_nlp;
-    vector< vector< vector<BaseQueue*> > > queues_nup_nc;
-    vector< vector< vector<BaseQueue*> > > queues_nlp_nup;
-    vector< vector< vector<BaseQueue*> > > queues_ns_nlp;
+    // indexed (from, to, link number in bundle)
+    LinkTable<Pipe*> pipes_nc_nup;
+    LinkTable<Pipe*> pipes_nup_nlp;
+    LinkTable<Pipe*> pipes_nlp_ns;
+    LinkTable<BaseQueue*> queues_nc_nup;
+    LinkTable<BaseQueue*> queues_nup_nlp;
+    LinkTable<BaseQueue*> queues_nlp_ns;
+
+    LinkTable<Pipe*> pipes_nup_nc;
+    LinkTable<Pipe*> pipes_nlp_nup;
+    LinkTable<Pipe*> pipes_ns_nlp;
+    LinkTable<BaseQueue*> queues_nup_nc;
+    LinkTable<BaseQueue*> queues_nlp_nup;
+    LinkTable<BaseQueue*> queues_ns_nlp;
   
     FirstFit* ff;
     QueueLoggerFactory* _logger_factory;
@@ -74,6 +140,8 @@ public:
 
     void init_network();
     virtual vector<const Route*>* get_bidir_paths(uint32_t src, uint32_t dest, bool reverse);
+    virtual uint32_t get_path_count(uint32_t src, uint32_t dest);
+    virtual const Route* get_path(uint32_t src, uint32_t dest, uint32_t k, bool reverse);
 
     BaseQueue* alloc_src_queue(QueueLogger* q);
     BaseQueue* alloc_queue(QueueLogger* q, mem_b queuesize, link_direction dir, int switch_tier, bool tor);
@@ -114,6 +182,11 @@ public:
     // add loggers to record total queue size at switches
     virtual void add_switch_loggers(Logfile& log, simtime_picosec sample_period); 
 
+    // change the ECN marking threshold of the switch queues that mark,
+    // mid-run.  Only for COMPOSITE_ECN_LB and AEOLUS_ECN; returns false
+    // for other queue types.
+    bool set_ecn_threshold(double fraction);
+
     uint32_t HOST_POD_SWITCH(uint32_t src){
         return src/_radix_down[TOR_TIER];
     }
@@ -167,6 +240,7 @@ public:
     
     //uint32_t getK() const {return K;}
     uint32_t getNAGG() const {return NAGG;}
+
 private:
     map<Queue*,int> _link_usage;
     static FatTreeTopology* load(istream& file, QueueLoggerFactory* logger_factory, EventList& eventlist,
@@ -182,13 +256,13 @@ private:
     void alloc_vectors();
     uint32_t NCORE, NAGG, NTOR, NSRV, NPOD;
     uint32_t _tor_switches_per_pod, _agg_switches_per_pod;
-    static uint32_t _tiers;
+    static thread_local uint32_t _tiers;
 
     // _link_latencies[0] is the ToR->host latency.
-    static simtime_picosec _link_latencies[3];
+    static thread_local simtime_picosec _link_latencies[3];
 
     // _switch_latencies[0] is the ToR switch latency.
-    static simtime_picosec _switch_latencies[3];
+    static thread_local simtime_picosec _switch_latencies[3];
 
     // How many uplinks to bundle from each node in a tier to the same
     // node in the tier below.  Eg bundlesize[2] = 2 means two
@@ -196,26 +270,26 @@ private:
     //
     // Note: we don't currently support bundling from the hosts to
     // ToRs because transport needs to know for that to work.
-    static uint32_t _bundlesize[3];
+    static thread_local uint32_t _bundlesize[3];
 
     // Linkspeed of each link in a switch tier to the tier below. ToRs are tier 0.
     // Eg. _downlink_speeds[0] = 400Gbps indicates 400Gbps links from hosts
     // to ToRs.
-    static linkspeed_bps _downlink_speeds[3];
+    static thread_local linkspeed_bps _downlink_speeds[3];
 
     // degree of oversubscription at tier.  Eg _oversub[TOR_TIER] = 3 implies 3x more bw to hosts than to agg switches.
-    static uint32_t _oversub[3];
+    static thread_local uint32_t _oversub[3];
 
     // switch radix used.  Eg _radix_down[0] = 32 indicates 32 downlinks from ToRs.  _radix_up[2] should be zero in a 3-tier topology.  
-    static uint32_t _radix_down[3];
-    static uint32_t _radix_up[2];
+    static thread_local uint32_t _radix_down[3];
+    static thread_local uint32_t _radix_up[2];
 
     // switch queue size used.  Eg _queue_down[0] = 32 indicates 32 downlinks from ToRs.  _queue_up[2] should be zero in a 3-tier topology.  
-    static mem_b _queue_down[3];
-    static mem_b _queue_up[2];
+    static thread_local mem_b _queue_down[3];
+    static thread_local mem_b _queue_up[2];
 
     // number of hosts in a pod.  
-    static uint32_t _hosts_per_pod; 
+    static thread_local uint32_t _hosts_per_pod; 
     
     uint32_t _no_of_nodes;
     simtime_picosec _hop_latency,_switch_latency;
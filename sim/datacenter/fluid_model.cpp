@@ -0,0 +1,299 @@
+// -*- c-basic-offset: 4; indent-tabs-mode: nil -*-
+#include <math.h>
+#include <queue>
+#include "fluid_model.h"
+#include "fat_tree_switch.h"
+#include "pipe.h"
+
+FluidModel::FluidModel(FatTreeTopology* top, EventList& eventlist)
+    : EventSource(eventlist, "fluid"), _top(top), _min_residual(0.05), _last_update(0),
+      _timer(*this), _fluid_flows(0), _finished(0)
+{
+}
+
+uint32_t
+FluidModel::addLink(BaseQueue* queue) {
+    unordered_map<BaseQueue*, uint32_t>::iterator i = _link_index.find(queue);
+    if (i != _link_index.end())
+        return i->second;
+    Link l;
+    l.queue = queue;
+    l.capacity = queue->bitrate();
+    l.fluid_rate = 0;
+    l.service_rate = l.capacity;
+    l.spare = 0;
+    l.unfrozen = 0;
+    l.version = 0;
+    _links.push_back(l);
+    _link_index[queue] = _links.size() - 1;
+    return _links.size() - 1;
+}
+
+void
+FluidModel::addFlow(const connection& c) {
+    // the connection matrix refuses fluid flows with triggers
+    assert(!c.trigger && !c.send_done_trigger && !c.recv_done_trigger);
+    Flow f;
+    f.src = c.src;
+    f.dst = c.dst;
+    f.id = c.flowid;
+    f.size = c.size;
+    f.start = c.start;
+    f.remaining = c.size;
+    f.rate = 0;
+    f.foreground = false;
+    f.done = false;
+    f.frozen = false;
+
+    // one path per flow, as ECMP would hash it
+    uint32_t k = freeBSDHash(c.src, c.dst, c.flowid) % _top->get_path_count(c.src, c.dst);
+    const Route* path = _top->get_path(c.src, c.dst, k, false);
+    // a link is a queue feeding a pipe; anything else on the path
+    // (lossless ingress queues, the sink) doesn't limit the rate
+    for (size_t i = 0; i + 1 < path->size(); i++) {
+        BaseQueue* q = dynamic_cast<BaseQueue*>(path->at(i));
+        if (q && dynamic_cast<Pipe*>(path->at(i + 1)))
+            f.links.push_back(addLink(q));
+    }
+    RouteStore::release(path);
+    _flows.push_back(f);
+    _fluid_flows++;
+    addArrival(_flows.size() - 1);
+}
+
+Trigger*
+FluidModel::addForeground(uint32_t src, uint32_t dst, simtime_picosec start,
+                          Trigger* start_trigger, Trigger* end_trigger) {
+    Flow f;
+    f.src = src;
+    f.dst = dst;
+    f.id = 0;
+    f.size = 0;
+    f.start = start;
+    f.remaining = 0;
+    f.rate = 0;
+    f.foreground = true;
+    f.done = false;
+    f.frozen = false;
+    f.links.push_back(addLink(_top->queues_ns_nlp(src, _top->HOST_POD_SWITCH(src), 0)));
+    f.links.push_back(addLink(_top->queues_nlp_ns(_top->HOST_POD_SWITCH(dst), dst, 0)));
+    _flows.push_back(f);
+    uint32_t index = _flows.size() - 1;
+    if (start == TRIGGER_START) {
+        assert(start_trigger);
+        start_trigger->add_target(*new FluidForegroundStart(*this, index));
+    } else {
+        addArrival(index);
+    }
+    return new FluidForegroundEnd(eventlist(), *this, index, end_trigger);
+}
+
+// a triggered packet flow has started
+void
+FluidModel::foregroundStart(uint32_t index) {
+    Flow& f = _flows[index];
+    assert(f.foreground && f.start == TRIGGER_START);
+    f.start = eventlist().now();
+    _arrivals.insert(make_pair(f.start, index));
+    _timer.set(f.start);
+}
+
+// the packet flow has finished: give its share of the host link and ToR
+// downlink back to the others
+void
+FluidModel::foregroundDone(uint32_t index) {
+    assert(_flows[index].foreground && !_flows[index].done);
+    _flows[index].done = true;
+    _timer.set(eventlist().now());
+}
+
+void
+FluidModel::addArrival(uint32_t index) {
+    simtime_picosec start = _flows[index].start;
+    multimap<simtime_picosec, uint32_t>::iterator i = _arrivals.insert(make_pair(start, index));
+    // flows are added before the run starts; only the first arrival
+    // needs the timer
+    if (i == _arrivals.begin())
+        _timer.set(start);
+}
+
+void
+FluidModel::doNextEvent() {
+    advance();
+    finish();
+    arrive();
+    allocate();
+    apply();
+    schedule();
+}
+
+// drain each fluid flow at its current rate up to now
+void
+FluidModel::advance() {
+    simtime_picosec now = eventlist().now();
+    double elapsed = timeAsSec(now - _last_update);
+    _last_update = now;
+    for (size_t i = 0; i < _active.size(); i++) {
+        Flow& f = _flows[_active[i]];
+        if (!f.foreground)
+            f.remaining -= f.rate * elapsed / 8;
+    }
+}
+
+void
+FluidModel::finish() {
+    simtime_picosec now = eventlist().now();
+    for (size_t i = 0; i < _active.size(); ) {
+        uint32_t fi = _active[i];
+        Flow& f = _flows[fi];
+        // schedule() rounds completions up, so what's left is rounding
+        if (f.foreground ? !f.done : f.remaining >= 1.0) {
+            i++;
+            continue;
+        }
+        if (!f.foreground) {
+            cout << "Fluid flow " << f.src << "->" << f.dst << " flowId " << f.id
+                 << " finished at " << timeAsUs(now) << " fct " << timeAsUs(now - f.start)
+                 << " total bytes " << f.size << endl;
+            _finished++;
+        }
+        for (size_t j = 0; j < f.links.size(); j++) {
+            vector<uint32_t>& flows = _links[f.links[j]].flows;
+            vector<uint32_t>::iterator k = find(flows.begin(), flows.end(), fi);
+            *k = flows.back();
+            flows.pop_back();
+        }
+        _active[i] = _active.back();
+        _active.pop_back();
+    }
+}
+
+void
+FluidModel::arrive() {
+    simtime_picosec now = eventlist().now();
+    while (!_arrivals.empty() && _arrivals.begin()->first <= now) {
+        uint32_t fi = _arrivals.begin()->second;
+        _arrivals.erase(_arrivals.begin());
+        Flow& f = _flows[fi];
+        if (f.done)
+            continue;
+        for (size_t j = 0; j < f.links.size(); j++)
+            _links[f.links[j]].flows.push_back(fi);
+        _active.push_back(fi);
+    }
+}
+
+// Max-min fairness by progressive filling: repeatedly take the link
+// offering the smallest equal share to the flows not yet fixed, and fix
+// those flows at that share.  A heap keyed on each link's share finds
+// it; entries made stale by a later change to the link are skipped.
+void
+FluidModel::allocate() {
+    struct Share {
+        double share;
+        uint32_t link;
+        uint32_t version;
+        bool operator>(const Share& s) const {return share > s.share;}
+    };
+    priority_queue<Share, vector<Share>, greater<Share> > heap;
+
+    for (size_t i = 0; i < _links.size(); i++) {
+        Link& l = _links[i];
+        l.spare = l.capacity;
+        l.unfrozen = l.flows.size();
+        l.version = 0;
+        if (l.unfrozen > 0) {
+            Share s = {l.spare / l.unfrozen, (uint32_t)i, 0};
+            heap.push(s);
+        }
+    }
+    for (size_t i = 0; i < _active.size(); i++)
+        _flows[_active[i]].frozen = false;
+
+    while (!heap.empty()) {
+        Share s = heap.top();
+        heap.pop();
+        Link& l = _links[s.link];
+        if (s.version != l.version || l.unfrozen == 0)
+            continue;
+        double share = max(l.spare / l.unfrozen, 0.0);
+        for (size_t i = 0; i < l.flows.size(); i++) {
+            Flow& f = _flows[l.flows[i]];
+            if (f.frozen)
+                continue;
+            f.frozen = true;
+            f.rate = share;
+            for (size_t j = 0; j < f.links.size(); j++) {
+                Link& m = _links[f.links[j]];
+                m.spare -= share;
+                m.unfrozen--;
+                if (f.links[j] != s.link && m.unfrozen > 0) {
+                    m.version++;
+                    Share next = {m.spare / m.unfrozen, f.links[j], m.version};
+                    heap.push(next);
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < _links.size(); i++) {
+        Link& l = _links[i];
+        l.fluid_rate = 0;
+        for (size_t j = 0; j < l.flows.size(); j++) {
+            const Flow& f = _flows[l.flows[j]];
+            if (!f.foreground)
+                l.fluid_rate += f.rate;
+        }
+    }
+}
+
+// packets get what the fluid flows leave of each link
+void
+FluidModel::apply() {
+    for (size_t i = 0; i < _links.size(); i++) {
+        Link& l = _links[i];
+        double rate = max(l.capacity - l.fluid_rate, l.capacity * _min_residual);
+        if (rate != l.service_rate) {
+            l.queue->setServiceRate((linkspeed_bps)rate);
+            l.service_rate = rate;
+        }
+    }
+}
+
+void
+FluidModel::schedule() {
+    simtime_picosec next = _arrivals.empty() ? 0 : _arrivals.begin()->first;
+    bool any = !_arrivals.empty();
+    simtime_picosec now = eventlist().now();
+    for (size_t i = 0; i < _active.size(); i++) {
+        const Flow& f = _flows[_active[i]];
+        if (f.foreground || f.rate <= 0)
+            continue;
+        simtime_picosec done = now + (simtime_picosec)ceil(f.remaining * 8 / f.rate * 1e12);
+        if (!any || done < next) {
+            next = done;
+            any = true;
+        }
+    }
+    if (any)
+        _timer.set(next);
+    else
+        _timer.cancel();
+}
+
+void
+FluidForegroundStart::activate() {
+    _model.foregroundStart(_flow);
+}
+
+FluidForegroundEnd::FluidForegroundEnd(EventList& eventlist, FluidModel& model, uint32_t flow, Trigger* next)
+    : Trigger(eventlist, 0), _model(model), _flow(flow), _next(next)
+{
+}
+
+void
+FluidForegroundEnd::activate() {
+    _model.foregroundDone(_flow);
+    if (_next)
+        _next->activate();
+}
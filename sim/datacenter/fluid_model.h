@@ -0,0 +1,121 @@
+// -*- c-basic-offset: 4; indent-tabs-mode: nil -*-
+#ifndef FLUID_MODEL_H
+#define FLUID_MODEL_H
+
+/*
+ * Hybrid fluid/packet simulation.
+ *
+ * Connections tagged "fluid" in the connection matrix are background
+ * load: rather than simulating their packets, each is a rate along one
+ * of its ECMP paths.  The rates are the max-min fair allocation of the
+ * links' capacities, recomputed whenever a fluid flow starts or
+ * finishes.  The packet-level queues on those links are then served
+ * at whatever capacity the fluid flows leave, so the foreground
+ * (packet) flows see the background load without its packets.
+ *
+ * Foreground flows may spray over every path, so they can't be placed
+ * on the fabric links.  But each of them crosses its source's host
+ * link and its destination's ToR downlink, and on those two links it
+ * takes part in the allocation as a flow of unlimited demand, from its
+ * start, or its start trigger, until its source's end trigger fires.
+ */
+
+#include <map>
+#include <unordered_map>
+#include "config.h"
+#include "eventlist.h"
+#include "queue.h"
+#include "connection_matrix.h"
+#include "fat_tree_topology.h"
+#include "trigger.h"
+
+class FluidModel;
+
+// A target of a triggered foreground flow's start trigger: brings the
+// flow into the allocation.
+class FluidForegroundStart : public TriggerTarget {
+ public:
+    FluidForegroundStart(FluidModel& model, uint32_t flow) : _model(model), _flow(flow) {}
+    virtual void activate();
+ private:
+    FluidModel& _model;
+    uint32_t _flow;
+};
+
+// The end trigger of a foreground flow's source: takes the flow out of
+// the allocation, then fires the connection's own end trigger, if any.
+class FluidForegroundEnd : public Trigger {
+ public:
+    FluidForegroundEnd(EventList& eventlist, FluidModel& model, uint32_t flow, Trigger* next);
+    virtual void activate();
+ private:
+    FluidModel& _model;
+    uint32_t _flow;
+    Trigger* _next;
+};
+
+class FluidModel : public EventSource {
+ public:
+    FluidModel(FatTreeTopology* top, EventList& eventlist);
+    // however loaded a link is, leave packets at least this fraction of it
+    void setMinResidual(double fraction) {_min_residual = fraction;}
+    void addFlow(const connection& c);
+    // returns the trigger the packet flow's source should activate when
+    // it finishes, in place of end_trigger, which may be NULL.  A flow
+    // with a TRIGGER_START start joins when start_trigger fires.
+    Trigger* addForeground(uint32_t src, uint32_t dst, simtime_picosec start,
+                           Trigger* start_trigger, Trigger* end_trigger);
+    void foregroundStart(uint32_t index);
+    void foregroundDone(uint32_t index);
+    virtual void doNextEvent();
+
+    uint32_t flows() const {return _fluid_flows;}
+    uint32_t finished() const {return _finished;}
+
+ private:
+    struct Link {
+        BaseQueue* queue;
+        double capacity;        // bits per second
+        double fluid_rate;      // taken by fluid flows
+        double service_rate;    // what the queue was last set to
+        vector<uint32_t> flows; // active flows crossing the link
+        // scratch for allocate()
+        double spare;
+        uint32_t unfrozen;
+        uint32_t version;
+    };
+    struct Flow {
+        uint32_t src, dst;
+        flowid_t id;
+        uint64_t size;
+        simtime_picosec start;
+        double remaining;       // bytes
+        double rate;            // bits per second
+        vector<uint32_t> links;
+        bool foreground;
+        bool done;              // a foreground flow that has finished
+        bool frozen;            // scratch for allocate()
+    };
+    uint32_t addLink(BaseQueue* queue);
+    void addArrival(uint32_t index);
+    void advance();
+    void finish();
+    void arrive();
+    void allocate();
+    void apply();
+    void schedule();
+
+    FatTreeTopology* _top;
+    double _min_residual;
+    vector<Flow> _flows;
+    vector<Link> _links;
+    unordered_map<BaseQueue*, uint32_t> _link_index;
+    multimap<simtime_picosec, uint32_t> _arrivals;
+    vector<uint32_t> _active;
+    simtime_picosec _last_update;
+    EventTimer _timer;
+    uint32_t _fluid_flows;
+    uint32_t _finished;
+};
+
+#endif
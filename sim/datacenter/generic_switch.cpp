@@ -0,0 +1,60 @@
+// -*- c-basic-offset: 4; indent-tabs-mode: nil -*-
+#include "generic_switch.h"
+#include "generic_topology.h"
+#include "fat_tree_switch.h"
+#include "routetable.h"
+
+GenericSwitch::GenericSwitch(EventList& eventlist, string s, uint32_t index, GenericTopology* top)
+    : Switch(eventlist, s) {
+    _index = index;
+    _top = top;
+    _hash_salt = random();
+    _fib = new RouteTable();
+}
+
+void GenericSwitch::setPortRoute(uint32_t port, Route* route) {
+    if (_port_entries.size() <= port)
+        _port_entries.resize(port + 1, NULL);
+    // the packet's direction has no meaning in an arbitrary graph
+    _port_entries[port] = new FibEntry(route, 1, NONE);
+}
+
+void GenericSwitch::setNextHops(uint32_t edge, const vector<uint32_t>& ports) {
+    if (_groups.size() <= edge)
+        _groups.resize(edge + 1);
+    _groups[edge].clear();
+    for (size_t i = 0; i < ports.size(); i++) {
+        assert(ports[i] < _port_entries.size() && _port_entries[ports[i]]);
+        _groups[edge].push_back(_port_entries[ports[i]]);
+    }
+}
+
+void GenericSwitch::addHostPort(int addr, int flowid, PacketSink* transport) {
+    Route* rt = new Route(_top->host_downlink(addr));
+    rt->push_back(transport);
+    _fib->addHostRoute(addr, rt, flowid);
+}
+
+void GenericSwitch::receivePacket(Packet& pkt) {
+    const Route* nh = getNextHop(pkt, NULL);
+    pkt.set_route(*nh);
+    pkt.sendOn();
+}
+
+Route* GenericSwitch::getNextHop(Packet& pkt, BaseQueue* ingress_port) {
+    GenericSwitch* edge_switch = _top->host_switch(pkt.dst());
+    if (edge_switch == this) {
+        //this host is directly connected!
+        HostFibEntry* fe = _fib->getHostRoute(pkt.dst(), pkt.flow_id());
+        assert(fe);
+        return fe->getEgressPort();
+    }
+    uint32_t edge = _top->host_edge(pkt.dst());
+    if (edge >= _groups.size() || _groups[edge].empty()) {
+        cerr << "Switch " << nodename() << " has no route to host " << pkt.dst() << endl;
+        abort();
+    }
+    const vector<FibEntry*>& group = _groups[edge];
+    uint32_t choice = group.size() == 1 ? 0 : freeBSDHash(pkt.flow_id(), pkt.pathid(), _hash_salt) % group.size();
+    return group[choice]->getEgressPort();
+}
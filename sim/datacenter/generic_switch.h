@@ -0,0 +1,43 @@
+// -*- c-basic-offset: 4; indent-tabs-mode: nil -*-
+#ifndef _GENERICSWITCH_H
+#define _GENERICSWITCH_H
+
+#include "switch.h"
+
+class GenericTopology;
+
+/*
+ * A switch in a GenericTopology that forwards on the packet's
+ * destination, for the ECMP_FIB family of route strategies.
+ *
+ * Each port's Route runs along the queues and pipes from the port to
+ * the next switch.  A destination host is reached through the switch
+ * its downlink hangs off (its edge switch), so the FIB holds one
+ * next-hop group per edge switch rather than one per host: the ports
+ * on a shortest path to it, as computed by
+ * GenericTopology::build_fib().  Packets are spread over a group by a
+ * hash of their flow and pathid.  Hosts on this switch are reached by
+ * host routes, as in FatTreeSwitch.
+ */
+class GenericSwitch : public Switch {
+public:
+    GenericSwitch(EventList& eventlist, string s, uint32_t index, GenericTopology* top);
+
+    virtual void receivePacket(Packet& pkt);
+    virtual Route* getNextHop(Packet& pkt, BaseQueue* ingress_port);
+    virtual void addHostPort(int addr, int flowid, PacketSink* transport);
+
+    uint32_t index() const {return _index;}
+    // the route from port to the next switch, built by the topology
+    void setPortRoute(uint32_t port, Route* route);
+    void setNextHops(uint32_t edge, const vector<uint32_t>& ports);
+
+private:
+    uint32_t _index;     // in the topology's switch list
+    GenericTopology* _top;
+    uint32_t _hash_salt;
+    vector<FibEntry*> _port_entries;
+    vector<vector<FibEntry*> > _groups; // by edge switch
+};
+
+#endif
@@ -1,17 +1,21 @@
 // -*- c-basic-offset: 4; indent-tabs-mode: nil -*-        
 #include "generic_topology.h"
+#include "generic_switch.h"
 #include "config.h"
 #include "compositequeue.h"
 #include <string>
 #include <algorithm>
 #include <stdlib.h>
 #include <fstream>
+#include <thread>
+#include <functional>
 
 // A topology that is loadable from a file
 
 GenericTopology::GenericTopology(Logfile* lg, EventList* ev){
   _logfile = lg;
   _eventlist = ev;
+  _file_hash = 0;
 }
 
 
@@ -20,6 +24,14 @@ bool GenericTopology::load(const char* filename){
     if (!f)
         return false;
 
+    // FNV-1a over the file, so a FIB cache can tell which topology it is for
+    _file_hash = 14695981039346656037ULL;
+    int c;
+    while ((c = getc(f)) != EOF) {
+        _file_hash = (_file_hash ^ (unsigned char)c) * 1099511628211ULL;
+    }
+    rewind(f);
+
     // we need to do two passes, one to build the ID tables, and one to fill in all the cross-references
     bool result = load(f, 0);
     if (!result) {
@@ -87,13 +99,8 @@ std::basic_string<T> lowercase(const std::basic_string<T>& s)
 }
 
 Host* GenericTopology::find_host(const string& id) {
-    // linear scan though vector is slow, but we only do this at startup so probably OK.  Otherwise add a map.
-    for (uint32_t i = 0; i < _hosts.size(); i++) {
-        if (_hosts[i]->nodename() == id) {
-            return _hosts[i];
-        }
-    }
-    return NULL;
+    unordered_map<string, Host*>::iterator i = _host_ids.find(id);
+    return i == _host_ids.end() ? NULL : i->second;
 }
 
 void GenericTopology::parse_host(std::vector<std::string>& tokens, int pass, std::fstream& gv) {
@@ -108,6 +115,7 @@ void GenericTopology::parse_host(std::vector<std::string>& tokens, int pass, std
         } else {
             host = new Host(id);
             _hosts.push_back(host);
+            _host_ids[id] = host;
             return;
         }
     } else {
@@ -130,31 +138,27 @@ void GenericTopology::parse_host(std::vector<std::string>& tokens, int pass, std
 }
 
 Switch* GenericTopology::find_switch(const string& id) {
-    // linear scan though vector is slow, but we only do this at startup so probably OK.  Otherwise add a map.
-    for (uint32_t i = 0; i < _switches.size(); i++) {
-        if (_switches[i]->nodename() == id) {
-            return _switches[i];
-        }
-    }
-    return NULL;
+    unordered_map<string, GenericSwitch*>::iterator i = _switch_ids.find(id);
+    return i == _switch_ids.end() ? NULL : i->second;
 }
 
 void GenericTopology::parse_switch(std::vector<std::string>& tokens, int pass, std::fstream& gv) {
     assert(tokens.size() >= 2);
     string id = tokens[1];
     assert(tokens[2] == ",");
-    Switch *sw = 0;
+    GenericSwitch *sw = 0;
     if (pass == 0) {
         if (find_switch(id)) {
             cerr << "Duplicate switch id " << id << " found - terminating" << endl;
             abort();
         } else {
-            sw = new Switch(*_eventlist, id);
+            sw = new GenericSwitch(*_eventlist, id, _switches.size(), this);
             _switches.push_back(sw);
+            _switch_ids[id] = sw;
             return;
         }
     } else {
-        sw = find_switch(id);
+        sw = _switch_ids[id];
     }
     vector<string> attribute;
     uint32_t ix = 3;
@@ -173,13 +177,8 @@ void GenericTopology::parse_switch(std::vector<std::string>& tokens, int pass, s
 }
 
 BaseQueue* GenericTopology::find_queue(const string& id) {
-    // linear scan though vector is slow, but we only do this at startup so probably OK.  Otherwise add a map.
-    for (uint32_t i = 0; i < _queues.size(); i++) {
-        if (_queues[i]->nodename() == id) {
-            return _queues[i];
-        }
-    }
-    return NULL;
+    unordered_map<string, BaseQueue*>::iterator i = _queue_ids.find(id);
+    return i == _queue_ids.end() ? NULL : i->second;
 }
 
 void GenericTopology::parse_queue(std::vector<std::string>& tokens, int pass, std::fstream& gv) {
@@ -271,6 +270,11 @@ void GenericTopology::parse_queue(std::vector<std::string>& tokens, int pass, st
             q = new CompositeQueue(linkspeed, queuesize, *_eventlist, queuelogger);
         } else if (queuetype == "fairscheduler") {
             q = new FairScheduler(linkspeed, *_eventlist, queuelogger);
+        } else if (queuetype == "prio") {
+            q = new PriorityQueue(linkspeed, queuesize, *_eventlist, queuelogger);
+        } else if (queuetype == "fair_prio") {
+            // host queues, for transports such as NDP that need one
+            q = new FairPriorityQueue(linkspeed, queuesize, *_eventlist, queuelogger);
         } else {
              cerr << "No valid type specified for Queue " << id << endl;
         }
@@ -278,17 +282,13 @@ void GenericTopology::parse_queue(std::vector<std::string>& tokens, int pass, st
         q->forceName(id);
         assert(id == q->nodename());
         _queues.push_back(q);
+        _queue_ids[id] = q;
     }
 }
 
 Pipe* GenericTopology::find_pipe(const string& id) {
-    // linear scan though vector is slow, but we only do this at startup so probably OK.  Otherwise add a map.
-    for (uint32_t i = 0; i < _pipes.size(); i++) {
-        if (_pipes[i]->nodename() == id) {
-            return _pipes[i];
-        }
-    }
-    return NULL;
+    unordered_map<string, Pipe*>::iterator i = _pipe_ids.find(id);
+    return i == _pipe_ids.end() ? NULL : i->second;
 }
 
 void GenericTopology::parse_pipe(std::vector<std::string>& tokens, int pass, std::fstream& gv) {
@@ -382,10 +382,12 @@ void GenericTopology::parse_pipe(std::vector<std::string>& tokens, int pass, std
         pipe->forceName(id);
         assert(id == pipe->nodename());
         _pipes.push_back(pipe);
+        _pipe_ids[id] = pipe;
         if (reverse_id != "") {
             pipe = new Pipe(latency, *_eventlist);
             pipe->forceName(reverse_id);
             _pipes.push_back(pipe);
+            _pipe_ids[reverse_id] = pipe;
         }
     } else {
         if (reverse_id != "") {
@@ -423,9 +425,11 @@ bool GenericTopology::load(FILE* f, int pass){
      
     
 
-    char line[256];
+    // a switch's ports all go on its one line, so lines can be long
+    char* line = NULL;
+    size_t line_size = 0;
     std::vector<std::string> tokens;
-    while(fgets(line, 255, f)) {
+    while(getline(&line, &line_size, f) != -1) {
         tokens.clear();
         char* s = skip_whitespace(line);
         if (*s == '#' || *s == '\n') {
@@ -448,6 +452,7 @@ bool GenericTopology::load(FILE* f, int pass){
         }
     }
     
+    free(line);
     fclose(f);
     gv << "}\n";
     gv.close();
@@ -466,3 +471,214 @@ vector<uint32_t>* GenericTopology::get_neighbours(uint32_t src){
 
 void GenericTopology::draw() {
 }
+
+// Walk the queues and pipes from start until they reach a switch or a
+// host, adding each to route.
+void GenericTopology::follow_link(PacketSink* start, Route& route, Switch*& sw, Host*& host) {
+    sw = NULL;
+    host = NULL;
+    PacketSink* hop = start;
+    while (hop) {
+        sw = dynamic_cast<Switch*>(hop);
+        host = dynamic_cast<Host*>(hop);
+        if (sw || host)
+            return;
+        route.push_back(hop);
+        if (BaseQueue* q = dynamic_cast<BaseQueue*>(hop)) {
+            hop = q->next();
+        } else if (Pipe* p = dynamic_cast<Pipe*>(hop)) {
+            hop = p->next();
+        } else {
+            hop = NULL;
+        }
+    }
+}
+
+// Find where every switch port leads, and the switch each host hangs off.
+bool GenericTopology::build_graph() {
+    uint32_t nswitches = _switches.size();
+    _port_peer.assign(nswitches, vector<int32_t>());
+    _in_links.assign(nswitches, vector<uint32_t>());
+    _host_switch.assign(_hosts.size(), NULL);
+    _host_edge.assign(_hosts.size(), UINT32_MAX);
+    _host_downlink.assign(_hosts.size(), NULL);
+    unordered_map<Host*, uint32_t> host_index;
+    for (uint32_t h = 0; h < _hosts.size(); h++) {
+        host_index[_hosts[h]] = h;
+    }
+
+    vector<int32_t> edge_of_switch(nswitches, -1);
+    _edges.clear();
+    for (uint32_t s = 0; s < nswitches; s++) {
+        GenericSwitch* sw = _switches[s];
+        for (uint32_t p = 0; p < sw->portCount(); p++) {
+            Route* route = new Route();
+            Switch* next_switch;
+            Host* next_host;
+            follow_link(sw->getPort(p), *route, next_switch, next_host);
+            int32_t peer = -1;
+            if (next_switch) {
+                peer = ((GenericSwitch*)next_switch)->index();
+                route->push_back(next_switch);
+                sw->setPortRoute(p, route);
+                _in_links[peer].push_back(s);
+            } else if (next_host) {
+                uint32_t h = host_index[next_host];
+                if (_host_switch[h] && _host_switch[h] != sw) {
+                    cerr << "Host " << next_host->nodename() << " is below more than one switch; FIB routing needs one" << endl;
+                    return false;
+                }
+                if (edge_of_switch[s] < 0) {
+                    edge_of_switch[s] = _edges.size();
+                    _edges.push_back(s);
+                }
+                _host_switch[h] = sw;
+                _host_edge[h] = edge_of_switch[s];
+                _host_downlink[h] = route;
+            } else {
+                delete route;
+            }
+            _port_peer[s].push_back(peer);
+        }
+    }
+    for (uint32_t h = 0; h < _hosts.size(); h++) {
+        if (!_host_switch[h]) {
+            cerr << "Host " << _hosts[h]->nodename() << " has no link from a switch" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// BFS back from edge switches first, first + step, ... filling in the
+// ports each switch has on a shortest path to them.
+void GenericTopology::compute_next_hops(uint32_t first, uint32_t step, vector<vector<vector<uint32_t> > >& next_hops) {
+    uint32_t nswitches = _switches.size();
+    vector<uint32_t> dist(nswitches);
+    vector<uint32_t> frontier;
+    frontier.reserve(nswitches);
+    for (uint32_t e = first; e < _edges.size(); e += step) {
+        fill(dist.begin(), dist.end(), UINT32_MAX);
+        frontier.clear();
+        dist[_edges[e]] = 0;
+        frontier.push_back(_edges[e]);
+        for (size_t i = 0; i < frontier.size(); i++) {
+            uint32_t v = frontier[i];
+            for (size_t j = 0; j < _in_links[v].size(); j++) {
+                uint32_t u = _in_links[v][j];
+                if (dist[u] == UINT32_MAX) {
+                    dist[u] = dist[v] + 1;
+                    frontier.push_back(u);
+                }
+            }
+        }
+        for (uint32_t s = 0; s < nswitches; s++) {
+            if (dist[s] == 0 || dist[s] == UINT32_MAX)
+                continue;
+            for (uint32_t p = 0; p < _port_peer[s].size(); p++) {
+                int32_t peer = _port_peer[s][p];
+                if (peer >= 0 && dist[peer] == dist[s] - 1)
+                    next_hops[e][s].push_back(p);
+            }
+        }
+    }
+}
+
+// The cache is text: a header naming the topology, then for each edge
+// switch, for each switch, a line with the count and the next hop ports.
+bool GenericTopology::read_fib_cache(const char* cache_file, vector<vector<vector<uint32_t> > >& next_hops) {
+    ifstream in(cache_file);
+    if (!in)
+        return false;
+    string magic;
+    uint64_t hash;
+    size_t nswitches, nedges;
+    in >> magic >> hex >> hash >> dec >> nswitches >> nedges;
+    if (!in || magic != "htsim_fib" || hash != _file_hash
+        || nswitches != _switches.size() || nedges != _edges.size()) {
+        cout << "FIB cache " << cache_file << " is for another topology, ignoring it" << endl;
+        return false;
+    }
+    for (size_t e = 0; e < nedges; e++) {
+        for (size_t s = 0; s < nswitches; s++) {
+            size_t count;
+            in >> count;
+            next_hops[e][s].resize(count);
+            for (size_t i = 0; i < count; i++) {
+                in >> next_hops[e][s][i];
+                if (in && next_hops[e][s][i] >= _port_peer[s].size())
+                    in.setstate(ios::failbit);
+            }
+        }
+    }
+    if (!in) {
+        cout << "FIB cache " << cache_file << " is truncated or corrupt, ignoring it" << endl;
+        for (size_t e = 0; e < nedges; e++)
+            for (size_t s = 0; s < nswitches; s++)
+                next_hops[e][s].clear();
+        return false;
+    }
+    return true;
+}
+
+void GenericTopology::write_fib_cache(const char* cache_file, const vector<vector<vector<uint32_t> > >& next_hops) {
+    ofstream out(cache_file);
+    out << "htsim_fib " << hex << _file_hash << dec << " " << _switches.size() << " " << _edges.size() << "\n";
+    for (size_t e = 0; e < next_hops.size(); e++) {
+        for (size_t s = 0; s < next_hops[e].size(); s++) {
+            out << next_hops[e][s].size();
+            for (size_t i = 0; i < next_hops[e][s].size(); i++)
+                out << " " << next_hops[e][s][i];
+            out << "\n";
+        }
+    }
+    if (!out)
+        cerr << "Failed to write FIB cache " << cache_file << endl;
+}
+
+bool GenericTopology::build_fib(uint32_t threads, const char* cache_file) {
+    if (!build_graph())
+        return false;
+    uint32_t nswitches = _switches.size();
+    vector<vector<vector<uint32_t> > > next_hops(_edges.size(), vector<vector<uint32_t> >(nswitches));
+
+    if (cache_file && read_fib_cache(cache_file, next_hops)) {
+        cout << "Loaded FIB from " << cache_file << endl;
+    } else {
+        // each thread takes every threads'th edge switch, and so its own rows
+        threads = max(1u, min(threads, (uint32_t)_edges.size()));
+        vector<thread> workers;
+        for (uint32_t t = 1; t < threads; t++) {
+            workers.push_back(thread(&GenericTopology::compute_next_hops, this, t, threads, ref(next_hops)));
+        }
+        compute_next_hops(0, threads, next_hops);
+        for (size_t t = 0; t < workers.size(); t++) {
+            workers[t].join();
+        }
+        cout << "Built FIB for " << nswitches << " switches and " << _edges.size()
+             << " edge switches on " << threads << " threads" << endl;
+        if (cache_file)
+            write_fib_cache(cache_file, next_hops);
+    }
+
+    for (uint32_t e = 0; e < _edges.size(); e++) {
+        for (uint32_t s = 0; s < nswitches; s++) {
+            if (!next_hops[e][s].empty())
+                _switches[s]->setNextHops(e, next_hops[e][s]);
+        }
+    }
+    return true;
+}
+
+Route* GenericTopology::host_uplink(uint32_t host) {
+    Route* route = new Route();
+    Switch* sw;
+    Host* next_host;
+    follow_link(_hosts[host]->queue(), *route, sw, next_host);
+    if (!sw) {
+        cerr << "Host " << _hosts[host]->nodename() << " has no link to a switch" << endl;
+        exit(1);
+    }
+    route->push_back(sw);
+    return route;
+}
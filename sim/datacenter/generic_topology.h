@@ -14,12 +14,16 @@
 #include "switch.h"
 #include <ostream>
 #include <fstream>
+#include <unordered_map>
+
+class GenericSwitch;
 
 
 class Host : public PacketSink, public Drawable {
 public:
     Host(string s) :_queue(0) { _nodename= s;}
     void setQueue(BaseQueue *q) {_queue=q;}
+    BaseQueue* queue() const {return _queue;}
     // inherited from PacketSink - we shouldn't normally be receiving
     // a packet on a host - the route already makes the switching
     // decision direct to the receiving protocol.  May revisit this later.
@@ -41,6 +45,19 @@ public:
     //void print_path(std::ofstream& paths, uint32_t src, const Route* route);
     vector<uint32_t>* get_neighbours(uint32_t src);
     uint32_t no_of_nodes() const {return _no_of_hosts;}
+
+    // Switch forwarding, for the ECMP_FIB route strategies.  build_fib
+    // finds every switch's shortest-path next hops to every edge switch
+    // (one with hosts below it), one BFS per edge switch spread over
+    // threads.  If cache_file is given, tables already computed for this
+    // topology file are read from it, otherwise written to it.
+    bool build_fib(uint32_t threads, const char* cache_file = NULL);
+    // from a host's queue to its switch, to start a flow's route
+    Route* host_uplink(uint32_t host);
+    GenericSwitch* host_switch(uint32_t host) const {return _host_switch[host];}
+    uint32_t host_edge(uint32_t host) const {return _host_edge[host];}
+    // from its switch to a host, less the host itself
+    const Route& host_downlink(uint32_t host) const {return *_host_downlink[host];}
 private:
     void parse_host(std::vector<std::string>& tokens, int pass, std::fstream& gv);
     void parse_switch(std::vector<std::string>& tokens, int pass, std::fstream& gv);
@@ -51,10 +68,28 @@ private:
     BaseQueue* find_queue(const string &id);
     Pipe* find_pipe(const string &id);
     bool load(FILE* f, int pass);
+    void follow_link(PacketSink* start, Route& route, Switch*& sw, Host*& host);
+    bool build_graph();
+    void compute_next_hops(uint32_t first, uint32_t step, vector<vector<vector<uint32_t> > >& next_hops);
+    bool read_fib_cache(const char* cache_file, vector<vector<vector<uint32_t> > >& next_hops);
+    void write_fib_cache(const char* cache_file, const vector<vector<vector<uint32_t> > >& next_hops);
     vector <Host*> _hosts;
-    vector <Switch*> _switches;
+    vector <GenericSwitch*> _switches;
     vector <Pipe*> _pipes;
     vector <BaseQueue*> _queues;
+    unordered_map<string, Host*> _host_ids;
+    unordered_map<string, GenericSwitch*> _switch_ids;
+    unordered_map<string, Pipe*> _pipe_ids;
+    unordered_map<string, BaseQueue*> _queue_ids;
+    uint64_t _file_hash; // identifies the topology in the FIB cache
+
+    // the switch graph, filled in by build_graph()
+    vector<vector<int32_t> > _port_peer;   // switch index each port leads to, or -1
+    vector<vector<uint32_t> > _in_links;  // switches with a port to each switch
+    vector<uint32_t> _edges;               // switch index of each edge switch
+    vector<GenericSwitch*> _host_switch;
+    vector<uint32_t> _host_edge;
+    vector<Route*> _host_downlink;
     uint32_t _no_of_hosts;
     uint32_t _no_of_links;
     uint32_t _no_of_switches;
@@ -18,8 +18,15 @@
 
 #include "fat_tree_topology.h"
 #include "fat_tree_switch.h"
+#include "dragon_fly_topology.h"
+#include "dragon_fly_switch.h"
+#include "generic_topology.h"
+#include "generic_switch.h"
+#include "sweep.h"
+#include "fluid_model.h"
 
 #include <list>
+#include <thread>
 
 // Simulation params
 
@@ -34,7 +41,7 @@ int DEFAULT_NODES = 128;
 EventList eventlist;
 
 void exit_error(char* progr) {
-    cout << "Usage " << progr << " [-nodes N]\n\t[-conns C]\n\t[-cwnd cwnd_size]\n\t[-q queue_size]\n\t[-oversubscribed_cc] Use receiver-driven AIMD to reduce total window when trims are not last hop\n\t[-queue_type composite|random|lossless|lossless_input|]\n\t[-tm traffic_matrix_file]\n\t[-strat route_strategy (single,rand,perm,pull,ecmp,\n\tecmp_host path_count,ecmp_ar,ecmp_rr,\n\tecmp_host_ar ar_thresh)]\n\t[-log log_level]\n\t[-seed random_seed]\n\t[-end end_time_in_usec]\n\t[-mtu MTU]\n\t[-hop_latency x] per hop wire latency in us,default 1\n\t[-switch_latency x] switching latency in us, default 0\n\t[-host_queue_type  swift|prio|fair_prio]\n\t[-logtime dt] sample time for sinklogger, etc" << endl;
+    cout << "Usage " << progr << " [-nodes N]\n\t[-conns C]\n\t[-cwnd cwnd_size]\n\t[-q queue_size]\n\t[-oversubscribed_cc] Use receiver-driven AIMD to reduce total window when trims are not last hop\n\t[-queue_type composite|random|lossless|lossless_input|]\n\t[-tm traffic_matrix_file]\n\t[-strat route_strategy (single,rand,perm,pull,ecmp,\n\tecmp_host path_count,ecmp_ar,ecmp_rr,\n\tecmp_host_ar ar_thresh)]\n\t[-log log_level]\n\t[-seed random_seed]\n\t[-end end_time_in_usec]\n\t[-scheduler heap|calendar]\n\t[-pktdb_stats] print packet memory use at the end\n\t[-sim_stats] print the number of events run and simulated time at the end\n\t[-sweep file] at the branch time, fork a run for each variant in file\n\t[-sweep_at t] branch time in us, default 0\n\t[-sweep_jobs N] run at most N variants at once, default 1\n\t[-dragonfly minimal|valiant|ugal_l|ugal_g] use a dragonfly routed by its switches instead of a fat tree\n\t[-generic_topo file] load a GenericTopology routed by its switches\n\t[-fib_threads N] threads to compute its FIB, default all cores\n\t[-fib_cache file] read its FIB from file if computed for this topology, else write it there\n\t[-fluid_min_residual f] fraction of a link fluid flows always leave to packets, default 0.05\n\t[-pktdb_prewarm] preallocate data packets for cwnd per connection\n\t[-hugepages] back packet slabs with huge pages\n\t[-mtu MTU]\n\t[-hop_latency x] per hop wire latency in us,default 1\n\t[-switch_latency x] switching latency in us, default 0\n\t[-host_queue_type  swift|prio|fair_prio]\n\t[-logtime dt] sample time for sinklogger, etc" << endl;
     exit(1);
 }
 
@@ -76,6 +83,18 @@ int main(int argc, char **argv) {
     //unsure how to set this. 
     queue_type snd_type = FAIR_PRIO;
 
+    bool pktdb_stats = false;
+    bool sim_stats = false;
+    char* sweep_file = NULL;
+    double sweep_at = 0;
+    uint32_t sweep_jobs = 1;
+    double fluid_min_residual = 0.05;
+    bool dragonfly = false;
+    char* generic_topo = NULL;
+    uint32_t fib_threads = thread::hardware_concurrency();
+    char* fib_cache = NULL;
+    bool pktdb_prewarm = false;
+
     float ar_sticky_delta = 10;
     FatTreeSwitch::sticky_choices ar_sticky = FatTreeSwitch::PER_PACKET;
 
@@ -99,6 +118,54 @@ int main(int argc, char **argv) {
             end_time = atoi(argv[i+1]);
             cout << "endtime(us) "<< end_time << endl;
             i++;            
+        } else if (!strcmp(argv[i],"-pktdb_stats")) {
+            pktdb_stats = true;
+        } else if (!strcmp(argv[i],"-sim_stats")) {
+            sim_stats = true;
+        } else if (!strcmp(argv[i],"-sweep")) {
+            sweep_file = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i],"-sweep_at")) {
+            sweep_at = atof(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i],"-sweep_jobs")) {
+            sweep_jobs = atoi(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i],"-dragonfly")) {
+            if (!DragonFlySwitch::set_strategy(argv[i+1])) {
+                cout << "Unknown dragonfly routing " << argv[i+1] << " expecting one of minimal, valiant, ugal_l, ugal_g" << endl;
+                exit(1);
+            }
+            dragonfly = true;
+            i++;
+        } else if (!strcmp(argv[i],"-generic_topo")) {
+            generic_topo = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i],"-fib_threads")) {
+            fib_threads = atoi(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i],"-fib_cache")) {
+            fib_cache = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i],"-fluid_min_residual")) {
+            fluid_min_residual = atof(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i],"-pktdb_prewarm")) {
+            pktdb_prewarm = true;
+        } else if (!strcmp(argv[i],"-hugepages")) {
+            PacketDBBase::setHugePages(true);
+            cout << "huge pages enabled" << endl;
+        } else if (!strcmp(argv[i],"-scheduler")) {
+            if (!strcmp(argv[i+1], "heap")) {
+                eventlist.setScheduler(EventList::HEAP);
+            } else if (!strcmp(argv[i+1], "calendar")) {
+                eventlist.setScheduler(EventList::CALENDAR);
+            } else {
+                cout << "Unknown scheduler " << argv[i+1] << " expecting one of heap|calendar" << endl;
+                exit_error(argv[0]);
+            }
+            cout << "scheduler " << argv[i+1] << endl;
+            i++;
         } else if (!strcmp(argv[i],"-nodes")) {
             no_of_nodes = atoi(argv[i+1]);
             cout << "no_of_nodes "<<no_of_nodes << endl;
@@ -239,35 +306,7 @@ int main(int argc, char **argv) {
             }   
             i++;
         } else if (!strcmp(argv[i],"-ar_method")){
-            if (!strcmp(argv[i+1],"pause")){
-                cout << "Adaptive routing based on pause state " << endl;
-                FatTreeSwitch::fn = &FatTreeSwitch::compare_pause;
-            }
-            else if (!strcmp(argv[i+1],"queue")){
-                cout << "Adaptive routing based on queue size " << endl;
-                FatTreeSwitch::fn = &FatTreeSwitch::compare_queuesize;
-            }
-            else if (!strcmp(argv[i+1],"bandwidth")){
-                cout << "Adaptive routing based on bandwidth utilization " << endl;
-                FatTreeSwitch::fn = &FatTreeSwitch::compare_bandwidth;
-            }
-            else if (!strcmp(argv[i+1],"pqb")){
-                cout << "Adaptive routing based on pause, queuesize and bandwidth utilization " << endl;
-                FatTreeSwitch::fn = &FatTreeSwitch::compare_pqb;
-            }
-            else if (!strcmp(argv[i+1],"pq")){
-                cout << "Adaptive routing based on pause, queuesize" << endl;
-                FatTreeSwitch::fn = &FatTreeSwitch::compare_pq;
-            }
-            else if (!strcmp(argv[i+1],"pb")){
-                cout << "Adaptive routing based on pause, bandwidth utilization" << endl;
-                FatTreeSwitch::fn = &FatTreeSwitch::compare_pb;
-            }
-            else if (!strcmp(argv[i+1],"qb")){
-                cout << "Adaptive routing based on queuesize, bandwidth utilization" << endl;
-                FatTreeSwitch::fn = &FatTreeSwitch::compare_qb; 
-            }
-            else {
+            if (!FatTreeSwitch::set_ar_method(argv[i+1])) {
                 cout << "Unknown AR method expecting one of pause, queue, bandwidth, pqb, pq, pb, qb" << endl;
                 exit(1);
             }
@@ -441,8 +480,35 @@ int main(int argc, char **argv) {
     no_of_nodes = conns->N;
 
 
-    FatTreeTopology* top;
-    if (topo_file) {
+    FatTreeTopology* top = NULL;
+    DragonFlyTopology* df_top = NULL;
+    GenericTopology* gen_top = NULL;
+    if (generic_topo) {
+        if (dragonfly || topo_file || log_switches || !conns->failures.empty()) {
+            cerr << "-generic_topo can't be combined with -dragonfly, -topo, switch logging or link failures" << endl;
+            exit(1);
+        }
+        gen_top = new GenericTopology(&logfile, &eventlist);
+        if (!gen_top->load(generic_topo)) {
+            cerr << "Failed to load topology " << generic_topo << endl;
+            exit(1);
+        }
+        if (gen_top->no_of_nodes() != no_of_nodes) {
+            cerr << "Mismatch between connection matrix (" << no_of_nodes << " nodes) and topology ("
+                 << gen_top->no_of_nodes() << " nodes)" << endl;
+            exit(1);
+        }
+        if (!gen_top->build_fib(fib_threads, fib_cache)) {
+            exit(1);
+        }
+    } else if (dragonfly) {
+        if (topo_file || log_switches || !conns->failures.empty()) {
+            cerr << "-dragonfly can't be combined with -topo, switch logging or link failures" << endl;
+            exit(1);
+        }
+        df_top = new DragonFlyTopology(no_of_nodes, queuesize, &logfile, &eventlist, qt, hop_latency,
+                                       linkspeed, switch_latency);
+    } else if (topo_file) {
         top = FatTreeTopology::load(topo_file, qlf, eventlist, queuesize, qt, snd_type);
         if (top->no_of_nodes() != no_of_nodes) {
             cerr << "Mismatch between connection matrix (" << no_of_nodes << " nodes) and topology ("
@@ -457,7 +523,7 @@ int main(int argc, char **argv) {
                                   snd_type);
     }
 
-    if (log_switches) {
+    if (log_switches && top) {
         top->add_switch_loggers(logfile, timeFromUs(20.0));
     }
     
@@ -481,14 +547,36 @@ int main(int argc, char **argv) {
     list <const Route*> routes;
 
     vector<connection*>* all_conns = conns->getAllConnections();
+    if (pktdb_prewarm) {
+        // a full window in flight for every connection at once is the worst case
+        EqdsDataPacket::reserve((size_t)all_conns->size() * cwnd);
+    }
     vector <EqdsSrc*> eqds_srcs;
 
     map <flowid_t, TriggerTarget*> flowmap;
 
+    // connections tagged fluid are background load that doesn't need packets
+    FluidModel* fluid = NULL;
+    for (size_t c = 0; c < all_conns->size() && !fluid; c++) {
+        if (all_conns->at(c)->fluid) {
+            if (!top) {
+                cerr << "Fluid flows need a fat tree" << endl;
+                exit(1);
+            }
+            fluid = new FluidModel(top, eventlist);
+            fluid->setMinResidual(fluid_min_residual);
+        }
+    }
+
     for (size_t c = 0; c < all_conns->size(); c++){
         connection* crt = all_conns->at(c);
         int src = crt->src;
         int dest = crt->dst;
+
+        if (crt->fluid) {
+            fluid->addFlow(*crt);
+            continue;
+        }
         //cout << "Connection " << crt->src << "->" <<crt->dst << " starting at " << crt->start << " size " << crt->size << endl;
 
         eqds_src = new EqdsSrc(traffic_logger, eventlist, *nics.at(src));
@@ -519,13 +607,21 @@ int main(int argc, char **argv) {
             eqds_src->setFlowsize(crt->size);
         }
 
+        Trigger* start_trigger = NULL;
         if (crt->trigger) {
-            Trigger* trig = conns->getTrigger(crt->trigger, eventlist);
-            trig->add_target(*eqds_src);
+            start_trigger = conns->getTrigger(crt->trigger, eventlist);
+            start_trigger->add_target(*eqds_src);
         }
+        Trigger* end_trigger = NULL;
         if (crt->send_done_trigger) {
-            Trigger* trig = conns->getTrigger(crt->send_done_trigger, eventlist);
-            eqds_src->setEndTrigger(*trig);
+            end_trigger = conns->getTrigger(crt->send_done_trigger, eventlist);
+        }
+        if (fluid) {
+            // a foreground flow leaves the fluid allocation when it finishes
+            end_trigger = fluid->addForeground(src, dest, crt->start, start_trigger, end_trigger);
+        }
+        if (end_trigger) {
+            eqds_src->setEndTrigger(*end_trigger);
         }
 
 
@@ -542,16 +638,36 @@ int main(int argc, char **argv) {
         case ECMP_FIB:
         case ECMP_FIB_ECN:
         case REACTIVE_ECN:
-            {
+            if (df_top) {
                 Route* srctotor = new Route();
-                srctotor->push_back(top->queues_ns_nlp[src][top->HOST_POD_SWITCH(src)][0]);
-                srctotor->push_back(top->pipes_ns_nlp[src][top->HOST_POD_SWITCH(src)][0]);
-                srctotor->push_back(top->queues_ns_nlp[src][top->HOST_POD_SWITCH(src)][0]->getRemoteEndpoint());
+                srctotor->push_back(df_top->queues_host_switch[src]);
+                srctotor->push_back(df_top->pipes_host_switch[src]);
+                srctotor->push_back(df_top->queues_host_switch[src]->getRemoteEndpoint());
 
                 Route* dsttotor = new Route();
-                dsttotor->push_back(top->queues_ns_nlp[dest][top->HOST_POD_SWITCH(dest)][0]);
-                dsttotor->push_back(top->pipes_ns_nlp[dest][top->HOST_POD_SWITCH(dest)][0]);
-                dsttotor->push_back(top->queues_ns_nlp[dest][top->HOST_POD_SWITCH(dest)][0]->getRemoteEndpoint());
+                dsttotor->push_back(df_top->queues_host_switch[dest]);
+                dsttotor->push_back(df_top->pipes_host_switch[dest]);
+                dsttotor->push_back(df_top->queues_host_switch[dest]->getRemoteEndpoint());
+
+                eqds_src->connect(*srctotor, *dsttotor, *eqds_snk, crt->start);
+
+                df_top->switches[df_top->HOST_SWITCH(src)]->addHostPort(src,eqds_snk->flowId(),eqds_src);
+                df_top->switches[df_top->HOST_SWITCH(dest)]->addHostPort(dest,eqds_src->flowId(),eqds_snk);
+            } else if (gen_top) {
+                eqds_src->connect(*gen_top->host_uplink(src), *gen_top->host_uplink(dest), *eqds_snk, crt->start);
+
+                gen_top->host_switch(src)->addHostPort(src,eqds_snk->flowId(),eqds_src);
+                gen_top->host_switch(dest)->addHostPort(dest,eqds_src->flowId(),eqds_snk);
+            } else {
+                Route* srctotor = new Route();
+                srctotor->push_back(top->queues_ns_nlp(src, top->HOST_POD_SWITCH(src), 0));
+                srctotor->push_back(top->pipes_ns_nlp(src, top->HOST_POD_SWITCH(src), 0));
+                srctotor->push_back(top->queues_ns_nlp(src, top->HOST_POD_SWITCH(src), 0)->getRemoteEndpoint());
+
+                Route* dsttotor = new Route();
+                dsttotor->push_back(top->queues_ns_nlp(dest, top->HOST_POD_SWITCH(dest), 0));
+                dsttotor->push_back(top->pipes_ns_nlp(dest, top->HOST_POD_SWITCH(dest), 0));
+                dsttotor->push_back(top->queues_ns_nlp(dest, top->HOST_POD_SWITCH(dest), 0)->getRemoteEndpoint());
 
 
                 eqds_src->connect(*srctotor, *dsttotor, *eqds_snk, crt->start);
@@ -563,8 +679,8 @@ int main(int argc, char **argv) {
                 assert(top->switches_lp[top->HOST_POD_SWITCH(src)]);
                 top->switches_lp[top->HOST_POD_SWITCH(src)]->addHostPort(src,eqds_snk->flowId(),eqds_src);
                 top->switches_lp[top->HOST_POD_SWITCH(dest)]->addHostPort(dest,eqds_src->flowId(),eqds_snk);
-                break;
             }
+            break;
         default:
             abort();
         }
@@ -585,12 +701,46 @@ int main(int argc, char **argv) {
     //logfile.write("# corelinkrate = " + ntoa(HOST_NIC*CORE_TO_HOST) + " pkt/sec");
     //logfile.write("# buffer = " + ntoa((double) (queues_na_ni[0][1]->_maxsize) / ((double) pktsize)) + " pkt");
     
+    if (sweep_file) {
+        // the overrides a sweep variant can apply at the branch time
+        Sweep* sweep = new Sweep(sweep_file, eventlist, logfile);
+        sweep->addHook("ecn_thresh", [top](const string& value) {
+            if (!top || !top->set_ecn_threshold(atof(value.c_str()))) {
+                cout << "ecn_thresh needs an ECN load balancing strategy or queue type aeolus_ecn" << endl;
+                exit(1);
+            }
+        });
+        sweep->addHook("ar_method", [](const string& value) {
+            if (!FatTreeSwitch::set_ar_method(value)) {
+                cout << "Unknown AR method expecting one of pause, queue, bandwidth, pqb, pq, pb, qb" << endl;
+                exit(1);
+            }
+        });
+        sweep->addHook("ar_sticky_delta", [](const string& value) {
+            FatTreeSwitch::_sticky_delta = timeFromUs(atof(value.c_str()));
+        });
+        sweep->start(timeFromUs(sweep_at), sweep_jobs);
+    }
+
     // GO!
     cout << "Starting simulation" << endl;
     while (eventlist.doNextEvent()) {
     }
 
     cout << "Done" << endl;
+    if (df_top) {
+        cout << "DragonFly routing: minimal " << DragonFlySwitch::_minimal_routed
+             << " valiant " << DragonFlySwitch::_valiant_routed << endl;
+    }
+    if (fluid) {
+        cout << "Fluid flows: " << fluid->flows() << " finished: " << fluid->finished() << endl;
+    }
+    if (pktdb_stats) {
+        PacketDBBase::printStats(cout);
+    }
+    if (sim_stats) {
+        cout << "sim_stats events=" << eventlist.eventCount() << " simtime_ps=" << eventlist.now() << endl;
+    }
     int new_pkts = 0, rtx_pkts = 0, bounce_pkts = 0, rts_pkts = 0;
     for (size_t ix = 0; ix < eqds_srcs.size(); ix++) {
         new_pkts += eqds_srcs[ix]->_new_packets_sent;
@@ -43,7 +43,7 @@ int DEFAULT_NODES = 432;
 EventList eventlist;
 
 void exit_error(char* progr) {
-    cout << "Usage " << progr << " [-nodes N]\n\t[-conns C]\n\t[-q queue_size]\n\t[-queue_type composite|random|lossless|lossless_input|]\n\t[-tm traffic_matrix_file]\n\t[-strat route_strategy (single,\n\tecmp_host,ecmp_ar,\n\tecmp_host_ar ar_thresh)]\n\t[-log log_level]\n\t[-seed random_seed]\n\t[-end end_time_in_usec]\n\t[-mtu MTU]\n\t[-hop_latency x] per hop wire latency in us,default 1\n\t[-switch_latency x] switching latency in us, default 0\n\t[-start_delta] time in us to randomly delay the start of connections\n\t[-pfc_thresholds low high]" << endl;
+    cout << "Usage " << progr << " [-nodes N]\n\t[-conns C]\n\t[-q queue_size]\n\t[-queue_type composite|random|lossless|lossless_input|]\n\t[-tm traffic_matrix_file]\n\t[-strat route_strategy (single,\n\tecmp_host,ecmp_ar,\n\tecmp_host_ar ar_thresh)]\n\t[-log log_level]\n\t[-seed random_seed]\n\t[-end end_time_in_usec]\n\t[-scheduler heap|calendar]\n\t[-mtu MTU]\n\t[-hop_latency x] per hop wire latency in us,default 1\n\t[-switch_latency x] switching latency in us, default 0\n\t[-start_delta] time in us to randomly delay the start of connections\n\t[-pfc_thresholds low high]\n\t[-pfc_classes N] PFC priority classes, default 1" << endl;
     exit(1);
 }
 
@@ -93,6 +93,17 @@ int main(int argc, char **argv) {
             end_time = atoi(argv[i+1]);
             cout << "endtime(us) "<< end_time << endl;
             i++;            
+        } else if (!strcmp(argv[i],"-scheduler")) {
+            if (!strcmp(argv[i+1], "heap")) {
+                eventlist.setScheduler(EventList::HEAP);
+            } else if (!strcmp(argv[i+1], "calendar")) {
+                eventlist.setScheduler(EventList::CALENDAR);
+            } else {
+                cout << "Unknown scheduler " << argv[i+1] << " expecting one of heap|calendar" << endl;
+                exit_error(argv[0]);
+            }
+            cout << "scheduler " << argv[i+1] << endl;
+            i++;
         } else if (!strcmp(argv[i],"-nodes")) {
             no_of_nodes = atoi(argv[i+1]);
             cout << "no_of_nodes "<<no_of_nodes << endl;
@@ -205,6 +216,15 @@ int main(int argc, char **argv) {
             high_pfc = atoi(argv[i+2]);
             cout << "PFC thresholds high " << high_pfc << " low " << low_pfc << endl;
             i+=2;
+        } else if (!strcmp(argv[i],"-pfc_classes")){
+            // packet priorities map onto the classes, see EthPausePacket::pfc_class()
+            EthPausePacket::_classes = atoi(argv[i+1]);
+            if (EthPausePacket::_classes < 1 || EthPausePacket::_classes > PFC_CLASSES) {
+                cout << "PFC classes must be between 1 and " << PFC_CLASSES << endl;
+                exit(1);
+            }
+            cout << "PFC classes " << EthPausePacket::_classes << endl;
+            i++;
         } else if (!strcmp(argv[i],"-ar_method")){
             if (!strcmp(argv[i+1],"pause")){
                 cout << "Adaptive routing based on pause state " << endl;
@@ -416,26 +436,12 @@ int main(int argc, char **argv) {
     all_conns = conns->getAllConnections();
     vector <HPCCSrc*> hpcc_srcs;
 
+    // count the connections that need each path list, so that its routes
+    // can be released once the last of them has been set up
     for (size_t c = 0; c < all_conns->size(); c++){
         connection* crt = all_conns->at(c);
-        int src = crt->src;
-        int dest = crt->dst;
-        path_refcounts[src][dest]++;
-        path_refcounts[dest][src]++;
-                        
-        if (!net_paths[src][dest]&&route_strategy!=ECMP_FIB) {
-            vector<const Route*>* paths = top->get_bidir_paths(src,dest,false);
-            net_paths[src][dest] = paths;
-            /*
-              for (unsigned int i = 0; i < paths->size(); i++) {
-              routes.push_back((*paths)[i]);
-              }
-            */
-        }
-        if (!net_paths[dest][src]&&route_strategy!=ECMP_FIB) {
-            vector<const Route*>* paths = top->get_bidir_paths(dest,src,false);
-            net_paths[dest][src] = paths;
-        }
+        path_refcounts[crt->src][crt->dst]++;
+        path_refcounts[crt->dst][crt->src]++;
     }
 
     map <flowid_t, TriggerTarget*> flowmap;
@@ -444,6 +450,15 @@ int main(int argc, char **argv) {
         connection* crt = all_conns->at(c);
         int src = crt->src;
         int dest = crt->dst;
+
+        // build the paths when the first connection that needs them is set up
+        if (route_strategy!=ECMP_FIB) {
+            if (!net_paths[src][dest])
+                net_paths[src][dest] = top->get_bidir_paths(src,dest,false);
+            if (!net_paths[dest][src])
+                net_paths[dest][src] = top->get_bidir_paths(dest,src,false);
+        }
+
         //cout << "Connection " << crt->src << "->" <<crt->dst << " starting at " << crt->start << " size " << crt->size << endl;
 
         hpccSrc = new HPCCSrc(NULL, NULL, eventlist,linkspeed);
@@ -481,21 +496,21 @@ int main(int argc, char **argv) {
         hpccSnk->setName("HPCC_sink_" + ntoa(src) + "_" + ntoa(dest));
         logfile.writeName(*hpccSnk);
                         
-        ((HostQueue*)top->queues_ns_nlp[src][top->HOST_POD_SWITCH(src)][0])->addHostSender(hpccSrc);
+        ((HostQueue*)top->queues_ns_nlp(src, top->HOST_POD_SWITCH(src), 0))->addHostSender(hpccSrc);
 
         if (route_strategy!=SINGLE_PATH && route_strategy!=ECMP_FIB){
             abort();
         } else if (route_strategy==ECMP_FIB) {
             Route* srctotor = new Route();
             
-            srctotor->push_back(top->queues_ns_nlp[src][top->HOST_POD_SWITCH(src)][0]);
-            srctotor->push_back(top->pipes_ns_nlp[src][top->HOST_POD_SWITCH(src)][0]);
-            srctotor->push_back(top->queues_ns_nlp[src][top->HOST_POD_SWITCH(src)][0]->getRemoteEndpoint());
+            srctotor->push_back(top->queues_ns_nlp(src, top->HOST_POD_SWITCH(src), 0));
+            srctotor->push_back(top->pipes_ns_nlp(src, top->HOST_POD_SWITCH(src), 0));
+            srctotor->push_back(top->queues_ns_nlp(src, top->HOST_POD_SWITCH(src), 0)->getRemoteEndpoint());
 
             Route* dsttotor = new Route();
-            dsttotor->push_back(top->queues_ns_nlp[dest][top->HOST_POD_SWITCH(dest)][0]);
-            dsttotor->push_back(top->pipes_ns_nlp[dest][top->HOST_POD_SWITCH(dest)][0]);
-            dsttotor->push_back(top->queues_ns_nlp[dest][top->HOST_POD_SWITCH(dest)][0]->getRemoteEndpoint());
+            dsttotor->push_back(top->queues_ns_nlp(dest, top->HOST_POD_SWITCH(dest), 0));
+            dsttotor->push_back(top->pipes_ns_nlp(dest, top->HOST_POD_SWITCH(dest), 0));
+            dsttotor->push_back(top->queues_ns_nlp(dest, top->HOST_POD_SWITCH(dest), 0)->getRemoteEndpoint());
 
 
             if (crt->start != TRIGGER_START && start_delta > 0){
@@ -513,7 +528,7 @@ int main(int argc, char **argv) {
             routeout = new Route(*(net_paths[src][dest]->at(choice)));
             routeout->add_endpoints(hpccSrc, hpccSnk);
                                 
-            routein = new Route(*top->get_bidir_paths(dest,src,false)->at(choice));
+            routein = new Route(*(net_paths[dest][src]->at(choice)));
             routein->add_endpoints(hpccSnk, hpccSrc);
             hpccSrc->connect(routeout, routein, *hpccSnk, timeFromUs((uint32_t)rand()%20));
         }
@@ -521,24 +536,20 @@ int main(int argc, char **argv) {
         path_refcounts[src][dest]--;
         path_refcounts[dest][src]--;
 
-        // free up the routes if no other connection needs them 
+        // free up the routes if no other connection needs them
         if (path_refcounts[src][dest] == 0 && net_paths[src][dest]) {
             vector<const Route*>::iterator i;
-            for (i = net_paths[src][dest]->begin(); i != net_paths[src][dest]->end(); i++) {
-                if ((*i)->reverse())
-                    delete (*i)->reverse();
-                delete *i;
-            }
+            for (i = net_paths[src][dest]->begin(); i != net_paths[src][dest]->end(); i++)
+                RouteStore::release(*i);
             delete net_paths[src][dest];
+            net_paths[src][dest] = NULL;
         }
         if (path_refcounts[dest][src] == 0 && net_paths[dest][src]) {
             vector<const Route*>::iterator i;
-            for (i = net_paths[dest][src]->begin(); i != net_paths[dest][src]->end(); i++) {
-                if ((*i)->reverse())
-                    delete (*i)->reverse();
-                delete *i;
-            }
+            for (i = net_paths[dest][src]->begin(); i != net_paths[dest][src]->end(); i++)
+                RouteStore::release(*i);
             delete net_paths[dest][src];
+            net_paths[dest][src] = NULL;
         }
 
         if (log_sink) {
@@ -572,6 +583,7 @@ int main(int argc, char **argv) {
         rtx_pkts += hpcc_srcs[ix]->_rtx_packets_sent;
     }
     cout << "New: " << new_pkts << " Rtx: " << rtx_pkts << endl;
+    cout << "PAUSE frames: " << EthPausePacket::_frames << endl;
 
     /*list <const Route*>::iterator rt_i;
       int counts[10]; int hop;
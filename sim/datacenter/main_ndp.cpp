@@ -23,8 +23,15 @@
 
 #include "fat_tree_topology.h"
 #include "fat_tree_switch.h"
+#include "dragon_fly_topology.h"
+#include "dragon_fly_switch.h"
+#include "generic_topology.h"
+#include "generic_switch.h"
+#include "sweep.h"
+#include "fluid_model.h"
 
 #include <list>
+#include <thread>
 
 // Simulation params
 
@@ -44,7 +51,7 @@ int DEFAULT_NODES = 432;
 EventList eventlist;
 
 void exit_error(char* progr) {
-    cout << "Usage " << progr << " [-nodes N]\n\t[-conns C]\n\t[-cwnd cwnd_size]\n\t[-q queue_size]\n\t[-oversubscribed_cc] Use receiver-driven AIMD to reduce total window when trims are not last hop\n\t[-queue_type composite|random|lossless|lossless_input|]\n\t[-tm traffic_matrix_file]\n\t[-strat route_strategy (single,rand,perm,pull,ecmp,\n\tecmp_host path_count,ecmp_ar,ecmp_rr,\n\tecmp_host_ar ar_thresh)]\n\t[-log log_level]\n\t[-seed random_seed]\n\t[-end end_time_in_usec]\n\t[-mtu MTU]\n\t[-hop_latency x] per hop wire latency in us,default 1\n\t[-switch_latency x] switching latency in us, default 0\n\t[-host_queue_type  swift|prio|fair_prio]" << endl;
+    cout << "Usage " << progr << " [-nodes N]\n\t[-conns C]\n\t[-cwnd cwnd_size]\n\t[-q queue_size]\n\t[-oversubscribed_cc] Use receiver-driven AIMD to reduce total window when trims are not last hop\n\t[-queue_type composite|random|lossless|lossless_input|]\n\t[-tm traffic_matrix_file]\n\t[-strat route_strategy (single,rand,perm,pull,ecmp,\n\tecmp_host path_count,ecmp_ar,ecmp_rr,\n\tecmp_host_ar ar_thresh)]\n\t[-log log_level]\n\t[-seed random_seed]\n\t[-end end_time_in_usec]\n\t[-scheduler heap|calendar]\n\t[-pktdb_stats] print packet memory use at the end\n\t[-sim_stats] print the number of events run and simulated time at the end\n\t[-sweep file] at the branch time, fork a run for each variant in file\n\t[-sweep_at t] branch time in us, default 0\n\t[-sweep_jobs N] run at most N variants at once, default 1\n\t[-dragonfly minimal|valiant|ugal_l|ugal_g] use a dragonfly routed by its switches instead of a fat tree\n\t[-generic_topo file] load a GenericTopology routed by its switches\n\t[-fib_threads N] threads to compute its FIB, default all cores\n\t[-fib_cache file] read its FIB from file if computed for this topology, else write it there\n\t[-fluid_min_residual f] fraction of a link fluid flows always leave to packets, default 0.05\n\t[-pktdb_prewarm] preallocate data packets for cwnd per connection\n\t[-hugepages] back packet slabs with huge pages\n\t[-lazy_paths] build each path when a flow first uses it\n\t[-path_cache N] with -lazy_paths, cache the N most recently used paths\n\t[-mtu MTU]\n\t[-hop_latency x] per hop wire latency in us,default 1\n\t[-switch_latency x] switching latency in us, default 0\n\t[-host_queue_type  swift|prio|fair_prio]" << endl;
     exit(1);
 }
 
@@ -100,6 +107,19 @@ int main(int argc, char **argv) {
     int i = 1;
 
     bool oversubscribed_congestion_control = false;
+    bool pktdb_stats = false;
+    bool sim_stats = false;
+    char* sweep_file = NULL;
+    double sweep_at = 0;
+    uint32_t sweep_jobs = 1;
+    double fluid_min_residual = 0.05;
+    bool dragonfly = false;
+    char* generic_topo = NULL;
+    uint32_t fib_threads = thread::hardware_concurrency();
+    char* fib_cache = NULL;
+    bool pktdb_prewarm = false;
+    bool lazy_paths = false;
+    size_t path_cache_size = 0;
 
     filename << "logout.dat";
     int end_time = 1000;//in microseconds
@@ -128,6 +148,59 @@ int main(int argc, char **argv) {
             end_time = atoi(argv[i+1]);
             cout << "endtime(us) "<< end_time << endl;
             i++;            
+        } else if (!strcmp(argv[i],"-pktdb_stats")) {
+            pktdb_stats = true;
+        } else if (!strcmp(argv[i],"-sim_stats")) {
+            sim_stats = true;
+        } else if (!strcmp(argv[i],"-sweep")) {
+            sweep_file = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i],"-sweep_at")) {
+            sweep_at = atof(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i],"-sweep_jobs")) {
+            sweep_jobs = atoi(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i],"-dragonfly")) {
+            if (!DragonFlySwitch::set_strategy(argv[i+1])) {
+                cout << "Unknown dragonfly routing " << argv[i+1] << " expecting one of minimal, valiant, ugal_l, ugal_g" << endl;
+                exit(1);
+            }
+            dragonfly = true;
+            i++;
+        } else if (!strcmp(argv[i],"-generic_topo")) {
+            generic_topo = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i],"-fib_threads")) {
+            fib_threads = atoi(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i],"-fib_cache")) {
+            fib_cache = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i],"-fluid_min_residual")) {
+            fluid_min_residual = atof(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i],"-pktdb_prewarm")) {
+            pktdb_prewarm = true;
+        } else if (!strcmp(argv[i],"-lazy_paths")) {
+            lazy_paths = true;
+        } else if (!strcmp(argv[i],"-path_cache")) {
+            path_cache_size = atoi(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i],"-hugepages")) {
+            PacketDBBase::setHugePages(true);
+            cout << "huge pages enabled" << endl;
+        } else if (!strcmp(argv[i],"-scheduler")) {
+            if (!strcmp(argv[i+1], "heap")) {
+                eventlist.setScheduler(EventList::HEAP);
+            } else if (!strcmp(argv[i+1], "calendar")) {
+                eventlist.setScheduler(EventList::CALENDAR);
+            } else {
+                cout << "Unknown scheduler " << argv[i+1] << " expecting one of heap|calendar" << endl;
+                exit_error(argv[0]);
+            }
+            cout << "scheduler " << argv[i+1] << endl;
+            i++;
         } else if (!strcmp(argv[i],"-rts")) {
             rts = true;
             cout << "rts enabled "<< endl;
@@ -270,35 +343,7 @@ int main(int argc, char **argv) {
             }   
             i++;
         } else if (!strcmp(argv[i],"-ar_method")){
-            if (!strcmp(argv[i+1],"pause")){
-                cout << "Adaptive routing based on pause state " << endl;
-                FatTreeSwitch::fn = &FatTreeSwitch::compare_pause;
-            }
-            else if (!strcmp(argv[i+1],"queue")){
-                cout << "Adaptive routing based on queue size " << endl;
-                FatTreeSwitch::fn = &FatTreeSwitch::compare_queuesize;
-            }
-            else if (!strcmp(argv[i+1],"bandwidth")){
-                cout << "Adaptive routing based on bandwidth utilization " << endl;
-                FatTreeSwitch::fn = &FatTreeSwitch::compare_bandwidth;
-            }
-            else if (!strcmp(argv[i+1],"pqb")){
-                cout << "Adaptive routing based on pause, queuesize and bandwidth utilization " << endl;
-                FatTreeSwitch::fn = &FatTreeSwitch::compare_pqb;
-            }
-            else if (!strcmp(argv[i+1],"pq")){
-                cout << "Adaptive routing based on pause, queuesize" << endl;
-                FatTreeSwitch::fn = &FatTreeSwitch::compare_pq;
-            }
-            else if (!strcmp(argv[i+1],"pb")){
-                cout << "Adaptive routing based on pause, bandwidth utilization" << endl;
-                FatTreeSwitch::fn = &FatTreeSwitch::compare_pb;
-            }
-            else if (!strcmp(argv[i+1],"qb")){
-                cout << "Adaptive routing based on queuesize, bandwidth utilization" << endl;
-                FatTreeSwitch::fn = &FatTreeSwitch::compare_qb; 
-            }
-            else {
+            if (!FatTreeSwitch::set_ar_method(argv[i+1])) {
                 cout << "Unknown AR method expecting one of pause, queue, bandwidth, pqb, pq, pb, qb" << endl;
                 exit(1);
             }
@@ -463,8 +508,37 @@ int main(int argc, char **argv) {
         qlf->set_sample_period(timeFromUs(10.0));
     }
 #ifdef FAT_TREE
-    FatTreeTopology* top;
-    if (topo_file) {
+    FatTreeTopology* top = NULL;
+    DragonFlyTopology* df_top = NULL;
+    GenericTopology* gen_top = NULL;
+    if (generic_topo) {
+        // as for the dragonfly, the switches do the routing
+        if (dragonfly || topo_file || log_switches || lazy_paths
+            || (route_strategy != ECMP_FIB && route_strategy != ECMP_FIB_ECN && route_strategy != REACTIVE_ECN)) {
+            cerr << "-generic_topo needs -strat ecmp_host, and can't be combined with -dragonfly, -topo, -lazy_paths or switch logging" << endl;
+            exit(1);
+        }
+        gen_top = new GenericTopology(&logfile, &eventlist);
+        if (!gen_top->load(generic_topo)) {
+            cerr << "Failed to load topology " << generic_topo << endl;
+            exit(1);
+        }
+        // the connection matrix is checked against this below
+        no_of_nodes = gen_top->no_of_nodes();
+        if (!gen_top->build_fib(fib_threads, fib_cache)) {
+            exit(1);
+        }
+    } else if (dragonfly) {
+        // the dragonfly switches route on the destination, so flows
+        // need a FIB strategy rather than source routes
+        if (topo_file || log_switches || lazy_paths
+            || (route_strategy != ECMP_FIB && route_strategy != ECMP_FIB_ECN && route_strategy != REACTIVE_ECN)) {
+            cerr << "-dragonfly needs -strat ecmp_host, and can't be combined with -topo, -lazy_paths or switch logging" << endl;
+            exit(1);
+        }
+        df_top = new DragonFlyTopology(no_of_nodes, queuesize, &logfile, &eventlist, qt, hop_latency,
+                                       linkspeed, switch_latency);
+    } else if (topo_file) {
         top = FatTreeTopology::load(topo_file, qlf, eventlist, queuesize, qt, snd_type);
     } else {
         FatTreeTopology::set_tiers(tiers);
@@ -497,25 +571,28 @@ int main(int argc, char **argv) {
     VL2Topology* top = new VL2Topology(lf, &eventlist,ff);
 #endif
 
-    if (log_switches) {
+    if (log_switches && top) {
         top->add_switch_loggers(logfile, timeFromUs(20.0));
     }
 
-    vector<const Route*>*** net_paths;
-    net_paths = new vector<const Route*>**[no_of_nodes];
-
-    int **path_refcounts;
-    path_refcounts = new int*[no_of_nodes];
+    // With -lazy_paths the sources ask the topology for each path as they
+    // first use it, and we don't list every path between every pair here.
+    vector<const Route*>*** net_paths = NULL;
+    int **path_refcounts = NULL;
+    PathCache* path_cache = NULL;
 
-    int* is_dest = new int[no_of_nodes];
-    
-    for (size_t s = 0; s < no_of_nodes; s++) {
-        is_dest[s] = 0;
-        net_paths[s] = new vector<const Route*>*[no_of_nodes];
-        path_refcounts[s] = new int[no_of_nodes];
-        for (size_t d = 0; d < no_of_nodes; d++) {
-            net_paths[s][d] = NULL;
-            path_refcounts[s][d] = 0;
+    if (lazy_paths) {
+        path_cache = new PathCache(top, path_cache_size);
+    } else {
+        net_paths = new vector<const Route*>**[no_of_nodes];
+        path_refcounts = new int*[no_of_nodes];
+        for (size_t s = 0; s < no_of_nodes; s++) {
+            net_paths[s] = new vector<const Route*>*[no_of_nodes];
+            path_refcounts[s] = new int[no_of_nodes];
+            for (size_t d = 0; d < no_of_nodes; d++) {
+                net_paths[s][d] = NULL;
+                path_refcounts[s][d] = 0;
+            }
         }
     }
     
@@ -539,6 +616,11 @@ int main(int argc, char **argv) {
         exit(-1);
     }
     
+    if ((df_top || gen_top) && !conns->failures.empty()) {
+        cerr << "-dragonfly and -generic_topo can't be combined with link failures" << endl;
+        exit(1);
+    }
+
     //handle link failures specified in the connection matrix.
     for (size_t c = 0; c < conns->failures.size(); c++){
         failure* crt = conns->failures.at(c);
@@ -556,49 +638,59 @@ int main(int argc, char **argv) {
     list <const Route*> routes;
 
     vector<connection*>* all_conns = conns->getAllConnections();
+    if (pktdb_prewarm) {
+        // a full window in flight for every connection at once is the worst case
+        NdpPacket::reserve((size_t)all_conns->size() * cwnd);
+    }
     vector <NdpSrc*> ndp_srcs;
 
-    for (size_t c = 0; c < all_conns->size(); c++){
+    // count the connections that need each path list, so that its routes
+    // can be released once the last of them has been set up
+    for (size_t c = 0; !lazy_paths && c < all_conns->size(); c++){
         connection* crt = all_conns->at(c);
-        int src = crt->src;
-        int dest = crt->dst;
-        path_refcounts[src][dest]++;
-        path_refcounts[dest][src]++;
-                        
-        if (!net_paths[src][dest]
-            && route_strategy!=ECMP_FIB
-            && route_strategy!=ECMP_FIB_ECN
-            && route_strategy!=REACTIVE_ECN ) {
-            vector<const Route*>* paths = top->get_bidir_paths(src,dest,false);
-            net_paths[src][dest] = paths;
-            /*
-            for (unsigned int i = 0; i < paths->size(); i++) {
-              routes.push_back((*paths)[i]);
-            }
-            */
-        }
-        if (!net_paths[dest][src]
-            && route_strategy!=ECMP_FIB
-            && route_strategy!=ECMP_FIB_ECN
-            && route_strategy!=REACTIVE_ECN ) {
-            vector<const Route*>* paths = top->get_bidir_paths(dest,src,false);
-            net_paths[dest][src] = paths;
-            /*
-            for (unsigned int i = 0; i < paths->size(); i++) {
-              routes.push_back((*paths)[i]);
-            }
-            */
-        }
+        if (crt->fluid)
+            continue;
+        path_refcounts[crt->src][crt->dst]++;
+        path_refcounts[crt->dst][crt->src]++;
     }
 
     map <flowid_t, TriggerTarget*> flowmap;
 
+    // connections tagged fluid are background load that doesn't need packets
+    FluidModel* fluid = NULL;
+    for (size_t c = 0; c < all_conns->size() && !fluid; c++) {
+        if (all_conns->at(c)->fluid) {
+            if (!top) {
+                cerr << "Fluid flows need a fat tree" << endl;
+                exit(1);
+            }
+            fluid = new FluidModel(top, eventlist);
+            fluid->setMinResidual(fluid_min_residual);
+        }
+    }
+
     for (size_t c = 0; c < all_conns->size(); c++){
         connection* crt = all_conns->at(c);
         int src = crt->src;
         int dest = crt->dst;
+
+        if (crt->fluid) {
+            fluid->addFlow(*crt);
+            continue;
+        }
         //cout << "Connection " << crt->src << "->" <<crt->dst << " starting at " << crt->start << " size " << crt->size << endl;
 
+        // build the paths when the first connection that needs them is set up
+        if (!lazy_paths
+            && route_strategy!=ECMP_FIB
+            && route_strategy!=ECMP_FIB_ECN
+            && route_strategy!=REACTIVE_ECN) {
+            if (!net_paths[src][dest])
+                net_paths[src][dest] = top->get_bidir_paths(src,dest,false);
+            if (!net_paths[dest][src])
+                net_paths[dest][src] = top->get_bidir_paths(dest,src,false);
+        }
+
         ndpSrc = new NdpSrc(NULL, NULL, eventlist,rts);
         ndpSrc->setCwnd(cwnd*Packet::data_packet_size());
         ndp_srcs.push_back(ndpSrc);
@@ -614,13 +706,21 @@ int main(int argc, char **argv) {
             ndpSrc->set_flowsize(crt->size);
         }
 
+        Trigger* start_trigger = NULL;
         if (crt->trigger) {
-            Trigger* trig = conns->getTrigger(crt->trigger, eventlist);
-            trig->add_target(*ndpSrc);
+            start_trigger = conns->getTrigger(crt->trigger, eventlist);
+            start_trigger->add_target(*ndpSrc);
         }
+        Trigger* end_trigger = NULL;
         if (crt->send_done_trigger) {
-            Trigger* trig = conns->getTrigger(crt->send_done_trigger, eventlist);
-            ndpSrc->set_end_trigger(*trig);
+            end_trigger = conns->getTrigger(crt->send_done_trigger, eventlist);
+        }
+        if (fluid) {
+            // a foreground flow leaves the fluid allocation when it finishes
+            end_trigger = fluid->addForeground(src, dest, crt->start, start_trigger, end_trigger);
+        }
+        if (end_trigger) {
+            ndpSrc->set_end_trigger(*end_trigger);
         }
 
         ndpSnk = new NdpSink(pacers[dest]);
@@ -649,22 +749,51 @@ int main(int argc, char **argv) {
         case SCATTER_ECMP:
         case PULL_BASED:
             ndpSrc->connect(NULL, NULL, *ndpSnk, crt->start);
-            ndpSrc->set_paths(net_paths[src][dest]);
-            ndpSnk->set_paths(net_paths[dest][src]);
+            if (lazy_paths) {
+                ndpSrc->set_paths(new TopologyPaths(path_cache, src, dest));
+                ndpSnk->set_paths(new TopologyPaths(path_cache, dest, src));
+            } else {
+                ndpSrc->set_paths(net_paths[src][dest]);
+                ndpSnk->set_paths(net_paths[dest][src]);
+            }
             break;
         case ECMP_FIB:
         case ECMP_FIB_ECN:
         case REACTIVE_ECN:
-            {
+            if (df_top) {
+                Route* srctotor = new Route();
+                srctotor->push_back(df_top->queues_host_switch[src]);
+                srctotor->push_back(df_top->pipes_host_switch[src]);
+                srctotor->push_back(df_top->queues_host_switch[src]->getRemoteEndpoint());
+
+                Route* dsttotor = new Route();
+                dsttotor->push_back(df_top->queues_host_switch[dest]);
+                dsttotor->push_back(df_top->pipes_host_switch[dest]);
+                dsttotor->push_back(df_top->queues_host_switch[dest]->getRemoteEndpoint());
+
+                ndpSrc->connect(srctotor, dsttotor, *ndpSnk, crt->start);
+                ndpSrc->set_paths(path_entropy_size);
+                ndpSnk->set_paths(path_entropy_size);
+
+                df_top->switches[df_top->HOST_SWITCH(src)]->addHostPort(src,ndpSrc->flow_id(),ndpSrc);
+                df_top->switches[df_top->HOST_SWITCH(dest)]->addHostPort(dest,ndpSrc->flow_id(),ndpSnk);
+            } else if (gen_top) {
+                ndpSrc->connect(gen_top->host_uplink(src), gen_top->host_uplink(dest), *ndpSnk, crt->start);
+                ndpSrc->set_paths(path_entropy_size);
+                ndpSnk->set_paths(path_entropy_size);
+
+                gen_top->host_switch(src)->addHostPort(src,ndpSrc->flow_id(),ndpSrc);
+                gen_top->host_switch(dest)->addHostPort(dest,ndpSrc->flow_id(),ndpSnk);
+            } else {
                 Route* srctotor = new Route();
-                srctotor->push_back(top->queues_ns_nlp[src][top->HOST_POD_SWITCH(src)][0]);
-                srctotor->push_back(top->pipes_ns_nlp[src][top->HOST_POD_SWITCH(src)][0]);
-                srctotor->push_back(top->queues_ns_nlp[src][top->HOST_POD_SWITCH(src)][0]->getRemoteEndpoint());
+                srctotor->push_back(top->queues_ns_nlp(src, top->HOST_POD_SWITCH(src), 0));
+                srctotor->push_back(top->pipes_ns_nlp(src, top->HOST_POD_SWITCH(src), 0));
+                srctotor->push_back(top->queues_ns_nlp(src, top->HOST_POD_SWITCH(src), 0)->getRemoteEndpoint());
 
                 Route* dsttotor = new Route();
-                dsttotor->push_back(top->queues_ns_nlp[dest][top->HOST_POD_SWITCH(dest)][0]);
-                dsttotor->push_back(top->pipes_ns_nlp[dest][top->HOST_POD_SWITCH(dest)][0]);
-                dsttotor->push_back(top->queues_ns_nlp[dest][top->HOST_POD_SWITCH(dest)][0]->getRemoteEndpoint());
+                dsttotor->push_back(top->queues_ns_nlp(dest, top->HOST_POD_SWITCH(dest), 0));
+                dsttotor->push_back(top->pipes_ns_nlp(dest, top->HOST_POD_SWITCH(dest), 0));
+                dsttotor->push_back(top->queues_ns_nlp(dest, top->HOST_POD_SWITCH(dest), 0)->getRemoteEndpoint());
 
 
                 ndpSrc->connect(srctotor, dsttotor, *ndpSnk, crt->start);
@@ -676,17 +805,26 @@ int main(int argc, char **argv) {
                 assert(top->switches_lp[top->HOST_POD_SWITCH(src)]);
                 top->switches_lp[top->HOST_POD_SWITCH(src)]->addHostPort(src,ndpSrc->flow_id(),ndpSrc);
                 top->switches_lp[top->HOST_POD_SWITCH(dest)]->addHostPort(dest,ndpSrc->flow_id(),ndpSnk);
-                break;
             }
+            break;
         case SINGLE_PATH:
             {
                 assert(route_strategy==SINGLE_PATH);
-                int choice = rand()%net_paths[src][dest]->size();
-                routeout = new Route(*(net_paths[src][dest]->at(choice)));
-                routeout->add_endpoints(ndpSrc, ndpSnk);
-                                
-                routein = new Route(*top->get_bidir_paths(dest,src,false)->at(choice));
-                routein->add_endpoints(ndpSnk, ndpSrc);
+                if (lazy_paths) {
+                    // a cached route only lives until the next lookup,
+                    // so copy it and its reverse straight away
+                    int choice = rand()%path_cache->get_path_count(src, dest);
+                    routeout = new Route(*path_cache->get_path(src, dest, choice));
+                    routeout->add_endpoints(ndpSrc, ndpSnk);
+                    routein = new Route(*path_cache->get_path(dest, src, choice));
+                    routein->add_endpoints(ndpSnk, ndpSrc);
+                } else {
+                    int choice = rand()%net_paths[src][dest]->size();
+                    routeout = new Route(*(net_paths[src][dest]->at(choice)));
+                    routein = new Route(*(net_paths[dest][src]->at(choice)));
+                    routeout->add_endpoints(ndpSrc, ndpSnk);
+                    routein->add_endpoints(ndpSnk, ndpSrc);
+                }
                 ndpSrc->connect(routeout, routein, *ndpSnk, crt->start);
                 break;
             }
@@ -694,31 +832,29 @@ int main(int argc, char **argv) {
             abort();
         }
 
-        path_refcounts[src][dest]--;
-        path_refcounts[dest][src]--;
+        if (!lazy_paths) {
+            path_refcounts[src][dest]--;
+            path_refcounts[dest][src]--;
+        }
 
 
         // set up the triggers
         // xxx
 
-        // free up the routes if no other connection needs them 
-        if (path_refcounts[src][dest] == 0 && net_paths[src][dest]) {
+        // free up the routes if no other connection needs them
+        if (!lazy_paths && path_refcounts[src][dest] == 0 && net_paths[src][dest]) {
             vector<const Route*>::iterator i;
-            for (i = net_paths[src][dest]->begin(); i != net_paths[src][dest]->end(); i++) {
-                if ((*i)->reverse())
-                    delete (*i)->reverse();
-                delete *i;
-            }
+            for (i = net_paths[src][dest]->begin(); i != net_paths[src][dest]->end(); i++)
+                RouteStore::release(*i);
             delete net_paths[src][dest];
+            net_paths[src][dest] = NULL;
         }
-        if (path_refcounts[dest][src] == 0 && net_paths[dest][src]) {
+        if (!lazy_paths && path_refcounts[dest][src] == 0 && net_paths[dest][src]) {
             vector<const Route*>::iterator i;
-            for (i = net_paths[dest][src]->begin(); i != net_paths[dest][src]->end(); i++) {
-                if ((*i)->reverse())
-                    delete (*i)->reverse();
-                delete *i;
-            }
+            for (i = net_paths[dest][src]->begin(); i != net_paths[dest][src]->end(); i++)
+                RouteStore::release(*i);
             delete net_paths[dest][src];
+            net_paths[dest][src] = NULL;
         }
 
         if (log_sink) {
@@ -726,7 +862,7 @@ int main(int argc, char **argv) {
         }
     }
 
-    for (size_t ix = 0; ix < no_of_nodes; ix++) {
+    for (size_t ix = 0; path_refcounts && ix < no_of_nodes; ix++) {
         delete path_refcounts[ix];
     }
 
@@ -740,12 +876,50 @@ int main(int argc, char **argv) {
     double rtt = timeAsSec(timeFromUs(RTT));
     logfile.write("# rtt =" + ntoa(rtt));
     
+    if (sweep_file) {
+        // the overrides a sweep variant can apply at the branch time
+        Sweep* sweep = new Sweep(sweep_file, eventlist, logfile);
+        sweep->addHook("ecn_thresh", [top](const string& value) {
+            if (!top || !top->set_ecn_threshold(atof(value.c_str()))) {
+                cout << "ecn_thresh needs an ECN load balancing strategy or queue type aeolus_ecn" << endl;
+                exit(1);
+            }
+        });
+        sweep->addHook("ar_method", [](const string& value) {
+            if (!FatTreeSwitch::set_ar_method(value)) {
+                cout << "Unknown AR method expecting one of pause, queue, bandwidth, pqb, pq, pb, qb" << endl;
+                exit(1);
+            }
+        });
+        sweep->addHook("ar_sticky_delta", [](const string& value) {
+            FatTreeSwitch::_sticky_delta = timeFromUs(atof(value.c_str()));
+        });
+        sweep->start(timeFromUs(sweep_at), sweep_jobs);
+    }
+
     // GO!
     cout << "Starting simulation" << endl;
     while (eventlist.doNextEvent()) {
     }
 
     cout << "Done" << endl;
+    if (df_top) {
+        cout << "DragonFly routing: minimal " << DragonFlySwitch::_minimal_routed
+             << " valiant " << DragonFlySwitch::_valiant_routed << endl;
+    }
+    if (fluid) {
+        cout << "Fluid flows: " << fluid->flows() << " finished: " << fluid->finished() << endl;
+    }
+    if (pktdb_stats) {
+        PacketDBBase::printStats(cout);
+    }
+    if (sim_stats) {
+        cout << "sim_stats events=" << eventlist.eventCount() << " simtime_ps=" << eventlist.now() << endl;
+    }
+    if (path_cache && path_cache_size) {
+        cout << "Path cache hits " << path_cache->hits() << " misses " << path_cache->misses()
+             << " routes " << RouteStore::route_count() << endl;
+    }
     int new_pkts = 0, rtx_pkts = 0, bounce_pkts = 0;
     for (size_t ix = 0; ix < ndp_srcs.size(); ix++) {
         new_pkts += ndp_srcs[ix]->_new_packets_sent;
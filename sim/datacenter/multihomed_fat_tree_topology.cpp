@@ -207,8 +207,8 @@ vector<const Route*>* MultihomedFatTreeTopology::get_paths(uint32_t src, uint32_
         routeout->push_back(queues_nlp_ns[HOST_POD_SWITCH1(dest)][dest]);
         routeout->push_back(pipes_nlp_ns[HOST_POD_SWITCH1(dest)][dest]);
 
-        paths->push_back(routeout);
         check_non_null(routeout);
+        paths->push_back(RouteStore::intern(routeout));
 
         routeout = new Route();
         pqueue = new Queue(speedFromPktps(2*HOST_NIC), memFromPkt(FEEDER_BUFFER), *eventlist, NULL);
@@ -221,8 +221,8 @@ vector<const Route*>* MultihomedFatTreeTopology::get_paths(uint32_t src, uint32_
         routeout->push_back(queues_nlp_ns[HOST_POD_SWITCH2(dest)][dest]);
         routeout->push_back(pipes_nlp_ns[HOST_POD_SWITCH2(dest)][dest]);
 
-        paths->push_back(routeout);
         check_non_null(routeout);
+        paths->push_back(RouteStore::intern(routeout));
 
         return paths;
     }
@@ -262,8 +262,8 @@ vector<const Route*>* MultihomedFatTreeTopology::get_paths(uint32_t src, uint32_
             routeout->push_back(queues_nlp_ns[swd][dest]);
             routeout->push_back(pipes_nlp_ns[swd][dest]);
 
-            paths->push_back(routeout);
             check_non_null(routeout);
+            paths->push_back(RouteStore::intern(routeout));
         }
         return paths;
     }
@@ -324,8 +324,8 @@ vector<const Route*>* MultihomedFatTreeTopology::get_paths(uint32_t src, uint32_
                 routeout->push_back(queues_nlp_ns[swd][dest]);
                 routeout->push_back(pipes_nlp_ns[swd][dest]);
         
-                paths->push_back(routeout);
                 check_non_null(routeout);
+                paths->push_back(RouteStore::intern(routeout));
             }
         return paths;
     }
@@ -224,9 +224,9 @@ vector<const Route*>* OversubscribedFatTreeTopology::get_bidir_paths(uint32_t sr
         routeout->push_back(queues_nlp_ns[HOST_POD_SWITCH(dest)][dest]);
         routeout->push_back(pipes_nlp_ns[HOST_POD_SWITCH(dest)][dest]);
 
-        paths->push_back(routeout);
-
         check_non_null(routeout);
+
+        paths->push_back(RouteStore::intern(routeout));
         return paths;
     }
     else if (HOST_POD(src)==HOST_POD(dest)){
@@ -249,8 +249,8 @@ vector<const Route*>* OversubscribedFatTreeTopology::get_bidir_paths(uint32_t sr
             routeout->push_back(queues_nlp_ns[HOST_POD_SWITCH(dest)][dest]);
             routeout->push_back(pipes_nlp_ns[HOST_POD_SWITCH(dest)][dest]);
       
-            paths->push_back(routeout);
             check_non_null(routeout);
+            paths->push_back(RouteStore::intern(routeout));
         }
         return paths;
     }
@@ -286,8 +286,8 @@ vector<const Route*>* OversubscribedFatTreeTopology::get_bidir_paths(uint32_t sr
                 routeout->push_back(queues_nlp_ns[HOST_POD_SWITCH(dest)][dest]);
                 routeout->push_back(pipes_nlp_ns[HOST_POD_SWITCH(dest)][dest]);
         
-                paths->push_back(routeout);
                 check_non_null(routeout);
+                paths->push_back(RouteStore::intern(routeout));
             }
         return paths;
     }
@@ -82,8 +82,8 @@ vector<const Route*>* StarTopology::get_paths(uint32_t src, uint32_t dest){
     routeout->push_back(queue_in_ns[dest]);
     routeout->push_back(pipe_in_ns[dest]);
 
-    paths->push_back(routeout);
     check_non_null(routeout);
+    paths->push_back(RouteStore::intern(routeout));
     return paths;
 }
 
@@ -1,6 +1,8 @@
 // -*- c-basic-offset: 4; indent-tabs-mode: nil -*-
 #ifndef TOPOLOGY
 #define TOPOLOGY
+#include <list>
+#include <unordered_map>
 #include "network.h"
 #include "loggers.h"
 
@@ -10,6 +12,30 @@ public:
         return get_bidir_paths(src, dest, true);
     }
     virtual vector<const Route*>* get_bidir_paths(uint32_t src, uint32_t dest, bool reverse)=0;
+
+    // The number of paths from src to dest, and path k of them in
+    // get_bidir_paths order, without building the others.  Regular
+    // topologies compute path k directly; here it is picked from the
+    // full list, and the other routes are released.  The caller holds a
+    // RouteStore reference on the route returned.
+    virtual uint32_t get_path_count(uint32_t src, uint32_t dest) {
+        vector<const Route*>* paths = get_bidir_paths(src, dest, false);
+        uint32_t count = paths->size();
+        for (uint32_t i = 0; i < count; i++)
+            RouteStore::release(paths->at(i));
+        delete paths;
+        return count;
+    }
+    virtual const Route* get_path(uint32_t src, uint32_t dest, uint32_t k, bool reverse) {
+        vector<const Route*>* paths = get_bidir_paths(src, dest, reverse);
+        const Route* path = paths->at(k);
+        for (uint32_t i = 0; i < paths->size(); i++) {
+            if (i != k)
+                RouteStore::release(paths->at(i));
+        }
+        delete paths;
+        return path;
+    }
     virtual vector<uint32_t>* get_neighbours(uint32_t src) = 0;  
     virtual uint32_t no_of_nodes() const {
         abort();
@@ -21,4 +47,69 @@ public:
     }
 };
 
+/*
+ * Bounded LRU cache in front of Topology::get_path, so that the paths
+ * that many flows spray over are not rebuilt each time.  A capacity of
+ * zero caches nothing.  The cache holds the RouteStore reference on
+ * each route it keeps and releases it on eviction, so the interned
+ * routes are bounded by the capacity too.  A route returned is only
+ * valid until the next call: copy it, and its reverse, before then.
+ */
+class PathCache {
+public:
+    PathCache(Topology* top, size_t capacity)
+        : _top(top), _capacity(capacity), _uncached(NULL), _hits(0), _misses(0) {}
+
+    uint32_t get_path_count(uint32_t src, uint32_t dest) {
+        return _top->get_path_count(src, dest);
+    }
+    const Route* get_path(uint32_t src, uint32_t dest, uint32_t k) {
+        if (_capacity == 0) {
+            if (_uncached)
+                RouteStore::release(_uncached);
+            _uncached = _top->get_path(src, dest, k, false);
+            return _uncached;
+        }
+        assert(src < (1 << 24) && dest < (1 << 24) && k < (1 << 16));
+        uint64_t key = ((uint64_t)src << 40) | ((uint64_t)dest << 16) | k;
+        unordered_map<uint64_t, list<entry>::iterator>::iterator i = _index.find(key);
+        if (i != _index.end()) {
+            _hits++;
+            _lru.splice(_lru.begin(), _lru, i->second);
+            return i->second->second;
+        }
+        _misses++;
+        if (_lru.size() == _capacity) {
+            _index.erase(_lru.back().first);
+            RouteStore::release(_lru.back().second);
+            _lru.pop_back();
+        }
+        _lru.push_front(entry(key, _top->get_path(src, dest, k, false)));
+        _index[key] = _lru.begin();
+        return _lru.front().second;
+    }
+    uint64_t hits() const {return _hits;}
+    uint64_t misses() const {return _misses;}
+private:
+    typedef pair<uint64_t, const Route*> entry;
+    Topology* _top;
+    size_t _capacity;
+    const Route* _uncached; // the last route returned, with no capacity
+    list<entry> _lru;   // most recently used first
+    unordered_map<uint64_t, list<entry>::iterator> _index;
+    uint64_t _hits, _misses;
+};
+
+// the paths from src to dest, built as a source first uses them
+class TopologyPaths : public PathSource {
+public:
+    TopologyPaths(PathCache* cache, uint32_t src, uint32_t dest)
+        : _cache(cache), _src(src), _dest(dest), _count(cache->get_path_count(src, dest)) {}
+    virtual uint32_t path_count() {return _count;}
+    virtual const Route* path(uint32_t k) {return _cache->get_path(_src, _dest, k);}
+private:
+    PathCache* _cache;
+    uint32_t _src, _dest, _count;
+};
+
 #endif
@@ -176,6 +176,26 @@ void VL2Topology::init_network(){
 
 vector<const Route*>* VL2Topology::get_paths(uint32_t src, uint32_t dest){
     vector<const Route*>* paths = new vector<const Route*>();
+    uint32_t count = get_path_count(src, dest);
+    paths->reserve(count);
+    for (uint32_t k = 0; k < count; k++)
+        paths->push_back(get_path(src, dest, k, false));
+    return paths;
+}
+
+uint32_t VL2Topology::get_path_count(uint32_t src, uint32_t dest){
+    if (HOST_TOR(src)==HOST_TOR(dest))
+        return 1;
+    //  return 2*NI;
+    return 4*NI;
+}
+
+// Path i goes up through the first agg switch for the first half of
+// the paths and the second for the rest, to int switch i/4, and down
+// through the first agg switch above the destination when i%NT2A is 0.
+// No reverse routes are built, so reverse is ignored.
+const Route* VL2Topology::get_path(uint32_t src, uint32_t dest, uint32_t i, bool reverse){
+    assert(i < get_path_count(src, dest));
 
     Route* routeout;
 
@@ -193,83 +213,77 @@ vector<const Route*>* VL2Topology::get_paths(uint32_t src, uint32_t dest){
         routeout->push_back(queues_nt_ns[HOST_TOR(dest)][HOST_TOR_ID(dest)]);
         routeout->push_back(pipes_nt_ns[HOST_TOR(dest)][HOST_TOR_ID(dest)]);
 
-        paths->push_back(routeout);
-        return paths;
+        return RouteStore::intern(routeout);
     }
 
-    //  for (uint32_t i=0;i<2*NI;i++){
-    for (uint32_t i=0;i<4*NI;i++){
-        routeout = new Route();
+    routeout = new Route();
 
-        Queue* pqueue = new Queue(speedFromPktps(CORE_TO_HOST*HOST_NIC), memFromPkt(FEEDER_BUFFER), *eventlist, NULL);
-        pqueue->setName("PQueue_" + ntoa(src) + "_" + ntoa(dest));
-        logfile->writeName(*pqueue);
+    Queue* pqueue = new Queue(speedFromPktps(CORE_TO_HOST*HOST_NIC), memFromPkt(FEEDER_BUFFER), *eventlist, NULL);
+    pqueue->setName("PQueue_" + ntoa(src) + "_" + ntoa(dest));
+    logfile->writeName(*pqueue);
   
-        routeout->push_back(pqueue);
+    routeout->push_back(pqueue);
   
-        //server to TOR switch
-        routeout->push_back(queues_ns_nt[HOST_TOR_ID(src)][HOST_TOR(src)]);
-        routeout->push_back(pipes_ns_nt[HOST_TOR_ID(src)][HOST_TOR(src)]);
+    //server to TOR switch
+    routeout->push_back(queues_ns_nt[HOST_TOR_ID(src)][HOST_TOR(src)]);
+    routeout->push_back(pipes_ns_nt[HOST_TOR_ID(src)][HOST_TOR(src)]);
 
-        assert(queues_ns_nt[HOST_TOR_ID(src)][HOST_TOR(src)]!=NULL);
-        assert(pipes_ns_nt[HOST_TOR_ID(src)][HOST_TOR(src)]!=NULL);
+    assert(queues_ns_nt[HOST_TOR_ID(src)][HOST_TOR(src)]!=NULL);
+    assert(pipes_ns_nt[HOST_TOR_ID(src)][HOST_TOR(src)]!=NULL);
 
-        uint32_t agg_switch;
-        //    if (src%NS<(NS/2))
-        if (i<2*NI)
-            //use link to first agg switch
-            agg_switch = TOR_AGG1(HOST_TOR(src));
-        else
-            agg_switch = TOR_AGG2(HOST_TOR(src));
-    
-        //TOR switch to AGG switch
-        routeout->push_back(queues_nt_na[HOST_TOR(src)][agg_switch]);
-        routeout->push_back( pipes_nt_na[HOST_TOR(src)][agg_switch]);
-    
-        assert(queues_nt_na[HOST_TOR(src)][agg_switch]!=NULL);
-        assert(pipes_nt_na[HOST_TOR(src)][agg_switch]!=NULL);
-    
-        //AGG to UINT32_T switch
-        //now I need to connect to the choice1 server
-        //0<=choice1<NI
+    uint32_t agg_switch;
+    //    if (src%NS<(NS/2))
+    if (i<2*NI)
+        //use link to first agg switch
+        agg_switch = TOR_AGG1(HOST_TOR(src));
+    else
+        agg_switch = TOR_AGG2(HOST_TOR(src));
 
-        assert(queues_na_ni[agg_switch][i/4]!=NULL);
-        assert(pipes_na_ni[agg_switch][i/4]!=NULL);    
+    //TOR switch to AGG switch
+    routeout->push_back(queues_nt_na[HOST_TOR(src)][agg_switch]);
+    routeout->push_back( pipes_nt_na[HOST_TOR(src)][agg_switch]);
 
-        routeout->push_back(queues_na_ni[agg_switch][i/4]);
-        routeout->push_back( pipes_na_ni[agg_switch][i/4]);    
+    assert(queues_nt_na[HOST_TOR(src)][agg_switch]!=NULL);
+    assert(pipes_nt_na[HOST_TOR(src)][agg_switch]!=NULL);
 
-        //now I need to connect to the choice2 agg server - this is more tricky!
+    //AGG to UINT32_T switch
+    //now I need to connect to the choice1 server
+    //0<=choice1<NI
 
-        uint32_t agg_switch_2;
-        if (i%NT2A==0)
-            agg_switch_2 = TOR_AGG1(HOST_TOR(dest));
-        else
-            agg_switch_2 = TOR_AGG2(HOST_TOR(dest));
-    
-        assert(queues_ni_na[i/4][agg_switch_2]!=NULL);
-        assert(pipes_ni_na[i/4][agg_switch_2]!=NULL);
+    assert(queues_na_ni[agg_switch][i/4]!=NULL);
+    assert(pipes_na_ni[agg_switch][i/4]!=NULL);    
 
-        //INT to agg switch
-        routeout->push_back(queues_ni_na[i/4][agg_switch_2]);
-        routeout->push_back(pipes_ni_na[i/4][agg_switch_2]);
+    routeout->push_back(queues_na_ni[agg_switch][i/4]);
+    routeout->push_back( pipes_na_ni[agg_switch][i/4]);    
 
-        //agg to TOR
-        routeout->push_back(queues_na_nt[agg_switch_2][HOST_TOR(dest)]);
-        routeout->push_back(pipes_na_nt[agg_switch_2][HOST_TOR(dest)]);
-        assert(queues_na_nt[agg_switch_2][HOST_TOR(dest)]!=NULL);
-        assert(pipes_na_nt[agg_switch_2][HOST_TOR(dest)]!=NULL);
+    //now I need to connect to the choice2 agg server - this is more tricky!
 
-        //tor to server
-        routeout->push_back(queues_nt_ns[HOST_TOR(dest)][HOST_TOR_ID(dest)]);
-        routeout->push_back(pipes_nt_ns[HOST_TOR(dest)][HOST_TOR_ID(dest)]);
+    uint32_t agg_switch_2;
+    if (i%NT2A==0)
+        agg_switch_2 = TOR_AGG1(HOST_TOR(dest));
+    else
+        agg_switch_2 = TOR_AGG2(HOST_TOR(dest));
 
-        assert(queues_nt_ns[HOST_TOR(dest)][HOST_TOR_ID(dest)]!=NULL);
-        assert(pipes_nt_ns[HOST_TOR(dest)][HOST_TOR_ID(dest)]!=NULL);
+    assert(queues_ni_na[i/4][agg_switch_2]!=NULL);
+    assert(pipes_ni_na[i/4][agg_switch_2]!=NULL);
 
-        paths->push_back(routeout);
-    }
+    //INT to agg switch
+    routeout->push_back(queues_ni_na[i/4][agg_switch_2]);
+    routeout->push_back(pipes_ni_na[i/4][agg_switch_2]);
 
-    return paths;
+    //agg to TOR
+    routeout->push_back(queues_na_nt[agg_switch_2][HOST_TOR(dest)]);
+    routeout->push_back(pipes_na_nt[agg_switch_2][HOST_TOR(dest)]);
+    assert(queues_na_nt[agg_switch_2][HOST_TOR(dest)]!=NULL);
+    assert(pipes_na_nt[agg_switch_2][HOST_TOR(dest)]!=NULL);
+
+    //tor to server
+    routeout->push_back(queues_nt_ns[HOST_TOR(dest)][HOST_TOR_ID(dest)]);
+    routeout->push_back(pipes_nt_ns[HOST_TOR(dest)][HOST_TOR_ID(dest)]);
+
+    assert(queues_nt_ns[HOST_TOR(dest)][HOST_TOR_ID(dest)]!=NULL);
+    assert(pipes_nt_ns[HOST_TOR(dest)][HOST_TOR_ID(dest)]!=NULL);
+
+    return RouteStore::intern(routeout);
 }
 
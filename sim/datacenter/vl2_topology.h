@@ -46,6 +46,8 @@ public:
 
     void init_network();
     virtual vector<const Route*>* get_paths(uint32_t src, uint32_t dest);
+    virtual uint32_t get_path_count(uint32_t src, uint32_t dest);
+    virtual const Route* get_path(uint32_t src, uint32_t dest, uint32_t k, bool reverse);
     vector<uint32_t>* get_neighbours(uint32_t src) {return NULL;};
     uint32_t no_of_nodes() const {return _no_of_nodes;}
 private:
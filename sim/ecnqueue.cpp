@@ -20,8 +20,14 @@ ECNQueue::receivePacket(Packet & pkt)
     //is this a PAUSE packet?
     if (pkt.type()==ETH_PAUSE){
         EthPausePacket* p = (EthPausePacket*)&pkt;
+
+        //a single FIFO, so it follows PFC class 0 only
+        if (!p->class_enabled(0)) {
+            pkt.free();
+            return;
+        }
         
-        if (p->sleepTime()>0){
+        if (p->sleepTime(0)>0){
             //remote end is telling us to shut up.
             //assert(_state_send == LosslessQueue::READY);
             if (queuesize()>0)
@@ -9,24 +9,24 @@ using namespace std;
 // Static stuff
 
 // _path_entropy_size is the number of paths we spray across.  If you don't set it, it will default to all paths.
-uint32_t EqdsSrc::_path_entropy_size = 256;
-int EqdsSrc::_global_node_count = 0;
+thread_local uint32_t EqdsSrc::_path_entropy_size = 256;
+thread_local int EqdsSrc::_global_node_count = 0;
 
 /* _min_rto can be tuned using setMinRTO. Don't change it here.  */
-simtime_picosec EqdsSrc::_min_rto = timeFromUs((uint32_t)DEFAULT_EQDS_RTO_MIN);
+thread_local simtime_picosec EqdsSrc::_min_rto = timeFromUs((uint32_t)DEFAULT_EQDS_RTO_MIN);
 
-mem_b EqdsSink::_bytes_unacked_threshold = 16384;
-int EqdsSink::TGT_EV_SIZE = 7;
+thread_local mem_b EqdsSink::_bytes_unacked_threshold = 16384;
+thread_local int EqdsSink::TGT_EV_SIZE = 7;
 
 /* if you change _credit_per_pull, fix pktTime in the Pacer too - this assumes one pull per MTU */
-EqdsBasePacket::pull_quanta EqdsSink::_credit_per_pull = 8; // uints of typically 512 bytes
+thread_local EqdsBasePacket::pull_quanta EqdsSink::_credit_per_pull = 8; // uints of typically 512 bytes
 
 /* this default will be overridden from packet size*/
-uint16_t EqdsSrc::_hdr_size = 64;
-uint16_t EqdsSrc::_mss = 4096;
-uint16_t EqdsSrc::_mtu = _mss + _hdr_size;
+thread_local uint16_t EqdsSrc::_hdr_size = 64;
+thread_local uint16_t EqdsSrc::_mss = 4096;
+thread_local uint16_t EqdsSrc::_mtu = _mss + _hdr_size;
 
-bool EqdsSrc::_debug = false; 
+thread_local bool EqdsSrc::_debug = false; 
 
 // uncomment below - commented out for testing
 //#define USE_CWND  
@@ -238,18 +238,132 @@ void EqdsNIC::doNextEvent() {
     }
 }
 
+////////////////////////////////////////////////////////////////
+//  EQDS TX RECORDS
+////////////////////////////////////////////////////////////////
+
+const EqdsTxRecords::seq_t EqdsTxRecords::NO_SEQ;
+
+EqdsTxRecords::EqdsTxRecords() :
+    _ring(16), _lo(0), _hi(0), _oldest(NO_SEQ), _newest(NO_SEQ), _rtx_first(0), _rtx_count(0)
+{
+}
+
+void EqdsTxRecords::add(seq_t seqno, State state, mem_b pkt_size) {
+    seq_t lo = seqno, hi = seqno + 1;
+    if (_lo != _hi) {
+        lo = min(lo, _lo);
+        hi = max(hi, _hi);
+    }
+    if (hi - lo > _ring.size()) {
+        // window has outgrown the ring
+        size_t size = _ring.size();
+        while (size < hi - lo)
+            size *= 2;
+        vector<Record> ring(size);
+        for (seq_t s = _lo; s < _hi; s++)
+            ring[s & (size - 1)] = rec(s);
+        _ring.swap(ring);
+    }
+    _lo = lo;
+    _hi = hi;
+    Record& r = rec(seqno);
+    assert(r.state == FREE);
+    r.state = state;
+    r.pkt_size = pkt_size;
+}
+
+void EqdsTxRecords::release(seq_t seqno) {
+    rec(seqno).state = FREE;
+    while (_lo < _hi && rec(_lo).state == FREE)
+        _lo++;
+    while (_hi > _lo && rec(_hi - 1).state == FREE)
+        _hi--;
+}
+
+void EqdsTxRecords::unlist(seq_t seqno) {
+    Record& r = rec(seqno);
+    assert(r.listed);
+    if (r.prev == NO_SEQ)
+        _oldest = r.next;
+    else
+        rec(r.prev).next = r.next;
+    if (r.next == NO_SEQ)
+        _newest = r.prev;
+    else
+        rec(r.next).prev = r.prev;
+    r.listed = false;
+}
+
+void EqdsTxRecords::addInFlight(seq_t seqno, mem_b pkt_size, simtime_picosec send_time) {
+    add(seqno, IN_FLIGHT, pkt_size);
+    Record& r = rec(seqno);
+    r.send_time = send_time;
+    if (_newest != NO_SEQ && rec(_newest).send_time == send_time) {
+        // another packet went at this time and has the list entry
+        return;
+    }
+    assert(_newest == NO_SEQ || rec(_newest).send_time < send_time);
+    r.listed = true;
+    r.prev = _newest;
+    r.next = NO_SEQ;
+    if (_newest == NO_SEQ)
+        _oldest = seqno;
+    else
+        rec(_newest).next = seqno;
+    _newest = seqno;
+}
+
+void EqdsTxRecords::eraseInFlight(seq_t seqno) {
+    assert(inFlight(seqno));
+    Record& r = rec(seqno);
+    if (r.listed) {
+        unlist(seqno);
+    } else {
+        // drop the list entry of the packet sent at the same time, if it is still there
+        for (seq_t s = _newest; s != NO_SEQ && rec(s).send_time >= r.send_time; s = rec(s).prev) {
+            if (rec(s).send_time == r.send_time) {
+                unlist(s);
+                break;
+            }
+        }
+    }
+    release(seqno);
+}
+
+void EqdsTxRecords::queueRtx(seq_t seqno, mem_b pkt_size) {
+    add(seqno, RTX, pkt_size);
+    if (_rtx_count == 0 || seqno < _rtx_first)
+        _rtx_first = seqno;
+    _rtx_count++;
+}
+
+void EqdsTxRecords::eraseRtx(seq_t seqno) {
+    assert(rtxQueued(seqno));
+    _rtx_count--;
+    release(seqno);
+}
+
+EqdsTxRecords::seq_t EqdsTxRecords::rtxFirst() {
+    assert(_rtx_count > 0);
+    if (_rtx_first < _lo)
+        _rtx_first = _lo;
+    while (rec(_rtx_first).state != RTX)
+        _rtx_first++;
+    return _rtx_first;
+}
+
 ////////////////////////////////////////////////////////////////                                                                   
 //  EQDS SRC
 ////////////////////////////////////////////////////////////////   
 
 EqdsSrc::EqdsSrc(TrafficLogger *trafficLogger, EventList &eventList, EqdsNIC &nic, bool rts) :
-    EventSource(eventList, "eqdsSrc"), _nic(nic), _flow(trafficLogger)
+    EventSource(eventList, "eqdsSrc"), _nic(nic), _rto_timer(*this), _flow(trafficLogger)
 {
     _node_num = _global_node_count++;
     _nodename = "eqdsSrc " + to_string(_node_num);
     _rtx_timeout_pending = false;
     _rtx_timeout = timeInf;
-    _rto_timer_handle = eventlist().nullHandle();
     _rtt = _min_rto;
     _mdev = 0;
     _rto = _min_rto;
@@ -391,20 +505,17 @@ void EqdsSrc::receivePacket(Packet &pkt) {
 }
 
 void EqdsSrc::handleAckno(EqdsDataPacket::seq_t ackno) {
-    auto i = _tx_bitmap.find(ackno);
-    if (i == _tx_bitmap.end())
+    if (!_tx_records.inFlight(ackno))
         return;
-    //mem_b pkt_size = i->second.pkt_size;
-    simtime_picosec send_time = i->second.send_time;
+    simtime_picosec send_time = _tx_records.sendTime(ackno);
 
     //computeRTO(send_time);
 
-    mem_b pkt_size = i->second.pkt_size;
+    mem_b pkt_size = _tx_records.pktSize(ackno);
     _in_flight -= pkt_size;
     assert(_in_flight >= 0);
     if (_debug_src) cout << _nodename << " handleAck " << ackno << " flow " << _flow.str() << endl;
-    _tx_bitmap.erase(i);
-    _send_times.erase(send_time);
+    _tx_records.eraseInFlight(ackno);
 
     if (send_time == _rto_send_time) {
         recalculateRTO();
@@ -413,34 +524,24 @@ void EqdsSrc::handleAckno(EqdsDataPacket::seq_t ackno) {
 
 void EqdsSrc::handleCumulativeAck(EqdsDataPacket::seq_t cum_ack) {
     // free up anything cumulatively acked
-    while (!_rtx_queue.empty()) {
-        auto seqno = _rtx_queue.begin()->first;
-
-        if (seqno < cum_ack) {
-            _rtx_queue.erase(_rtx_queue.begin());
-        }
-        else break;
+    for (auto seqno = _tx_records.lo(); seqno < cum_ack && seqno < _tx_records.hi(); seqno++) {
+        if (_tx_records.rtxQueued(seqno))
+            _tx_records.eraseRtx(seqno);
     }
 
-    auto i = _tx_bitmap.begin();
-    while (i != _tx_bitmap.end()) {
-        auto seqno = i->first;
-        // cumulative ack is next expected packet, not yet received
-        if (seqno >= cum_ack) {
-            // nothing else acked
-            break;
-        }
-        mem_b pkt_size = i->second.pkt_size;
-        simtime_picosec send_time = i->second.send_time;
+    // cumulative ack is next expected packet, not yet received
+    for (auto seqno = _tx_records.lo(); seqno < cum_ack && seqno < _tx_records.hi(); seqno++) {
+        if (!_tx_records.inFlight(seqno))
+            continue;
+        mem_b pkt_size = _tx_records.pktSize(seqno);
+        simtime_picosec send_time = _tx_records.sendTime(seqno);
 
         //computeRTO(send_time);
 
         _in_flight -= pkt_size;
         assert(_in_flight >= 0);
         if (_debug_src) cout << _nodename << " handleCumAck " << seqno << " flow " << _flow.str() << endl;
-        _tx_bitmap.erase(i);
-        i = _tx_bitmap.begin();
-        _send_times.erase(send_time);
+        _tx_records.eraseInFlight(seqno);
         if (send_time == _rto_send_time) {
             recalculateRTO();
         }
@@ -531,8 +632,7 @@ void EqdsSrc::processNack(const EqdsNackPacket& pkt) {
     //bool ecn_echo = pkt.ecn_echo();
 
     // move the packet to the RTX queue
-    auto i = _tx_bitmap.find(nacked_seqno);
-    if (i == _tx_bitmap.end()) {
+    if (!_tx_records.inFlight(nacked_seqno)) {
         if (_debug_src) 
             cout << "Didn't find NACKed packet in _active_packets flow " << _flow.str() << endl;
 
@@ -544,26 +644,27 @@ void EqdsSrc::processNack(const EqdsNackPacket& pkt) {
         // this can happen when the NACK arrives later than a cumulative ACK covering the NACKed packet.
         //return;
     }
-    mem_b pkt_size = i->second.pkt_size;
+    mem_b pkt_size = _tx_records.pktSize(nacked_seqno);
     
     assert(pkt_size >= _hdr_size); // check we're not seeing NACKed RTS packets.
     if (pkt_size == _hdr_size){
         _stats.rts_nacks ++;
     } 
     
-    auto seqno = i->first;
-    simtime_picosec send_time = i->second.send_time;
+    auto seqno = nacked_seqno;
+    simtime_picosec send_time = _tx_records.sendTime(seqno);
 
     //computeDynamicRTO(send_time);
 
     if (_debug_src) cout << _nodename << " erasing send record, seqno: " << seqno << " flow " << _flow.str() << endl;
-    _tx_bitmap.erase(i);
-    assert(_tx_bitmap.find(seqno) == _tx_bitmap.end()); // xxx remove when working
+    _tx_records.eraseInFlight(seqno);
 
     _in_flight -= pkt_size;
     assert(_in_flight >= 0);
     
-    _send_times.erase(send_time);
+    // stop speculating before queueing the retransmission, which may
+    // send it straight away, and must not do so on speculative credit
+    stopSpeculating();
     queueForRtx(seqno, pkt_size);
 
     if (send_time == _rto_send_time) {
@@ -571,7 +672,6 @@ void EqdsSrc::processNack(const EqdsNackPacket& pkt) {
     }
 
     penalizePath(ev, 1);
-    stopSpeculating();
     sendIfPermitted();
 }
 
@@ -587,7 +687,7 @@ void EqdsSrc::processPull(const EqdsPullPacket& pkt) {
 
 void EqdsSrc::doNextEvent() {
     // a timer event fired.  Can either be a timeout, or the timed start of the flow.
-    if (_rtx_timeout_pending) {
+    if (_rto_timer.firing()) {
         clearRTO();
         assert(_logger == 0);
 
@@ -649,7 +749,9 @@ void EqdsSrc::stopSpeculating() {
     // we just got an ack, nack or pull.  We need to stop speculating
 
     _speculating = false;
-    if (_backlog > 0 && _state == SPECULATING) {
+    // commit even if everything has already been sent speculatively:
+    // anything we now retransmit has to be paid for with pull credit
+    if (_state == SPECULATING) {
         _state = COMMITTED;
     } 
 }
@@ -701,7 +803,7 @@ void EqdsSrc::sendIfPermitted() {
 
     // how large will the packet be?
     mem_b pkt_size = 0;
-    if (_rtx_queue.empty()) {
+    if (_tx_records.rtxEmpty()) {
         if (_backlog == 0) {
             // nothing to retransmit, and no backlog.  Nothing to do here.
             if (_credit_pull > 0) {
@@ -718,7 +820,7 @@ void EqdsSrc::sendIfPermitted() {
         }
         pkt_size = payload_size + _hdr_size;
     } else {
-        pkt_size = _rtx_queue.begin()->second;
+        pkt_size = _tx_records.pktSize(_tx_records.rtxFirst());
     }
 
 #ifdef USE_CWND
@@ -754,7 +856,7 @@ void EqdsSrc::sendIfPermitted() {
 // we will likely be sending something (sendNewPacket can return 0 if
 // we only had speculative credit we're not allowed to use though)
 mem_b EqdsSrc::sendPacket() {
-    if (_rtx_queue.empty()) {
+    if (_tx_records.rtxEmpty()) {
         return sendNewPacket();
     } else {
         return sendRtxPacket();
@@ -773,8 +875,7 @@ void EqdsSrc::startRTO(simtime_picosec send_time) {
        
         if (_debug) cout << "Start timer at " << timeAsUs(eventlist().now()) << " source " << _flow.str() << " expires at " << timeAsUs(_rtx_timeout) << " flow " << _flow.str() << endl;
 
-        _rto_timer_handle = eventlist().sourceIsPendingGetHandle(*this, _rtx_timeout);
-        if (_rto_timer_handle == eventlist().nullHandle()) {
+        if (!_rto_timer.set(_rtx_timeout)) {
             // this happens when _rtx_timeout is past the configured simulation end time.
             _rtx_timeout_pending = false;
             if (_debug) cout << "Cancel timer because too late for flow " << _flow.str() << endl;
@@ -791,7 +892,6 @@ void EqdsSrc::startRTO(simtime_picosec send_time) {
 
 void EqdsSrc::clearRTO() {
     // clear the state
-    _rto_timer_handle = eventlist().nullHandle();
     _rtx_timeout_pending = false;
 
     if (_debug) cout << "Clear RTO " << timeAsUs(eventlist().now()) << " source " << _flow.str() << endl;
@@ -800,7 +900,7 @@ void EqdsSrc::clearRTO() {
 void EqdsSrc::cancelRTO() {
     if (_rtx_timeout_pending) {
         // cancel the timer
-        eventlist().cancelPendingSourceByHandle(*this, _rto_timer_handle);
+        _rto_timer.cancel();
         clearRTO();
     }
 }
@@ -889,9 +989,9 @@ mem_b EqdsSrc::sendNewPacket() {
 }
 
 mem_b EqdsSrc::sendRtxPacket() {
-    assert(!_rtx_queue.empty());
-    auto seq_no = _rtx_queue.begin()->first;
-    mem_b full_pkt_size = _rtx_queue.begin()->second;
+    assert(!_tx_records.rtxEmpty());
+    auto seq_no = _tx_records.rtxFirst();
+    mem_b full_pkt_size = _tx_records.pktSize(seq_no);
     bool speculative = false;
     bool can_send = spendCredit(full_pkt_size, speculative);
     assert(!speculative); // I don't think this can happen, but remove this assert if we decide it can
@@ -900,7 +1000,7 @@ mem_b EqdsSrc::sendRtxPacket() {
         return 0;
     }
     
-    _rtx_queue.erase(_rtx_queue.begin());
+    _tx_records.eraseRtx(seq_no);
     _in_flight += full_pkt_size;
     auto *p = EqdsDataPacket::newpkt(_flow, *_route, seq_no, full_pkt_size,
                                      EqdsDataPacket::DATA_RTX, _pull_target, /*unordered=*/true, _dstaddr);
@@ -945,21 +1045,18 @@ void EqdsSrc::sendRTS() {
 void EqdsSrc::createSendRecord(EqdsBasePacket::seq_t seqno, mem_b full_pkt_size) {
     //assert(full_pkt_size > 64);
     if (_debug_src) cout << _nodename << " createSendRecord seqno: " << seqno << " size " << full_pkt_size << endl;
-    assert(_tx_bitmap.find(seqno) == _tx_bitmap.end());
-    _tx_bitmap.emplace(seqno, sendRecord(full_pkt_size, eventlist().now()));
-    _send_times.emplace(eventlist().now(), seqno);
+    _tx_records.addInFlight(seqno, full_pkt_size, eventlist().now());
 }
 
 void EqdsSrc::queueForRtx(EqdsBasePacket::seq_t seqno, mem_b pkt_size) {
-    assert(_rtx_queue.find(seqno) == _rtx_queue.end());
-    _rtx_queue.emplace(seqno, pkt_size);
+    _tx_records.queueRtx(seqno, pkt_size);
     sendIfPermitted();
 }
 
 void EqdsSrc::timeToSend() {
     if (_debug_src) cout << "timeToSend" << " flow " << _flow.str() << " at " << timeAsUs(eventlist().now()) << endl;
 
-    if (_unsent == 0 && _rtx_queue.empty()){
+    if (_unsent == 0 && _tx_records.rtxEmpty()){
         _nic.cantSend(*this);
         return; 
     }
@@ -975,7 +1072,7 @@ void EqdsSrc::timeToSend() {
 
     mem_b full_pkt_size;
     // how much do we want to send?
-    if (_rtx_queue.empty()) {
+    if (_tx_records.rtxEmpty()) {
         // we want to send new data
         mem_b payload_size = _mss;
         if (_unsent < payload_size) {
@@ -985,7 +1082,7 @@ void EqdsSrc::timeToSend() {
         full_pkt_size = payload_size + _hdr_size;
     } else {
         // we want to retransmit
-        full_pkt_size = _rtx_queue.begin()->second;
+        full_pkt_size = _tx_records.pktSize(_tx_records.rtxFirst());
     }
 #ifdef USE_CWND
     if (_cwnd < full_pkt_size) {
@@ -1004,7 +1101,7 @@ void EqdsSrc::timeToSend() {
 
     // OK, we're probably good to send
     mem_b bytes_sent = 0;
-    if (_rtx_queue.empty()) {
+    if (_tx_records.rtxEmpty()) {
         bytes_sent = sendNewPacket();
     } else {
         bytes_sent = sendRtxPacket();
@@ -1028,7 +1125,7 @@ void EqdsSrc::timeToSend() {
         return;
     }
 
-    if (_unsent == 0 && _rtx_queue.empty()) {
+    if (_unsent == 0 && _tx_records.rtxEmpty()) {
         // we're done - nothing more to send.
         assert(_backlog == 0);
         return;
@@ -1047,11 +1144,11 @@ void EqdsSrc::recalculateRTO() {
     // we're no longer waiting for the packet we set the timer for -
     // figure out what the timer should be now.
     cancelRTO();
-    if (_send_times.empty()) {
+    if (_tx_records.noSendTimes()) {
         // nothing left that we're waiting for
         return;
     }
-    auto earliest_send_time = _send_times.begin()->first;
+    auto earliest_send_time = _tx_records.sendTime(_tx_records.oldest());
     startRTO(earliest_send_time);
 }
 
@@ -1059,22 +1156,17 @@ void EqdsSrc::rtxTimerExpired() {
     assert(eventlist().now() == _rtx_timeout);
     clearRTO();
 
-    auto first_entry = _send_times.begin();
-    assert(first_entry != _send_times.end());
-    auto seqno = first_entry->second;
-
-    auto send_record = _tx_bitmap.find(seqno);
-    assert(send_record != _tx_bitmap.end());
-    mem_b pkt_size = send_record->second.pkt_size;
+    assert(!_tx_records.noSendTimes());
+    auto seqno = _tx_records.oldest();
+    mem_b pkt_size = _tx_records.pktSize(seqno);
 
     //update flightsize?
 
-    _send_times.erase(first_entry);
     if (_debug_src) cout << _nodename << " rtx timer expired for " << seqno << " flow " << _flow.str() << endl;
-    _tx_bitmap.erase(send_record);
+    _tx_records.eraseInFlight(seqno);
     recalculateRTO();
 
-    if (!_rtx_queue.empty()) {
+    if (!_tx_records.rtxEmpty()) {
         // there's already a queue, so clearly we shouldn't just
         // resend right now.  But send an RTS (no more than once per
         // RTT) to cover the case where the receiver doesn't know
@@ -33,6 +33,71 @@ class ModularVector {
 };
 
 static const unsigned eqdsMaxInFlightPkts = 1 << 12;
+
+// EqdsTxRecords holds the sender's per-packet state: packets in
+// flight, with their size and send time, and packets waiting to be
+// retransmitted.  Records are indexed by seqno in a ring that covers
+// the seqnos from the oldest unacked packet to the highest sent, so
+// lookups need no search and no allocation once the ring has grown to
+// fit the window.  In-flight packets are also on a list in the order
+// they were sent, for the RTO.
+//
+// The list keeps the quirk of the map from send time to seqno that it
+// replaces: only the first packet sent at a given time is on it, and
+// erasing any packet removes whichever listed packet has its send time.
+class EqdsTxRecords {
+public:
+    typedef EqdsBasePacket::seq_t seq_t;
+    static const seq_t NO_SEQ = UINT64_MAX;
+
+    EqdsTxRecords();
+
+    // packets in flight
+    bool inFlight(seq_t seqno) const {return inWindow(seqno) && rec(seqno).state == IN_FLIGHT;}
+    mem_b pktSize(seq_t seqno) const {return rec(seqno).pkt_size;}
+    simtime_picosec sendTime(seq_t seqno) const {return rec(seqno).send_time;}
+    void addInFlight(seq_t seqno, mem_b pkt_size, simtime_picosec send_time);
+    void eraseInFlight(seq_t seqno);
+
+    // the in-flight packet at the head of the send time list
+    bool noSendTimes() const {return _oldest == NO_SEQ;}
+    seq_t oldest() const {return _oldest;}
+
+    // packets queued for retransmission, lowest seqno first
+    bool rtxEmpty() const {return _rtx_count == 0;}
+    bool rtxQueued(seq_t seqno) const {return inWindow(seqno) && rec(seqno).state == RTX;}
+    void queueRtx(seq_t seqno, mem_b pkt_size);
+    void eraseRtx(seq_t seqno);
+    seq_t rtxFirst();
+
+    // all records lie in [lo(), hi())
+    seq_t lo() const {return _lo;}
+    seq_t hi() const {return _hi;}
+
+private:
+    enum State {FREE, IN_FLIGHT, RTX};
+    struct Record {
+        Record() : state(FREE), listed(false), pkt_size(0), send_time(0), prev(NO_SEQ), next(NO_SEQ) {}
+        State state;
+        bool listed;        // on the send time list
+        mem_b pkt_size;
+        simtime_picosec send_time;
+        seq_t prev, next;   // send time list
+    };
+    bool inWindow(seq_t seqno) const {return seqno >= _lo && seqno < _hi;}
+    Record& rec(seq_t seqno) {return _ring[seqno & (_ring.size() - 1)];}
+    const Record& rec(seq_t seqno) const {return _ring[seqno & (_ring.size() - 1)];}
+    void add(seq_t seqno, State state, mem_b pkt_size);
+    void release(seq_t seqno);
+    void unlist(seq_t seqno);
+
+    vector<Record> _ring;   // power of 2 size
+    seq_t _lo, _hi;
+    seq_t _oldest, _newest; // send time list
+    seq_t _rtx_first;       // no rtx record below this
+    uint32_t _rtx_count;
+};
+
 class EqdsPullPacer;
 class EqdsSink;
 class EqdsSrc;
@@ -97,12 +162,12 @@ class EqdsSrc : public EventSource, public PacketSink, public TriggerTarget {
     // called from a trigger to start the flow.
     virtual void activate();
 
-    static uint32_t _path_entropy_size; // now many paths do we include in our path set
-    static int _global_node_count;
-    static simtime_picosec _min_rto;
-    static uint16_t _hdr_size;
-    static uint16_t _mss; // does not include header
-    static uint16_t _mtu; // does include header
+    static thread_local uint32_t _path_entropy_size; // now many paths do we include in our path set
+    static thread_local int _global_node_count;
+    static thread_local simtime_picosec _min_rto;
+    static thread_local uint16_t _hdr_size;
+    static thread_local uint16_t _mss; // does not include header
+    static thread_local uint16_t _mtu; // does include header
     
     virtual const string& nodename() { return _nodename; }
     inline void setFlowId(flowid_t flow_id) { _flow.set_flowid(flow_id);}
@@ -119,19 +184,12 @@ class EqdsSrc : public EventSource, public PacketSink, public TriggerTarget {
     uint32_t _rts_packets_sent;
     uint32_t _bounces_received;
  
-    static bool _debug;
+    static thread_local bool _debug;
     bool _debug_src;
     bool debug() const {return _debug_src;}
    
  private:
     EqdsNIC& _nic;
-    struct sendRecord {
-        // need a constructor to be able to put this in a map
-        sendRecord(mem_b psize, simtime_picosec stime) :
-            pkt_size(psize), send_time(stime) {};
-        mem_b pkt_size;
-        simtime_picosec send_time;
-    };
     EqdsLogger* _logger;
     TrafficLogger* _pktlogger;
     FlowEventLogger* _flow_logger;
@@ -140,11 +198,8 @@ class EqdsSrc : public EventSource, public PacketSink, public TriggerTarget {
     // TODO in-flight packet storage - acks and sacks clear it
     //list<EqdsDataPacket*> _activePackets;
 
-    // we need to access the in_flight packet list quickly by sequence number, or by send time.
-    map <EqdsDataPacket::seq_t, sendRecord> _tx_bitmap;
-    map <simtime_picosec, EqdsDataPacket::seq_t> _send_times;
-    
-    map <EqdsDataPacket::seq_t, mem_b> _rtx_queue;
+    // we need to access the in_flight packets quickly by sequence number, or by send time.
+    EqdsTxRecords _tx_records;
     void startFlow();
     bool isSpeculative();
     uint16_t nextEntropy();
@@ -162,10 +217,7 @@ class EqdsSrc : public EventSource, public PacketSink, public TriggerTarget {
 
     // not used, except for debugging timer issues
     void checkRTO() {
-        if (_rtx_timeout_pending )
-            assert(_rto_timer_handle != eventlist().nullHandle());
-        else
-            assert(_rto_timer_handle == eventlist().nullHandle());
+        assert(_rtx_timeout_pending == _rto_timer.armed());
     }
     
     void rtxTimerExpired();
@@ -215,7 +267,7 @@ class EqdsSrc : public EventSource, public PacketSink, public TriggerTarget {
     simtime_picosec _rto_send_time; // when we sent the oldest packet that the RTO is waiting on.
     simtime_picosec _rtx_timeout; // when the RTO is currently set to expire
     simtime_picosec _last_rts;  // time when we last sent an RTS (or zero if never sent)
-    EventList::Handle _rto_timer_handle;
+    EventTimer _rto_timer;
 
     simtime_picosec _last_credit_move;
 
@@ -298,9 +350,9 @@ class EqdsSink : public PacketSink, public DataReceiver {
     EqdsSrc* getSrc(){ return _src;}
     uint32_t getMaxCwnd() { return _src->maxWnd();};
 
-    static mem_b _bytes_unacked_threshold;
-    static EqdsBasePacket::pull_quanta _credit_per_pull;
-    static int TGT_EV_SIZE;
+    static thread_local mem_b _bytes_unacked_threshold;
+    static thread_local EqdsBasePacket::pull_quanta _credit_per_pull;
+    static thread_local int TGT_EV_SIZE;
 
     // for sink logger
     inline mem_b total_received() const {return _stats.bytes_received;}
@@ -94,6 +94,8 @@ public:
 
 
     void free() {_packetdb.freePacket(this);}
+    // pre-allocate room for count packets in flight
+    static void reserve(size_t count) {_packetdb.reserve(count);}
     virtual ~EqdsDataPacket(){}
 
     inline seq_t epsn() const {return _epsn;}
@@ -138,7 +140,7 @@ protected:
     //trim information, need to see if this stays here or goes to separate header.
     int32_t _trim_hop;
     packet_direction _trim_direction;
-    static PacketDB<EqdsDataPacket> _packetdb;
+    static thread_local PacketDB<EqdsDataPacket> _packetdb;
 };
 
 class EqdsPullPacket : public EqdsBasePacket {
@@ -182,7 +184,7 @@ protected:
 
     bool _rnr;
 
-    static PacketDB<EqdsPullPacket> _packetdb;
+    static thread_local PacketDB<EqdsPullPacket> _packetdb;
 };
 
 class EqdsAckPacket : public EqdsBasePacket {
@@ -236,7 +238,7 @@ protected:
     bool _ecn_echo;
     simtime_picosec _residency_time;
 
-    static PacketDB<EqdsAckPacket> _packetdb;
+    static thread_local PacketDB<EqdsAckPacket> _packetdb;
 };
 
 class EqdsNackPacket : public EqdsBasePacket {
@@ -280,7 +282,7 @@ protected:
     uint16_t _ev;
     bool _rnr;
     bool _ecn_echo;
-    static PacketDB<EqdsNackPacket> _packetdb;
+    static thread_local PacketDB<EqdsNackPacket> _packetdb;
 };
 
 class EqdsRtsPacket : public EqdsDataPacket {
@@ -321,7 +323,7 @@ protected:
     pull_quanta _retx_backlog;
     bool _to;
 
-    static PacketDB<EqdsRtsPacket> _packetdb;
+    static thread_local PacketDB<EqdsRtsPacket> _packetdb;
 };
 
 #endif
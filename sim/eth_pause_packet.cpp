@@ -1,4 +1,6 @@
 #include "eth_pause_packet.h"
 
-PacketDB<EthPausePacket> EthPausePacket::_packetdb;
+thread_local PacketDB<EthPausePacket> EthPausePacket::_packetdb;
+thread_local uint32_t EthPausePacket::_classes = 1;
+thread_local uint64_t EthPausePacket::_frames = 0;
 
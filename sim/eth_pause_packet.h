@@ -12,34 +12,66 @@
 // rather you use the static method newpkt() which knows to reuse old packets from the database.
 
 #define PAUSESIZE 64
+#define PFC_CLASSES 8
 
 class EthPausePacket : public Packet {
  public:
-    //do not implement PFC; one priority class alone
+    // A PFC (802.1Qbb) frame: a class-enable vector and a pause time
+    // for each enabled class.  Classes whose bit is clear are left as
+    // they were.  With one class in use this is plain 802.3x PAUSE.
 
-    inline static EthPausePacket* newpkt(uint32_t sleep, uint32_t senderid){
+    inline static EthPausePacket* newpkt(uint32_t senderid){
         EthPausePacket* p = _packetdb.allocPacket();
         p->_type = ETH_PAUSE;
-        p->_sleepTime = sleep;
+        p->_class_enable = 0;
         p->_senderID = senderid;
+        p->_port = UINT32_MAX;
         p->_size = PAUSESIZE;
         p->_flow = &(Packet::_defaultFlow);
+        _frames++;
+        return p;
+    }
+
+    inline static EthPausePacket* newpkt(uint32_t pclass, uint32_t sleep, uint32_t senderid){
+        EthPausePacket* p = newpkt(senderid);
+        p->set_class(pclass, sleep);
         return p;
     }
   
     virtual PktPriority priority() const {return Packet::PRIO_NONE;} // This shouldn't encounter a priority queue
-    virtual uint32_t getPausedClass() {return _pausedClass;}
-    virtual void setPausedClass(uint32_t pc) {_pausedClass = pc;}
     void free() {_packetdb.freePacket(this);}
     virtual ~EthPausePacket(){}
 
-    inline uint32_t sleepTime() const {return _sleepTime;}
+    inline void set_class(uint32_t pclass, uint32_t sleep) {
+        assert(pclass < PFC_CLASSES);
+        _class_enable |= 1 << pclass;
+        _sleepTime[pclass] = sleep;
+    }
+    inline bool class_enabled(uint32_t pclass) const {return _class_enable & (1 << pclass);}
+    inline uint8_t class_enable() const {return _class_enable;}
+    inline uint32_t sleepTime(uint32_t pclass) const {return _sleepTime[pclass];}
     inline uint32_t senderID() const {return _senderID;}
+
+    // the port on the receiving switch that feeds the sender, when the
+    // sender knows it (see Switch::configureLossless)
+    inline uint32_t port() const {return _port;}
+    inline void set_port(uint32_t port) {_port = port;}
+
+    // the PFC class that carries packets of priority prio: one class
+    // per priority while there are enough, and the top class carries
+    // the rest.  With the default of one class everything is class 0.
+    static uint32_t pfc_class(PktPriority prio) {
+        return (uint32_t)prio < _classes ? (uint32_t)prio : _classes - 1;
+    }
+
+    static thread_local uint32_t _classes;   // PFC classes in use, at most PFC_CLASSES
+    static thread_local uint64_t _frames;    // frames generated, for reporting
  protected:
-    uint32_t _sleepTime;
+    uint8_t _class_enable;
+    uint32_t _sleepTime[PFC_CLASSES];
     uint32_t _senderID;
-    static PacketDB<EthPausePacket> _packetdb;
-    uint32_t _pausedClass{0};
+    uint32_t _port;
+    static thread_local PacketDB<EthPausePacket> _packetdb;
 };
 
 #endif
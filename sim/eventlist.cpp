@@ -2,24 +2,32 @@
 
 #include "eventlist.h"
 #include "trigger.h"
+#ifdef PROFILE_EVENTS
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <cxxabi.h>
+#endif
 
-simtime_picosec EventList::_endtime = 0;
-simtime_picosec EventList::_lasteventtime = 0;
-EventList::pendingsources_t EventList::_pendingsources;
-vector <TriggerTarget*> EventList::_pending_triggers;
-int EventList::_instanceCount = 0;
-EventList* EventList::_theEventList = nullptr;
+thread_local EventList* EventList::_theEventList = nullptr;
 
 EventList::EventList()
+    : _endtime(0), _lasteventtime(0), _current(EventQueue::NULL_HANDLE), _event_count(0)
 {
-    if (EventList::_instanceCount != 0) 
-    {
-        std::cerr << "There should be only one instance of EventList. Abort." << std::endl;
-        abort();
-    }
+    if (EventList::_theEventList == nullptr)
+        EventList::_theEventList = this;
+    _pendingsources = new HeapEventQueue();
+}
 
-    EventList::_theEventList = this;
-    EventList::_instanceCount += 1;
+EventList::~EventList()
+{
+#ifdef PROFILE_EVENTS
+    if (_event_count > 0)
+        _profile.print(cout);
+#endif
+    if (EventList::_theEventList == this)
+        EventList::_theEventList = nullptr;
+    delete _pendingsources;
 }
 
 EventList& 
@@ -32,10 +40,37 @@ EventList::getTheEventList()
     return *EventList::_theEventList;
 }
 
+void
+EventList::setScheduler(scheduler_type type)
+{
+    EventQueue* q = NULL;
+    switch (type) {
+    case HEAP:
+        q = new HeapEventQueue();
+        break;
+    case CALENDAR:
+        q = new CalendarEventQueue();
+        break;
+    }
+    // move anything already scheduled (e.g. the Clock) across in
+    // order, so same-time ordering is kept.  Handles obtained from the
+    // old scheduler are no longer valid.
+    if (_pendingsources) {
+        while (!_pendingsources->empty()) {
+            simtime_picosec when;
+            Handle handle;
+            EventSource* src = _pendingsources->pop(when, handle);
+            q->insert(when, src);
+        }
+        delete _pendingsources;
+    }
+    _pendingsources = q;
+}
+
 void
 EventList::setEndtime(simtime_picosec endtime)
 {
-    EventList::_endtime = endtime;
+    _endtime = endtime;
 }
 
 bool
@@ -46,18 +81,32 @@ EventList::doNextEvent()
     if (!_pending_triggers.empty()) {
         TriggerTarget *target = _pending_triggers.back();
         _pending_triggers.pop_back();
+#ifdef PROFILE_EVENTS
+        _profile.trigger(*target);
+#endif
         target->activate();
         return true;
     }
     
-    if (_pendingsources.empty())
+    if (_pendingsources->empty())
         return false;
     
-    simtime_picosec nexteventtime = _pendingsources.begin()->first;
-    EventSource* nextsource = _pendingsources.begin()->second;
-    _pendingsources.erase(_pendingsources.begin());
+    simtime_picosec nexteventtime;
+    EventSource* nextsource = _pendingsources->pop(nexteventtime, _current);
     assert(nexteventtime >= _lasteventtime);
     _lasteventtime = nexteventtime; // set this before calling doNextEvent, so that this::now() is accurate
+    _event_count++;
+#ifdef PROFILE_EVENTS
+    EventProfile::Entry* entry = _profile.entry(*nextsource);
+    entry->events++;
+    if (_profile.sample(_pendingsources->size() + 1)) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        nextsource->doNextEvent();
+        entry->sampled++;
+        entry->ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        return true;
+    }
+#endif
     nextsource->doNextEvent();
     return true;
 }
@@ -68,7 +117,7 @@ EventList::sourceIsPending(EventSource &src, simtime_picosec when)
 {
     assert(when>=now());
     if (_endtime==0 || when<_endtime)
-        _pendingsources.insert(make_pair(when,&src));
+        _pendingsources->insert(when, &src);
 }
 
 EventList::Handle
@@ -76,10 +125,10 @@ EventList::sourceIsPendingGetHandle(EventSource &src, simtime_picosec when)
 {
     assert(when>=now());
     if (_endtime==0 || when<_endtime) {
-        EventList::Handle handle =_pendingsources.insert(make_pair(when,&src));
+        EventList::Handle handle = _pendingsources->insert(when, &src);
         return handle;
     }
-    return _pendingsources.end();
+    return nullHandle();
 }
 
 void
@@ -89,42 +138,29 @@ EventList::triggerIsPending(TriggerTarget &target) {
 
 void 
 EventList::cancelPendingSource(EventSource &src) {
-    pendingsources_t::iterator i = _pendingsources.begin();
-    while (i != _pendingsources.end()) {
-        if (i->second == &src) {
-            _pendingsources.erase(i);
-            return;
-        }
-        i++;
-    }
+    Handle handle = _pendingsources->find(&src);
+    if (handle != nullHandle())
+        _pendingsources->erase(handle);
 }
 
 void 
 EventList::cancelPendingSourceByTime(EventSource &src, simtime_picosec when) {
-    // fast cancellation of a timer - the timer MUST exist
-    // this should normally be fast, except if we have a lot of events with exactly the same time value
-
-    auto range = _pendingsources.equal_range(when);
-
-    for (auto i = range.first; i != range.second; ++i) {
-        if (i->second == &src) {
-            _pendingsources.erase(i);
-            return;
-        }
-    }
-    abort();
+    Handle handle = _pendingsources->find(&src, when);
+    if (handle != nullHandle())
+        _pendingsources->erase(handle);
 }
 
 
 void EventList::cancelPendingSourceByHandle(EventSource &src, EventList::Handle handle) {
-    // If we're cancelling timers often, cancel them by handle.  But
-    // be careful - cancelling a handle that has already been
-    // cancelled or has already expired is undefined behaviour
-    assert(handle->second == &src);
-    assert(handle != _pendingsources.end());
-    assert(handle->first >= now());
+    // If we're cancelling timers often, cancel them by handle.  The
+    // handle carries a generation count, so one that has already
+    // expired or been cancelled is recognised and ignored.
+    if (!_pendingsources->pending(handle))
+        return;
+    assert(_pendingsources->source(handle) == &src);
+    assert(_pendingsources->when(handle) >= now());
     
-    _pendingsources.erase(handle);
+    _pendingsources->erase(handle);
 }
 
 void 
@@ -136,3 +172,93 @@ EventList::reschedulePendingSource(EventSource &src, simtime_picosec when) {
 EventSource::EventSource(const string& name) : EventSource(EventList::getTheEventList(), name) 
 {
 }
+
+#ifdef PROFILE_EVENTS
+thread_local uint32_t EventProfile::_sample_period = 16;
+
+EventProfile::EventProfile()
+    : _countdown(0), _max_pending(0), _pending_sum(0), _pending_samples(0)
+{
+}
+
+EventProfile::~EventProfile()
+{
+    for (auto& i : _sources)
+        delete i.second;
+    for (auto& i : _triggers)
+        delete i.second;
+}
+
+EventProfile::Entry*
+EventProfile::lookup(unordered_map<type_index, Entry*>& table, const type_info& type) {
+    auto i = table.find(type_index(type));
+    if (i != table.end())
+        return i->second;
+    int status;
+    char* name = abi::__cxa_demangle(type.name(), NULL, NULL, &status);
+    Entry* entry = new Entry(status == 0 ? name : type.name());
+    free(name);
+    table[type_index(type)] = entry;
+    return entry;
+}
+
+EventProfile::Entry*
+EventProfile::entry(EventSource& src) {
+    if (!src._profile_entry)
+        src._profile_entry = lookup(_sources, typeid(src));
+    return src._profile_entry;
+}
+
+void
+EventProfile::trigger(TriggerTarget& target) {
+    lookup(_triggers, typeid(target))->events++;
+}
+
+static bool by_events(const EventProfile::Entry* a, const EventProfile::Entry* b) {
+    return a->events > b->events;
+}
+
+void
+EventProfile::print(ostream& out) const {
+    // estimate each class's wall time from its timed events
+    vector<const Entry*> entries;
+    vector<double> est_ms;
+    uint64_t events = 0;
+    double total_ms = 0;
+    for (auto& i : _sources)
+        entries.push_back(i.second);
+    sort(entries.begin(), entries.end(), by_events);
+    for (const Entry* e : entries) {
+        double ms = e->sampled ? e->ns * 1e-6 * e->events / e->sampled : 0;
+        est_ms.push_back(ms);
+        events += e->events;
+        total_ms += ms;
+    }
+
+    ios_base::fmtflags flags = out.flags();
+    out << fixed << setprecision(1);
+    out << "Event profile: " << events << " events, 1 in " << _sample_period << " timed, estimated "
+        << total_ms << " ms in event handlers" << endl;
+    out << "Pending events: max " << _max_pending << " mean "
+        << (_pending_samples ? (double)_pending_sum / _pending_samples : 0) << endl;
+    out << left << setw(40) << "source" << right << setw(14) << "events" << setw(8) << "%"
+        << setw(12) << "est_ms" << setw(8) << "%" << setw(12) << "ns/event" << endl;
+    for (size_t i = 0; i < entries.size(); i++) {
+        const Entry* e = entries[i];
+        out << left << setw(40) << e->type << right << setw(14) << e->events
+            << setw(8) << 100.0 * e->events / events
+            << setw(12) << est_ms[i] << setw(8) << (total_ms > 0 ? 100.0 * est_ms[i] / total_ms : 0)
+            << setw(12) << (e->sampled ? (double)e->ns / e->sampled : 0) << endl;
+    }
+    if (!_triggers.empty()) {
+        out << left << setw(40) << "trigger target" << right << setw(14) << "triggers" << endl;
+        entries.clear();
+        for (auto& i : _triggers)
+            entries.push_back(i.second);
+        sort(entries.begin(), entries.end(), by_events);
+        for (const Entry* e : entries)
+            out << left << setw(40) << e->type << right << setw(14) << e->events << endl;
+    }
+    out.flags(flags);
+}
+#endif
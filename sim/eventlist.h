@@ -4,13 +4,69 @@
 
 #include <map>
 #include <sys/time.h>
+#ifdef PROFILE_EVENTS
+#include <typeindex>
+#include <unordered_map>
+#endif
 #include "config.h"
 #include "loggertypes.h"
+#include "eventqueue.h"
 
 class EventList;
 class TriggerTarget;
+class EventSource;
+
+#ifdef PROFILE_EVENTS
+// Self-profiling of the simulator, compiled in with -DPROFILE_EVENTS
+// (make PROFILE_EVENTS=1).  Every event and trigger is counted by the
+// class of its target, and one event in every sample period is timed
+// to estimate where the wall-clock time goes.  The pending event count
+// is tracked too.  The EventList prints the summary when it is
+// destroyed, so a program's global EventList reports at exit.
+class EventProfile {
+public:
+    struct Entry {
+        Entry(const string& t) : type(t), events(0), sampled(0), ns(0) {}
+        string type;
+        uint64_t events;
+        uint64_t sampled;   // events that were timed
+        uint64_t ns;        // wall time of the timed events
+    };
+    EventProfile();
+    ~EventProfile();
+    static void setSamplePeriod(uint32_t period) {_sample_period = period;}
+    // the entry for src's class, cached in the source after the first lookup
+    Entry* entry(EventSource& src);
+    void trigger(TriggerTarget& target);
+    // counts an event, and returns true if this one should be timed
+    bool sample(size_t pending) {
+        if (pending > _max_pending)
+            _max_pending = pending;
+        if (++_countdown < _sample_period)
+            return false;
+        _countdown = 0;
+        _pending_sum += pending;
+        _pending_samples++;
+        return true;
+    }
+    void print(ostream& out) const;
+private:
+    Entry* lookup(unordered_map<type_index, Entry*>& table, const type_info& type);
+    unordered_map<type_index, Entry*> _sources;
+    unordered_map<type_index, Entry*> _triggers;
+    uint32_t _countdown;
+    size_t _max_pending;
+    uint64_t _pending_sum;
+    uint64_t _pending_samples;
+    static thread_local uint32_t _sample_period;
+};
+#endif
 
 class EventSource : public Logged {
+    friend class EventQueue;
+#ifdef PROFILE_EVENTS
+    friend class EventProfile;
+#endif
 public:
     EventSource(EventList& eventlist, const string& name) : Logged(name), _eventlist(eventlist) {};
     EventSource(const string& name);
@@ -19,27 +75,64 @@ public:
     inline EventList& eventlist() const {return _eventlist;}
 protected:
     EventList& _eventlist;
+private:
+    // head of the EventQueue's list of events pending for this source
+    EventQueue::Index _pending_events{EventQueue::NULL_INDEX};
+#ifdef PROFILE_EVENTS
+    EventProfile::Entry* _profile_entry{nullptr};
+#endif
 };
 
+// Each simulation has its own EventList, and EventLists are
+// independent of one another, so several simulations can be built
+// and run in one process.  The first EventList constructed on a
+// thread is that thread's default, which is what
+// EventSource(const string&) and getTheEventList() use.
+//
+// The rest of a simulation's state that lives in statics is
+// thread_local: the packet pools, flow and log id counters, the
+// random number generator, and the static configuration of the
+// transports, switches and topologies (packet size,
+// FatTreeSwitch::_strategy, EqdsSrc::_min_rto and the like).  So a
+// simulation is one thread: it must be configured, seeded, built and
+// run on the same thread, and each thread can run its own.
 class EventList {
 public:
-    typedef multimap <simtime_picosec, EventSource*>::iterator Handle;
+    typedef EventQueue::Handle Handle;
+    // HEAP is a safe default; CALENDAR is usually faster with very
+    // large numbers of pending events.  Both give identical results.
+    typedef enum {HEAP, CALENDAR} scheduler_type;
     EventList();
-    static void setEndtime(simtime_picosec endtime); // end simulation at endtime (rather than forever)
-    static bool doNextEvent(); // returns true if it did anything, false if there's nothing to do
-    static void sourceIsPending(EventSource &src, simtime_picosec when);
-    static Handle sourceIsPendingGetHandle(EventSource &src, simtime_picosec when);
-    static void sourceIsPendingRel(EventSource &src, simtime_picosec timefromnow)
-    { sourceIsPending(src, EventList::now()+timefromnow); }
-    static void cancelPendingSource(EventSource &src);
-    // optimized cancel, if we know the expiry time
-    static void cancelPendingSourceByTime(EventSource &src, simtime_picosec when);   
-    // optimized cancel by handle - be careful to ensure handle is still valid
-    static void cancelPendingSourceByHandle(EventSource &src, Handle handle);       
-    static void reschedulePendingSource(EventSource &src, simtime_picosec when);
-    static void triggerIsPending(TriggerTarget &target);
-    static inline simtime_picosec now() {return EventList::_lasteventtime;}
-    static Handle nullHandle() {return _pendingsources.end();}
+    ~EventList();
+    // call during setup, before anything holds an event Handle
+    void setScheduler(scheduler_type type);
+    void setEndtime(simtime_picosec endtime); // end simulation at endtime (rather than forever)
+    bool doNextEvent(); // returns true if it did anything, false if there's nothing to do
+    void sourceIsPending(EventSource &src, simtime_picosec when);
+    Handle sourceIsPendingGetHandle(EventSource &src, simtime_picosec when);
+    void sourceIsPendingRel(EventSource &src, simtime_picosec timefromnow)
+    { sourceIsPending(src, now()+timefromnow); }
+    // cancel the earliest event pending for src, if there is one.
+    // Cost depends on how many events src has pending, not on the
+    // size of the event list.
+    void cancelPendingSource(EventSource &src);
+    // cancel src's event at exactly time when, if there is one
+    void cancelPendingSourceByTime(EventSource &src, simtime_picosec when);   
+    // cancel by handle.  A handle whose event has already fired or
+    // been cancelled is ignored.
+    void cancelPendingSourceByHandle(EventSource &src, Handle handle);       
+    void reschedulePendingSource(EventSource &src, simtime_picosec when);
+    void triggerIsPending(TriggerTarget &target);
+    inline simtime_picosec now() const {return _lasteventtime;}
+    // events processed so far, for measuring the simulator's own speed
+    inline uint64_t eventCount() const {return _event_count;}
+    static Handle nullHandle() {return EventQueue::NULL_HANDLE;}
+    inline bool isPending(Handle handle) const {return _pendingsources->pending(handle);}
+    // handle of the event currently being processed
+    inline Handle currentHandle() const {return _current;}
+#ifdef PROFILE_EVENTS
+    inline const EventProfile& profile() const {return _profile;}
+#endif
 
 
     static EventList& getTheEventList();
@@ -47,14 +140,43 @@ public:
     void operator=(const EventList&) = delete;  // disable Assign Constructor
 
 private:
-    static simtime_picosec _endtime;
-    static simtime_picosec _lasteventtime;
-    typedef multimap <simtime_picosec, EventSource*> pendingsources_t;
-    static pendingsources_t _pendingsources;
-    static vector <TriggerTarget*> _pending_triggers;
-
-    static int _instanceCount;
-    static EventList* _theEventList;
+    simtime_picosec _endtime;
+    simtime_picosec _lasteventtime;
+    EventQueue* _pendingsources;
+    Handle _current;
+    uint64_t _event_count;
+    vector <TriggerTarget*> _pending_triggers;
+#ifdef PROFILE_EVENTS
+    EventProfile _profile;
+#endif
+
+    static thread_local EventList* _theEventList;
+};
+
+// A timer belonging to an EventSource.  Arming, re-arming and
+// cancelling cost O(log n) at worst, and a timer can be cancelled
+// whether or not it is still running.  When it expires, the owner's
+// doNextEvent() is called; firing() tells it which timer that was if
+// it has more than one reason to be scheduled.
+class EventTimer {
+public:
+    EventTimer(EventSource& owner) : _owner(owner), _handle(EventList::nullHandle()) {}
+    // returns false, leaving the timer stopped, if when is after the simulation end time
+    bool set(simtime_picosec when) {
+        cancel();
+        _handle = _owner.eventlist().sourceIsPendingGetHandle(_owner, when);
+        return _handle != EventList::nullHandle();
+    }
+    bool setRel(simtime_picosec timefromnow) {return set(_owner.eventlist().now() + timefromnow);}
+    void cancel() {
+        _owner.eventlist().cancelPendingSourceByHandle(_owner, _handle);
+        _handle = EventList::nullHandle();
+    }
+    inline bool armed() const {return _owner.eventlist().isPending(_handle);}
+    inline bool firing() const {return _handle != EventList::nullHandle() && _handle == _owner.eventlist().currentHandle();}
+private:
+    EventSource& _owner;
+    EventList::Handle _handle;
 };
 
 #endif
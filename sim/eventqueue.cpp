@@ -0,0 +1,327 @@
+// -*- c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include <algorithm>
+#include "eventqueue.h"
+#include "eventlist.h"
+
+const EventQueue::Handle EventQueue::NULL_HANDLE;
+const EventQueue::Index EventQueue::NULL_INDEX;
+
+EventQueue::Handle
+EventQueue::insert(simtime_picosec when, EventSource* src) {
+    assert(src);
+    Index i;
+    if (_free_head != NULL_INDEX) {
+        i = _free_head;
+        _free_head = _nodes[i].next;
+    } else {
+        assert(_nodes.size() < NULL_INDEX);
+        i = _nodes.size();
+        _nodes.push_back(Node());
+        _nodes[i].gen = 0;
+    }
+    Node& n = _nodes[i];
+    n.when = when;
+    n.seq = _next_seq++;
+    n.src = src;
+
+    // push onto the front of the source's own list of pending events
+    n.src_prev = NULL_INDEX;
+    n.src_next = src->_pending_events;
+    if (n.src_next != NULL_INDEX)
+        _nodes[n.src_next].src_prev = i;
+    src->_pending_events = i;
+
+    _size++;
+    push(i);
+    return handle(i);
+}
+
+void
+EventQueue::release(Index i) {
+    Node& n = _nodes[i];
+    if (n.src_prev == NULL_INDEX)
+        n.src->_pending_events = n.src_next;
+    else
+        _nodes[n.src_prev].src_next = n.src_next;
+    if (n.src_next != NULL_INDEX)
+        _nodes[n.src_next].src_prev = n.src_prev;
+
+    n.src = NULL;
+    n.gen++;
+    n.next = _free_head;
+    _free_head = i;
+    _size--;
+}
+
+EventSource*
+EventQueue::pop(simtime_picosec& when, Handle& h) {
+    assert(_size > 0);
+    Index i = pop_top();
+    EventSource* src = _nodes[i].src;
+    when = _nodes[i].when;
+    h = handle(i);
+    release(i);
+    return src;
+}
+
+void
+EventQueue::erase(Handle h) {
+    assert(pending(h));
+    Index i = index(h);
+    remove(i);
+    release(i);
+}
+
+EventQueue::Handle
+EventQueue::find(const EventSource* src) const {
+    // picks the same event the old multimap scan did: the earliest
+    // one, and the first inserted if there's a tie.
+    Index found = NULL_INDEX;
+    for (Index i = src->_pending_events; i != NULL_INDEX; i = _nodes[i].src_next) {
+        if (found == NULL_INDEX || before(i, found))
+            found = i;
+    }
+    return found == NULL_INDEX ? NULL_HANDLE : handle(found);
+}
+
+EventQueue::Handle
+EventQueue::find(const EventSource* src, simtime_picosec when) const {
+    Index found = NULL_INDEX;
+    for (Index i = src->_pending_events; i != NULL_INDEX; i = _nodes[i].src_next) {
+        if (_nodes[i].when == when && (found == NULL_INDEX || before(i, found)))
+            found = i;
+    }
+    return found == NULL_INDEX ? NULL_HANDLE : handle(found);
+}
+
+////////////////////////////////////////////////////////////////
+//  4-ary heap
+////////////////////////////////////////////////////////////////
+
+void
+EventQueue::NodeHeap::push(Index h) {
+    _heap.push_back(h);
+    sift_up(_heap.size() - 1);
+}
+
+EventQueue::Index
+EventQueue::NodeHeap::pop_top() {
+    Index h = _heap[0];
+    Index last = _heap.back();
+    _heap.pop_back();
+    if (!_heap.empty()) {
+        place(0, last);
+        sift_down(0);
+    }
+    _q._nodes[h].pos = NOT_IN_HEAP;
+    return h;
+}
+
+void
+EventQueue::NodeHeap::remove(Index h) {
+    uint32_t pos = _q._nodes[h].pos;
+    assert(_heap[pos] == h);
+    Index last = _heap.back();
+    _heap.pop_back();
+    if (pos < _heap.size()) {
+        place(pos, last);
+        sift_up(pos);
+        sift_down(_q._nodes[last].pos);
+    }
+    _q._nodes[h].pos = NOT_IN_HEAP;
+}
+
+void
+EventQueue::NodeHeap::sift_up(uint32_t pos) {
+    Index h = _heap[pos];
+    while (pos > 0) {
+        uint32_t parent = (pos - 1) / ARITY;
+        if (!_q.before(h, _heap[parent]))
+            break;
+        place(pos, _heap[parent]);
+        pos = parent;
+    }
+    place(pos, h);
+}
+
+void
+EventQueue::NodeHeap::sift_down(uint32_t pos) {
+    Index h = _heap[pos];
+    uint32_t size = _heap.size();
+    while (true) {
+        uint32_t first = pos * ARITY + 1;
+        if (first >= size)
+            break;
+        uint32_t last = min(first + ARITY, size);
+        uint32_t best = first;
+        for (uint32_t c = first + 1; c < last; c++) {
+            if (_q.before(_heap[c], _heap[best]))
+                best = c;
+        }
+        if (!_q.before(_heap[best], h))
+            break;
+        place(pos, _heap[best]);
+        pos = best;
+    }
+    place(pos, h);
+}
+
+////////////////////////////////////////////////////////////////
+//  Calendar queue
+////////////////////////////////////////////////////////////////
+
+#define CALENDAR_MIN_BUCKETS 16
+#define CALENDAR_MAX_BUCKETS (1 << 20)
+#define CALENDAR_SAMPLE 32
+
+CalendarEventQueue::CalendarEventQueue()
+    : _nbuckets(CALENDAR_MIN_BUCKETS), _width(timeFromNs(100.0)),
+      _start(0), _cur(0), _calendar_size(0), _overflow(*this)
+{
+    _head.resize(_nbuckets, NULL_INDEX);
+    _tail.resize(_nbuckets, NULL_INDEX);
+    _end = _start + _nbuckets * _width;
+}
+
+void
+CalendarEventQueue::link(Index h) {
+    // buckets are sorted by (when, seq).  Events mostly arrive in
+    // increasing time order, so search back from the tail.
+    uint32_t b = bucket_of(_nodes[h].when);
+    assert(b >= _cur && b < _nbuckets);
+    Index after = _tail[b];
+    while (after != NULL_INDEX && before(h, after))
+        after = _nodes[after].prev;
+    Node& n = _nodes[h];
+    n.pos = NOT_IN_HEAP;
+    n.prev = after;
+    if (after == NULL_INDEX) {
+        n.next = _head[b];
+        _head[b] = h;
+    } else {
+        n.next = _nodes[after].next;
+        _nodes[after].next = h;
+    }
+    if (n.next == NULL_INDEX)
+        _tail[b] = h;
+    else
+        _nodes[n.next].prev = h;
+    _calendar_size++;
+}
+
+void
+CalendarEventQueue::unlink(Index h) {
+    uint32_t b = bucket_of(_nodes[h].when);
+    Node& n = _nodes[h];
+    if (n.prev == NULL_INDEX)
+        _head[b] = n.next;
+    else
+        _nodes[n.prev].next = n.next;
+    if (n.next == NULL_INDEX)
+        _tail[b] = n.prev;
+    else
+        _nodes[n.next].prev = n.prev;
+    _calendar_size--;
+}
+
+void
+CalendarEventQueue::push(Index h) {
+    if (_nodes[h].when >= _end) {
+        _overflow.push(h);
+        return;
+    }
+    link(h);
+    if (_calendar_size > 2 * _nbuckets && _nbuckets < CALENDAR_MAX_BUCKETS && _width > 1)
+        grow();
+}
+
+void
+CalendarEventQueue::remove(Index h) {
+    if (_nodes[h].pos != NOT_IN_HEAP)
+        _overflow.remove(h);
+    else
+        unlink(h);
+}
+
+EventQueue::Index
+CalendarEventQueue::pop_top() {
+    if (_calendar_size == 0)
+        refill();
+    while (_head[_cur] == NULL_INDEX)
+        _cur++;
+    Index h = _head[_cur];
+    unlink(h);
+    return h;
+}
+
+void
+CalendarEventQueue::grow() {
+    // twice as many buckets, each half as wide, covering the same window
+    vector<Index> pending;
+    pending.reserve(_calendar_size);
+    for (uint32_t b = _cur; b < _nbuckets; b++) {
+        for (Index h = _head[b]; h != NULL_INDEX; h = _nodes[h].next)
+            pending.push_back(h);
+    }
+    simtime_picosec curtime = _cur * _width;
+    _nbuckets *= 2;
+    _width = (_width + 1) / 2;
+    _cur = curtime / _width;
+    _head.assign(_nbuckets, NULL_INDEX);
+    _tail.assign(_nbuckets, NULL_INDEX);
+    _calendar_size = 0;
+    for (size_t i = 0; i < pending.size(); i++)
+        link(pending[i]);
+}
+
+void
+CalendarEventQueue::refill() {
+    // The window is used up, so start a new one at the earliest
+    // overflow event.  Bucket width uses Brown's heuristic: three
+    // times the average separation of the events at the front of the
+    // queue, ignoring outliers.  A sample with no spread at all
+    // (e.g. every flow starting at once) keeps the old width.
+    assert(_calendar_size == 0 && !_overflow.empty());
+    vector<Index> sample;
+    while (sample.size() < CALENDAR_SAMPLE && !_overflow.empty())
+        sample.push_back(_overflow.pop_top());
+
+    size_t n = sample.size();
+    simtime_picosec total = _nodes[sample[n - 1]].when - _nodes[sample[0]].when;
+    if (total > 0) {
+        simtime_picosec avg = total / (n - 1);
+        simtime_picosec trimmed = 0;
+        size_t count = 0;
+        for (size_t i = 1; i < n; i++) {
+            simtime_picosec gap = _nodes[sample[i]].when - _nodes[sample[i - 1]].when;
+            if (gap <= 2 * avg) {
+                trimmed += gap;
+                count++;
+            }
+        }
+        if (trimmed > 0)
+            _width = max((simtime_picosec)1, 3 * trimmed / count);
+    }
+
+    uint32_t nbuckets = CALENDAR_MIN_BUCKETS;
+    while (nbuckets < _size && nbuckets < CALENDAR_MAX_BUCKETS)
+        nbuckets *= 2;
+    if (nbuckets != _nbuckets) {
+        _nbuckets = nbuckets;
+        _head.assign(_nbuckets, NULL_INDEX);
+        _tail.assign(_nbuckets, NULL_INDEX);
+    }
+    _start = _nodes[sample[0]].when;
+    _end = _start + _nbuckets * _width;
+    _cur = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        if (_nodes[sample[i]].when < _end)
+            link(sample[i]);
+        else
+            _overflow.push(sample[i]);
+    }
+    while (!_overflow.empty() && _nodes[_overflow.top()].when < _end)
+        link(_overflow.pop_top());
+}
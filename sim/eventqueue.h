@@ -0,0 +1,162 @@
+// -*- c-basic-offset: 4; indent-tabs-mode: nil -*-
+#ifndef EVENTQUEUE_H
+#define EVENTQUEUE_H
+
+/*
+ * Pending event storage for EventList.
+ *
+ * Events are kept in a pool of nodes and referred to by a 32-bit
+ * Handle (the node's index in the pool), so scheduling an event never
+ * calls malloc once the pool has warmed up, and an event can be
+ * cancelled directly by handle.  Each event is stamped with an
+ * insertion sequence number, and events are ordered by (time,
+ * sequence).  That gives exactly the FIFO ordering for events
+ * scheduled at the same time that the old multimap-based EventList
+ * had, so results don't depend on which backend is in use.
+ *
+ * Two backends are provided:
+ *
+ *  HeapEventQueue - a 4-ary min-heap.  O(log n) insert/pop/cancel, and
+ *  a good default for any workload.
+ *
+ *  CalendarEventQueue - a calendar queue (after Brown) covering a
+ *  window of the near future, with far-future events (typically
+ *  retransmit timers) parked in a 4-ary heap until the window reaches
+ *  them.  O(1) expected insert/pop/cancel for the packet events that
+ *  make up the bulk of a large datacenter run, and it degrades to heap
+ *  performance rather than to a linear scan when event times are
+ *  badly skewed.
+ */
+
+#include <vector>
+#include "config.h"
+
+class EventSource;
+
+class EventQueue {
+public:
+    // A Handle is a node index plus the node's generation, so a
+    // handle kept after its event has fired or been cancelled is
+    // simply no longer pending, even once the node has been reused.
+    typedef uint64_t Handle;
+    typedef uint32_t Index;
+    static const Handle NULL_HANDLE = UINT64_MAX;
+    static const Index NULL_INDEX = UINT32_MAX;
+
+    EventQueue() : _size(0), _next_seq(0) {}
+    virtual ~EventQueue() {}
+
+    Handle insert(simtime_picosec when, EventSource* src);
+    // remove the earliest event from the queue, returning its source and time
+    EventSource* pop(simtime_picosec& when, Handle& handle);
+    // remove an event that is still pending
+    void erase(Handle h);
+
+    // earliest pending event for src, or NULL_HANDLE if there is none.
+    // Cost is linear in the number of events pending for src, not in
+    // the size of the queue.
+    Handle find(const EventSource* src) const;
+    // earliest pending event for src at exactly time when
+    Handle find(const EventSource* src, simtime_picosec when) const;
+
+    inline bool empty() const {return _size == 0;}
+    inline size_t size() const {return _size;}
+    inline simtime_picosec when(Handle h) const {return _nodes[index(h)].when;}
+    inline EventSource* source(Handle h) const {return _nodes[index(h)].src;}
+    inline bool pending(Handle h) const {
+        Index i = index(h);
+        return i < _nodes.size() && _nodes[i].src != NULL && _nodes[i].gen == generation(h);
+    }
+
+protected:
+    struct Node {
+        simtime_picosec when;
+        uint64_t seq;       // insertion order, used to break ties on when
+        EventSource* src;   // NULL when the node is on the free list
+        uint32_t gen;       // bumped each time the node is reused
+        uint32_t pos;       // heap position, or NOT_IN_HEAP
+        Index prev, next;   // bucket list links (calendar backend), free list link
+        Index src_prev, src_next;  // other events pending for the same source
+    };
+    static const uint32_t NOT_IN_HEAP = UINT32_MAX;
+
+    static inline Index index(Handle h) {return (Index)h;}
+    static inline uint32_t generation(Handle h) {return (uint32_t)(h >> 32);}
+    inline Handle handle(Index i) const {return ((Handle)_nodes[i].gen << 32) | i;}
+
+    inline bool before(Index a, Index b) const {
+        const Node& na = _nodes[a];
+        const Node& nb = _nodes[b];
+        return na.when < nb.when || (na.when == nb.when && na.seq < nb.seq);
+    }
+
+    // 4-ary min-heap of node indices, ordered by (when, seq)
+    class NodeHeap {
+    public:
+        NodeHeap(EventQueue& q) : _q(q) {}
+        void push(Index h);
+        Index pop_top();
+        void remove(Index h);
+        inline Index top() const {return _heap[0];}
+        inline bool empty() const {return _heap.empty();}
+        inline size_t size() const {return _heap.size();}
+    private:
+        static const int ARITY = 4;
+        void sift_up(uint32_t pos);
+        void sift_down(uint32_t pos);
+        inline void place(uint32_t pos, Index h) {_heap[pos] = h; _q._nodes[h].pos = pos;}
+        EventQueue& _q;
+        vector<Index> _heap;
+    };
+
+    // backend interface
+    virtual void push(Index h) = 0;
+    virtual Index pop_top() = 0;
+    virtual void remove(Index h) = 0;
+
+    vector<Node> _nodes;
+    size_t _size;
+private:
+    void release(Index i);
+    Index _free_head{NULL_INDEX};
+    uint64_t _next_seq;
+};
+
+class HeapEventQueue : public EventQueue {
+public:
+    HeapEventQueue() : _heap(*this) {}
+protected:
+    virtual void push(Index h) {_heap.push(h);}
+    virtual Index pop_top() {return _heap.pop_top();}
+    virtual void remove(Index h) {_heap.remove(h);}
+private:
+    NodeHeap _heap;
+};
+
+class CalendarEventQueue : public EventQueue {
+public:
+    CalendarEventQueue();
+protected:
+    virtual void push(Index h);
+    virtual Index pop_top();
+    virtual void remove(Index h);
+private:
+    inline uint32_t bucket_of(simtime_picosec when) const {return (when - _start) / _width;}
+    void link(Index h);
+    void unlink(Index h);
+    void grow();
+    void refill();
+
+    // The calendar covers [_start, _end); bucket i holds the events in
+    // [_start + i*_width, _start + (i+1)*_width), sorted by (when, seq).
+    // Everything at or beyond _end waits in _overflow.
+    vector<Index> _head, _tail;
+    uint32_t _nbuckets;
+    simtime_picosec _width;
+    simtime_picosec _start, _end;
+    uint32_t _cur;                // no bucket before this one is in use
+    size_t _calendar_size;        // events in the buckets, rather than in _overflow
+    NodeHeap _overflow;
+};
+
+#endif
@@ -67,24 +67,67 @@ FifoPullQueue<PullPkt>::flush_flow(flowid_t flow_id, int /*priority*/) {
 }
 
 template<class PullPkt>
-FairPullQueue<PullPkt>::FairPullQueue() {
-    _current_queue = _queue_map.begin();
+FairPullQueue<PullPkt>::FairPullQueue() : _head(NULL), _tail(NULL) {
 }
 
+template<class PullPkt>
+FairPullQueue<PullPkt>::~FairPullQueue() {
+    for (size_t i = 0; i < _own_flows.size(); i++)
+        delete _own_flows[i];
+}
 
 template<class PullPkt>
 void
 FairPullQueue<PullPkt>::enqueue(PullPkt& pkt, int /*priority*/) {
-    CircularBuffer<PullPkt*>* pull_queue;
-    if (queue_exists(pkt)) {
-            pull_queue = find_queue(pkt);
-    }  else {
-            pull_queue = create_queue(pkt);
+    PullQueueFlow*& flow = _flows[pkt.flow_id()];
+    if (!flow) {
+        flow = new PullQueueFlow();
+        flow->_owner = this;
+        _own_flows.push_back(flow);
+    }
+    push(pkt, *flow);
+}
+
+template<class PullPkt>
+void
+FairPullQueue<PullPkt>::enqueue(PullPkt& pkt, PullQueueFlow& flow, int /*priority*/) {
+    if (flow._owner != this) {
+        // first use - remember it so flush_flow can find it
+        assert(flow._owner == NULL);
+        flow._owner = this;
+        bool added = _flows.insert(make_pair(pkt.flow_id(), &flow)).second;
+        assert(added);
     }
-    //we add packets to the front,remove them from the back
-    PullPkt* pkt_p = &pkt;
-    pull_queue->push(pkt_p);
+    push(pkt, flow);
+}
+
+template<class PullPkt>
+void
+FairPullQueue<PullPkt>::push(PullPkt& pkt, PullQueueFlow& flow) {
+    Packet* pkt_p = &pkt;
+    flow._pulls.push(pkt_p);
     this->_pull_count++;
+    if (!flow._active) {
+        flow._active = true;
+        flow._next = NULL;
+        if (_tail)
+            _tail->_next = &flow;
+        else
+            _head = &flow;
+        _tail = &flow;
+    }
+}
+
+template<class PullPkt>
+void
+FairPullQueue<PullPkt>::pop_head() {
+    PullQueueFlow* flow = _head;
+    _head = flow->_next;
+    if (!_head)
+        _tail = NULL;
+    flow->_next = NULL;
+    flow->_active = false;
+    flow->_deficit = 0;
 }
 
 template<class PullPkt>
@@ -93,65 +136,45 @@ FairPullQueue<PullPkt>::dequeue() {
     if (this->_pull_count == 0)
         return 0;
     while (1) {
-        if (_current_queue == _queue_map.end())
-            _current_queue = _queue_map.begin();
-        CircularBuffer <PullPkt*>* pull_queue = _current_queue->second;
-        _current_queue++;
-        if (!pull_queue->empty()) {
-            //we add packets to the front,remove them from the back
-            PullPkt* packet = pull_queue->pop();
-            this->_pull_count--;
-            return packet;
+        PullQueueFlow* flow = _head;
+        if (flow->_pulls.empty()) {
+            // flushed while waiting for its turn.  There are pulls
+            // queued, so we'll eventually find a flow that has one.
+            pop_head();
+            continue;
+        }
+        if (flow->_deficit == 0)
+            flow->_deficit = flow->_weight;
+        Packet* packet = flow->_pulls.pop();
+        this->_pull_count--;
+        flow->_deficit--;
+        if (flow->_pulls.empty()) {
+            pop_head();
+        } else if (flow->_deficit == 0 && flow != _tail) {
+            // end of its turn - to the back of the ring
+            _head = flow->_next;
+            flow->_next = NULL;
+            _tail->_next = flow;
+            _tail = flow;
         }
-        // there are packets queued, so we'll eventually find a queue
-        // that lets this terminate
+        return (PullPkt*)packet;
     }
 }
 
 template<class PullPkt>
 void
 FairPullQueue<PullPkt>::flush_flow(flowid_t flow_id, int /*priority*/) {
-    typename map <flowid_t, CircularBuffer<PullPkt*>*>::iterator i;
-    i = _queue_map.find(flow_id);
-    if (i == _queue_map.end())
+    typename unordered_map<flowid_t, PullQueueFlow*>::iterator i;
+    i = _flows.find(flow_id);
+    if (i == _flows.end())
         return;
-    CircularBuffer<PullPkt*>* pull_queue = i->second;
-    while (!pull_queue->empty()) {
-            PullPkt* packet = pull_queue->pop();
+    PullQueueFlow* flow = i->second;
+    while (!flow->_pulls.empty()) {
+            PullPkt* packet = (PullPkt*)flow->_pulls.pop();
             packet->free();
             this->_pull_count--;
     }
-    if (_current_queue == i)
-        _current_queue++;
-    _queue_map.erase(i);
-}
-
-template<class PullPkt>
-bool 
-FairPullQueue<PullPkt>::queue_exists(const PullPkt& pkt) {
-    typename map <flowid_t, CircularBuffer<PullPkt*>*>::iterator i;
-    i = _queue_map.find(pkt.flow_id());
-    if (i == _queue_map.end())
-        return false;
-    return true;
-}
-
-template<class PullPkt>
-CircularBuffer<PullPkt*>* 
-FairPullQueue<PullPkt>::find_queue(const PullPkt& pkt) {
-    typename map <flowid_t, CircularBuffer<PullPkt*>*>::iterator i;
-    i = _queue_map.find(pkt.flow_id());
-    if (i == _queue_map.end())
-        return 0;
-    return i->second;
-}
-
-template<class PullPkt>
-CircularBuffer<PullPkt*>* 
-FairPullQueue<PullPkt>::create_queue(const PullPkt& pkt) {
-    CircularBuffer<PullPkt*>* new_queue = new CircularBuffer<PullPkt*>;
-    _queue_map.insert(pair<flowid_t, CircularBuffer<PullPkt*>*>(pkt.flow_id(), new_queue));
-    return new_queue;
+    // the flow leaves the ring when it next reaches the head
 }
 
 template class BasePullQueue<NdpPull>;
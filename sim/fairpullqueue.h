@@ -7,18 +7,44 @@
  */
 
 #include <list>
+#include <unordered_map>
 #include "config.h"
 #include "eventlist.h"
 #include "network.h"
 #include "circular_buffer.h"
 
 
+// Per-flow state for FairPullQueue: the flow's queued pulls and its
+// place in the ring of flows waiting to be served.  A sink can embed
+// one and pass it to enqueue() so the queue needs no lookup;
+// otherwise the queue keeps one per flow id, created on first use.
+class PullQueueFlow {
+ public:
+    PullQueueFlow() : _weight(1), _deficit(0), _active(false), _next(NULL), _owner(NULL) {}
+    // how many pulls the flow sends per turn, relative to other flows
+    void set_weight(uint32_t weight) {assert(weight > 0); _weight = weight;}
+    uint32_t weight() const {return _weight;}
+ private:
+    template<class PullPkt> friend class FairPullQueue;
+    CircularBuffer<Packet*> _pulls;
+    uint32_t _weight;
+    uint32_t _deficit;          // pulls left in the current turn
+    bool _active;               // in the ring
+    PullQueueFlow* _next;       // in the ring
+    const void* _owner;         // the queue this flow is used with
+};
+
 template<class PullPkt>
 class BasePullQueue {
  public:
     BasePullQueue();
     virtual ~BasePullQueue(){};
     virtual void enqueue(PullPkt& pkt, int priority = 0) = 0;
+    // as above, with per-flow state kept by the caller.  Only the fair
+    // queue makes use of it.
+    virtual void enqueue(PullPkt& pkt, PullQueueFlow& /*flow*/, int priority = 0) {
+        enqueue(pkt, priority);
+    }
     virtual PullPkt* dequeue() = 0;
     virtual void flush_flow(flowid_t flow_id, int priority = 0) = 0;
     virtual void set_preferred_flow(flowid_t preferred_flow) {
@@ -35,6 +61,7 @@ template<class PullPkt>
 class FifoPullQueue : public BasePullQueue<PullPkt>{
  public:
     FifoPullQueue();
+    using BasePullQueue<PullPkt>::enqueue;
     virtual void enqueue(PullPkt& pkt, int priority = 0);
     virtual PullPkt* dequeue();
     virtual void flush_flow(flowid_t flow_id, int priority = 0);
@@ -42,19 +69,25 @@ class FifoPullQueue : public BasePullQueue<PullPkt>{
     list <PullPkt*> _pull_queue; // needs insert middle, so can't use circular buffer
 };
 
+// Deficit round robin between flows.  Flows with pulls queued wait in
+// a ring; the flow at the head sends up to its weight in pulls and
+// then goes to the back, so enqueue and dequeue are both O(1).
 template<class PullPkt>
 class FairPullQueue : public BasePullQueue<PullPkt>{
  public:
     FairPullQueue();
+    virtual ~FairPullQueue();
     virtual void enqueue(PullPkt& pkt, int priority = 0);
+    virtual void enqueue(PullPkt& pkt, PullQueueFlow& flow, int priority = 0);
     virtual PullPkt* dequeue();
     virtual void flush_flow(flowid_t flow_id, int priority = 0);
  protected:
-    map<flowid_t, CircularBuffer<PullPkt*>*> _queue_map;  // map flow id to pull queue
-    bool queue_exists(const PullPkt& pkt);
-    CircularBuffer<PullPkt*>* find_queue(const PullPkt& pkt);
-    CircularBuffer<PullPkt*>* create_queue(const PullPkt& pkt);
-    typename map<flowid_t, CircularBuffer<PullPkt*>*>::iterator _current_queue;
+    void push(PullPkt& pkt, PullQueueFlow& flow);
+    void pop_head();
+    unordered_map<flowid_t, PullQueueFlow*> _flows;  // every flow we've queued for
+    vector<PullQueueFlow*> _own_flows; // those not embedded by the caller
+    PullQueueFlow* _head;       // ring of flows with pulls queued
+    PullQueueFlow* _tail;
 };
 
 #endif
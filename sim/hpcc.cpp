@@ -24,13 +24,13 @@ using namespace std;
 /* keep track of RTOs.  Generally, we shouldn't see RTOs if
    return-to-sender is enabled.  Otherwise we'll see them with very
    large incasts. */
-uint32_t HPCCSrc::_global_node_count = 0;
+thread_local uint32_t HPCCSrc::_global_node_count = 0;
 
-simtime_picosec HPCCSrc::_T = timeFromUs(12.0);//Known baseline RTT
-double HPCCSrc::_eta = 0.95;//Target link utilization
-uint32_t HPCCSrc::_max_stages = 5;//Maximum stages for additive increases
-uint32_t HPCCSrc::_N = 10;//maximum number of flows.
-uint32_t HPCCSrc::_Wai = 0;//Additive increase amount.
+thread_local simtime_picosec HPCCSrc::_T = timeFromUs(12.0);//Known baseline RTT
+thread_local double HPCCSrc::_eta = 0.95;//Target link utilization
+thread_local uint32_t HPCCSrc::_max_stages = 5;//Maximum stages for additive increases
+thread_local uint32_t HPCCSrc::_N = 10;//maximum number of flows.
+thread_local uint32_t HPCCSrc::_Wai = 0;//Additive increase amount.
 
 HPCCSrc::HPCCSrc(HPCCLogger* logger, TrafficLogger* pktlogger, EventList &eventlist, linkspeed_bps rate)
     : BaseQueue(rate,eventlist,NULL), _logger(logger), _flow(pktlogger)
@@ -202,7 +202,7 @@ void HPCCSrc::processAck(const HPCCAck& ack) {
     _pacing_rate = _cwnd * 8 * pow(10,12) / _T;
     update_spacing();
 
-    //cout << "INT Entries " << ack._int_hop << " qs " << ack._int_info[0]._queuesize << " TS " << timeAsUs(ack._int_info[0]._ts) << " TX " << ack._int_info[0]._txbytes << endl; 
+    //cout << "INT Entries " << ack.int_hops() << " qs " << ack.int_info(0)._queuesize << " TS " << timeAsUs(ack.int_info(0)._ts) << " TX " << ack.int_info(0)._txbytes << endl; 
 
 
     if (_logger) _logger->logHPCC(*this, HPCCLogger::HPCC_RCV);
@@ -219,7 +219,12 @@ void HPCCSrc::processAck(const HPCCAck& ack) {
 }
 
 void HPCCSrc::processPause(const EthPausePacket& p) {
-    if (p.sleepTime()>0){
+    //all our data packets are in one PFC class
+    uint32_t c = EthPausePacket::pfc_class(Packet::PRIO_LO);
+    if (!p.class_enabled(c))
+        return;
+
+    if (p.sleepTime(c)>0){
         //remote end is telling us to shut up.
         //cout << "Source " << str() << " PAUSE " << timeAsUs(eventlist().now()) << endl;
         //assert(_state_send != PAUSED);
@@ -238,6 +243,7 @@ void HPCCSrc::receivePacket(Packet& pkt)
 {
     if (!_flow_started){
         assert(pkt.type()==ETH_PAUSE);
+        pkt.free();
         return; 
     }
 
@@ -247,8 +253,10 @@ void HPCCSrc::receivePacket(Packet& pkt)
         _stop_time = 0;
     }
 
-    if (_done)
+    if (_done) {
+        pkt.free();
         return;
+    }
 
     switch (pkt.type()) {
     case ETH_PAUSE:    
@@ -357,14 +365,15 @@ double HPCCSrc::measureInFlight(const HPCCAck& ack){
     double txRate;
     simtime_picosec tau = _T;
 
-    if (ack._int_hop == _link_count){
+    if (ack.int_hops() == _link_count){
         for (i = 0;i<_link_count;i++){
-            txRate = (ack._int_info[i]._txbytes - _link_info[i]._txbytes) * 8 * pow(10,12) / (ack._int_info[i]._ts - _link_info[i]._ts);
+            const IntEntry& info = ack.int_info(i);
+            txRate = (info._txbytes - _link_info[i]._txbytes) * 8 * pow(10,12) / (info._ts - _link_info[i]._ts);
 
-            uprime = min(ack._int_info[i]._queuesize, _link_info[i]._queuesize)*8 * pow (10,12) / ( (double)ack._int_info[i]._linkrate * _T ) + txRate / ack._int_info[i]._linkrate; 
+            uprime = min(info._queuesize, _link_info[i]._queuesize)*8 * pow (10,12) / ( (double)info._linkrate * _T ) + txRate / info._linkrate; 
             if (uprime > u) {
                 u = uprime;
-                tau = ack._int_info[i]._ts - _link_info[i]._ts;
+                tau = info._ts - _link_info[i]._ts;
             }
         }
 
@@ -373,9 +382,10 @@ double HPCCSrc::measureInFlight(const HPCCAck& ack){
         _U = (1 - tau/_T)*_U + tau/_T*u;
     }
     else {    //reset path state
-        _link_count = ack._int_hop;
+        _link_count = ack.int_hops();
+        _link_info.resize(_link_count);
         for (i = 0;i<_link_count;i++)
-            _link_info[i] = ack._int_info[i];
+            _link_info[i] = ack.int_info(i);
     }
 
     return _U;
@@ -495,19 +505,19 @@ void HPCCSink::receivePacket(Packet& pkt) {
     } else if (seqno < _cumulative_ack+1) {
         //must have been a bad retransmit
     }
-    send_ack(ts,p->_int_info, p->_int_hop);
+    send_ack(ts,p->take_int());
     // have we seen everything yet?
     pkt.flow().logTraffic(pkt,*this,TrafficLogger::PKT_RCVDESTROY);
     pkt.free();
 }
 
-void HPCCSink::send_ack(simtime_picosec ts, IntEntry* intinfo, uint32_t hops) {
+void HPCCSink::send_ack(simtime_picosec ts, IntStack* intinfo) {
     HPCCAck *ack = 0;
     ack = HPCCAck::newpkt(_src->_flow, *_route, _cumulative_ack,_srcaddr);
     ack->set_pathid(0);
 
-    if (hops>0)
-        ack->copy_int_info(intinfo,hops);
+    if (intinfo)
+        ack->set_int(intinfo);
 
     ack->sendOn();
 }
@@ -104,18 +104,18 @@ public:
     void log_me();
     bool _log_me;
 
-    static uint32_t _global_node_count; 
-    static uint32_t _global_rto_count;  // keep track of the total number of timeouts across all srcs
+    static thread_local uint32_t _global_node_count; 
+    static thread_local uint32_t _global_rto_count;  // keep track of the total number of timeouts across all srcs
 
     //HPCC specific parameters (globals)
-    static simtime_picosec _T;//Known baseline RTT
-    static double _eta;//Target link utilization
-    static uint32_t _max_stages;//Maximum stages for additive increases
-    static uint32_t _N;//maximum number of flows.
-    static uint32_t _Wai;//Additive increase amount.
+    static thread_local simtime_picosec _T;//Known baseline RTT
+    static thread_local double _eta;//Target link utilization
+    static thread_local uint32_t _max_stages;//Maximum stages for additive increases
+    static thread_local uint32_t _N;//maximum number of flows.
+    static thread_local uint32_t _Wai;//Additive increase amount.
 
 private:
-    IntEntry _link_info[5];
+    vector<IntEntry> _link_info;
     uint32_t _link_count;
     HPCCPacket::seq_t _last_update_seq;
     HPCCPacket::seq_t _cwnd, _flightsize, _Wc;
@@ -193,7 +193,7 @@ private:
     HPCCPacket::seq_t _highest_seqno;
  
     // Mechanism
-    void send_ack(simtime_picosec ts, IntEntry* intinfo, uint32_t hops);
+    void send_ack(simtime_picosec ts, IntStack* intinfo);
     void send_nack(simtime_picosec ts, HPCCPacket::seq_t ackno);
 };
 
@@ -1,13 +1,21 @@
 // -*- c-basic-offset: 4; indent-tabs-mode: nil -*- 
 #include "hpccpacket.h"
 
-PacketDB<HPCCPacket> HPCCPacket::_packetdb;
-PacketDB<HPCCAck> HPCCAck::_packetdb;
-PacketDB<HPCCNack> HPCCNack::_packetdb;
-
-void HPCCAck::copy_int_info(IntEntry* info, int cnt){
-    for (int i = 0;i<cnt;i++)
-        _int_info[i] = info[i];
-        
-    _int_hop = cnt;
-};
+thread_local PacketDB<HPCCPacket> HPCCPacket::_packetdb;
+thread_local PacketDB<HPCCAck> HPCCAck::_packetdb;
+thread_local PacketDB<HPCCNack> HPCCNack::_packetdb;
+
+thread_local vector<IntStack*> IntStack::_pool;
+
+IntStack* IntStack::alloc() {
+    if (_pool.empty())
+        return new IntStack();
+    IntStack* stack = _pool.back();
+    _pool.pop_back();
+    return stack;
+}
+
+void IntStack::release(IntStack* stack) {
+    stack->_entries.clear();
+    _pool.push_back(stack);
+}
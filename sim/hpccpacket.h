@@ -25,6 +25,26 @@ public:
     linkspeed_bps _linkrate;
 };
 
+// The INT records gathered along a packet's path, one per queue it left,
+// length-prefixed by the vector.  Packets carry a pointer to one rather
+// than a fixed array, so paths can be any length, and the sink hands the
+// data packet's stack on to its ACK rather than copying it.  Stacks are
+// pooled and keep their capacity, so after warm-up adding a hop doesn't
+// allocate.
+class IntStack {
+public:
+    static IntStack* alloc();
+    // back to the pool; done by the packet holding it when it is freed
+    static void release(IntStack* stack);
+
+    uint32_t hops() const {return _entries.size();}
+    const IntEntry& at(uint32_t hop) const {return _entries[hop];}
+    IntEntry& push() {_entries.push_back(IntEntry()); return _entries.back();}
+private:
+    vector<IntEntry> _entries;
+    static thread_local vector<IntStack*> _pool;
+};
+
 class HPCCPacket : public Packet {
 public:
     typedef uint64_t seq_t;
@@ -46,7 +66,6 @@ public:
         p->_path_len = 0;
         p->_direction = NONE;
         p->set_dst(destination);
-        p->_int_hop = 0;
         return p;
     }
   
@@ -64,12 +83,17 @@ public:
         p->_retransmitted = retransmitted;
         p->_last_packet = last_packet;
         p->_path_len = route.size();
-        p->_int_hop = 0;
         p->set_dst(destination);
         return p;
     }
   
-    void free() {_packetdb.freePacket(this);}
+    void free() {
+        if (ref_count() == 1 && _int) {
+            IntStack::release(_int);
+            _int = NULL;
+        }
+        _packetdb.freePacket(this);
+    }
     virtual ~HPCCPacket(){}
     
     inline seq_t seqno() const {return _seqno;}
@@ -79,8 +103,12 @@ public:
     inline void set_ts(simtime_picosec ts) {_ts = ts;}
     inline uint32_t path_id() const {if (_pathid!=UINT32_MAX) return _pathid; else return _route->path_id();}
     virtual PktPriority priority() const {return Packet::PRIO_LO;}
-    IntEntry _int_info[5];
-    uint32_t _int_hop;
+
+    // INT records: a queue adds one as the packet leaves it
+    IntEntry& push_int() {if (!_int) _int = IntStack::alloc(); return _int->push();}
+    uint32_t int_hops() const {return _int ? _int->hops() : 0;}
+    // the packet's records, which are now the caller's; NULL if none
+    IntStack* take_int() {IntStack* stack = _int; _int = NULL; return stack;}
     const static int ACKSIZE=64;
 protected:
     seq_t _seqno;
@@ -89,7 +117,8 @@ protected:
     bool _last_packet;  // set to true in the last packet in a flow.
 
     //area to aggregate switch INT information
-    static PacketDB<HPCCPacket> _packetdb;
+    IntStack* _int = NULL;
+    static thread_local PacketDB<HPCCPacket> _packetdb;
 };
 
 class HPCCAck : public Packet {
@@ -106,13 +135,21 @@ public:
         p->_path_len = 0;
         p->_direction = NONE;
         p->set_dst(destination);
-        p->_int_hop = 0;
         return p;
     }
 
-    void copy_int_info(IntEntry* info, int cnt);
+    // takes over the INT records the data packet gathered
+    void set_int(IntStack* stack) {assert(!_int); _int = stack;}
+    uint32_t int_hops() const {return _int ? _int->hops() : 0;}
+    const IntEntry& int_info(uint32_t hop) const {return _int->at(hop);}
   
-    void free() {_packetdb.freePacket(this);}
+    void free() {
+        if (ref_count() == 1 && _int) {
+            IntStack::release(_int);
+            _int = NULL;
+        }
+        _packetdb.freePacket(this);
+    }
     inline seq_t ackno() const {return _ackno;}
     inline simtime_picosec ts() const {return _ts;}
     inline void set_ts(simtime_picosec ts) {_ts = ts;}
@@ -120,12 +157,11 @@ public:
   
     virtual ~HPCCAck(){}
 
-    IntEntry _int_info[5];
-    uint32_t _int_hop;
 protected:
     seq_t _ackno;
     simtime_picosec _ts;
-    static PacketDB<HPCCAck> _packetdb;
+    IntStack* _int = NULL;
+    static thread_local PacketDB<HPCCAck> _packetdb;
 };
 
 
@@ -157,7 +193,7 @@ public:
 protected:
     seq_t _ackno;
     simtime_picosec _ts;
-    static PacketDB<HPCCNack> _packetdb;
+    static thread_local PacketDB<HPCCNack> _packetdb;
 };
 
 
@@ -5,6 +5,10 @@
 #include <sstream>
 #include <iomanip>
 #include <ios>
+#include <string.h>
+#ifdef LOG_ZLIB
+#include <zlib.h>
+#endif
 
 RawLogEvent::RawLogEvent(double time, uint32_t type, uint32_t id, uint32_t ev, 
                          double val1, double val2, double val3, string name = "") :
@@ -25,28 +29,81 @@ string RawLogEvent::str() {
 Logfile::Logfile(const string& filename, EventList& eventlist) 
 : _starttime(0), _eventlist(eventlist), 
   _preamble(ios_base::out | ios_base::in), 
-  _logfilename(filename), _numRecords(0)
+  _logfilename(filename), _numRecords(0), _compress(false)
 {
     _logfile = fopen(_logfilename.c_str(), "wbS");
     if (_logfile==NULL) {
         cerr << "Failed to open logfile " << _logfilename << endl;
         exit(1);
     }
+    LogFileHeader header;
+    memset(header.text, ' ', sizeof(header.text));
+    const char* text = "# htsim columnar log";
+    memcpy(header.text, text, strlen(text));
+    header.text[sizeof(header.text) - 1] = '\n';
+    fwrite(&header, sizeof(header), 1, _logfile);
+
+    _timeRec.reserve(LOG_BLOCK_RECORDS);
+    _val1Rec.reserve(LOG_BLOCK_RECORDS);
+    _val2Rec.reserve(LOG_BLOCK_RECORDS);
+    _val3Rec.reserve(LOG_BLOCK_RECORDS);
+    _typeRec.reserve(LOG_BLOCK_RECORDS);
+    _idRec.reserve(LOG_BLOCK_RECORDS);
+    _evRec.reserve(LOG_BLOCK_RECORDS);
 }
 
 Logfile::~Logfile() {
     if (_logfile != NULL) {
+        writeBlock();
+        writeTrailer();
         fclose(_logfile);
-        transposeLog();
     }
 }
 
+void
+Logfile::branch(const string& filename) {
+    // copy through a descriptor of our own: an inherited one shares
+    // its file offset with the parent and any siblings
+    fflush(_logfile);
+    long int written = ftell(_logfile);
+    FILE* from = fopen(_logfilename.c_str(), "rb");
+    FILE* to = fopen(filename.c_str(), "wbS");
+    if (from == NULL || to == NULL) {
+        cerr << "Failed to branch logfile " << _logfilename << " to " << filename << endl;
+        exit(1);
+    }
+    char buf[65536];
+    while (written > 0) {
+        size_t n = fread(buf, 1, min((long int)sizeof(buf), written), from);
+        if (n == 0) {
+            cerr << "Failed to read logfile " << _logfilename << endl;
+            exit(1);
+        }
+        fwrite(buf, 1, n, to);
+        written -= n;
+    }
+    fclose(from);
+    fclose(_logfile);
+    _logfile = to;
+    _logfilename = filename;
+}
+
 void
 Logfile::addLogger(Logger& logger) {
     logger.setLogfile(*this);
     _loggers.push_back(&logger);
 }
 
+void
+Logfile::setCompression(bool compress) {
+#ifndef LOG_ZLIB
+    if (compress) {
+        cerr << "Log compression needs a build with LOG_ZLIB defined" << endl;
+        exit(1);
+    }
+#endif
+    _compress = compress;
+}
 
 void 
 Logfile::write(const string& msg) {
@@ -68,83 +125,100 @@ Logfile::writeRecord(uint32_t type, uint32_t id, uint32_t ev,
                      double val1, double val2, double val3) {
     uint64_t time = _eventlist.now();
     if (time<_starttime) return;
-    double time_sec = timeAsSec(time);
-    fwrite(&time_sec, sizeof(double), 1, _logfile);
-    fwrite(&type, sizeof(uint32_t), 1, _logfile);
-    fwrite(&id, sizeof(uint32_t), 1, _logfile);
-    fwrite(&ev, sizeof(uint32_t), 1, _logfile);
-    fwrite(&val1, sizeof(double), 1, _logfile);
-    fwrite(&val2, sizeof(double), 1, _logfile);
-    fwrite(&val3, sizeof(double), 1, _logfile);
+    _timeRec.push_back(timeAsSec(time));
+    _typeRec.push_back(type);
+    _idRec.push_back(id);
+    _evRec.push_back(ev + 100*type);
+    _val1Rec.push_back(val1);
+    _val2Rec.push_back(val2);
+    _val3Rec.push_back(val3);
     _numRecords++;
+    if (_timeRec.size() == LOG_BLOCK_RECORDS)
+        writeBlock();
 }
 
 void
-Logfile::transposeLog() {
-    double* timeRec = new double[_numRecords];
-    uint32_t* typeRec = new uint32_t[_numRecords];
-    uint32_t* idRec = new uint32_t[_numRecords];
-    uint32_t* evRec = new uint32_t[_numRecords];
-    double* val1Rec = new double[_numRecords];
-    double* val2Rec = new double[_numRecords];
-    double *val3Rec = new double[_numRecords];
-    FILE* logfile;
-    logfile = fopen(_logfilename.c_str(),"rbS");
-    if (logfile==NULL) {
-        cerr << "Failed to open logfile " << _logfilename << endl;
-        exit(1);
-    }
-    size_t read;
-    double rd;
-    uint32_t ri;
-    int numread;
-    for (numread=0; numread<_numRecords; numread++) {
-        read = fread(&rd, sizeof(double), 1, logfile); if (read<1) break;
-        timeRec[numread] = rd;
-        read = fread(&ri, sizeof(uint32_t), 1, logfile); if (read<1) break;
-        typeRec[numread] = ri;
-        read = fread(&ri, sizeof(uint32_t), 1, logfile); if (read<1) break;
-        idRec[numread] = ri;
-        read = fread(&ri, sizeof(uint32_t), 1, logfile); if (read<1) break;
-        evRec[numread] = ri + 100*typeRec[numread];
-        read = fread(&rd, sizeof(double), 1, logfile); if (read<1) break;
-        val1Rec[numread] = rd;
-        read = fread(&rd, sizeof(double), 1, logfile); if (read<1) break;
-        val2Rec[numread] = rd;
-        read = fread(&rd, sizeof(double), 1, logfile); if (read<1) break;
-        val3Rec[numread] = rd;
-    }
-    fclose(logfile);
-    assert(numread==_numRecords);
-    _preamble << "# numrecords=" << numread << endl;
-    logfile = fopen(_logfilename.c_str(),"wbS");
-    if (logfile==0) {
-        cerr << "Failed to open logfile " << _logfilename << endl;
-        exit(1);
+Logfile::writeBlock() {
+    uint64_t records = _timeRec.size();
+    if (records == 0)
+        return;
+
+    LogBlockIndex entry;
+    entry.offset = ftell(_logfile);
+    entry.first_record = _numRecords - records;
+    entry.records = records;
+    entry.first_time = _timeRec.front();
+    entry.last_time = _timeRec.back();
+    _index.push_back(entry);
+
+    // lay the columns out as they will be on disk
+    uint64_t raw_bytes = log_block_bytes(records);
+    vector<char> data(raw_bytes, 0);
+    char* p = data.data();
+    const vector<double>* dcols[] = {&_timeRec, &_val1Rec, &_val2Rec, &_val3Rec};
+    for (int c = 0; c < 4; c++) {
+        memcpy(p, dcols[c]->data(), records * sizeof(double));
+        p += records * sizeof(double);
     }
-    while (true) {
-        if (_preamble.peek()==-1) break;
-        char thisLine[1000];
-        _preamble.getline(&thisLine[0],1000);
-        fputs(thisLine, logfile);
-        fputs("\n", logfile);
+    const vector<uint32_t>* icols[] = {&_typeRec, &_idRec, &_evRec};
+    for (int c = 0; c < 3; c++) {
+        memcpy(p, icols[c]->data(), records * sizeof(uint32_t));
+        p += records * sizeof(uint32_t);
     }
-    fputs("# transpose=0\n",logfile);
-    fputs("# TRACE\n",logfile);
-    for (int i=0; i < numread; i++) {
-        fwrite(&timeRec[i], sizeof(double), 1, logfile);
-        fwrite(&typeRec[i], sizeof(uint32_t), 1, logfile);
-        fwrite(&idRec[i],   sizeof(uint32_t), 1, logfile);
-        fwrite(&evRec[i],   sizeof(uint32_t), 1, logfile);
-        fwrite(&val1Rec[i], sizeof(double), 1, logfile);
-        fwrite(&val2Rec[i], sizeof(double), 1, logfile);
-        fwrite(&val3Rec[i], sizeof(double), 1, logfile);
+
+    LogBlockHeader header;
+    header.magic = LOG_BLOCK_MAGIC;
+    header.records = records;
+    header.flags = 0;
+    header.pad = 0;
+    header.raw_bytes = raw_bytes;
+    header.stored_bytes = raw_bytes;
+#ifdef LOG_ZLIB
+    if (_compress) {
+        uLongf compressed_bytes = compressBound(raw_bytes);
+        vector<char> compressed(compressed_bytes);
+        if (compress2((Bytef*)compressed.data(), &compressed_bytes,
+                      (const Bytef*)data.data(), raw_bytes, Z_BEST_SPEED) != Z_OK) {
+            cerr << "Failed to compress log block" << endl;
+            exit(1);
+        }
+        compressed.resize((compressed_bytes + 7) & ~(uLongf)7, 0);
+        data.swap(compressed);
+        header.flags |= LOG_BLOCK_ZLIB;
+        header.stored_bytes = data.size();
     }
-    fclose(logfile);
-    delete[] timeRec;
-    delete[] typeRec;
-    delete[] idRec;
-    delete[] evRec;
-    delete[] val1Rec;
-    delete[] val2Rec;
+#endif
+    fwrite(&header, sizeof(header), 1, _logfile);
+    fwrite(data.data(), 1, header.stored_bytes, _logfile);
+
+    _timeRec.clear();
+    _val1Rec.clear();
+    _val2Rec.clear();
+    _val3Rec.clear();
+    _typeRec.clear();
+    _idRec.clear();
+    _evRec.clear();
+}
+
+void
+Logfile::writeTrailer() {
+    LogFileTrailer trailer;
+    _preamble << "# numrecords=" << _numRecords << endl;
+    _preamble << "# format=columnar" << endl;
+    _preamble << "# TRACE" << endl;
+    string preamble = _preamble.str();
+    trailer.preamble_offset = ftell(_logfile);
+    trailer.preamble_bytes = preamble.size();
+    fwrite(preamble.data(), 1, preamble.size(), _logfile);
+    // keep the index 8-byte aligned for readers that mmap the file
+    static const char zeros[8] = {0};
+    fwrite(zeros, 1, (8 - preamble.size() % 8) % 8, _logfile);
+
+    trailer.index_offset = ftell(_logfile);
+    trailer.blocks = _index.size();
+    trailer.records = _numRecords;
+    memcpy(trailer.magic, LOG_FILE_MAGIC, sizeof(trailer.magic));
+    if (!_index.empty())
+        fwrite(_index.data(), sizeof(LogBlockIndex), _index.size(), _logfile);
+    fwrite(&trailer, sizeof(trailer), 1, _logfile);
 }
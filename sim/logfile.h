@@ -20,6 +20,63 @@
 class Logfile;
 class Logger;
 
+// On-disk format.  Records are buffered in memory and written out as
+// blocks, each holding up to LOG_BLOCK_RECORDS records stored column
+// by column (all the times, then all the val1s, ...), so a reader can
+// mmap or stream the file a block at a time.  The text preamble
+// (names and ids of logged objects) and an index of the blocks come
+// at the end, located by a fixed-size trailer:
+//
+//   LogFileHeader
+//   LogBlockHeader, block data     (repeated)
+//   preamble text
+//   LogBlockIndex                  (one per block)
+//   LogFileTrailer
+//
+// Block data is time[], val1[], val2[], val3[] (doubles) then type[],
+// id[], ev[] (uint32_t), padded to 8 bytes.  If the block is
+// LOG_BLOCK_ZLIB, the data is a single zlib stream; compression needs
+// a build with -DLOG_ZLIB and -lz.
+#define LOG_BLOCK_RECORDS 65536
+#define LOG_FILE_MAGIC "HTSIMCOL"
+#define LOG_BLOCK_MAGIC 0x4b4c4248 // "HBLK"
+#define LOG_BLOCK_ZLIB 1
+
+struct LogFileHeader {
+    char text[64];              // "# htsim columnar log\n", space padded
+};
+
+struct LogBlockHeader {
+    uint32_t magic;
+    uint32_t records;
+    uint32_t flags;
+    uint32_t pad;
+    uint64_t stored_bytes;      // size of the block data in the file
+    uint64_t raw_bytes;         // size of the block data uncompressed
+};
+
+struct LogBlockIndex {
+    uint64_t offset;            // of the LogBlockHeader
+    uint64_t first_record;
+    uint64_t records;
+    double first_time;
+    double last_time;
+};
+
+struct LogFileTrailer {
+    uint64_t preamble_offset;
+    uint64_t preamble_bytes;
+    uint64_t index_offset;
+    uint64_t blocks;
+    uint64_t records;
+    char magic[8];              // LOG_FILE_MAGIC, not NUL terminated
+};
+
+// bytes of block data for this many records, before compression
+inline uint64_t log_block_bytes(uint64_t records) {
+    return ((records * (4 * sizeof(double) + 3 * sizeof(uint32_t))) + 7) & ~(uint64_t)7;
+}
+
 class RawLogEvent {
  public:
     RawLogEvent(double time, uint32_t type, uint32_t id, uint32_t ev, 
@@ -45,17 +102,30 @@ class Logfile {
     void writeRecord(uint32_t type, uint32_t id, uint32_t ev, 
                      double val1, double val2, double val3); // prepend uint64_t time
     void addLogger(Logger& logger);
+    // compress blocks written from now on; needs a build with LOG_ZLIB
+    void setCompression(bool compress);
+    // carry on in a new file that starts with a copy of everything
+    // written so far.  For a forked child, see Sweep.
+    void branch(const string& filename);
+    const string& filename() const {return _logfilename;}
     simtime_picosec _starttime;
  private:
     EventList& _eventlist;
     vector<Logger*> _loggers;
     // managing the files for writing
-    void transposeLog();
+    void writeBlock();
+    void writeTrailer();
     stringstream _preamble;
     string _logfilename;
     FILE* _logfile;
     //bool _startedTrace;
     long int _numRecords;
+    bool _compress;
+
+    // the block being filled, one vector per column
+    vector<double> _timeRec, _val1Rec, _val2Rec, _val3Rec;
+    vector<uint32_t> _typeRec, _idRec, _evRec;
+    vector<LogBlockIndex> _index;
 };
 
 #endif
@@ -22,7 +22,7 @@ void LoggedManager::dump_idmap() {
     fout.close();
 }
 
-LoggedManager Logged::_logged_manager;
+thread_local LoggedManager Logged::_logged_manager;
 
 string Logger::event_to_str(RawLogEvent& event) {
     return event.str();
@@ -46,8 +46,8 @@ class Logged {
     static void dump_idmap() {_logged_manager.dump_idmap();}
  private:
     id_t _log_id;
-    static id_t LASTIDNUM;
-    static LoggedManager _logged_manager;
+    static thread_local id_t LASTIDNUM;
+    static thread_local LoggedManager _logged_manager;
 };
 
 class Logger {
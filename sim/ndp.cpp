@@ -26,33 +26,33 @@ using namespace std;
 //#define RCV_CWND 15
 #define RCV_CWND 0
 
-int NdpSrc::_global_node_count = 0;
+thread_local int NdpSrc::_global_node_count = 0;
 /* _rtt_hist is used to build a histogram of RTTs.  The index is in
    units of microseconds, and RTT is from when a packet is first sent
    til when it is ACKed, including any retransmissions.  You can read
    this out after the sim has finished if you care about this. */
-int NdpSrc::_rtt_hist[10000000] = {0};
+thread_local vector<int> NdpSrc::_rtt_hist;
 
 /* keep track of RTOs.  Generally, we shouldn't see RTOs if
    return-to-sender is enabled.  Otherwise we'll see them with very
    large incasts. */
-uint32_t NdpSrc::_global_rto_count = 0;
+thread_local uint32_t NdpSrc::_global_rto_count = 0;
 
 /* _min_rto can be tuned using SetMinRTO. Don't change it here.  */
-simtime_picosec NdpSrc::_min_rto = timeFromUs((uint32_t)DEFAULT_RTO_MIN);
+thread_local simtime_picosec NdpSrc::_min_rto = timeFromUs((uint32_t)DEFAULT_RTO_MIN);
 
 // You MUST set a route strategy.  The default is to abort without
 // running - this is deliberate!
-RouteStrategy NdpSrc::_route_strategy = NOT_SET;
-RouteStrategy NdpSink::_route_strategy = NOT_SET;
+thread_local RouteStrategy NdpSrc::_route_strategy = NOT_SET;
+thread_local RouteStrategy NdpSink::_route_strategy = NOT_SET;
 
 // _path_entropy_size is the number of paths we spray across.  If you don't set it, it will default to all paths.
-uint32_t NdpSrc::_path_entropy_size = 10000000;
+thread_local uint32_t NdpSrc::_path_entropy_size = 10000000;
 
-bool NdpSink::_oversubscribed_congestion_control = false;
-double NdpSink::_g = 1.0/16.0;
+thread_local bool NdpSink::_oversubscribed_congestion_control = false;
+thread_local double NdpSink::_g = 1.0/16.0;
 
-int ooo_distance = 0;
+thread_local int ooo_distance = 0;
 
 NdpSrc::NdpSrc(NdpLogger* logger, TrafficLogger* pktlogger, EventList &eventlist, bool rts, NdpRTSPacer* rts_pacer)
     : EventSource(eventlist,"ndp"), _logger(logger), _flow(pktlogger)
@@ -92,6 +92,7 @@ NdpSrc::NdpSrc(NdpLogger* logger, TrafficLogger* pktlogger, EventList &eventlist
     _pull_window = 0;
   
     _crt_path = 0; // used for SCATTER_PERMUTE route strategy
+    _path_source = NULL;
     _same_path_burst = 1;
 
     _feedback_count = 0;
@@ -198,8 +199,11 @@ void NdpSrc::set_paths(uint32_t no_of_paths){
 }
 
 
-void NdpSrc::set_paths(vector<const Route*>* rt_list){
-    uint32_t no_of_paths = rt_list->size();
+// pick which of path_count paths go in each of our path slots, and
+// reset the per-path state.  The routes themselves are filled in by
+// the caller.
+void NdpSrc::choose_paths(uint32_t path_count){
+    uint32_t no_of_paths = path_count;
     switch(_route_strategy) {
     case NOT_SET:
     case SINGLE_PATH:
@@ -228,27 +232,21 @@ void NdpSrc::set_paths(vector<const Route*>* rt_list){
         _path_counts_rto.resize(no_of_paths);
 #endif
 
-        // generate a randomize sequence of 0 .. size of rt_list - 1
-        vector <int> randseq(rt_list->size());
+        // generate a randomize sequence of 0 .. path_count - 1
+        _path_choice.resize(path_count);
         if (_route_strategy == SCATTER_ECMP) {
             // randsec may have duplicates, as with ECMP
-            randomize_sequence(randseq);
+            randomize_sequence(_path_choice);
         } else {
             // randsec will have no duplicates
-            permute_sequence(randseq);
+            permute_sequence(_path_choice);
         }
+        _path_choice.resize(no_of_paths);
 
         for (size_t i=0; i < no_of_paths; i++){
-            // we need to copy the route before adding endpoints, as
-            // it may be used in the reverse direction too.
-            // Pick a random route from the available ones
-            Route* tmp = new Route(*(rt_list->at(randseq[i])), *_sink);
-            //Route* tmp = new Route(*(rt_list->at(i)));
-            tmp->add_endpoints(this, _sink);
-            tmp->set_path_id(i, rt_list->size());
-            _paths[i] = tmp;
+            _paths[i] = NULL;
             _path_ids[i] = i;
-            _original_paths[i] = tmp;
+            _original_paths[i] = NULL;
 #ifdef DEBUG_PATH_STATS        
             _path_counts_new[i] = 0;
             _path_counts_rtx[i] = 0;
@@ -261,12 +259,52 @@ void NdpSrc::set_paths(vector<const Route*>* rt_list){
             _avoid_score[i] = 0;
             _bad_path[i] = false;
         }
-        _crt_path = 0;
-        permute_paths();
         break;
     }
 }
 
+// our own copy of a path, with our endpoints added
+Route* NdpSrc::make_path(const Route& orig, int path_id, uint32_t path_count){
+    // we need to copy the route before adding endpoints, as
+    // it may be used in the reverse direction too.
+    Route* tmp = new Route(orig, *_sink);
+    tmp->add_endpoints(this, _sink);
+    tmp->set_path_id(path_id, path_count);
+    _original_paths[path_id] = tmp;
+    return tmp;
+}
+
+void NdpSrc::set_paths(vector<const Route*>* rt_list){
+    choose_paths(rt_list->size());
+    for (size_t i=0; i < _paths.size(); i++){
+        // Pick a random route from the available ones
+        _paths[i] = make_path(*(rt_list->at(_path_choice[i])), i, rt_list->size());
+    }
+    vector<int>().swap(_path_choice);
+    _crt_path = 0;
+    permute_paths();
+}
+
+// as above, but the routes are only built when a path is first used
+void NdpSrc::set_paths(PathSource* paths){
+    _path_source = paths;
+    choose_paths(paths->path_count());
+    _crt_path = 0;
+    permute_paths();
+}
+
+// the route in slot i of the current permutation
+const Route* NdpSrc::path(uint32_t i){
+    const Route* rt = _paths.at(i);
+    if (!rt) {
+        assert(_path_source);
+        int id = _path_ids[i];
+        rt = make_path(*_path_source->path(_path_choice[id]), id, _path_source->path_count());
+        _paths[i] = rt;
+    }
+    return rt;
+}
+
 void NdpSrc::startflow(){
     cout << "startflow " <<  _flow._name <<  " CWND " << _cwnd << " rts " << _rts << " at " << timeAsUs(eventlist().now()) << endl;
     _highest_sent = 0;
@@ -305,7 +343,7 @@ void NdpSrc::startflow(){
                 p->set_route(*_route);
                 p->set_pathid(0);
             } else {
-                const Route *rt = _paths.at(choose_route());
+                const Route *rt = path(choose_route());
                 p->set_route(*rt);        
 #ifdef DEBUG_PATH_STATS        
                 _path_counts_rtx[p->path_id()]++;
@@ -543,7 +581,7 @@ void NdpSrc::processNack(const NdpNack& nack){
     case SCATTER_RANDOM:
     case PULL_BASED:
     case SCATTER_ECMP: {
-        const Route *rt = _paths.at(choose_route());
+        const Route *rt = path(choose_route());
         p = NdpPacket::newpkt(_flow, *rt, seqno, 0, _mss, true,
                     _paths.size()>0?_paths.size():1, last_packet,_dstaddr);
         break;
@@ -904,7 +942,7 @@ int NdpSrc::send_packet(NdpPull::seq_t pacer_no) {
                 break;
             }
         default:
-            const Route *rt = _paths.at(choose_route());
+            const Route *rt = path(choose_route());
             p->set_route(*rt);
 #ifdef DEBUG_PATH_STATS
             _path_counts_rtx[p->path_id()]++;
@@ -949,7 +987,7 @@ int NdpSrc::send_packet(NdpPull::seq_t pacer_no) {
         case SCATTER_ECMP:
         {
             assert(_paths.size() > 0);
-            const Route *rt = _paths.at(choose_route());
+            const Route *rt = path(choose_route());
             p = NdpPacket::newpkt(_flow, *rt, _highest_sent+1, pacer_no, _mss, false,
                                   _paths.size()>0?_paths.size():1, last_packet,_dstaddr);
             
@@ -1088,7 +1126,7 @@ NdpSrc::retransmit_packet() {
         case SCATTER_ECMP:
         {
             assert(_paths.size() > 0);
-            const Route* rt = _paths.at(_crt_path);
+            const Route* rt = path(_crt_path);
             p = NdpPacket::newpkt(_flow, *rt, seqno, 0, _mss, true,
                                   _paths.size(), last_packet,_dstaddr);
             if (_route_strategy == SCATTER_RANDOM) {
@@ -1171,9 +1209,12 @@ void NdpSrc::rtx_timer_hook(simtime_picosec now, simtime_picosec period) {
 
 void NdpSrc::log_rtt(simtime_picosec sent_time) {
     int64_t rtt = eventlist().now() - sent_time;
-    if (rtt >= 0) 
-        _rtt_hist[(int)timeAsUs(rtt)]++;
-    else
+    if (rtt >= 0) {
+        size_t us = (size_t)timeAsUs(rtt);
+        if (us >= _rtt_hist.size())
+            _rtt_hist.resize(us + 1);
+        _rtt_hist[us]++;
+    } else
         cout << "Negative RTT: " << rtt << endl;
 }
 
@@ -1214,6 +1255,7 @@ NdpSink::NdpSink(EventList& event, linkspeed_bps linkspeed, double pull_rate_mod
     : DataReceiver("ndp_sink"),_cumulative_ack(0) , _total_received(0), _ooo(0)
 {
     _src = 0;
+    _path_source = NULL;
     _pacer = new NdpPullPacer(event, linkspeed, pull_rate_modifier);
     //_pacer = new NdpPullPacer(event, "/Users/localadmin/poli/new-datacenter-protocol/data/1500.recv.cdf.pretty");
     
@@ -1252,6 +1294,7 @@ NdpSink::NdpSink(EventList& event, linkspeed_bps linkspeed, double pull_rate_mod
 NdpSink::NdpSink(NdpPullPacer* pacer) : DataReceiver("ndp_sink"),_cumulative_ack(0) , _total_received(0) , _ooo(0)
 {
     _src = 0;
+    _path_source = NULL;
     _pacer = pacer;
     _nodename = "ndpsink";
     _priority = 100; // lower is better
@@ -1355,6 +1398,45 @@ void NdpSink::set_paths(vector<const Route*>* rt_list){
     }
 }
 
+/* as above, but the routes are only built when a path is first used */
+void NdpSink::set_paths(PathSource* paths){
+    switch (_route_strategy) {
+    case SCATTER_PERMUTE:
+    case SCATTER_RANDOM:
+    case PULL_BASED:
+    case SCATTER_ECMP:
+        assert(_paths.size() == 0);
+        _path_source = paths;
+        _paths.resize(paths->path_count(), NULL);
+        _path_ids.resize(paths->path_count());
+        for (unsigned int i=0;i<_path_ids.size();i++){
+            _path_ids[i] = i;
+        }
+        _crt_path = 0;
+        permute_paths();
+        break;
+    case SINGLE_PATH:
+    case ECMP_FIB:
+    case ECMP_FIB_ECN:
+    case REACTIVE_ECN:
+    case NOT_SET:
+        abort();
+    }
+}
+
+// the route in slot i of the current permutation
+const Route* NdpSink::path(uint32_t i){
+    const Route* rt = _paths.at(i);
+    if (!rt) {
+        assert(_path_source);
+        Route* t = new Route(*_path_source->path(_path_ids[i]), *_src);
+        t->add_endpoints(this, _src);
+        _paths[i] = t;
+        rt = t;
+    }
+    return rt;
+}
+
 void NdpSink::set_paths(uint32_t no_of_paths){
     switch (_route_strategy) {
     case SCATTER_PERMUTE:
@@ -1427,7 +1509,7 @@ void NdpSink::receiver_increase(NdpPacket* p){
         if (_route)
             pull_pkt = NdpPull::newpkt(p->flow(),*_route,_cumulative_ack,++_pull_no,_srcaddr);
         else 
-            pull_pkt = NdpPull::newpkt(p->flow(),*(_paths[random()%_paths.size()]),_cumulative_ack,++_pull_no,_srcaddr);
+            pull_pkt = NdpPull::newpkt(p->flow(),*path(random()%_paths.size()),_cumulative_ack,++_pull_no,_srcaddr);
     
         _pacer->enqueue_pull(pull_pkt, this);
         _parked_increase = _pacer->pacer_no();
@@ -1549,35 +1631,22 @@ void NdpSink::receivePacket(Packet& pkt) {
     if (seqno == _cumulative_ack+1) { // it's the next expected seq no
                 _cumulative_ack = seqno + size - 1;
                 // are there any additional received packets we can now ack?
-                while (!_received.empty() && (_received.front() == _cumulative_ack+1) ) {
-                        _received.pop_front();
-                        _cumulative_ack+= size;
-                        if (_buffer_logger) _buffer_logger->logBuffer(ReorderBufferLogger::BUF_DEQUEUE);
+                uint64_t filled = _received.advance(_cumulative_ack+1);
+                _cumulative_ack += filled * size;
+                if (_buffer_logger) {
+                        for (uint64_t i = 0; i < filled; i++)
+                                _buffer_logger->logBuffer(ReorderBufferLogger::BUF_DEQUEUE);
                 }
     } else if (seqno < _cumulative_ack+1) {
                 //must have been a bad retransmit
     } else { // it's not the next expected sequence number
-                if (_received.empty()) {
-                        _received.push_front(seqno);
-                        if (_buffer_logger) _buffer_logger->logBuffer(ReorderBufferLogger::BUF_ENQUEUE);
-                        
-                        //commenting out the code below, probably copied from TCP and innacurate for NDP where reordering is expected
-                        //it's a drop in this simulator there are no reorderings.
-                        //_drops += (size + seqno-_cumulative_ack-1)/size;
-                } else if (seqno > _received.back()) { // likely case
-                        _received.push_back(seqno);
+                //commenting out the code below, probably copied from TCP and innacurate for NDP where reordering is expected
+                //it's a drop in this simulator there are no reorderings.
+                //_drops += (size + seqno-_cumulative_ack-1)/size;
+
+                // insert fails if we already have it - a bad retransmit
+                if (_received.insert(seqno, size)) {
                         if (_buffer_logger) _buffer_logger->logBuffer(ReorderBufferLogger::BUF_ENQUEUE);
-                } 
-                else { // uncommon case - it fills a hole
-                        list<uint64_t>::iterator i;
-                        for (i = _received.begin(); i != _received.end(); i++) {
-                                if (seqno == *i) break; // it's a bad retransmit
-                                if (seqno < (*i)) {
-                                        _received.insert(i, seqno);
-                                        if (_buffer_logger) _buffer_logger->logBuffer(ReorderBufferLogger::BUF_ENQUEUE);
-                                        break;
-                                }
-                    }
                 }
                 if (_ooo < _received.size())
                         _ooo = _received.size();
@@ -1621,7 +1690,7 @@ void NdpSink::process_request_to_send(NdpRTS* pkt){
                     _crt_path = 0;
                 }
             }
-            r = _paths.at(_crt_path);
+            r = path(_crt_path);
         }
         
         NdpPull* pull_pkt = NdpPull::newpkt(pkt,*r,_cumulative_ack,_pull_no,_srcaddr);
@@ -1669,7 +1738,7 @@ void NdpSink::send_ack(simtime_picosec ts, NdpPacket::seq_t ackno,
     case PULL_BASED:
     case SCATTER_ECMP:
         assert(_paths.size() > 0);
-        ack = NdpAck::newpkt(_src->_flow, *(_paths.at(_crt_path)), 0, ackno, 
+        ack = NdpAck::newpkt(_src->_flow, *path(_crt_path), 0, ackno, 
                     _cumulative_ack, _pull_no, 
                     _path_history[_path_hist_index].path_id(), _srcaddr);
         if (_route_strategy == SCATTER_RANDOM) {
@@ -1739,7 +1808,7 @@ void NdpSink::send_nack(simtime_picosec ts, NdpPacket::seq_t ackno, NdpPacket::s
     case PULL_BASED:
     case SCATTER_ECMP:
         assert(_paths.size() > 0);
-        nack = NdpNack::newpkt(_src->_flow, *(_paths.at(_crt_path)), 0, ackno, 
+        nack = NdpNack::newpkt(_src->_flow, *path(_crt_path), 0, ackno, 
                     _cumulative_ack, _pull_no,
                     _path_history[_path_hist_index].path_id(),_srcaddr);
         if (_route_strategy == SCATTER_RANDOM) {
@@ -1804,8 +1873,8 @@ void NdpSink::permute_paths() {
 }
 
 
-double* NdpPullPacer::_pull_spacing_cdf = NULL;
-int NdpPullPacer::_pull_spacing_cdf_count = 0;
+thread_local double* NdpPullPacer::_pull_spacing_cdf = NULL;
+thread_local int NdpPullPacer::_pull_spacing_cdf_count = 0;
 
 
 /* Every NdpSink needs an NdpPullPacer to pace out it's PULL packets.
@@ -1952,7 +2021,7 @@ void NdpPullPacer::sendPacket(Packet* ack, NdpPacket::seq_t rcvd_pacer_no, NdpSi
     }
     pull_pkt->flow().logTraffic(*pull_pkt,*this,TrafficLogger::PKT_CREATE);
 
-    _pull_queue.enqueue(*pull_pkt, receiver->priority());
+    _pull_queue.enqueue(*pull_pkt, receiver->pull_queue_flow(), receiver->priority());
 
     ack->flow().logTraffic(*ack,*this,TrafficLogger::PKT_SEND);
     //cout << "Sending Plain ACK with pullno " <<  ((NdpAck*)ack)->pullno() << endl;
@@ -1989,7 +2058,7 @@ void NdpPullPacer::enqueue_pull(NdpPull* pkt, NdpSink* receiver){
     bool should_tx = _pull_queue.empty() && (_last_pull==0 || (delta >= _packet_drain_time));
     bool should_schedule = _pull_queue.empty() && delta < _packet_drain_time;
 
-    _pull_queue.enqueue(*pkt, receiver->priority());
+    _pull_queue.enqueue(*pkt, receiver->pull_queue_flow(), receiver->priority());
     /*
     if (_log_me){
         cout << "Enqueue pull, pull queue size is " << _pull_queue.pull_count() << " should_tx is " << should_tx << " delta " << timeAsUs(delta) << " drain " << timeAsUs(_packet_drain_time) << endl;
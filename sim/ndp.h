@@ -15,6 +15,7 @@
 #include "priopullqueue.h"
 #include "trigger.h"
 #include "eventlist.h"
+#include "reorder_scoreboard.h"
 
 #define timeInf 0
 #define NDP_PACKET_SCATTER
@@ -89,6 +90,7 @@ class NdpSrc : public PacketSink, public EventSource, public TriggerTarget {
     
     //used by all routing strategies except SINGLE and ECMP_FIB
     void set_paths(vector<const Route*>* rt);
+    void set_paths(PathSource* paths);
 
     //used by ECMP_FIB strategy
     void set_paths(uint32_t path_count);
@@ -121,6 +123,8 @@ class NdpSrc : public PacketSink, public EventSource, public TriggerTarget {
     uint32_t _dstaddr;
     vector<const Route*> _paths;
     vector<const Route*> _original_paths; //paths in original permutation order
+    PathSource* _path_source; // where to build paths from, if they are built as they are used
+    vector<int> _path_choice; // which path from _path_source each original path is
 #ifdef DEBUG_PATH_STATS
     vector<int> _path_counts_new; // only used for debugging, can remove later.
     vector<int> _path_counts_rtx; // only used for debugging, can remove later.
@@ -175,12 +179,12 @@ class NdpSrc : public PacketSink, public EventSource, public TriggerTarget {
     void log_me();
     bool _log_me;
 
-    static uint32_t _global_rto_count;  // keep track of the total number of timeouts across all srcs
-    static simtime_picosec _min_rto;
-    static RouteStrategy _route_strategy;
-    static uint32_t _path_entropy_size; // now many paths do we include in our path set
-    static int _global_node_count;
-    static int _rtt_hist[10000000];
+    static thread_local uint32_t _global_rto_count;  // keep track of the total number of timeouts across all srcs
+    static thread_local simtime_picosec _min_rto;
+    static thread_local RouteStrategy _route_strategy;
+    static thread_local uint32_t _path_entropy_size; // now many paths do we include in our path set
+    static thread_local int _global_node_count;
+    static thread_local vector<int> _rtt_hist;
     int _node_num;
 
  private:
@@ -205,6 +209,9 @@ class NdpSrc : public PacketSink, public EventSource, public TriggerTarget {
     void clear_timer(uint64_t start,uint64_t end);
     void retransmit_packet();
     void permute_paths();
+    void choose_paths(uint32_t path_count);
+    Route* make_path(const Route& orig, int path_id, uint32_t path_count);
+    const Route* path(uint32_t i);
     void update_rtx_time();
     void process_cumulative_ack(NdpPacket::seq_t cum_ackno);
     inline void count_ack(int32_t path_id) {count_feedback(path_id, ACK);}
@@ -253,7 +260,7 @@ class NdpSink : public PacketSink, public DataReceiver {
     void set_src(uint32_t s) {_srcaddr = s;}
     void set_end_trigger(Trigger& trigger);
 
-    list<NdpAck::seq_t> _received; // list of packets above a hole, that we've received
+    ReorderScoreboard _received; // packets above a hole, that we've received
  
     NdpSrc* _src;
 
@@ -265,6 +272,7 @@ class NdpSink : public PacketSink, public DataReceiver {
     
     //needed by all strategies except SINGLE and ECMP_FIB
     void set_paths(vector<const Route*>* rt);
+    void set_paths(PathSource* paths);
     void set_paths(uint32_t no_of_paths);
 
 #ifdef RECORD_PATH_LENS
@@ -272,15 +280,19 @@ class NdpSink : public PacketSink, public DataReceiver {
     vector<uint32_t> _path_lens;
     vector<uint32_t> _trimmed_path_lens;
 #endif
-    static RouteStrategy _route_strategy;
+    static thread_local RouteStrategy _route_strategy;
 
     uint64_t reorder_buffer_size() {return _received.size();};
     uint64_t reorder_buffer_max() {return _ooo;};
 
     void set_priority(int priority) {_priority = priority;}
     inline int priority() const {return _priority;}
-    static bool _oversubscribed_congestion_control;
-    static double _g;
+    // share of the pacer's pulls this sink gets relative to others on
+    // the same pacer (fair pull queue only)
+    void set_pull_weight(uint32_t weight) {_pull_queue_flow.set_weight(weight);}
+    PullQueueFlow& pull_queue_flow() {return _pull_queue_flow;}
+    static thread_local bool _oversubscribed_congestion_control;
+    static thread_local double _g;
  private:
  
     // Connectivity
@@ -297,6 +309,8 @@ class NdpSink : public PacketSink, public DataReceiver {
     vector<int> _path_ids; // path IDs to be used for ECMP FIB. 
     vector<const Route*> _paths; //paths in current permutation order
     vector<const Route*> _original_paths; //paths in original permutation order
+    PathSource* _path_source; // where to build paths from, if they are built as they are used
+    const Route* path(uint32_t i);
     const Route* _route;
     Trigger* _end_trigger;
 
@@ -310,6 +324,7 @@ class NdpSink : public PacketSink, public DataReceiver {
     uint64_t _total_received;
     NdpPacket::seq_t _highest_seqno;
     int _priority; // this receiver's priority relative to others on same pacer - low is best
+    PullQueueFlow _pull_queue_flow; // our pulls queued at the pacer
 
     uint32_t _parked_cwnd;
     uint32_t _parked_increase;
@@ -378,8 +393,8 @@ class NdpPullPacer : public EventSource {
     NdpPull::seq_t _pacer_no; // pull sequence number, shared by all connections on this pacer
 
     //pull distribution from real life
-    static int _pull_spacing_cdf_count;
-    static double* _pull_spacing_cdf;
+    static thread_local int _pull_spacing_cdf_count;
+    static thread_local double* _pull_spacing_cdf;
 
     //debugging
     double _total_excess;
@@ -82,6 +82,8 @@ public:
     }
 
     void free() {_packetdb.freePacket(this);}
+    // pre-allocate room for count packets in flight
+    static void reserve(size_t count) {_packetdb.reserve(count);}
     virtual ~NdpPacket(){}
     inline seq_t seqno() const {return _seqno;}
     inline seq_t pacerno() const {return _pacerno;}
@@ -117,7 +119,7 @@ protected:
     bool _last_packet;  // set to true in the last packet in a flow.
     int32_t _trim_hop;
     packet_direction _trim_direction;
-    static PacketDB<NdpPacket> _packetdb;
+    static thread_local PacketDB<NdpPacket> _packetdb;
 };
 
 class NdpAck : public Packet {
@@ -172,7 +174,7 @@ protected:
     int32_t _path_id; //see comment in NdpPull
     bool _pull;
     bool _ecn_echo;
-    static PacketDB<NdpAck> _packetdb;
+    static thread_local PacketDB<NdpAck> _packetdb;
 };
 
 
@@ -228,7 +230,7 @@ protected:
     int32_t _path_id;
     bool _pull;
     bool _ecn_echo;
-    static PacketDB<NdpNack> _packetdb;
+    static thread_local PacketDB<NdpNack> _packetdb;
 };
 
 class NdpRTS : public Packet {
@@ -279,7 +281,7 @@ protected:
     simtime_picosec _ts;
     seq_t _grants;
     int32_t _path_id; // indicates ??
-    static PacketDB<NdpRTS> _packetdb;
+    static thread_local PacketDB<NdpRTS> _packetdb;
 };
 
 
@@ -400,7 +402,7 @@ protected:
     seq_t _cumulative_ack;
     seq_t _pullno;
     int32_t _path_id; // indicates ??
-    static PacketDB<NdpPull> _packetdb;
+    static thread_local PacketDB<NdpPull> _packetdb;
 };
 
 #endif
@@ -23,20 +23,20 @@
 //#define RCV_CWND 15
 #define RCV_CWND 0
 
-int NdpTunnelSrc::_global_node_count = 0;
+thread_local int NdpTunnelSrc::_global_node_count = 0;
 
 /* keep track of RTOs.  Generally, we shouldn't see RTOs if
    return-to-sender is enabled.  Otherwise we'll see them with very
    large incasts. */
-uint32_t NdpTunnelSrc::_global_rto_count = 0;
+thread_local uint32_t NdpTunnelSrc::_global_rto_count = 0;
 
 /* _min_rto can be tuned using SetMinRTO. Don't change it here.  */
-simtime_picosec NdpTunnelSrc::_min_rto = timeFromUs((uint32_t)DEFAULT_RTO_MIN);
+thread_local simtime_picosec NdpTunnelSrc::_min_rto = timeFromUs((uint32_t)DEFAULT_RTO_MIN);
 
 // You MUST set a route strategy.  The default is to abort without
 // running - this is deliberate!
-RouteStrategy NdpTunnelSrc::_route_strategy = NOT_SET;
-RouteStrategy NdpTunnelSink::_route_strategy = NOT_SET;
+thread_local RouteStrategy NdpTunnelSrc::_route_strategy = NOT_SET;
+thread_local RouteStrategy NdpTunnelSink::_route_strategy = NOT_SET;
 
 NdpTunnelSrc::NdpTunnelSrc(NdpTunnelLogger* logger, TrafficLogger* pktlogger, EventList &eventlist)
     : EventSource(eventlist,"ndp"),  _logger(logger), _flow(pktlogger)
@@ -982,8 +982,8 @@ void NdpTunnelSink::permute_paths() {
 }
 
 
-double* NdpTunnelPullPacer::_pull_spacing_cdf = NULL;
-int NdpTunnelPullPacer::_pull_spacing_cdf_count = 0;
+thread_local double* NdpTunnelPullPacer::_pull_spacing_cdf = NULL;
+thread_local int NdpTunnelPullPacer::_pull_spacing_cdf_count = 0;
 
 /* Every NdpTunnelSink needs an NdpTunnelPullPacer to pace out it's PULL packets.
    Multiple incoming flows at the same receiving node much share a
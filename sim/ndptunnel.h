@@ -121,11 +121,11 @@ public:
     void log_me();
     bool _log_me;
 
-    static uint32_t _global_rto_count;  // keep track of the total number of timeouts across all srcs
-    static simtime_picosec _min_rto;
-    static RouteStrategy _route_strategy;
-    static int _global_node_count;
-    static int _rtt_hist[10000000];
+    static thread_local uint32_t _global_rto_count;  // keep track of the total number of timeouts across all srcs
+    static thread_local simtime_picosec _min_rto;
+    static thread_local RouteStrategy _route_strategy;
+    static thread_local int _global_node_count;
+    static thread_local int _rtt_hist[10000000];
     int _node_num;
 
  private:
@@ -183,7 +183,7 @@ class NdpTunnelSink : public PacketSink, public DataReceiver {
 
     void set_paths(vector<const Route*>* rt);
 
-    static RouteStrategy _route_strategy;
+    static thread_local RouteStrategy _route_strategy;
     int priority() const {return _priority;}
  private:
  
@@ -250,8 +250,8 @@ class NdpTunnelPullPacer : public EventSource {
     NdpPull::seq_t _pacer_no; // pull sequence number, shared by all connections on this pacer
 
     //pull distribution from real life
-    static int _pull_spacing_cdf_count;
-    static double* _pull_spacing_cdf;
+    static thread_local int _pull_spacing_cdf_count;
+    static thread_local double* _pull_spacing_cdf;
 
     //debugging
     double _total_excess;
@@ -115,7 +115,7 @@ protected:
     Packet* _encap_packet;
     bool _last_packet;  // set to true in the last packet in a flow.
     
-    static PacketDB<NdpTunnelPacket> _packetdb;
+    static thread_local PacketDB<NdpTunnelPacket> _packetdb;
 };
 
 #endif
@@ -1,9 +1,12 @@
 // -*- c-basic-offset: 4; indent-tabs-mode: nil -*- 
 #include "network.h"
+#include <cxxabi.h>
+#include <iomanip>
+#include <sys/mman.h>
 
 #define DEFAULTDATASIZE 1500
-int Packet::_data_packet_size = DEFAULTDATASIZE;
-bool Packet::_packet_size_fixed = false;
+thread_local int Packet::_data_packet_size = DEFAULTDATASIZE;
+thread_local bool Packet::_packet_size_fixed = false;
 PacketFlow Packet::_defaultFlow(nullptr);
 
 // use set_attrs only when we want to do a late binding of the route -
@@ -52,38 +55,6 @@ Packet::set_route(const Route *route){
     //_detour = NULL;
 }
 
-PacketSink *
-Packet::sendOn() {
-    PacketSink* nextsink;
-
-    /*if (_detour){
-        nextsink = _detour;
-        _detour = NULL;
-        }else*/
-    
-    if (_route) {
-        if (_bounced) {
-            assert(_nexthop > 0);
-            assert(_nexthop < _route->size());
-            assert(_nexthop < _route->reverse()->size());
-            //assert(_route->size() == _route->reverse()->size());
-            nextsink = _route->reverse()->at(_nexthop);
-            _nexthop++;
-        } else {
-            assert(_nexthop<_route->size());
-            nextsink = _route->at(_nexthop);
-            _nexthop++;
-        }
-    } else if (_next_routed_hop)
-        nextsink = _next_routed_hop;
-    else {
-        assert(0);
-    }
-    //cout << "sendOn nextsink is: " << nextsink->nodename() << endl;
-    nextsink->receivePacket(*this);
-    return nextsink;
-}
-
 PacketSink *
 Packet::sendOn2(VirtualQueue* crtSink) {
     PacketSink* nextsink;
@@ -243,7 +214,7 @@ Packet::str() const {
 
 // flow ids above this are dynamically allocated; ones less than this can be manually allocated
 #define FLOW_ID_DYNAMIC_BASE 1000000000
-flowid_t PacketFlow::_max_flow_id = FLOW_ID_DYNAMIC_BASE;
+thread_local flowid_t PacketFlow::_max_flow_id = FLOW_ID_DYNAMIC_BASE;
 
 PacketFlow::PacketFlow(TrafficLogger* logger)
     : Logged("PacketFlow"),
@@ -280,4 +251,86 @@ void print_route(const Route& route) {
     cout << endl;
 }
 
-Logged::id_t Logged::LASTIDNUM = 1;
+thread_local Logged::id_t Logged::LASTIDNUM = 1;
+
+thread_local bool PacketDBBase::_use_huge_pages = false;
+
+vector<PacketDBBase*>&
+PacketDBBase::registry() {
+    // function-local so it exists before any PacketDB is constructed
+    static thread_local vector<PacketDBBase*> dbs;
+    return dbs;
+}
+
+PacketDBBase::PacketDBBase(size_t object_size)
+    : _object_size(object_size), _live(0), _peak(0), _capacity(0) {
+    registry().push_back(this);
+}
+
+PacketDBBase::~PacketDBBase() {
+    vector<PacketDBBase*>& dbs = registry();
+    for (size_t i = 0; i < dbs.size(); i++) {
+        if (dbs[i] == this) {
+            dbs.erase(dbs.begin() + i);
+            break;
+        }
+    }
+}
+
+#define CACHE_LINE_SIZE 64
+#define SLAB_BYTES (64 * 1024)
+#define HUGE_PAGE_BYTES (2 * 1024 * 1024)
+
+void*
+PacketDBBase::allocSlab(size_t& count) {
+    // Slabs are never freed: packets are recycled through the
+    // freelist instead.  Round up to fill the slab.
+    size_t align = _use_huge_pages ? HUGE_PAGE_BYTES : CACHE_LINE_SIZE;
+    size_t min_bytes = _use_huge_pages ? HUGE_PAGE_BYTES : SLAB_BYTES;
+    size_t bytes = max(count * _object_size, min_bytes);
+    bytes = (bytes + align - 1) / align * align;
+    void* slab;
+    if (posix_memalign(&slab, align, bytes) != 0) {
+        cerr << "Failed to allocate " << bytes << " bytes for packets" << endl;
+        abort();
+    }
+#ifdef MADV_HUGEPAGE
+    if (_use_huge_pages)
+        madvise(slab, bytes, MADV_HUGEPAGE);
+#endif
+    count = bytes / _object_size;
+    return slab;
+}
+
+void
+PacketDBBase::printStats(ostream& out) {
+    vector<PacketDBBase*>& dbs = registry();
+    size_t total_peak = 0, total_capacity = 0;
+    out << "Packet memory:" << endl;
+    for (size_t i = 0; i < dbs.size(); i++) {
+        PacketDBBase* db = dbs[i];
+        if (db->capacity() == 0)
+            continue;
+        out << "  " << left << setw(20) << db->name() << right
+            << " size " << setw(4) << db->object_size()
+            << " live " << setw(9) << db->live()
+            << " peak " << setw(9) << db->peak()
+            << " allocated " << setw(9) << db->capacity()
+            << " peak_bytes " << setw(11) << db->peak() * db->object_size()
+            << " allocated_bytes " << setw(11) << db->capacity() * db->object_size() << endl;
+        total_peak += db->peak() * db->object_size();
+        total_capacity += db->capacity() * db->object_size();
+    }
+    out << "  total peak_bytes " << total_peak << " allocated_bytes " << total_capacity << endl;
+}
+
+string
+demangle(const char* mangled) {
+    int status;
+    char* name = abi::__cxa_demangle(mangled, NULL, NULL, &status);
+    if (status != 0)
+        return mangled;
+    string result(name);
+    free(name);
+    return result;
+}
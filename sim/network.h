@@ -4,6 +4,7 @@
 
 #include <vector>
 #include <iostream>
+#include <typeinfo>
 #include "config.h"
 #include "loggertypes.h"
 #include "route.h"
@@ -36,7 +37,7 @@ class PacketFlow : public Logged {
     inline flowid_t flow_id() const {return _flow_id;}
     bool log_me() const {return _logger != NULL;}
  protected:
-    static packetid_t _max_flow_id;
+    static thread_local packetid_t _max_flow_id;
     flowid_t _flow_id;
     TrafficLogger* _logger;
 };
@@ -92,13 +93,15 @@ class Packet {
         return _data_packet_size;
     }
 
-    virtual PacketSink* sendOn(); // "go on to the next hop along your route"
-                                  // returns what that hop is
+    // The per-hop calls below are not virtual, so a hop costs one
+    // virtual call, to the next sink's receivePacket.
+    inline PacketSink* sendOn(); // "go on to the next hop along your route"
+                                 // returns what that hop is
 
-    virtual PacketSink* previousHop() {if (_nexthop>=2) return _route->at(_nexthop-2); else return NULL;}
-    virtual PacketSink* currentHop() {if (_nexthop>=1) return _route->at(_nexthop-1); else return NULL;}
+    PacketSink* previousHop() {if (_nexthop>=2) return _route->at(_nexthop-2); else return NULL;}
+    PacketSink* currentHop() {if (_nexthop>=1) return _route->at(_nexthop-1); else return NULL;}
     
-    virtual PacketSink* sendOn2(VirtualQueue* crtSink);
+    PacketSink* sendOn2(VirtualQueue* crtSink);
 
     uint16_t size() const {return _size;}
     void set_size(int i) {_size = i;}
@@ -120,13 +123,13 @@ class Packet {
     inline void set_next_hop(PacketSink* snk) { _next_routed_hop = snk;}
 
     virtual void strip_payload() { assert(!_is_header); _is_header = true;};
-    virtual void bounce();
-    virtual void unbounce(uint16_t pktsize);
+    void bounce();
+    void unbounce(uint16_t pktsize);
     inline uint32_t path_len() const {return _path_len;}
 
-    virtual void go_up(){ if (_direction == NONE) _direction = UP; else if (_direction == DOWN) abort();}
-    virtual void go_down(){ if (_direction == UP) _direction = DOWN; else if (_direction == NONE) abort();}
-    virtual void set_direction(packet_direction d){ 
+    void go_up(){ if (_direction == NONE) _direction = UP; else if (_direction == DOWN) abort();}
+    void go_down(){ if (_direction == UP) _direction = DOWN; else if (_direction == NONE) abort();}
+    void set_direction(packet_direction d){ 
         if (d==_direction) return; 
         if ((_direction == NONE) || (_direction == UP && d==DOWN)) 
             _direction = d; 
@@ -136,9 +139,11 @@ class Packet {
         }
     }
 
+    // only priority queues ask, and the answer can depend on the
+    // subclass's state (trimmed, speculative), so this stays virtual
     virtual PktPriority priority() const = 0;
 
-    virtual packet_direction get_direction() {return _direction;}
+    packet_direction get_direction() const {return _direction;}
 
     void inc_ref_count() { _refcount++;};
     void dec_ref_count() { _refcount--;};
@@ -162,43 +167,56 @@ class Packet {
  protected:
     void set_attrs(PacketFlow& flow, int pkt_size, packetid_t id);
 
-    static int _data_packet_size; // default size of a TCP or NDP data packet,
+    static thread_local int _data_packet_size; // default size of a TCP or NDP data packet,
                                   // measured in bytes
-    static bool _packet_size_fixed; //prevent foot-shooting
-    
-    packet_type _type;
-    
-    uint16_t _size,_oldsize;
-    
+    static thread_local bool _packet_size_fixed; //prevent foot-shooting
     
+    // Laid out so that what a queue, pipe or switch reads on each hop
+    // shares the first cache line with the vtable pointer; the rest
+    // is only used on bounces, lossless queues and BCube.  Keep it
+    // that way when adding fields: the static_assert below is the
+    // budget.
+
+    // A packet can contain a route or a routegraph, but not both.
+    // Eventually switch over entirely to RouteGraph?
+    const Route* _route;
+
+    //used when using routing tables in switches, i.e. the packet has no route.
+    PacketSink* _next_routed_hop;
+
+    PacketFlow* _flow{nullptr};
+
+    //PacketSink* _detour;
+    uint32_t _nexthop;
+
+    uint16_t _size;
     bool _is_header;
     bool _bounced; // packet has hit a full queue, and is being bounced back to the sender
     uint32_t _flags; // used for ECN & friends
 
     uint32_t _dst; //used for packets that do not have a route in switched networks.    
     uint32_t _pathid;  //used for ECMP hashing.
+    packet_type _type;
     packet_direction _direction; //used to avoid loop in FatTrees.   
+    packetid_t _id;
 
-    // A packet can contain a route or a routegraph, but not both.
-    // Eventually switch over entirely to RouteGraph?
-    const Route* _route;
-
-    //PacketSink* _detour;
-    uint32_t _nexthop,_oldnexthop;
+    // cold
+    LosslessInputQueue* _ingressqueue;
+    uint32_t _oldnexthop;
+    uint32_t _path_len; // length of the path in hops - used in BCube priority routing with NDP
+    uint16_t _oldsize;
 
     //used for tunneling purposes when one packet can be referenced by multiple classes
-    uint8_t _refcount;
-
-    //used when using routing tables in switches, i.e. the packet has no route.
-    PacketSink* _next_routed_hop;
+    uint16_t _refcount;
 
-    packetid_t _id;
-    PacketFlow* _flow{nullptr};
+    // shared by every thread's simulation: nothing changes it once built
     static PacketFlow _defaultFlow;
-    LosslessInputQueue* _ingressqueue;
-    uint32_t _path_len; // length of the path in hops - used in BCube priority routing with NDP
 };
 
+#if defined(__x86_64__) || defined(__aarch64__)
+static_assert(sizeof(Packet) <= 88, "Packet has outgrown its size budget");
+#endif
+
 class PacketSink {
  public:
     PacketSink() { _remoteEndpoint = NULL; }
@@ -217,50 +235,116 @@ class PacketSink {
     PacketSink* _remoteEndpoint;
 };
 
+inline PacketSink*
+Packet::sendOn() {
+    PacketSink* nextsink;
+    if (_route) {
+        if (_bounced) {
+            assert(_nexthop > 0);
+            assert(_nexthop < _route->size());
+            assert(_nexthop < _route->reverse()->size());
+            nextsink = _route->reverse()->at(_nexthop);
+        } else {
+            assert(_nexthop<_route->size());
+            nextsink = _route->at(_nexthop);
+        }
+        _nexthop++;
+    } else {
+        assert(_next_routed_hop);
+        nextsink = _next_routed_hop;
+    }
+    nextsink->receivePacket(*this);
+    return nextsink;
+}
+
 
 // For speed, it may be useful to keep a database of all packets that
 // have been allocated -- that way we don't need a malloc for every
 // new packet, we can just reuse old packets. Care, though -- the set()
 // method will need to be invoked properly for each new/reused packet
+//
+// Packets are carved out of cache-line aligned slabs, so packets of
+// the same type sit together in memory, and each PacketDB keeps
+// live/peak counts so we can see where the memory in a run goes.
+
+class PacketDBBase {
+ public:
+    PacketDBBase(size_t object_size);
+    virtual ~PacketDBBase();
+    virtual string name() const = 0;
+
+    size_t live() const {return _live;}
+    size_t peak() const {return _peak;}
+    size_t capacity() const {return _capacity;}
+    size_t object_size() const {return _object_size;}
+
+    // print live/peak/allocated counts and bytes for every packet type used so far
+    static void printStats(ostream& out);
+    // back slabs allocated from now on with transparent huge pages
+    static void setHugePages(bool use_huge_pages) {_use_huge_pages = use_huge_pages;}
+
+ protected:
+    // returns a cache-line aligned slab with room for at least count objects
+    void* allocSlab(size_t& count);
+
+    size_t _object_size;
+    size_t _live;
+    size_t _peak;
+    size_t _capacity;
+    static thread_local bool _use_huge_pages;
+ private:
+    static vector<PacketDBBase*>& registry();
+};
 
 template<class P>
-class PacketDB {
+class PacketDB : public PacketDBBase {
  public:
-    PacketDB() : _alloc_count(0) {}
-    ~PacketDB() {
-        //cout << "Pkt count: " << _alloc_count << endl;
-        //cout << "Pkt mem used: " << _alloc_count * sizeof(P) << endl;
-    }
+    PacketDB() : PacketDBBase(sizeof(P)) {}
+    virtual string name() const;
+
     P* allocPacket() {
-        if (_freelist.empty()) {
-            P* p = new P();
-            p->inc_ref_count();
-            /*
-            if (_alloc_count == 0) {
-                cout << "Packet size: " << sizeof(P) << endl;
-            }
-            */
-            _alloc_count++;
-            return p;
-        } else {
-            P* p = _freelist.back();
-            _freelist.pop_back();
-            p->inc_ref_count();
-            return p;
-        }
+        if (_freelist.empty())
+            grow(_capacity < SLAB_MIN_PACKETS ? SLAB_MIN_PACKETS : _capacity);
+        P* p = _freelist.back();
+        _freelist.pop_back();
+        p->inc_ref_count();
+        if (++_live > _peak)
+            _peak = _live;
+        return p;
     };
     void freePacket(P* pkt) {
         assert(pkt->ref_count()>=1);
         pkt->dec_ref_count();
 
-        if (!pkt->ref_count())
+        if (!pkt->ref_count()) {
             _freelist.push_back(pkt);
+            _live--;
+        }
     };
+    // pre-allocate so that count packets can be live without further allocation
+    void reserve(size_t count) {
+        if (count > _capacity)
+            grow(count - _capacity);
+    }
 
  protected:
+    static const size_t SLAB_MIN_PACKETS = 64;
+    void grow(size_t count) {
+        P* slab = (P*)allocSlab(count);
+        _freelist.reserve(_freelist.size() + count);
+        // push in reverse so the lowest addresses are handed out first
+        for (size_t i = count; i > 0; i--)
+            _freelist.push_back(new (&slab[i-1]) P());
+        _capacity += count;
+    }
     vector<P*> _freelist; // Irek says it's faster with vector than with list
-    int _alloc_count;
 };
 
+string demangle(const char* mangled);
+
+template<class P>
+string PacketDB<P>::name() const {
+    return demangle(typeid(P).name());
+}
 
 #endif
@@ -3,11 +3,19 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sstream>
 #include <iostream>
+#include <iomanip>
 #include <math.h>
 #include <algorithm>
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 using namespace std;
 
 //#ifdef __clang__
@@ -22,6 +30,9 @@ using namespace std;
 
 #include "loggers.h"
 #include "eqds_logger.h"
+#ifdef LOG_ZLIB
+#include <zlib.h>
+#endif
 
 struct eqint
 {
@@ -31,19 +42,416 @@ struct eqint
     }
 };
 
+// A run of records with each column contiguous.  Uncompressed columnar
+// blocks point straight into the mapped log file; compressed blocks are
+// inflated into raw by whichever worker thread processes them.  Logs in
+// the older formats are read into arrays and cut into chunks of the
+// same size.
+struct LogChunk {
+    LogChunk() : records(0), time(NULL), val1(NULL), val2(NULL), val3(NULL),
+                 type(NULL), id(NULL), ev(NULL), stored(NULL), stored_bytes(0), raw_bytes(0) {}
+    uint64_t records;
+    const double *time, *val1, *val2, *val3;
+    const uint32_t *type, *id, *ev;
+    const char* stored;         // compressed block data, or NULL
+    uint64_t stored_bytes, raw_bytes;
+    vector<char> raw;
+};
+
+// point the columns of a chunk at block data laid out as in logfile.h
+void set_block_columns(LogChunk& chunk, const char* data) {
+    uint64_t n = chunk.records;
+    chunk.time = (const double*)data;
+    chunk.val1 = chunk.time + n;
+    chunk.val2 = chunk.val1 + n;
+    chunk.val3 = chunk.val2 + n;
+    chunk.type = (const uint32_t*)(chunk.val3 + n);
+    chunk.id = chunk.type + n;
+    chunk.ev = chunk.id + n;
+}
+
+// index the blocks of a mapped columnar log
+void map_log_blocks(const char* map, uint64_t map_bytes, const LogFileTrailer& trailer,
+                    vector<LogChunk>& chunks) {
+    if (trailer.index_offset + trailer.blocks * sizeof(LogBlockIndex) > map_bytes) {
+        cerr << "Failed to read log block index" << endl;
+        exit(1);
+    }
+    const LogBlockIndex* index = (const LogBlockIndex*)(map + trailer.index_offset);
+    chunks.resize(trailer.blocks);
+    for (size_t b = 0; b < chunks.size(); b++) {
+        const LogBlockHeader* header = (const LogBlockHeader*)(map + index[b].offset);
+        if (index[b].offset + sizeof(LogBlockHeader) > map_bytes || header->magic != LOG_BLOCK_MAGIC
+            || header->records != index[b].records
+            || index[b].offset + sizeof(LogBlockHeader) + header->stored_bytes > map_bytes) {
+            cerr << "Corrupt log block " << b << endl;
+            exit(1);
+        }
+        LogChunk& chunk = chunks[b];
+        chunk.records = header->records;
+        chunk.stored_bytes = header->stored_bytes;
+        chunk.raw_bytes = header->raw_bytes;
+        const char* data = (const char*)(header + 1);
+        if (header->flags & LOG_BLOCK_ZLIB) {
+#ifndef LOG_ZLIB
+            cerr << "Log is compressed; rebuild with LOG_ZLIB defined to read it" << endl;
+            exit(1);
+#endif
+            chunk.stored = data;
+        } else {
+            chunk.stored = NULL;
+            set_block_columns(chunk, data);
+        }
+    }
+}
+
+// make the columns of a chunk readable, inflating it if need be
+void load_chunk(LogChunk& chunk) {
+    if (!chunk.stored)
+        return;
+#ifdef LOG_ZLIB
+    chunk.raw.resize(chunk.raw_bytes);
+    uLongf raw_bytes = chunk.raw.size();
+    if (uncompress((Bytef*)chunk.raw.data(), &raw_bytes,
+                   (const Bytef*)chunk.stored, chunk.stored_bytes) != Z_OK) {
+        cerr << "Failed to uncompress log block" << endl;
+        exit(1);
+    }
+    set_block_columns(chunk, chunk.raw.data());
+#endif
+}
+
+void unload_chunk(LogChunk& chunk) {
+    if (chunk.stored)
+        vector<char>().swap(chunk.raw);
+}
+
+// Record predicates pushed down to the column scan; -1 matches anything.
+// none is set when two predicates on the same column can never agree.
+struct RecordFilter {
+    RecordFilter() : type(-1), ev(-1), id(-1), none(false) {}
+    void narrow(int64_t& field, int64_t value) {
+        if (value < 0)
+            return;
+        if (field >= 0 && field != value)
+            none = true;
+        field = value;
+    }
+    int64_t type, ev, id;
+    bool none;
+};
+
+// Scan the columns of a chunk and write the indices of the records that
+// pass the filter to sel.  Records at time zero are never reported.  The
+// loop is branch-free so the compiler can vectorise the comparisons.
+uint32_t select_records(const LogChunk& chunk, const RecordFilter& filter, uint32_t* sel) {
+    if (filter.none)
+        return 0;
+    const bool any_type = filter.type < 0, any_ev = filter.ev < 0, any_id = filter.id < 0;
+    const uint32_t type = filter.type, ev = filter.ev, id = filter.id;
+    const double* time = chunk.time;
+    const uint32_t *types = chunk.type, *evs = chunk.ev, *ids = chunk.id;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < chunk.records; i++) {
+        sel[n] = i;
+        n += (time[i] != 0) & (any_type | (types[i] == type))
+            & (any_ev | (evs[i] == ev)) & (any_id | (ids[i] == id));
+    }
+    return n;
+}
+
+const string& object_name(const vector<string>& names, uint32_t id) {
+    static const string unnamed;
+    return id < names.size() ? names[id] : unnamed;
+}
+
+void set_object_name(vector<string>& names, int id, const string& name) {
+    assert(id >= 0);
+    if ((size_t)id >= names.size())
+        names.resize(id + 1);
+    names[id] = name;
+}
+
+string event_to_str(const LogChunk& chunk, uint32_t i, const vector<string>& names) {
+    RawLogEvent event(chunk.time[i], chunk.type[i], chunk.id[i], chunk.ev[i],
+                      chunk.val1[i], chunk.val2[i], chunk.val3[i], object_name(names, chunk.id[i]));
+    string out;
+    switch((Logger::EventType)event._type) {
+    case Logger::QUEUE_EVENT: //0
+        out = QueueLoggerSimple::event_to_str(event);
+        break;
+    case Logger::TCP_EVENT: //1
+    case Logger::TCP_STATE: //2
+        out = TcpLoggerSimple::event_to_str(event); 
+        break;
+    case Logger::TRAFFIC_EVENT: //3
+        out = TrafficLoggerSimple::event_to_str(event); 
+        break;
+    case Logger::QUEUE_RECORD: //4
+    case Logger::QUEUE_APPROX: //5
+        out = QueueLoggerSampling::event_to_str(event);
+        break;
+    case Logger::TCP_RECORD: //6
+        out = AggregateTcpLogger::event_to_str(event);
+        break;
+    case Logger::QCN_EVENT: //7
+    case Logger::QCNQUEUE_EVENT: //8
+        out = QcnLoggerSimple::event_to_str(event);
+        break;
+    case Logger::TCP_TRAFFIC: //9
+        out = TcpTrafficLogger::event_to_str(event);
+        break;
+    case Logger::NDP_TRAFFIC: //10
+        out = NdpTrafficLogger::event_to_str(event);
+        break;
+    case Logger::ROCE_TRAFFIC: //10
+        out = RoceTrafficLogger::event_to_str(event);
+        break;
+        break;                
+    case Logger::HPCC_TRAFFIC: //10
+        out = HPCCTrafficLogger::event_to_str(event);
+        break;
+    case Logger::TCP_SINK: //11
+        out = TcpSinkLoggerSampling::event_to_str(event);
+        break;
+    case Logger::MTCP: //12
+        out = MultipathTcpLoggerSimple::event_to_str(event);
+        break;
+    case Logger::ENERGY: //13
+        // not currently used, so use default logger
+        out = Logger::event_to_str(event);
+        break;
+    case Logger::TCP_MEMORY: //14
+        out = MemoryLoggerSampling::event_to_str(event);
+        break;
+    case Logger::NDP_EVENT: //15
+    case Logger::NDP_STATE: //16
+    case Logger::NDP_RECORD: //17
+    case Logger::NDP_MEMORY: //19
+        // not currently used, so use default logger
+        out = Logger::event_to_str(event);
+        break;
+    case Logger::EQDS_EVENT: 
+    case Logger::EQDS_STATE: 
+    case Logger::EQDS_RECORD:
+    case Logger::EQDS_MEMORY:
+    case Logger::EQDS_TRAFFIC:
+        // not currently used, so use default logger
+        out = Logger::event_to_str(event);
+        break;
+    case Logger::NDP_SINK: //18
+        out = NdpSinkLoggerSampling::event_to_str(event);
+        break;
+    case Logger::EQDS_SINK: //18
+        out = EqdsSinkLoggerSampling::event_to_str(event);
+        break;
+    case Logger::ROCE_SINK: //18
+        out = RoceSinkLoggerSampling::event_to_str(event);
+        break;
+    case Logger::HPCC_SINK: //18
+        out = HPCCSinkLoggerSampling::event_to_str(event);
+        break;                
+    case Logger::SWIFT_EVENT: //20
+    case Logger::SWIFT_STATE: //21
+        out = SwiftLoggerSimple::event_to_str(event); 
+        break;
+    case Logger::SWIFT_MEMORY: //22
+        // not currently used, so use default logger
+        out = Logger::event_to_str(event);
+        break;
+    case Logger::SWIFT_SINK: //23
+        out = SwiftSinkLoggerSampling::event_to_str(event);
+        out += " ";
+        out.append(to_string(chunk.type[i]));
+        out += " ";
+        out.append(to_string(chunk.ev[i]));
+        break;
+    case Logger::SWIFT_TRAFFIC: //10
+        out = SwiftTrafficLogger::event_to_str(event);
+        break;
+    case Logger::STRACK_EVENT:
+    case Logger::STRACK_STATE: 
+        out = STrackLoggerSimple::event_to_str(event); 
+        break;
+    case Logger::STRACK_MEMORY: //22
+        // not currently used, so use default logger
+        out = Logger::event_to_str(event);
+        break;
+    case Logger::STRACK_SINK: //23
+        out = STrackSinkLoggerSampling::event_to_str(event);
+        out += " ";
+        out.append(to_string(chunk.type[i]));
+        out += " ";
+        out.append(to_string(chunk.ev[i]));
+        break;
+    case Logger::STRACK_TRAFFIC:
+        out = STrackTrafficLogger::event_to_str(event);
+        break;
+    case Logger::FLOW_EVENT:
+        out = FlowEventLoggerSimple::event_to_str(event);
+        break;
+    }
+    return out;
+}
+
+void csv_line(const LogChunk& chunk, uint32_t i, const vector<string>& names, string& out) {
+    stringstream ss;
+    ss << fixed << setprecision(9) << chunk.time[i] << defaultfloat << setprecision(15)
+       << ',' << chunk.type[i] << ',' << chunk.id[i] << ',' << chunk.ev[i]
+       << ',' << chunk.val1[i] << ',' << chunk.val2[i] << ',' << chunk.val3[i]
+       << ",\"" << object_name(names, chunk.id[i]) << '"';
+    out = ss.str();
+}
+
+// Run work(c) for every chunk c on nthreads worker threads, and call
+// emit(c) on the calling thread in chunk order as each one completes.
+// Workers stay at most window chunks ahead of emit, so output for a
+// large log is streamed rather than held in memory.
+template<class Work, class Emit>
+void run_ordered(size_t nchunks, unsigned nthreads, Work work, Emit emit) {
+    mutex lock;
+    condition_variable changed;
+    vector<char> done(nchunks, 0);
+    size_t next = 0, emitted = 0, window = 4 * nthreads;
+    vector<thread> workers;
+    for (unsigned t = 0; t < nthreads; t++) {
+        workers.push_back(thread([&]() {
+            while (true) {
+                size_t c;
+                {
+                    unique_lock<mutex> guard(lock);
+                    changed.wait(guard, [&]() {return next == nchunks || next < emitted + window;});
+                    if (next == nchunks)
+                        return;
+                    c = next++;
+                }
+                work(c);
+                {
+                    lock_guard<mutex> guard(lock);
+                    done[c] = 1;
+                }
+                changed.notify_all();
+            }
+        }));
+    }
+    for (size_t c = 0; c < nchunks; c++) {
+        {
+            unique_lock<mutex> guard(lock);
+            changed.wait(guard, [&]() {return done[c] != 0;});
+        }
+        emit(c);
+        {
+            lock_guard<mutex> guard(lock);
+            emitted++;
+        }
+        changed.notify_all();
+    }
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+}
+
+struct FlowSample {
+    uint32_t id;
+    double val2, val3;
+};
+
+// running sums for one flow; first and first2 are the positions of the
+// samples that created the val3 and val2 entries
+struct FlowAggregate {
+    FlowAggregate() : rate(0), count(0), rate2(0), count2(0), first(0), first2(0) {}
+    double rate, count, rate2, count2;
+    uint64_t first, first2;
+};
+
+// Sum val3 and val2 per flow over the selected samples.  Flows are shared
+// out between threads by id so each flow is still summed in record order,
+// and the maps are filled in order of each flow's first sample, exactly as
+// a single pass over the records would have left them.
+void aggregate_flows(const vector< vector<FlowSample> >& samples, unsigned nthreads,
+                     hashmap<int, double>& flow_rates, hashmap<int, double>& flow_count,
+                     hashmap<int, double>& flow_rates2, hashmap<int, double>& flow_count2) {
+    vector<uint64_t> base(samples.size() + 1, 0);
+    for (size_t c = 0; c < samples.size(); c++)
+        base[c + 1] = base[c] + samples[c].size();
+
+    vector< hashmap<uint32_t, FlowAggregate> > partial(nthreads);
+    vector<thread> workers;
+    for (unsigned t = 0; t < nthreads; t++) {
+        workers.push_back(thread([&, t]() {
+            hashmap<uint32_t, FlowAggregate>& flows = partial[t];
+            for (size_t c = 0; c < samples.size(); c++) {
+                for (size_t k = 0; k < samples[c].size(); k++) {
+                    const FlowSample& s = samples[c][k];
+                    if (s.id % nthreads != t)
+                        continue;
+                    FlowAggregate& f = flows[s.id];
+                    if (!isnan((long double)s.val3)) {
+                        if (f.count == 0) {
+                            f.first = base[c] + k;
+                            f.rate = s.val3;
+                        } else {
+                            f.rate += s.val3;
+                        }
+                        f.count++;
+                    }
+                    if (!isnan((long double)s.val2)) {
+                        if (f.count2 == 0) {
+                            f.first2 = base[c] + k;
+                            f.rate2 = s.val2;
+                        } else {
+                            f.rate2 += s.val2;
+                        }
+                        f.count2++;
+                    }
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+
+    vector< pair<uint64_t, uint32_t> > order, order2;
+    for (unsigned t = 0; t < nthreads; t++) {
+        hashmap<uint32_t, FlowAggregate>::const_iterator i;
+        for (i = partial[t].begin(); i != partial[t].end(); i++) {
+            if (i->second.count > 0)
+                order.push_back(make_pair(i->second.first, i->first));
+            if (i->second.count2 > 0)
+                order2.push_back(make_pair(i->second.first2, i->first));
+        }
+    }
+    sort(order.begin(), order.end());
+    sort(order2.begin(), order2.end());
+    for (size_t k = 0; k < order.size(); k++) {
+        uint32_t id = order[k].second;
+        const FlowAggregate& f = partial[id % nthreads][id];
+        flow_rates[id] = f.rate;
+        flow_count[id] = f.count;
+    }
+    for (size_t k = 0; k < order2.size(); k++) {
+        uint32_t id = order2[k].second;
+        const FlowAggregate& f = partial[id % nthreads][id];
+        flow_rates2[id] = f.rate2;
+        flow_count2[id] = f.count2;
+    }
+}
+
 int main(int argc, char** argv){
     if (argc < 2){
-        printf("Usage %s filename [-show|-verbose|-ascii]\n", argv[0]);
+        printf("Usage %s filename [-show|-verbose|-ascii|-csv] [-type n] [-ev n] [-id n] [-threads n]\n", argv[0]);
         return 1;
     }
 
-    bool show = false, verbose = false, ascii = false;
+    bool show = false, verbose = false, ascii = false, csv = false;
     stringstream filename;
     filename.str(std::string());
     filename << "";
     vector <string> filters;
     vector <string> splits;
     vector <int> fields;
+    // -ev matches the stored event column, which is type*100 + event
+    int64_t type_filter = -1, ev_filter = -1, id_filter = -1;
+    unsigned nthreads = thread::hardware_concurrency();
 
     int i = 2;
     while (i<argc) {
@@ -56,6 +464,8 @@ int main(int argc, char** argv){
             verbose = true;
         } else if (!strcmp(argv[i],"-ascii") || !strcmp(argv[i],"--ascii")){
             ascii = true;
+        } else if (!strcmp(argv[i],"-csv")){
+            csv = true;
         } else if (!strcmp(argv[i],"-filter")){
             string* s = new string(argv[i+1]);
             filters.push_back(*s);
@@ -68,9 +478,23 @@ int main(int argc, char** argv){
         } else if (!strcmp(argv[i],"-field")){
             fields.push_back(atoi(argv[i+1]));
             i++;
+        } else if (!strcmp(argv[i],"-type")){
+            type_filter = atoll(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i],"-ev")){
+            ev_filter = atoll(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i],"-id")){
+            id_filter = atoll(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i],"-threads")){
+            nthreads = atoi(argv[i+1]);
+            i++;
         }
         i++;
     }
+    if (nthreads < 1)
+        nthreads = 1;
 
     /*    
           if ((argc>2 && !strcmp(argv[2], "-show"))
@@ -85,14 +509,14 @@ int main(int argc, char** argv){
           || (argc>3 && !strcmp(argv[3], "-verbose")))
           verbose = 1;
     */
-    if (ascii && (show || verbose)) {
+    if ((ascii || csv) && (show || verbose)) {
         perror("Use -ascii by itself, not with -show or -verbose!\n");
         exit(1);
     }
 
 
     FILE* logfile;
-    hashmap<int, string> object_names;
+    vector<string> object_names;
 
     logfile = fopen(argv[1], "rbS");
     if (logfile==NULL) {
@@ -100,6 +524,18 @@ int main(int argc, char** argv){
         exit(1);
     }
 
+    // columnar logs keep the preamble at the end, found via the trailer
+    LogFileTrailer trailer;
+    bool columnar = false;
+    if (fseek(logfile, -(long)sizeof(trailer), SEEK_END) == 0
+        && fread(&trailer, sizeof(trailer), 1, logfile) == 1
+        && !memcmp(trailer.magic, LOG_FILE_MAGIC, sizeof(trailer.magic))) {
+        columnar = true;
+        fseek(logfile, trailer.preamble_offset, SEEK_SET);
+    } else {
+        rewind(logfile);
+    }
+
     //parse preamble first
     char* line = new char[10000];
     //cout << "reading preamble\n";
@@ -136,9 +572,7 @@ int main(int argc, char** argv){
                 id = atoi(split+1);
             
             split[0]=0;
-            string * name = new string(line+2);
-            assert(id >= 0);
-            object_names[id] = *name;
+            set_object_name(object_names, id, line+2);
         }
     }
     //cout << "done\n";
@@ -160,48 +594,83 @@ int main(int argc, char** argv){
             split++;
             split[strlen(split)-1] = 0;
 
-            string * name = new string(split);
+            string name(split);
             split[0]=0;
 
             id = atoi(line);
                                 
-            //cout << "Found mapping " << id << " to " << *name << endl;
-            object_names[id] = *name;
+            //cout << "Found mapping " << id << " to " << name << endl;
+            set_object_name(object_names, id, name);
         }
     }
 
 
     //must find the number of records here, and go to #TRACE
 
-    int numread = numRecords;
-
-    double* timeRec = new double[numRecords];
-    uint32_t* typeRec = new uint32_t[numRecords];
-    uint32_t* idRec = new uint32_t[numRecords];
-    uint32_t* evRec = new uint32_t[numRecords];
-    double* val1Rec = new double[numRecords];
-    double* val2Rec = new double[numRecords];
-    double *val3Rec = new double[numRecords];
-
-    if (transpose) {
-        /* old-style transposed data */
-        std::ignore = fread(timeRec, sizeof(double), numread, logfile);
-        std::ignore = fread(typeRec, sizeof(uint32_t), numread, logfile);
-        std::ignore = fread(idRec,   sizeof(uint32_t), numread, logfile);
-        std::ignore = fread(evRec,   sizeof(uint32_t), numread, logfile);
-        std::ignore = fread(val1Rec, sizeof(double), numread, logfile);
-        std::ignore = fread(val2Rec, sizeof(double), numread, logfile);
-        std::ignore = fread(val3Rec, sizeof(double), numread, logfile);  
+    vector<LogChunk> chunks;
+    double *timeRec = NULL, *val1Rec = NULL, *val2Rec = NULL, *val3Rec = NULL;
+    uint32_t *typeRec = NULL, *idRec = NULL, *evRec = NULL;
+
+    if (columnar) {
+        // the blocks are 8-byte aligned, so uncompressed columns are
+        // read in place from the mapping
+        struct stat st;
+        if (fstat(fileno(logfile), &st) < 0) {
+            cerr << "Failed to stat logfile " << argv[1] << endl;
+            exit(1);
+        }
+        void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(logfile), 0);
+        if (map == MAP_FAILED) {
+            cerr << "Failed to map logfile " << argv[1] << endl;
+            exit(1);
+        }
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        map_log_blocks((const char*)map, st.st_size, trailer, chunks);
     } else {
-        /* new-style one record at a time */
-        for (int i = 0; i < numRecords; i++) {
-            std::ignore = fread(&timeRec[i], sizeof(double), 1, logfile);
-            std::ignore = fread(&typeRec[i], sizeof(uint32_t), 1, logfile);
-            std::ignore = fread(&idRec[i],   sizeof(uint32_t), 1, logfile);
-            std::ignore = fread(&evRec[i],   sizeof(uint32_t), 1, logfile);
-            std::ignore = fread(&val1Rec[i], sizeof(double), 1, logfile);
-            std::ignore = fread(&val2Rec[i], sizeof(double), 1, logfile);
-            std::ignore = fread(&val3Rec[i], sizeof(double), 1, logfile);  
+        int numread = numRecords;
+
+        timeRec = new double[numRecords];
+        typeRec = new uint32_t[numRecords];
+        idRec = new uint32_t[numRecords];
+        evRec = new uint32_t[numRecords];
+        val1Rec = new double[numRecords];
+        val2Rec = new double[numRecords];
+        val3Rec = new double[numRecords];
+
+        if (transpose) {
+            /* old-style transposed data */
+            std::ignore = fread(timeRec, sizeof(double), numread, logfile);
+            std::ignore = fread(typeRec, sizeof(uint32_t), numread, logfile);
+            std::ignore = fread(idRec,   sizeof(uint32_t), numread, logfile);
+            std::ignore = fread(evRec,   sizeof(uint32_t), numread, logfile);
+            std::ignore = fread(val1Rec, sizeof(double), numread, logfile);
+            std::ignore = fread(val2Rec, sizeof(double), numread, logfile);
+            std::ignore = fread(val3Rec, sizeof(double), numread, logfile);  
+        } else {
+            /* new-style one record at a time */
+            for (int i = 0; i < numRecords; i++) {
+                std::ignore = fread(&timeRec[i], sizeof(double), 1, logfile);
+                std::ignore = fread(&typeRec[i], sizeof(uint32_t), 1, logfile);
+                std::ignore = fread(&idRec[i],   sizeof(uint32_t), 1, logfile);
+                std::ignore = fread(&evRec[i],   sizeof(uint32_t), 1, logfile);
+                std::ignore = fread(&val1Rec[i], sizeof(double), 1, logfile);
+                std::ignore = fread(&val2Rec[i], sizeof(double), 1, logfile);
+                std::ignore = fread(&val3Rec[i], sizeof(double), 1, logfile);  
+            }
+        }
+
+        // cut the arrays into chunks so they can be shared out like blocks
+        for (int first = 0; first < numRecords; first += LOG_BLOCK_RECORDS) {
+            LogChunk chunk;
+            chunk.records = min(numRecords - first, LOG_BLOCK_RECORDS);
+            chunk.time = timeRec + first;
+            chunk.val1 = val1Rec + first;
+            chunk.val2 = val2Rec + first;
+            chunk.val3 = val3Rec + first;
+            chunk.type = typeRec + first;
+            chunk.id = idRec + first;
+            chunk.ev = evRec + first;
+            chunks.push_back(chunk);
         }
     }
 
@@ -250,195 +719,95 @@ int main(int argc, char** argv){
         TYPE = -1; EV = -1;
     }
 
-    for (int i=0;i<numRecords;i++){
-        if (!timeRec[i]) {
-            continue;
-        }
+    // everything that can be decided from the type, ev and id columns is
+    // done by the column scan before any record is formatted
+    RecordFilter filter;
+    filter.narrow(filter.type, type_filter);
+    filter.narrow(filter.ev, ev_filter);
+    filter.narrow(filter.id, id_filter);
+    if (!ascii && !csv) {
+        filter.narrow(filter.type, TYPE);
+        filter.narrow(filter.ev, EV);
+    }
 
-        if (ascii) {
-            RawLogEvent event(timeRec[i], typeRec[i], idRec[i], evRec[i], 
-                              val1Rec[i], val2Rec[i], val3Rec[i],object_names[idRec[i]]);
-            //cout << Logger::event_to_str(event) << endl;
-            string out;
-            //cout << "ev type: " << (Logger::EventType)typeRec[i] << endl;
-            switch((Logger::EventType)typeRec[i]) {
-            case Logger::QUEUE_EVENT: //0
-                out = QueueLoggerSimple::event_to_str(event);
-                break;
-            case Logger::TCP_EVENT: //1
-            case Logger::TCP_STATE: //2
-                out = TcpLoggerSimple::event_to_str(event); 
-                break;
-            case Logger::TRAFFIC_EVENT: //3
-                out = TrafficLoggerSimple::event_to_str(event); 
-                break;
-            case Logger::QUEUE_RECORD: //4
-            case Logger::QUEUE_APPROX: //5
-                out = QueueLoggerSampling::event_to_str(event);
-                break;
-            case Logger::TCP_RECORD: //6
-                out = AggregateTcpLogger::event_to_str(event);
-                break;
-            case Logger::QCN_EVENT: //7
-            case Logger::QCNQUEUE_EVENT: //8
-                out = QcnLoggerSimple::event_to_str(event);
-                break;
-            case Logger::TCP_TRAFFIC: //9
-                out = TcpTrafficLogger::event_to_str(event);
-                break;
-            case Logger::NDP_TRAFFIC: //10
-                out = NdpTrafficLogger::event_to_str(event);
-                break;
-            case Logger::ROCE_TRAFFIC: //10
-                out = RoceTrafficLogger::event_to_str(event);
-                break;
-                break;                
-            case Logger::HPCC_TRAFFIC: //10
-                out = HPCCTrafficLogger::event_to_str(event);
-                break;
-            case Logger::TCP_SINK: //11
-                out = TcpSinkLoggerSampling::event_to_str(event);
-                break;
-            case Logger::MTCP: //12
-                out = MultipathTcpLoggerSimple::event_to_str(event);
-                break;
-            case Logger::ENERGY: //13
-                // not currently used, so use default logger
-                out = Logger::event_to_str(event);
-                break;
-            case Logger::TCP_MEMORY: //14
-                out = MemoryLoggerSampling::event_to_str(event);
-                break;
-            case Logger::NDP_EVENT: //15
-            case Logger::NDP_STATE: //16
-            case Logger::NDP_RECORD: //17
-            case Logger::NDP_MEMORY: //19
-                // not currently used, so use default logger
-                out = Logger::event_to_str(event);
-                break;
-            case Logger::EQDS_EVENT: 
-            case Logger::EQDS_STATE: 
-            case Logger::EQDS_RECORD:
-            case Logger::EQDS_MEMORY:
-            case Logger::EQDS_TRAFFIC:
-                // not currently used, so use default logger
-                out = Logger::event_to_str(event);
-                break;
-            case Logger::NDP_SINK: //18
-                out = NdpSinkLoggerSampling::event_to_str(event);
-                break;
-            case Logger::EQDS_SINK: //18
-                out = EqdsSinkLoggerSampling::event_to_str(event);
-                break;
-            case Logger::ROCE_SINK: //18
-                out = RoceSinkLoggerSampling::event_to_str(event);
-                break;
-            case Logger::HPCC_SINK: //18
-                out = HPCCSinkLoggerSampling::event_to_str(event);
-                break;                
-            case Logger::SWIFT_EVENT: //20
-            case Logger::SWIFT_STATE: //21
-                out = SwiftLoggerSimple::event_to_str(event); 
-                break;
-            case Logger::SWIFT_MEMORY: //22
-                // not currently used, so use default logger
-                out = Logger::event_to_str(event);
-                break;
-            case Logger::SWIFT_SINK: //23
-                out = SwiftSinkLoggerSampling::event_to_str(event);
-                out += " ";
-                out.append(to_string(typeRec[i]));
-                out += " ";
-                out.append(to_string(evRec[i]));
-                break;
-            case Logger::SWIFT_TRAFFIC: //10
-                out = SwiftTrafficLogger::event_to_str(event);
-                break;
-            case Logger::STRACK_EVENT:
-            case Logger::STRACK_STATE: 
-                out = STrackLoggerSimple::event_to_str(event); 
-                break;
-            case Logger::STRACK_MEMORY: //22
-                // not currently used, so use default logger
-                out = Logger::event_to_str(event);
-                break;
-            case Logger::STRACK_SINK: //23
-                out = STrackSinkLoggerSampling::event_to_str(event);
-                out += " ";
-                out.append(to_string(typeRec[i]));
-                out += " ";
-                out.append(to_string(evRec[i]));
-                break;
-            case Logger::STRACK_TRAFFIC:
-                out = STrackTrafficLogger::event_to_str(event);
-                break;
-            case Logger::FLOW_EVENT:
-                out = FlowEventLoggerSimple::event_to_str(event);
-                break;
-            }
-            bool do_output = true;
-            for (size_t f=0; f < filters.size(); f++) {
-                size_t pos = out.find(filters[f]);
-                if (pos == string::npos) {
-                    // not found
-                    do_output = false;
-                    break;
-                }
-            }
-            if (do_output) {
-                if (fields.size() > 0) {
-                    stringstream out2(ios_base::out);
-                    //out2.str(std::string());
-                    std::istringstream iss(out);
-                    string item;
-                    int inum = 0;
-                    while (std::getline(iss, item, ' ')) {
-                        for (vector<int>::const_iterator fi = fields.begin(); fi != fields.end(); fi++) {
-                            if (inum == *fi) {
-                                out2 << item << " ";
+    if (csv)
+        cout << "time,type,id,ev,val1,val2,val3,name" << endl;
+
+    vector<string> output(chunks.size());
+    vector< vector<FlowSample> > samples(chunks.size());
+    run_ordered(chunks.size(), nthreads,
+                [&](size_t c) {
+                    LogChunk& chunk = chunks[c];
+                    load_chunk(chunk);
+                    vector<uint32_t> sel(chunk.records);
+                    uint32_t selected = select_records(chunk, filter, sel.data());
+                    string& text = output[c];
+                    if (ascii || csv) {
+                        string out;
+                        for (uint32_t k = 0; k < selected; k++) {
+                            uint32_t i = sel[k];
+                            if (csv)
+                                csv_line(chunk, i, object_names, out);
+                            else
+                                out = event_to_str(chunk, i, object_names);
+                            bool do_output = true;
+                            for (size_t f=0; f < filters.size(); f++) {
+                                size_t pos = out.find(filters[f]);
+                                if (pos == string::npos) {
+                                    // not found
+                                    do_output = false;
+                                    break;
+                                }
                             }
+                            if (!do_output)
+                                continue;
+                            if (ascii && fields.size() > 0) {
+                                stringstream out2(ios_base::out);
+                                std::istringstream iss(out);
+                                string item;
+                                int inum = 0;
+                                while (std::getline(iss, item, ' ')) {
+                                    for (vector<int>::const_iterator fi = fields.begin(); fi != fields.end(); fi++) {
+                                        if (inum == *fi) {
+                                            out2 << item << " ";
+                                        }
+                                    }
+                                    inum++;
+                                }
+                                text += out2.str();
+                            } else {
+                                text += out;
+                            }
+                            text += '\n';
                         }
-                        inum++;
-                    }
-                    cout << out2.str() << endl;
-                } else {
-                    cout << out << endl;
-                }
-            }
-        } else {
-            if ((typeRec[i]==(uint32_t)TYPE || TYPE==-1) 
-                && (evRec[i]==(uint32_t)EV || EV==-1)) {
-                if (verbose)
-                    cout << timeRec[i] << " Type=" << typeRec[i] << " EV=" << evRec[i] 
-                         << " ID=" << idRec[i] << " VAL1=" << val1Rec[i] 
-                         << " VAL2=" << val2Rec[i] << " VAL3=" << val3Rec[i] << endl;        
-
-                if (!isnan((long double)val3Rec[i])) {
-                    if (flow_rates.find(idRec[i]) == flow_rates.end()){
-                        flow_rates[idRec[i]] = val3Rec[i];
-                        flow_count[idRec[i]] = 1;
                     } else {
-                        flow_rates[idRec[i]] += val3Rec[i];
-                        flow_count[idRec[i]]++;
-                    }
-                }
-
-                if (!isnan((long double)val2Rec[i])) {
-                    if (flow_rates2.find(idRec[i]) == flow_rates2.end()) {
-                        flow_rates2[idRec[i]] = val2Rec[i];
-                        flow_count2[idRec[i]] = 1;
-                    } else {
-                        flow_rates2[idRec[i]]+= val2Rec[i];
-                        flow_count2[idRec[i]]++;
+                        stringstream ss;
+                        vector<FlowSample>& flows = samples[c];
+                        flows.resize(selected);
+                        for (uint32_t k = 0; k < selected; k++) {
+                            uint32_t i = sel[k];
+                            if (verbose)
+                                ss << chunk.time[i] << " Type=" << chunk.type[i] << " EV=" << chunk.ev[i]
+                                   << " ID=" << chunk.id[i] << " VAL1=" << chunk.val1[i]
+                                   << " VAL2=" << chunk.val2[i] << " VAL3=" << chunk.val3[i] << "\n";
+                            flows[k].id = chunk.id[i];
+                            flows[k].val2 = chunk.val2[i];
+                            flows[k].val3 = chunk.val3[i];
+                        }
+                        text = ss.str();
                     }
-                }
-            }
-        }
-    }
-    if (ascii) {
+                    unload_chunk(chunk);
+                },
+                [&](size_t c) {
+                    cout.write(output[c].data(), output[c].size());
+                    string().swap(output[c]);
+                });
+    if (ascii || csv) {
         exit(0);
     }
 
+    aggregate_flows(samples, nthreads, flow_rates, flow_count, flow_rates2, flow_count2);
+
     //now print rates;
     vector<double> rates;
 
@@ -464,7 +833,7 @@ int main(int argc, char** argv){
         rates.push_back(r);
 
         if (show)
-            printf("%.2f Mbps val %d name %s\n", r*8/1000000,id,object_names[id].c_str());
+            printf("%.2f Mbps val %d name %s\n", r*8/1000000,id,object_name(object_names, id).c_str());
 
         it++;
     }
@@ -493,5 +862,6 @@ int main(int argc, char** argv){
     delete[] evRec;
     delete[] val1Rec;
     delete[] val2Rec;
+    delete[] val3Rec;
     delete[] line;
 }
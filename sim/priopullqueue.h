@@ -17,6 +17,7 @@ template<class PullPkt>
 class PrioPullQueue : public BasePullQueue<PullPkt>{
 public:
     PrioPullQueue();
+    using BasePullQueue<PullPkt>::enqueue;
     virtual void enqueue(PullPkt& pkt, int priority);
     virtual PullPkt* dequeue();
     virtual void flush_flow(flowid_t flow_id, int priority);
@@ -10,8 +10,8 @@ const linkspeed_bps QcnReactor::RATEINCREASE=500000; //0.5Mb/s
 const linkspeed_bps QcnReactor::MINRATE=1000000; //1Mb/s
 const double QcnQueue::GAMMA = 2;
 
-PacketDB<QcnPacket> QcnPacket::_packetdb;
-PacketDB<QcnAck> QcnAck::_packetdb;
+thread_local PacketDB<QcnPacket> QcnPacket::_packetdb;
+thread_local PacketDB<QcnAck> QcnAck::_packetdb;
 
 
 QcnReactor::QcnReactor(QcnLogger* logger, TrafficLogger* pktlogger, EventList &eventlist)
@@ -20,7 +20,11 @@ QcnReactor::QcnReactor(QcnLogger* logger, TrafficLogger* pktlogger, EventList &e
 
 void QcnReactor::connect(route_t& route, routes_t& routesback, simtime_picosec startTime, linkspeed_bps linkspeed) {
     _route = &route;
-    _routesback = &routesback;
+    // acks follow the route back from where they're generated, then
+    // come to us
+    for (size_t i = 0; i < routesback.size(); i++)
+        _ackroutes.push_back(routesback[i] ? new Route(*routesback[i], *this) : NULL);
+    _routesback = &_ackroutes;
     _flow.set_id(get_id()); // identify the packet flow with the QCN source that generated it
     //
     _packetCycles = 0;
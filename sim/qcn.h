@@ -43,7 +43,7 @@ protected:
     routes_t* _routesback;
     seq_t _seqno;
     PacketSink* _reactor;
-    static PacketDB<QcnPacket> _packetdb;
+    static thread_local PacketDB<QcnPacket> _packetdb;
 };
 
 class QcnAck : public Packet {
@@ -55,7 +55,6 @@ public:
         assert(datapkt._nexthop>=1);
         route_t* routeback = (*datapkt._routesback)[datapkt._nexthop-1];
         p->set_route(*datapkt._flow, *routeback, QcnAck::ACK_SIZE, datapkt._seqno);
-        p->_reactor = datapkt._reactor;
         p->_fb = fb;
         return p;
     }
@@ -63,17 +62,8 @@ public:
     void free() {_packetdb.freePacket(this);}
     virtual PktPriority priority() const {return Packet::PRIO_NONE;}
     const static int ACK_SIZE;
-    PacketSink* sendOn() { 
-        assert(_nexthop<=_route->size());
-        PacketSink* nextsink;
-        if (_nexthop==_route->size()) nextsink=_reactor; else nextsink=(*_route).at(_nexthop);
-        _nexthop++;
-        nextsink->receivePacket(*this);
-        return nextsink;
-    }
 protected:
-    static PacketDB<QcnAck> _packetdb;
-    PacketSink* _reactor;
+    static thread_local PacketDB<QcnAck> _packetdb;
     fb_t _fb;
 };
 
@@ -103,6 +93,7 @@ private:
     PacketFlow _flow;
     route_t* _route;
     routes_t* _routesback;
+    routes_t _ackroutes; // _routesback, each extended to end here
     QcnPacket::seq_t _seqno;
     // Mechanism
     void onFeedback(double fb);
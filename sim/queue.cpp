@@ -5,7 +5,7 @@
 #include "ndppacket.h"
 #include "queue_lossless.h"
 
-simtime_picosec BaseQueue::_update_period = timeFromUs(0.1);
+thread_local simtime_picosec BaseQueue::_update_period = timeFromUs(0.1);
 
 // base queue is a generic queue that we can log, but doesn't actually store anything
 BaseQueue::BaseQueue(linkspeed_bps bitrate, EventList& eventlist, QueueLogger* logger)
@@ -20,6 +20,11 @@ BaseQueue::BaseQueue(linkspeed_bps bitrate, EventList& eventlist, QueueLogger* l
     _last_utilization = 0;
 }
 
+void
+BaseQueue::setServiceRate(linkspeed_bps rate) {
+    _ps_per_byte = (simtime_picosec)((pow(10.0, 12.0) * 8) / rate);
+}
+
 void 
 BaseQueue::log_packet_send(simtime_picosec duration){
     //a packet tranmission has just finished; it lasted from a to b.
@@ -215,7 +220,7 @@ PriorityQueue::PriorityQueue(linkspeed_bps bitrate, mem_b maxsize,
     _queuesize[Q_MID] = 0;
     _queuesize[Q_HI] = 0;
     _servicing = Q_NONE;
-    _state_send = LosslessQueue::READY;
+    _state_send = 0;
 }
 
 PriorityQueue::queue_priority_t 
@@ -260,31 +265,25 @@ PriorityQueue::receivePacket(Packet& pkt)
     if (pkt.type()==ETH_PAUSE){
         EthPausePacket* p = (EthPausePacket*)&pkt;
 
-        if (p->sleepTime()>0 && _state_send == LosslessQueue::READY){
-            //remote end is telling us to shut up.
-            //assert(_state_send == LosslessQueue::READY);
-            if (queuesize()>0)
-                //we have a packet in flight
-                _state_send = LosslessQueue::PAUSE_RECEIVED;
+        for (uint32_t c = 0; c < EthPausePacket::_classes; c++) {
+            if (!p->class_enabled(c))
+                continue;
+            if (p->sleepTime(c)>0)
+                //remote end is telling us to shut up; a packet in flight still completes.
+                _state_send |= 1 << c;
             else
-                _state_send = LosslessQueue::PAUSED;
-            
-            //cout << timeAsMs(eventlist().now()) << " " << _name << " PAUSED "<<endl;
-        }
-        else if (_state_send != LosslessQueue::READY) {
-            //we are allowed to send!
-            _state_send = LosslessQueue::READY;
-            //cout << timeAsMs(eventlist().now()) << " " << _name << " GO "<<endl;
-
-            //start transmission if we have packets to send!
-            if(queuesize()>0)
-                beginService();
+                //we are allowed to send!
+                _state_send &= ~(1 << c);
         }
 
-        //must send the packets to all sources on the same host!
+        //start transmission if we have packets to send!
+        if (_servicing == Q_NONE && next_band() != Q_NONE)
+            beginService();
+
+        //must send the packets to all sources on the same host!  They share this frame.
         for (uint32_t i = 0;i<_senders.size();i++){
-            EthPausePacket* e = EthPausePacket::newpkt(p->sleepTime(),p->senderID());
-            _senders[i]->receivePacket(*e);
+            p->inc_ref_count();
+            _senders[i]->receivePacket(*p);
         }
 
         pkt.free();
@@ -304,26 +303,30 @@ PriorityQueue::receivePacket(Packet& pkt)
 
     if (_logger) _logger->logQueue(*this, QueueLogger::PKT_ENQUEUE, pkt);
 
-    if (queueWasEmpty && _state_send==LosslessQueue::READY) {
+    if (queueWasEmpty && _servicing == Q_NONE && next_band() != Q_NONE) {
         /* schedule the dequeue event */
         assert(_queue[Q_LO].size() + _queue[Q_MID].size() + _queue[Q_HI].size() == 1);
         beginService();
     }
 }
 
+PriorityQueue::queue_priority_t
+PriorityQueue::next_band() const {
+    for (int prio = Q_HI; prio >= Q_LO; --prio) {
+        if (_queuesize[prio] > 0 && !(_state_send & (1 << EthPausePacket::pfc_class((Packet::PktPriority)prio))))
+            return (queue_priority_t)prio;
+    }
+    return Q_NONE;
+}
+
 void
 PriorityQueue::beginService()
 {
-    assert(_state_send == LosslessQueue::READY);
-
     /* schedule the next dequeue event */
-    for (int prio = Q_HI; prio >= Q_LO; --prio) {
-        if (_queuesize[prio] > 0) {
-            eventlist().sourceIsPendingRel(*this, drainTime(_queue[prio].back()));
-            _servicing = (queue_priority_t)prio;
-            return;
-        }
-    }
+    queue_priority_t prio = next_band();
+    assert(prio != Q_NONE);
+    eventlist().sourceIsPendingRel(*this, drainTime(_queue[prio].back()));
+    _servicing = prio;
 }
 
 void
@@ -347,23 +350,12 @@ PriorityQueue::completeService()
         pkt->sendOn();
     }
 
-    if (_state_send==LosslessQueue::PAUSE_RECEIVED)
-        _state_send = LosslessQueue::PAUSED;
-
-    //if (_state_send!=LosslessQueue::READY){
-    //cout << eventlist().now() << " queue " << _name << " not ready but sending " << endl;
-    //}
+    _servicing = Q_NONE;
 
-    if (queuesize() > 0) {
-        if (_state_send==LosslessQueue::READY)
-            /* schedule the next dequeue event */
-            beginService();
-        else {
-            //we've received pause or are already paused and will do nothing until the other end unblocks us        }
-        }
-    } else {
-        _servicing = Q_NONE;
-    }
+    //if all the bands with packets are paused, we will do nothing until the other end unblocks us
+    if (next_band() != Q_NONE)
+        /* schedule the next dequeue event */
+        beginService();
 }
 
 mem_b
@@ -387,7 +379,7 @@ FairPriorityQueue::FairPriorityQueue(linkspeed_bps bitrate, mem_b maxsize,
     _queuesize[Q_HI] = 0;
     _servicing = Q_NONE;
     _sending = NULL;
-    _state_send = LosslessQueue::READY;
+    _state_send = 0;
 }
 
 FairPriorityQueue::queue_priority_t 
@@ -432,32 +424,25 @@ FairPriorityQueue::receivePacket(Packet& pkt)
     if (pkt.type()==ETH_PAUSE){
         EthPausePacket* p = (EthPausePacket*)&pkt;
 
-        if (p->sleepTime()>0){
-            //remote end is telling us to shut up.
-            //assert(_state_send == LosslessQueue::READY);
-            if (queuesize()>0)
-                //we have a packet in flight
-                _state_send = LosslessQueue::PAUSE_RECEIVED;
+        for (uint32_t c = 0; c < EthPausePacket::_classes; c++) {
+            if (!p->class_enabled(c))
+                continue;
+            if (p->sleepTime(c)>0)
+                //remote end is telling us to shut up; a packet in flight still completes.
+                _state_send |= 1 << c;
             else
-                _state_send = LosslessQueue::PAUSED;
-            
-            //cout << timeAsMs(eventlist().now()) << " FPQ " << _name << " PAUSED "<<endl;
-        }
-        else {
-            //we are allowed to send!
-            _state_send = LosslessQueue::READY;
-            //cout << timeAsMs(eventlist().now()) << " FPQ " << _name << " GO "<<endl;
-
-            //start transmission if we have packets to send!
-            if(queuesize()>0)
-                beginService();
+                //we are allowed to send!
+                _state_send &= ~(1 << c);
         }
 
-        //must send the packets to all sources on the same host!
+        //start transmission if we have packets to send!
+        if (_servicing == Q_NONE && next_band() != Q_NONE)
+            beginService();
+
+        //must send the packets to all sources on the same host!  They share this frame.
         for (uint32_t i = 0;i<_senders.size();i++){
-            //cout << "Sending pause" << endl;
-            EthPausePacket* e = EthPausePacket::newpkt(p->sleepTime(),p->senderID());
-            _senders[i]->receivePacket(*e);
+            p->inc_ref_count();
+            _senders[i]->receivePacket(*p);
         }
         
         pkt.free();
@@ -483,36 +468,37 @@ FairPriorityQueue::receivePacket(Packet& pkt)
 
     if (_logger) _logger->logQueue(*this, QueueLogger::PKT_ENQUEUE, pkt);
 
-    if (queueWasEmpty && _state_send==LosslessQueue::READY) {
+    if (queueWasEmpty && _servicing == Q_NONE && next_band() != Q_NONE) {
         /* schedule the dequeue event */
         beginService();
     }
 }
 
+FairPriorityQueue::queue_priority_t
+FairPriorityQueue::next_band() const {
+    for (int prio = Q_HI; prio >= Q_LO; --prio) {
+        if (_queuesize[prio] > 0 && !(_state_send & (1 << EthPausePacket::pfc_class((Packet::PktPriority)prio))))
+            return (queue_priority_t)prio;
+    }
+    return Q_NONE;
+}
+
 void
 FairPriorityQueue::beginService()
 {
-    assert(_state_send == LosslessQueue::READY);
-
     /* schedule the next dequeue event */
-    for (int prio = Q_HI; prio >= Q_LO; --prio) {
-        if (_queuesize[prio] > 0) {
-            _sending = _queue[prio].dequeue();
+    queue_priority_t prio = next_band();
+    assert(prio != Q_NONE);
+    _sending = _queue[prio].dequeue();
 
-            assert (_sending != NULL);
-            eventlist().sourceIsPendingRel(*this, drainTime(_sending));
-            _servicing = (queue_priority_t)prio;
-            return;
-        }
-    }
+    assert (_sending != NULL);
+    eventlist().sourceIsPendingRel(*this, drainTime(_sending));
+    _servicing = prio;
 }
 
 void
 FairPriorityQueue::completeService()
 {
-    if (_state_send == LosslessQueue::PAUSED)
-        return;
-
     if (_servicing == Q_NONE || _sending == NULL){
         cout << _name << " trying to deque " << _servicing << ", qsize " << queuesize () << endl;
     }
@@ -530,18 +516,11 @@ FairPriorityQueue::completeService()
         pkt->sendOn();
     }
 
-    if (_state_send==LosslessQueue::PAUSE_RECEIVED)
-        _state_send = LosslessQueue::PAUSED;
-
-    //if (_state_send!=LosslessQueue::READY){
-    //cout << eventlist().now() << " queue " << _name << " not ready but sending " << endl;
-    //}
+    _servicing = Q_NONE;
 
-    if (queuesize() > 0 && _state_send==LosslessQueue::READY){
+    if (next_band() != Q_NONE){
         /* schedule the next dequeue event since we're allowed to send*/
         beginService();
-    } else {
-        _servicing = Q_NONE;
     }
 }
 
@@ -58,13 +58,19 @@ class BaseQueue  : public EventSource, public PacketSink, public Drawable {
             return (mem_b)(timeAsSec(t) * (double)_bitrate); 
     }
 
+    linkspeed_bps bitrate() const { return _bitrate; }
+    // serve packets at rate rather than the link's own bitrate, as when
+    // some of the link is taken by traffic that isn't simulated as
+    // packets; bitrate() still reports the link's speed
+    void setServiceRate(linkspeed_bps rate);
+
     virtual void log_packet_send(simtime_picosec duration);
     virtual uint16_t average_utilization();
 
     virtual uint64_t quantized_queuesize();
     virtual uint8_t quantized_utilization();
 
-    static simtime_picosec _update_period;
+    static thread_local simtime_picosec _update_period;
 
 protected:
     // Housekeeping
@@ -147,10 +153,12 @@ class PriorityQueue : public HostQueue {
     // wrap up serving the item at the head of the queue
     virtual void completeService(); 
     PriorityQueue::queue_priority_t getPriority(Packet& pkt);
+    // the highest band with packets whose PFC class isn't paused
+    queue_priority_t next_band() const;
     list <Packet*> _queue[Q_NONE];
     mem_b _queuesize[Q_NONE];
-    queue_priority_t _servicing;
-    int _state_send;
+    queue_priority_t _servicing; // Q_NONE when idle
+    uint8_t _state_send; // one bit per PFC class paused by the switch
 };
 
 /* implement a 3-level priority queue */
@@ -174,12 +182,14 @@ class FairPriorityQueue : public HostQueue {
     // wrap up serving the item at the head of the queue
     virtual void completeService(); 
     FairPriorityQueue::queue_priority_t getPriority(Packet& pkt);
+    // the highest band with packets whose PFC class isn't paused
+    queue_priority_t next_band() const;
     FairPullQueue<Packet> _queue[Q_NONE];
 
     Packet* _sending;
     mem_b _queuesize[Q_NONE];
-    queue_priority_t _servicing;
-    int _state_send;
+    queue_priority_t _servicing; // Q_NONE when idle
+    uint8_t _state_send; // one bit per PFC class paused by the switch
 };
 
 
@@ -7,8 +7,10 @@
 LosslessQueue::LosslessQueue(linkspeed_bps bitrate, mem_b maxsize, 
                              EventList& eventlist, QueueLogger* logger, Switch* sw)
     : Queue(bitrate,maxsize,eventlist,logger), 
-      _state_send(READY),
-      _state_recv(READY)
+      _state_send(0),
+      _state_recv(0),
+      _class_queue(EthPausePacket::_classes),
+      _class_size(EthPausePacket::_classes, 0)
 {
     //assume worst case: PAUSE frame waits for one MSS packet to be sent to other switch, and there is 
     //an MSS just beginning to be sent when PAUSE frame arrives; this means 2 packets per incoming
@@ -20,6 +22,7 @@ LosslessQueue::LosslessQueue(linkspeed_bps bitrate, mem_b maxsize,
         sw->addPort(this);
 
     _sending = 0;
+    _servicing = PFC_CLASSES;
     _high_threshold = maxsize;
     _low_threshold = 0;
 }
@@ -27,7 +30,8 @@ LosslessQueue::LosslessQueue(linkspeed_bps bitrate, mem_b maxsize,
 
 void
 LosslessQueue::initThresholds(){
-    _high_threshold = _maxsize - (_switch->portCount())*Packet::data_packet_size()*5;
+    //each PFC class gets an equal share of the buffer, less its own headroom
+    _high_threshold = _maxsize / EthPausePacket::_classes - (_switch->portCount())*Packet::data_packet_size()*5;
 
     assert(_high_threshold>0);
 
@@ -35,6 +39,14 @@ LosslessQueue::initThresholds(){
     assert(_high_threshold > _low_threshold);
 }
 
+uint32_t
+LosslessQueue::next_class() {
+    for (uint32_t c = _class_queue.size(); c-- > 0; ) {
+        if (!_class_queue[c].empty() && !(_state_send & (1 << c)))
+            return c;
+    }
+    return PFC_CLASSES;
+}
 
 void
 LosslessQueue::receivePacket(Packet& pkt) 
@@ -43,26 +55,20 @@ LosslessQueue::receivePacket(Packet& pkt)
     if (pkt.type()==ETH_PAUSE){
         EthPausePacket* p = (EthPausePacket*)&pkt;
 
-        if (p->sleepTime()>0){
-            //remote end is telling us to shut up.
-            //assert(_state_send == READY);
-            if (_sending)
-                //we have a packet in flight
-                _state_send = PAUSE_RECEIVED;
+        for (uint32_t c = 0; c < _class_queue.size(); c++) {
+            if (!p->class_enabled(c))
+                continue;
+            if (p->sleepTime(c)>0)
+                //remote end is telling us to shut up; a packet in flight still completes.
+                _state_send |= 1 << c;
             else
-                _state_send = PAUSED;
-
-            //cout << timeAsMs(eventlist().now()) << " " << _name << " PAUSED "<<endl;            
-        }
-        else {
-            //we are allowed to send!
-            _state_send = READY;
-            //cout << timeAsMs(eventlist().now()) << " " << _name << " GO "<<endl;
-
-            //start transmission if we have packets to send!
-            if(_enqueued.size()>0&&!_sending)
-                beginService();
+                //we are allowed to send!
+                _state_send &= ~(1 << c);
         }
+
+        //start transmission if we have packets to send!
+        if (!_sending && next_class() < PFC_CLASSES)
+            beginService();
         
         pkt.free();
         return;
@@ -71,16 +77,17 @@ LosslessQueue::receivePacket(Packet& pkt)
     /* normal packet, enqueue it */
 
     pkt.flow().logTraffic(pkt, *this, TrafficLogger::PKT_ARRIVE);
-    bool queueWasEmpty = _enqueued.empty();
 
+    uint32_t c = EthPausePacket::pfc_class(pkt.priority());
     Packet* pkt_p = &pkt;
-    _enqueued.push(pkt_p);
+    _class_queue[c].push(pkt_p);
+    _class_size[c] += pkt.size();
     _queuesize += pkt.size();
 
     //send PAUSE notifications if that is the case!
-    if (_queuesize > _high_threshold && _state_recv!=PAUSED){
-        _state_recv = PAUSED;
-        _switch->sendPause(this,1000);
+    if (_class_size[c] > _high_threshold && !pause_requested(c)){
+        _state_recv |= 1 << c;
+        _switch->sendPause(this,c,1000);
     }
 
     //if (_state_recv==PAUSED)
@@ -93,25 +100,27 @@ LosslessQueue::receivePacket(Packet& pkt)
     if (_logger) 
         _logger->logQueue(*this, QueueLogger::PKT_ENQUEUE, pkt);
 
-    if (queueWasEmpty && _state_send == READY) {
+    if (!_sending && next_class() < PFC_CLASSES) {
         /* schedule the dequeue event */
-        assert(_enqueued.size()==1);
         beginService();
     }
 }
 
 void LosslessQueue::beginService(){
-    assert(_state_send==READY&&!_sending);
-    Queue::beginService();
+    assert(!_sending);
+    _servicing = next_class();
+    assert(_servicing < PFC_CLASSES);
+
+    eventlist().sourceIsPendingRel(*this, drainTime(_class_queue[_servicing].back()));
     _sending = 1;
 }
 
 void LosslessQueue::completeService(){
     /* dequeue the packet */
-    assert(!_enqueued.empty());
-    //Packet* pkt = _enqueued.back();
-    //_enqueued.pop_back();
-    Packet* pkt = _enqueued.pop();
+    assert(_servicing < PFC_CLASSES && !_class_queue[_servicing].empty());
+    uint32_t c = _servicing;
+    Packet* pkt = _class_queue[c].pop();
+    _class_size[c] -= pkt->size();
     _queuesize -= pkt->size();
     
     pkt->flow().logTraffic(*pkt, *this, TrafficLogger::PKT_DEPART);
@@ -123,20 +132,15 @@ void LosslessQueue::completeService(){
     pkt->sendOn();
 
     _sending = 0;
-
-    if (_state_send == PAUSE_RECEIVED)
-        _state_send = PAUSED;
+    _servicing = PFC_CLASSES;
 
     //unblock if that is the case
-    if (_queuesize < _low_threshold && _state_recv == PAUSED) {
-        _switch->sendPause(this,0);
-        _state_recv = READY;
+    if (_class_size[c] < _low_threshold && pause_requested(c)) {
+        _state_recv &= ~(1 << c);
+        _switch->sendPause(this,c,0);
     }
 
-    if (!_enqueued.empty()) {
-        if (_state_send == READY)
-            /* start packet transmission, schedule the next dequeue event */
-            beginService();
-    }
+    if (next_class() < PFC_CLASSES)
+        /* start packet transmission, schedule the next dequeue event */
+        beginService();
 }
-
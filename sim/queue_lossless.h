@@ -25,6 +25,9 @@ public:
     void completeService();
     void initThresholds();
 
+    // has this queue asked the switch to pause its inputs for pclass?
+    bool pause_requested(uint32_t pclass) const {return _state_recv & (1 << pclass);}
+
     //    void setSwitch(Switch *s) {_switch = s;};
     //Switch* getSwitch() {return _switch;};
 
@@ -33,11 +36,21 @@ public:
     enum {PAUSED,READY,PAUSE_RECEIVED};
 
 private:
+    // the highest priority class with packets that is not paused, or
+    // PFC_CLASSES if there is none
+    uint32_t next_class();
+
     //    Switch* _switch;
-    int _state_send;
-    int _state_recv;
+    // one bit per PFC class
+    uint8_t _state_send;
+    uint8_t _state_recv;
 
     int _sending;
+    uint32_t _servicing;
+
+    // one FIFO and byte count per PFC class
+    vector<CircularBuffer<Packet*> > _class_queue;
+    vector<mem_b> _class_size;
 
     int _low_threshold;
     int _high_threshold;
@@ -5,13 +5,14 @@
 #include <sstream>
 #include "switch.h"
 
-uint64_t LosslessInputQueue::_high_threshold = 0;
-uint64_t LosslessInputQueue::_low_threshold = 0;
+thread_local uint64_t LosslessInputQueue::_high_threshold = 0;
+thread_local uint64_t LosslessInputQueue::_low_threshold = 0;
 
 LosslessInputQueue::LosslessInputQueue(EventList& eventlist)
     : Queue(speedFromGbps(1),Packet::data_packet_size()*2000,eventlist,NULL),
       VirtualQueue(),
-      _state_recv(READY)
+      _state_recv(0),
+      _class_size(EthPausePacket::_classes, 0)
 {
     assert(_high_threshold>0);
     assert(_high_threshold > _low_threshold);
@@ -22,7 +23,8 @@ LosslessInputQueue::LosslessInputQueue(EventList& eventlist)
 LosslessInputQueue::LosslessInputQueue(EventList& eventlist,BaseQueue* peer)
     : Queue(speedFromGbps(1),Packet::data_packet_size()*2000,eventlist,NULL),
       VirtualQueue(),
-      _state_recv(READY)
+      _state_recv(0),
+      _class_size(EthPausePacket::_classes, 0)
 {
     assert(_high_threshold>0);
     assert(_high_threshold > _low_threshold);
@@ -40,7 +42,8 @@ LosslessInputQueue::LosslessInputQueue(EventList& eventlist,BaseQueue* peer)
 LosslessInputQueue::LosslessInputQueue(EventList& eventlist,BaseQueue* peer, Switch* sw, simtime_picosec wire_latency)
     : Queue(speedFromGbps(1),Packet::data_packet_size()*2000,eventlist,NULL),
       VirtualQueue(),
-      _state_recv(READY)
+      _state_recv(0),
+      _class_size(EthPausePacket::_classes, 0)
 {
     assert(_high_threshold>0);
     assert(_high_threshold > _low_threshold);
@@ -63,13 +66,15 @@ void
 LosslessInputQueue::receivePacket(Packet& pkt) 
 {
     /* normal packet, enqueue it */
+    uint32_t c = EthPausePacket::pfc_class(pkt.priority());
     _queuesize += pkt.size();
+    _class_size[c] += pkt.size();
 
     //send PAUSE notifications if that is the case!
     assert(_queuesize > 0);
-    if ((uint64_t)_queuesize > _high_threshold && _state_recv!=PAUSED){
-        _state_recv = PAUSED;
-        sendPause(1000);
+    if ((uint64_t)_class_size[c] > _high_threshold && !(_state_recv & (1 << c))){
+        _state_recv |= 1 << c;
+        sendPause(c,1000);
     }
 
     //if (_state_recv==PAUSED)
@@ -93,23 +98,25 @@ LosslessInputQueue::receivePacket(Packet& pkt)
 }
 
 void LosslessInputQueue::completedService(Packet& pkt){
+    uint32_t c = EthPausePacket::pfc_class(pkt.priority());
     _queuesize -= pkt.size();
+    _class_size[c] -= pkt.size();
 
     //unblock if that is the case
-    assert(_queuesize >= 0);
-    if ((uint64_t)_queuesize < _low_threshold && _state_recv == PAUSED) {
-        _state_recv = READY;
-        sendPause(0);
+    assert(_class_size[c] >= 0);
+    if ((uint64_t)_class_size[c] < _low_threshold && (_state_recv & (1 << c))) {
+        _state_recv &= ~(1 << c);
+        sendPause(c,0);
     }
 }
 
-void LosslessInputQueue::sendPause(unsigned int wait){
+void LosslessInputQueue::sendPause(uint32_t pclass, unsigned int wait){
     //cout << "Ingress link " << getRemoteEndpoint() << " PAUSE " << wait << endl;    
     uint32_t switchID = 0;
     if (_switch)
         switchID = getSwitch()->getID();
 
-    EthPausePacket* pkt = EthPausePacket::newpkt(wait,switchID);
+    EthPausePacket* pkt = EthPausePacket::newpkt(pclass,wait,switchID);
 
     if (_wire)
         _wire->receivePacket(*pkt);
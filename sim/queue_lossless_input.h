@@ -25,7 +25,7 @@ public:
 
     virtual void receivePacket(Packet& pkt);
 
-    void sendPause(unsigned int wait);
+    void sendPause(uint32_t pclass, unsigned int wait);
     virtual void completedService(Packet& pkt);
 
     virtual void setName(const string& name) {
@@ -36,11 +36,15 @@ public:
 
     enum {PAUSED,READY,PAUSE_RECEIVED};
 
-    static uint64_t _low_threshold;
-    static uint64_t _high_threshold;
+    // per PFC class: each class's bytes held for this input port are
+    // counted against the thresholds separately, so one class filling
+    // up doesn't pause the others.
+    static thread_local uint64_t _low_threshold;
+    static thread_local uint64_t _high_threshold;
 
 private:
-    int _state_recv;
+    uint8_t _state_recv; // one bit per PFC class we have paused
+    vector<mem_b> _class_size;
     CallbackPipe* _wire;
 };
 
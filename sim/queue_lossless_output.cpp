@@ -10,13 +10,16 @@
 LosslessOutputQueue::LosslessOutputQueue(linkspeed_bps bitrate, mem_b maxsize, 
                                          EventList& eventlist, QueueLogger* logger, int ECN, int K)
     : Queue(bitrate,maxsize,eventlist,logger), 
-      _state_send(READY)
+      _class_queue(EthPausePacket::_classes),
+      _class_vq(EthPausePacket::_classes),
+      _state_send(0)
 {
     //assume worst case: PAUSE frame waits for one MSS packet to be sent to other switch, and there is 
     //an MSS just beginning to be sent when PAUSE frame arrives; this means 2 packets per incoming
     //port, and we must have buffering for all ports except this one (assuming no one hop cycles!)
 
     _sending = 0;
+    _servicing = PFC_CLASSES;
 
     _ecn_enabled = ECN;
     _K = K;
@@ -46,26 +49,20 @@ LosslessOutputQueue::receivePacket(Packet& pkt,VirtualQueue* prev)
     if (pkt.type()==ETH_PAUSE){
         EthPausePacket* p = (EthPausePacket*)&pkt;
 
-        if (p->sleepTime()>0){
-            //remote end is telling us to shut up.
-            //assert(_state_send == READY);
-            if (_sending)
-                //we have a packet in flight
-                _state_send = PAUSE_RECEIVED;
+        for (uint32_t c = 0; c < _class_queue.size(); c++) {
+            if (!p->class_enabled(c))
+                continue;
+            if (p->sleepTime(c)>0)
+                //remote end is telling us to shut up; a packet in flight still completes.
+                _state_send |= 1 << c;
             else
-                _state_send = PAUSED;
-
-            //cout << timeAsMs(eventlist().now()) << " " << _name << " PAUSED "<<endl;            
-        }
-        else {
-            //we are allowed to send!
-            _state_send = READY;
-            //cout << timeAsMs(eventlist().now()) << " " << _name << " GO "<<endl;
-
-            //start transmission if we have packets to send!
-            if(_enqueued.size()>0&&!_sending)
-                beginService();
+                //we are allowed to send!
+                _state_send &= ~(1 << c);
         }
+
+        //start transmission if we have packets to send!
+        if (!_sending && next_class() < PFC_CLASSES)
+            beginService();
         
         pkt.free();
         return;
@@ -78,11 +75,10 @@ LosslessOutputQueue::receivePacket(Packet& pkt,VirtualQueue* prev)
 
     pkt.flow().logTraffic(pkt, *this, TrafficLogger::PKT_ARRIVE);
 
-    bool queueWasEmpty = _enqueued.empty();
-
-    _vq.push_front(prev);
+    uint32_t c = EthPausePacket::pfc_class(pkt.priority());
     Packet* pkt_p = &pkt;
-    _enqueued.push(pkt_p);
+    _class_queue[c].push(pkt_p);
+    _class_vq[c].push(prev);
 
     _queuesize += pkt.size();
 
@@ -93,29 +89,35 @@ LosslessOutputQueue::receivePacket(Packet& pkt,VirtualQueue* prev)
     if (_logger) 
         _logger->logQueue(*this, QueueLogger::PKT_ENQUEUE, pkt);
 
-    if (queueWasEmpty && _state_send == READY) {
+    if (!_sending && next_class() < PFC_CLASSES) {
         /* schedule the dequeue event */
-        assert(_enqueued.size()==1);
         beginService();
     }
 }
 
+uint32_t LosslessOutputQueue::next_class() {
+    for (uint32_t c = _class_queue.size(); c-- > 0; ) {
+        if (!_class_queue[c].empty() && !(_state_send & (1 << c)))
+            return c;
+    }
+    return PFC_CLASSES;
+}
+
 void LosslessOutputQueue::beginService(){
-    assert(_state_send==READY&&!_sending);
+    assert(!_sending);
+    _servicing = next_class();
+    assert(_servicing < PFC_CLASSES);
 
-    Queue::beginService();
+    eventlist().sourceIsPendingRel(*this, drainTime(_class_queue[_servicing].back()));
     _sending = 1;
 }
 
 void LosslessOutputQueue::completeService(){
     /* dequeue the packet */
-    assert(!_enqueued.empty());
+    assert(_servicing < PFC_CLASSES && !_class_queue[_servicing].empty());
 
-    Packet* pkt = _enqueued.pop();
-    VirtualQueue* q = _vq.back();
-
-    //_enqueued.pop_back();
-    _vq.pop_back();
+    Packet* pkt = _class_queue[_servicing].pop();
+    VirtualQueue* q = _class_vq[_servicing].pop();
 
     //mark on deque
     if (_ecn_enabled && _queuesize > _K)
@@ -124,20 +126,18 @@ void LosslessOutputQueue::completeService(){
     if (pkt->type()==HPCC){
         //HPPC INT information adding to packet
         HPCCPacket* h = dynamic_cast<HPCCPacket*>(pkt);
-        assert(h->_int_hop<5);
+        IntEntry& info = h->push_int();
 
-        h->_int_info[h->_int_hop]._queuesize = _queuesize;
-        h->_int_info[h->_int_hop]._ts = eventlist().now();
+        info._queuesize = _queuesize;
+        info._ts = eventlist().now();
 
         if (_switch){
-            h->_int_info[h->_int_hop]._switchID = _switch->getID();
-            h->_int_info[h->_int_hop]._type = _switch->getType();
+            info._switchID = _switch->getID();
+            info._type = _switch->getType();
         }
 
-        h->_int_info[h->_int_hop]._txbytes = _txbytes;
-        h->_int_info[h->_int_hop]._linkrate = _bitrate;
-
-        h->_int_hop++;
+        info._txbytes = _txbytes;
+        info._linkrate = _bitrate;
     }   
 
     _queuesize -= pkt->size();
@@ -160,17 +160,9 @@ void LosslessOutputQueue::completeService(){
     pkt->sendOn();
 
     _sending = 0;
+    _servicing = PFC_CLASSES;
 
-    //if (_state_send!=READY){
-    //cout << timeAsMs(eventlist().now()) << " queue " << _name << " not ready but sending pkt " << pkt->type() << endl;
-    //}
-
-    if (_state_send == PAUSE_RECEIVED)
-        _state_send = PAUSED;
-
-    if (!_enqueued.empty()) {
-        if (_state_send == READY)
-            /* start packet transmission, schedule the next dequeue event */
-            beginService();
-    }
+    if (next_class() < PFC_CLASSES)
+        /* start packet transmission, schedule the next dequeue event */
+        beginService();
 }
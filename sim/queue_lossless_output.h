@@ -24,15 +24,24 @@ public:
     void beginService();
     void completeService();
 
-    bool is_paused() { return _state_send == PAUSED || _state_send == PAUSE_RECEIVED;}
+    // paused in any PFC class
+    bool is_paused() { return _state_send != 0;}
 
     enum queue_state {PAUSED,READY,PAUSE_RECEIVED};
 
 private:
-    list<VirtualQueue*> _vq;
+    // the highest priority class with packets that is not paused, or
+    // PFC_CLASSES if there is none
+    uint32_t next_class();
 
-    int _state_send;
+    // one FIFO per PFC class, with the virtual queue each packet came
+    // from alongside
+    vector<CircularBuffer<Packet*> > _class_queue;
+    vector<CircularBuffer<VirtualQueue*> > _class_vq;
+
+    uint8_t _state_send; // one bit per paused PFC class
     int _sending;
+    uint32_t _servicing;
     uint64_t _txbytes;
 
     int _ecn_enabled;
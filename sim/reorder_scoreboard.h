@@ -0,0 +1,114 @@
+// -*- c-basic-offset: 4; indent-tabs-mode: nil -*-
+#ifndef REORDER_SCOREBOARD_H
+#define REORDER_SCOREBOARD_H
+
+/*
+ * Receiver-side record of the packets that have arrived above a hole
+ * in the sequence space, used by the sinks in place of a sorted list
+ * of seqnos.  There is one bit per packet in a ring indexed by packet
+ * number, so a packet is recorded in O(1) however far out of order it
+ * is, and the cumulative ack moves over up to a word of received
+ * packets at a time.  The ring doubles when a packet lands beyond it.
+ *
+ * All the packets of a flow are assumed to be the same size, as the
+ * sinks already did, so packet numbers are counted in packet sizes
+ * from the next expected seqno.
+ */
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include "config.h"
+
+class ReorderScoreboard {
+public:
+    ReorderScoreboard() : _bits(4, 0), _pktsize(0), _origin(0), _next_seqno(1), _held(0) {}
+
+    // record packet seqno, which is above the next expected seqno.
+    // Returns false if we already hold it.
+    bool insert(uint64_t seqno, uint64_t pktsize) {
+        if (_held == 0) {
+            _pktsize = pktsize;
+            _origin = _next_seqno % _pktsize;
+        }
+        assert(seqno > _next_seqno && (seqno - _origin) % _pktsize == 0);
+        uint64_t pkt = (seqno - _origin) / _pktsize;
+        uint64_t offset = pkt - next_pkt();
+        if (offset >= capacity())
+            grow(offset);
+        uint64_t pos = pkt & (capacity() - 1);
+        uint64_t bit = (uint64_t)1 << (pos & 63);
+        if (_bits[pos >> 6] & bit)
+            return false;
+        _bits[pos >> 6] |= bit;
+        _held++;
+        return true;
+    }
+
+    // The cumulative ack has moved so that next_seqno is the next
+    // expected seqno.  Removes the run of held packets starting there,
+    // and returns how many packets the cumulative ack can skip.
+    uint64_t advance(uint64_t next_seqno) {
+        _next_seqno = next_seqno;
+        if (_held == 0 || (next_seqno - _origin) % _pktsize != 0)
+            return 0;
+        uint64_t run = 0;
+        while (_held > 0) {
+            uint64_t pos = next_pkt() & (capacity() - 1);
+            uint64_t shift = pos & 63;
+            uint64_t word = _bits[pos >> 6] >> shift;
+            uint64_t ones = ~word ? __builtin_ctzll(~word) : 64;
+            if (ones > 64 - shift)
+                ones = 64 - shift;
+            if (ones == 0)
+                break;
+            uint64_t mask = ones == 64 ? ~(uint64_t)0 : (((uint64_t)1 << ones) - 1) << shift;
+            _bits[pos >> 6] &= ~mask;
+            _held -= ones;
+            _next_seqno += ones * _pktsize;
+            run += ones;
+            if (ones < 64 - shift)
+                break;
+        }
+        return run;
+    }
+
+    // forget everything, when a sink is reset for a new flow
+    void clear() {
+        std::fill(_bits.begin(), _bits.end(), 0);
+        _next_seqno = 1;
+        _held = 0;
+    }
+
+    uint64_t size() const {return _held;}
+    bool empty() const {return _held == 0;}
+
+private:
+    uint64_t capacity() const {return _bits.size() * 64;}
+    uint64_t next_pkt() const {return (_next_seqno - _origin) / _pktsize;}
+
+    // make room for a packet offset packets above the next expected one
+    void grow(uint64_t offset) {
+        size_t words = _bits.size();
+        while (words * 64 <= offset)
+            words *= 2;
+        vector<uint64_t> bits(words, 0);
+        uint64_t first = next_pkt(), oldmask = capacity() - 1, newmask = words * 64 - 1;
+        for (uint64_t pkt = first; pkt < first + capacity(); pkt++) {
+            uint64_t pos = pkt & oldmask;
+            if (_bits[pos >> 6] & ((uint64_t)1 << (pos & 63))) {
+                uint64_t npos = pkt & newmask;
+                bits[npos >> 6] |= (uint64_t)1 << (npos & 63);
+            }
+        }
+        _bits.swap(bits);
+    }
+
+    vector<uint64_t> _bits;     // ring of held packets, power of 2 words
+    uint64_t _pktsize;          // set with _origin when an empty ring gets a packet
+    uint64_t _origin;           // seqno of packet number 0
+    uint64_t _next_seqno;       // next seqno expected
+    uint64_t _held;
+};
+
+#endif
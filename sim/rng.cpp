@@ -4,7 +4,9 @@
 
 using namespace std;
 
-static mt19937 random_engine;
+// one generator per thread, so each simulation's draws depend only on
+// its own seed
+static thread_local mt19937 random_engine;
 
 void srand(unsigned seed)
 {
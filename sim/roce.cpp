@@ -24,11 +24,11 @@ using namespace std;
 /* keep track of RTOs.  Generally, we shouldn't see RTOs if
    return-to-sender is enabled.  Otherwise we'll see them with very
    large incasts. */
-uint32_t RoceSrc::_global_node_count = 0;
-uint32_t RoceSrc::_global_rto_count = 0;
+thread_local uint32_t RoceSrc::_global_node_count = 0;
+thread_local uint32_t RoceSrc::_global_rto_count = 0;
 
 /* _min_rto can be tuned using SetMinRTO. Don't change it here.  */
-simtime_picosec RoceSrc::_min_rto = timeFromUs((uint32_t)DEFAULT_RTO_MIN);
+thread_local simtime_picosec RoceSrc::_min_rto = timeFromUs((uint32_t)DEFAULT_RTO_MIN);
 
 RoceSrc::RoceSrc(RoceLogger* logger, TrafficLogger* pktlogger, EventList &eventlist, linkspeed_bps rate)
     : BaseQueue(rate,eventlist,NULL), _flow(pktlogger), _logger(logger)
@@ -211,7 +211,12 @@ void RoceSrc::processAck(const RoceAck& ack) {
 }
 
 void RoceSrc::processPause(const EthPausePacket& p) {
-    if (p.sleepTime()>0){
+    //all our data packets are in one PFC class
+    uint32_t c = EthPausePacket::pfc_class(Packet::PRIO_LO);
+    if (!p.class_enabled(c))
+        return;
+
+    if (p.sleepTime(c)>0){
         //remote end is telling us to shut up.
         //cout << "Source " << str() << " PAUSE " << timeAsUs(eventlist().now()) << endl;
         //assert(_state_send != PAUSED);
@@ -229,6 +234,7 @@ void RoceSrc::receivePacket(Packet& pkt)
 {
     if (!_flow_started){
         assert(pkt.type()==ETH_PAUSE);
+        pkt.free();
         return; 
     }
 
@@ -238,8 +244,10 @@ void RoceSrc::receivePacket(Packet& pkt)
         _stop_time = 0;
     }
 
-    if (_done)
+    if (_done) {
+        pkt.free();
         return;
+    }
 
     switch (pkt.type()) {
     case ETH_PAUSE:
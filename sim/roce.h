@@ -114,9 +114,9 @@ public:
     void log_me();
     bool _log_me;
 
-    static uint32_t _global_node_count; 
-    static uint32_t _global_rto_count;  // keep track of the total number of timeouts across all srcs
-    static simtime_picosec _min_rto;
+    static thread_local uint32_t _global_node_count; 
+    static thread_local uint32_t _global_rto_count;  // keep track of the total number of timeouts across all srcs
+    static thread_local simtime_picosec _min_rto;
 
     PacketFlow _flow;
 
@@ -1,5 +1,5 @@
 #include "rocepacket.h"
 
-PacketDB<RocePacket> RocePacket::_packetdb;
-PacketDB<RoceAck> RoceAck::_packetdb;
-PacketDB<RoceNack> RoceNack::_packetdb;
+thread_local PacketDB<RocePacket> RocePacket::_packetdb;
+thread_local PacketDB<RoceAck> RoceAck::_packetdb;
+thread_local PacketDB<RoceNack> RoceNack::_packetdb;
@@ -71,7 +71,7 @@ class RocePacket : public Packet {
     simtime_picosec _ts;
     bool _retransmitted;
     bool _last_packet;  // set to true in the last packet in a flow.
-    static PacketDB<RocePacket> _packetdb;
+    static thread_local PacketDB<RocePacket> _packetdb;
 };
 
 class RoceAck : public Packet {
@@ -103,7 +103,7 @@ class RoceAck : public Packet {
  protected:
     seq_t _ackno;
     simtime_picosec _ts;
-    static PacketDB<RoceAck> _packetdb;
+    static thread_local PacketDB<RoceAck> _packetdb;
 };
 
 
@@ -135,7 +135,7 @@ class RoceNack : public Packet {
  protected:
     seq_t _ackno;
     simtime_picosec _ts;
-    static PacketDB<RoceNack> _packetdb;
+    static thread_local PacketDB<RoceNack> _packetdb;
 };
 
 
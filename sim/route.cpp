@@ -1,5 +1,6 @@
 // -*- c-basic-offset: 4; indent-tabs-mode: nil -*-  
 #include <climits>
+#include <algorithm>
 #include "route.h"
 #include "network.h"
 #include "queue.h"
@@ -7,12 +8,19 @@
 
 #define MAXQUEUES 10
 
-Route::Route() : _hop_count(0), _reverse(NULL) {};
+Route::Route() : _hops(NULL), _size(0), _owned(true), _id(NO_ROUTE), _hop_count(0), _reverse(NULL),
+                 _path_id(0), _no_of_paths(0) {};
 
-Route::Route(int size) : _hop_count(0), _reverse(NULL) {
+Route::Route(int size) : _hops(NULL), _size(0), _owned(true), _id(NO_ROUTE), _hop_count(0), _reverse(NULL),
+                         _path_id(0), _no_of_paths(0) {
     _sinklist.reserve(size);
+    sync();
 };
 
+Route::Route(const Route& orig) {
+    *this = orig;
+}
+
 Route::Route(const Route& orig, PacketSink& dst) : _sinklist(orig.size()+1){
     //_sinklist.resize(orig.size()+1);
     _path_id = orig.path_id();
@@ -24,6 +32,26 @@ Route::Route(const Route& orig, PacketSink& dst) : _sinklist(orig.size()+1){
     }
     _sinklist[orig.size()] = &dst;
     _hop_count++;
+    _owned = true;
+    _id = NO_ROUTE;
+    sync();
+}
+
+// a copy of an interned route takes its own hops, as the interned
+// route may be released while the copy is still in use
+Route&
+Route::operator=(const Route& orig) {
+    if (this == &orig)
+        return *this;
+    _sinklist.assign(orig._hops, orig._hops + orig._size);
+    _owned = true;
+    sync();
+    _id = NO_ROUTE;
+    _hop_count = orig._hop_count;
+    _reverse = orig._reverse;
+    _path_id = orig._path_id;
+    _no_of_paths = orig._no_of_paths;
+    return *this;
 }
 
 
@@ -43,17 +71,31 @@ Route::clone() const {
       copy->push_back(*i);
       }
     */
-    copy->_sinklist.resize(_sinklist.size());
-    for (uint32_t i = 0; i < _sinklist.size(); i++) {
-        copy->_sinklist[i] = _sinklist[i];
-    }
+    copy->_sinklist.assign(_hops, _hops + _size);
+    copy->sync();
     return copy;
 }
 
+void
+Route::clear() {
+    _sinklist.clear();
+    _owned = true;
+    sync();
+    _id = NO_ROUTE;
+    _hop_count = 0;
+    _reverse = NULL;
+    _path_id = 0;
+    _no_of_paths = 0;
+}
+
 void
 Route::add_endpoints(PacketSink *src, PacketSink* dst) {
     //_sinklist.push_back(dst);
     if (_reverse) {
+        if (_reverse->id() != NO_ROUTE) {
+            // don't extend the interned route that other flows share
+            _reverse = new Route(*_reverse);
+        }
         _reverse->push_back(src);
     }
 }
@@ -89,3 +131,247 @@ void check_non_null(Route* rt){
         assert(0);
     }
 }
+
+/************************************************************************/
+/* RouteStore                                                           */
+/************************************************************************/
+
+const route_id_t Route::NO_ROUTE;
+const uint32_t RouteStore::NO_HOPS;
+const size_t RouteStore::BLOCK_SIZE;
+
+thread_local deque<Route> RouteStore::_routes;
+thread_local vector<RouteStore::RouteKey> RouteStore::_route_keys;
+thread_local vector<uint32_t> RouteStore::_route_index;
+thread_local vector<route_id_t> RouteStore::_free_routes;
+thread_local vector<RouteStore::HopList> RouteStore::_hoplists;
+thread_local vector<uint32_t> RouteStore::_hoplist_index;
+thread_local vector<uint32_t> RouteStore::_free_hoplists;
+thread_local vector<vector<PacketSink*> > RouteStore::_blocks;
+thread_local PacketSink** RouteStore::_block_next = NULL;
+thread_local size_t RouteStore::_block_free = 0;
+thread_local vector<vector<PacketSink**> > RouteStore::_free_hops;
+thread_local size_t RouteStore::_hops_stored = 0;
+
+static inline size_t
+mix_hash(size_t h, uint64_t v) {
+    h = (h + v) * 0x9e3779b97f4a7c15ULL;
+    return h ^ (h >> 29);
+}
+
+// rebuild an index of the live items with a hash field at twice the size
+template <class T>
+static void
+grow_index(vector<uint32_t>& index, const vector<T>& items) {
+    vector<uint32_t> bigger(index.size() * 2, UINT32_MAX);
+    size_t mask = bigger.size() - 1;
+    for (size_t x = 0; x < items.size(); x++) {
+        if (!items[x].live())
+            continue;
+        size_t i = items[x].hash & mask;
+        while (bigger[i] != UINT32_MAX)
+            i = (i + 1) & mask;
+        bigger[i] = x;
+    }
+    index.swap(bigger);
+}
+
+// remove item x from an index, shifting back the entries probed past it
+template <class T>
+static void
+unindex(vector<uint32_t>& index, const vector<T>& items, uint32_t x) {
+    size_t mask = index.size() - 1;
+    size_t i = items[x].hash & mask;
+    while (index[i] != x)
+        i = (i + 1) & mask;
+    for (size_t j = (i + 1) & mask; index[j] != UINT32_MAX; j = (j + 1) & mask) {
+        size_t home = items[index[j]].hash & mask;
+        // index[j] may fill the hole at i unless its home lies in (i, j]
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            index[i] = index[j];
+            i = j;
+        }
+    }
+    index[i] = UINT32_MAX;
+}
+
+uint32_t
+RouteStore::intern_hops(const Route& route) {
+    size_t hash = route.size();
+    for (size_t h = 0; h < route.size(); h++)
+        hash = mix_hash(hash, (uint64_t)(uintptr_t)route.at(h));
+
+    if (_hoplist_index.empty())
+        _hoplist_index.assign(1024, NO_HOPS);
+    size_t mask = _hoplist_index.size() - 1;
+    size_t i = hash & mask;
+    for (; _hoplist_index[i] != NO_HOPS; i = (i + 1) & mask) {
+        const HopList& hl = _hoplists[_hoplist_index[i]];
+        if (hl.hash == hash && hl.size == route.size()
+            && equal(route.begin(), route.end(), hl.hops))
+            return _hoplist_index[i];
+    }
+
+    // copy the hops into the arena, reusing the space of a freed hop
+    // list of the same size if there is one
+    PacketSink** hops;
+    if (route.size() < _free_hops.size() && !_free_hops[route.size()].empty()) {
+        hops = _free_hops[route.size()].back();
+        _free_hops[route.size()].pop_back();
+    } else {
+        if (_block_free < route.size()) {
+            size_t size = max(BLOCK_SIZE, route.size());
+            // growing _blocks moves the blocks without moving their hops
+            _blocks.push_back(vector<PacketSink*>(size));
+            _block_next = _blocks.back().data();
+            _block_free = size;
+        }
+        hops = _block_next;
+        _block_next += route.size();
+        _block_free -= route.size();
+    }
+    copy(route.begin(), route.end(), hops);
+    _hops_stored += route.size();
+
+    HopList hl;
+    hl.hops = hops;
+    hl.size = route.size();
+    hl.refs = 0;
+    hl.hash = hash;
+    uint32_t x;
+    if (_free_hoplists.empty()) {
+        x = _hoplists.size();
+        _hoplists.push_back(hl);
+    } else {
+        x = _free_hoplists.back();
+        _free_hoplists.pop_back();
+        _hoplists[x] = hl;
+    }
+    _hoplist_index[i] = x;
+    if (_hoplists.size() * 2 > _hoplist_index.size())
+        grow_index(_hoplist_index, _hoplists);
+    return x;
+}
+
+route_id_t
+RouteStore::intern_route(RouteKey& key) {
+    key.hash = mix_hash(mix_hash(mix_hash(mix_hash(0, key.hops), key.reverse_hops), key.hop_count),
+                        ((uint64_t)(uint32_t)key.path_id << 32) | (uint32_t)key.no_of_paths);
+    if (_route_index.empty())
+        _route_index.assign(1024, Route::NO_ROUTE);
+    size_t mask = _route_index.size() - 1;
+    size_t i = key.hash & mask;
+    for (; _route_index[i] != Route::NO_ROUTE; i = (i + 1) & mask) {
+        const RouteKey& k = _route_keys[_route_index[i]];
+        if (k.hops == key.hops && k.reverse_hops == key.reverse_hops && k.hop_count == key.hop_count
+            && k.path_id == key.path_id && k.no_of_paths == key.no_of_paths) {
+            _route_keys[_route_index[i]].refs++;
+            return _route_index[i];
+        }
+    }
+
+    route_id_t id;
+    if (_free_routes.empty()) {
+        id = _routes.size();
+        _routes.push_back(Route());
+        _route_keys.push_back(key);
+    } else {
+        id = _free_routes.back();
+        _free_routes.pop_back();
+        _route_keys[id] = key;
+    }
+    _route_keys[id].refs = 1;
+    _hoplists[key.hops].refs++;
+    if (key.reverse_hops != NO_HOPS)
+        _hoplists[key.reverse_hops].refs++;
+
+    const HopList& hl = _hoplists[key.hops];
+    Route& rt = _routes[id];
+    rt._hops = hl.hops;
+    rt._size = hl.size;
+    rt._owned = false;
+    rt._id = id;
+    rt._hop_count = key.hop_count;
+    rt.set_path_id(key.path_id, key.no_of_paths);
+    _route_index[i] = id;
+    if (_route_keys.size() * 2 > _route_index.size())
+        grow_index(_route_index, _route_keys);
+    return id;
+}
+
+const Route*
+RouteStore::intern(const Route& route) {
+    RouteKey key;
+    key.hops = intern_hops(route);
+    key.reverse_hops = route.reverse() ? intern_hops(*route.reverse()) : NO_HOPS;
+    key.hop_count = route.hop_count();
+    key.path_id = route.path_id();
+    key.no_of_paths = route.no_of_paths();
+    route_id_t id = intern_route(key);
+
+    if (_routes[id]._reverse) {
+        // whoever holds the route may follow it to its reverse
+        _route_keys[_routes[id]._reverse->_id].refs++;
+    } else if (route.reverse()) {
+        const Route& reverse = *route.reverse();
+        RouteKey rkey;
+        rkey.hops = key.reverse_hops;
+        rkey.reverse_hops = key.hops;
+        rkey.hop_count = reverse.hop_count();
+        rkey.path_id = reverse.path_id();
+        rkey.no_of_paths = reverse.no_of_paths();
+        route_id_t rid = intern_route(rkey);
+        _routes[id]._reverse = &_routes[rid];
+        if (!_routes[rid]._reverse)
+            _routes[rid]._reverse = &_routes[id];
+    }
+    return &_routes[id];
+}
+
+const Route*
+RouteStore::intern(Route* route) {
+    const Route* interned = intern(*route);
+    if (route->_reverse)
+        delete route->_reverse;
+    delete route;
+    return interned;
+}
+
+void
+RouteStore::release(const Route* route) {
+    assert(route->_id != Route::NO_ROUTE && _route_keys[route->_id].refs > 0);
+    const Route* reverse = route->_reverse;
+    drop_route(route->_id);
+    if (reverse)
+        drop_route(reverse->_id);
+}
+
+void
+RouteStore::drop_route(route_id_t id) {
+    RouteKey& key = _route_keys[id];
+    if (--key.refs > 0)
+        return;
+    Route& rt = _routes[id];
+    if (rt._reverse && rt._reverse->_reverse == &rt)
+        rt._reverse->_reverse = NULL;
+    unindex(_route_index, _route_keys, id);
+    drop_hops(key.hops);
+    if (key.reverse_hops != NO_HOPS)
+        drop_hops(key.reverse_hops);
+    rt.clear();
+    _free_routes.push_back(id);
+}
+
+void
+RouteStore::drop_hops(uint32_t x) {
+    HopList& hl = _hoplists[x];
+    if (--hl.refs > 0)
+        return;
+    unindex(_hoplist_index, _hoplists, x);
+    if (hl.size >= _free_hops.size())
+        _free_hops.resize(hl.size + 1);
+    _free_hops[hl.size].push_back(hl.hops);
+    _hops_stored -= hl.size;
+    hl.hops = NULL;
+    _free_hoplists.push_back(x);
+}
@@ -1,4 +1,4 @@
-// -*- c-basic-offset: 4; indent-tabs-mode: nil -*-        
+// -*- c-basic-offset: 4; indent-tabs-mode: nil -*-
 #ifndef ROUTE_H
 #define ROUTE_H
 
@@ -9,34 +9,47 @@
 #include "config.h"
 #include <list>
 #include <vector>
+#include <deque>
 
 class PacketSink;
+typedef uint32_t route_id_t;
+
 class Route {
+    friend class RouteStore;
   public:
+    static const route_id_t NO_ROUTE = UINT32_MAX;
     Route();
     Route(int size);
+    Route(const Route& orig);
     Route(const Route& orig, PacketSink& dst);
+    Route& operator=(const Route& orig);
     Route* clone() const;
-    inline PacketSink* at(size_t n) const {return _sinklist.at(n);}
+    inline PacketSink* at(size_t n) const {assert(n < _size); return _hops[n];}
     void push_back(PacketSink* sink) {
         assert(sink != NULL);
+        own();
         _sinklist.push_back(sink);
+        sync();
         update_hopcount(sink);
     }
     void push_at(PacketSink* sink,int id) {
+        own();
         _sinklist.insert(_sinklist.begin()+id, sink);
+        sync();
             update_hopcount(sink);
     }
     void push_front(PacketSink* sink) {
+        own();
         _sinklist.insert(_sinklist.begin(), sink);
+        sync();
             update_hopcount(sink);
     }
+    void clear();
     void add_endpoints(PacketSink *src, PacketSink* dst);
-    inline size_t size() const {return _sinklist.size();}
-    typedef vector<PacketSink*>::const_iterator const_iterator;
-    //typedef vector<PacketSink*>::iterator iterator;
-    inline const_iterator begin() const {return _sinklist.begin();}
-    inline const_iterator end() const {return _sinklist.end();}
+    inline size_t size() const {return _size;}
+    typedef PacketSink* const* const_iterator;
+    inline const_iterator begin() const {return _hops;}
+    inline const_iterator end() const {return _hops + _size;}
     void set_reverse(Route* reverse) {_reverse = reverse;}
     inline const Route* reverse() const {return _reverse;}
     void set_path_id(int path_id, int no_of_paths) {
@@ -46,9 +59,26 @@ class Route {
     inline int path_id() const {return _path_id;}
     inline int no_of_paths() const {return _no_of_paths;}
     inline uint32_t hop_count() const {return _hop_count;}
+    // id in the RouteStore, or NO_ROUTE if this route was not interned
+    inline route_id_t id() const {return _id;}
  private:
     void update_hopcount(PacketSink* sink);
-    vector<PacketSink*> _sinklist;
+    // take a private copy of interned hops before changing them
+    void own() {
+        if (!_owned) {
+            _sinklist.assign(_hops, _hops + _size);
+            _owned = true;
+        }
+    }
+    void sync() {
+        _hops = _sinklist.data();
+        _size = _sinklist.size();
+    }
+    vector<PacketSink*> _sinklist; // our hops, unless they are interned
+    PacketSink* const* _hops;      // _sinklist, or the RouteStore arena
+    uint32_t _size;
+    bool _owned;
+    route_id_t _id;
     uint32_t _hop_count;
     Route* _reverse;
     int _path_id; //path identifier for this path
@@ -60,4 +90,77 @@ typedef vector<route_t*> routes_t;
 
 void check_non_null(Route* rt);
 
+/*
+ * The paths between one pair of hosts, numbered from 0.  Sources that
+ * spray over many paths ask for each path as they first use it, so
+ * they need not hold a Route for every path they might use.
+ */
+class PathSource {
+  public:
+    virtual ~PathSource() {}
+    virtual uint32_t path_count() = 0;
+    virtual const Route* path(uint32_t k) = 0;
+};
+
+/*
+ * RouteStore interns the routes that topologies hand out.  Routes with
+ * the same hops, reverse hops and path ids are stored once, with their
+ * hops packed into one arena, and are named by a 32-bit route id.
+ * Interned routes are shared between all the flows that asked for them
+ * and must not be deleted.  Each intern takes a reference on the route
+ * and its reverse, and release drops it again; a route is freed, and
+ * its slot and hops reused, when its last reference is dropped.  Copies
+ * of an interned route have their own hops, but their reverse still
+ * points into the store.  The store is per thread, like the rest of a
+ * simulation's state.
+ */
+class RouteStore {
+  public:
+    // intern route, and its reverse if it has one
+    static const Route* intern(const Route& route);
+    // as above, then delete route and its reverse
+    static const Route* intern(Route* route);
+    // drop a reference taken by intern
+    static void release(const Route* route);
+    static const Route* route(route_id_t id) {return &_routes[id];}
+    static size_t route_count() {return _routes.size() - _free_routes.size();}
+    static size_t hop_count() {return _hops_stored;}
+  private:
+    struct HopList {
+        PacketSink** hops;  // NULL once freed
+        uint32_t size;
+        uint32_t refs;      // route keys using these hops
+        size_t hash;
+        bool live() const {return hops != NULL;}
+    };
+    struct RouteKey {
+        uint32_t hops, reverse_hops; // hop lists
+        uint32_t hop_count;
+        int path_id, no_of_paths;
+        uint32_t refs;      // zero once freed
+        size_t hash;
+        bool live() const {return refs > 0;}
+    };
+    static const uint32_t NO_HOPS = UINT32_MAX;
+    static const size_t BLOCK_SIZE = 1 << 16;
+
+    static uint32_t intern_hops(const Route& route);
+    static route_id_t intern_route(RouteKey& key);
+    static void drop_route(route_id_t id);
+    static void drop_hops(uint32_t x);
+
+    static thread_local deque<Route> _routes;
+    static thread_local vector<RouteKey> _route_keys;
+    static thread_local vector<uint32_t> _route_index;  // open addressed, hash of RouteKey -> route id
+    static thread_local vector<route_id_t> _free_routes;
+    static thread_local vector<HopList> _hoplists;
+    static thread_local vector<uint32_t> _hoplist_index; // open addressed, hash of hops -> hop list
+    static thread_local vector<uint32_t> _free_hoplists;
+    static thread_local vector<vector<PacketSink*> > _blocks;  // the arena
+    static thread_local PacketSink** _block_next;      // free space at the end of the last block
+    static thread_local size_t _block_free;
+    static thread_local vector<vector<PacketSink**> > _free_hops; // freed arena space, by size
+    static thread_local size_t _hops_stored;
+};
+
 #endif
@@ -4,7 +4,7 @@
 #include <math.h>
 
 #define KILL_THRESHOLD 5
-uint32_t STrackSrc::_default_cwnd = 12;
+thread_local uint32_t STrackSrc::_default_cwnd = 12;
 
 ////////////////////////////////////////////////////////////////
 //  STRACK SOURCE
@@ -764,11 +764,12 @@ STrackSink::receivePacket(Packet& pkt) {
         _cumulative_ack = seqno + size - 1;
         _total_received += size;
         // are there any additional received packets we can now ack?
-        while (!_received.empty() && (_received.front() == _cumulative_ack+1) ) {
-            _received.pop_front();
-            _cumulative_ack += size;
-            _total_received += size;
-            if (_buffer_logger) _buffer_logger->logBuffer(ReorderBufferLogger::BUF_DEQUEUE);
+        uint64_t filled = _received.advance(_cumulative_ack+1);
+        _cumulative_ack += filled * size;
+        _total_received += filled * size;
+        if (_buffer_logger) {
+            for (uint64_t i = 0; i < filled; i++)
+                _buffer_logger->logBuffer(ReorderBufferLogger::BUF_DEQUEUE);
         }
     } else if (seqno < _cumulative_ack+1) {
         // it is before the next expected sequence - must be a spurious retransmit.
@@ -776,22 +777,9 @@ STrackSink::receivePacket(Packet& pkt) {
         cout << "Spurious retransmit received!\n";
     } else {
         // it's not the next expected sequence number
-        if (_received.empty()) {
-            _received.push_front(seqno);
-        } else if (seqno > _received.back()) {
-            // likely case - new packet above a hole
-            _received.push_back(seqno);
-        } else {
-            // uncommon case - it fills a hole, but not first hole
-            list<uint64_t>::iterator i;
-            for (i = _received.begin(); i != _received.end(); i++) {
-                if (seqno == *i) break; // it's a bad retransmit
-                if (seqno < (*i)) {
-                    _received.insert(i, seqno);
-                    if (_buffer_logger) _buffer_logger->logBuffer(ReorderBufferLogger::BUF_ENQUEUE);
-                    break;
-                }
-            }
+        // insert fails if we already have it - a bad retransmit
+        if (_received.insert(seqno, size)) {
+            if (_buffer_logger) _buffer_logger->logBuffer(ReorderBufferLogger::BUF_ENQUEUE);
         }
     }
     if (_ooo < _received.size())
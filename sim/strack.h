@@ -14,6 +14,7 @@
 #include "swift_scheduler.h"
 #include "eventlist.h"
 #include "sent_packets.h"
+#include "reorder_scoreboard.h"
 
 //#define MODEL_RECEIVE_WINDOW 1
 
@@ -148,7 +149,7 @@ protected:
 
 
     // remember the default cwnd
-    static uint32_t _default_cwnd;
+    static thread_local uint32_t _default_cwnd;
     uint32_t _prev_cwnd;
     uint64_t _packets_sent;
     uint16_t _dupacks;
@@ -222,8 +223,8 @@ class STrackSink : public PacketSink, public DataReceiver {
     // Mechanism
     void send_ack(simtime_picosec ts);
 
-    list<STrackAck::seq_t> _received; /* list of packets above a hole, that 
-                                      we've received */
+    ReorderScoreboard _received; /* packets above a hole, that
+                                    we've received */
     uint64_t _ooo; // out of order max
     uint64_t _total_received;
     string _nodename;
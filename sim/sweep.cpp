@@ -0,0 +1,138 @@
+// -*- c-basic-offset: 4; indent-tabs-mode: nil -*-
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "sweep.h"
+
+Sweep::Sweep(const string& filename, EventList& eventlist, Logfile& logfile)
+    : EventSource(eventlist, "sweep"), _logfile(logfile), _jobs(1)
+{
+    ifstream in(filename.c_str());
+    if (!in) {
+        cerr << "Failed to open sweep file " << filename << endl;
+        exit(1);
+    }
+    string line;
+    int lineno = 0;
+    while (getline(in, line)) {
+        lineno++;
+        size_t hash = line.find('#');
+        if (hash != string::npos)
+            line.erase(hash);
+        stringstream ss(line);
+        Variant v;
+        if (!(ss >> v.name))
+            continue;
+        string field;
+        while (ss >> field) {
+            size_t eq = field.find('=');
+            if (eq == string::npos || eq == 0) {
+                cerr << filename << ":" << lineno << ": expected key=value, found " << field << endl;
+                exit(1);
+            }
+            v.overrides.push_back(make_pair(field.substr(0, eq), field.substr(eq + 1)));
+        }
+        for (size_t i = 0; i < _variants.size(); i++) {
+            if (_variants[i].name == v.name) {
+                cerr << filename << ":" << lineno << ": duplicate variant " << v.name << endl;
+                exit(1);
+            }
+        }
+        _variants.push_back(v);
+    }
+    if (_variants.empty()) {
+        cerr << "Sweep file " << filename << " has no variants" << endl;
+        exit(1);
+    }
+}
+
+void
+Sweep::addHook(const string& key, Hook hook) {
+    _hooks[key] = hook;
+}
+
+void
+Sweep::start(simtime_picosec when, uint32_t jobs) {
+    // check the whole file now, rather than after the warm-up
+    for (size_t i = 0; i < _variants.size(); i++) {
+        for (size_t j = 0; j < _variants[i].overrides.size(); j++) {
+            const string& key = _variants[i].overrides[j].first;
+            if (_hooks.find(key) == _hooks.end()) {
+                cerr << "Sweep variant " << _variants[i].name << ": can't override " << key << endl;
+                exit(1);
+            }
+        }
+    }
+    _jobs = jobs > 0 ? jobs : 1;
+    eventlist().sourceIsPending(*this, when);
+}
+
+void
+Sweep::doNextEvent() {
+    // anything still buffered would otherwise be written by every child
+    cout.flush();
+    fflush(NULL);
+
+    map<pid_t, string> running;
+    int failures = 0;
+    for (size_t i = 0; i < _variants.size(); i++) {
+        while (running.size() >= _jobs)
+            waitChild(running, failures);
+        pid_t pid = fork();
+        if (pid < 0) {
+            cerr << "Sweep: fork failed for variant " << _variants[i].name << endl;
+            exit(1);
+        }
+        if (pid == 0) {
+            runChild(_variants[i]);
+            return;
+        }
+        running[pid] = _variants[i].name;
+    }
+    while (!running.empty())
+        waitChild(running, failures);
+
+    // each child's log has the warm-up in it; ours would be a
+    // truncated copy of that
+    unlink(_logfile.filename().c_str());
+    cout << "Sweep: " << _variants.size() - failures << " of " << _variants.size()
+         << " variants completed" << endl;
+    exit(failures ? 1 : 0);
+}
+
+void
+Sweep::runChild(const Variant& v) {
+    _variant = v.name;
+    string logname = _logfile.filename() + "." + v.name;
+    if (!freopen((logname + ".out").c_str(), "w", stdout)) {
+        cerr << "Sweep: failed to open " << logname << ".out" << endl;
+        exit(1);
+    }
+    _logfile.branch(logname);
+    cout << "Sweep variant " << v.name << " branching at " << timeAsUs(eventlist().now()) << "us" << endl;
+    for (size_t i = 0; i < v.overrides.size(); i++) {
+        cout << "Sweep override " << v.overrides[i].first << "=" << v.overrides[i].second << endl;
+        _hooks[v.overrides[i].first](v.overrides[i].second);
+    }
+}
+
+void
+Sweep::waitChild(map<pid_t, string>& running, int& failures) {
+    int status;
+    pid_t pid = wait(&status);
+    if (pid < 0) {
+        cerr << "Sweep: wait failed" << endl;
+        exit(1);
+    }
+    map<pid_t, string>::iterator i = running.find(pid);
+    if (i == running.end())
+        return;
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        cout << "Sweep variant " << i->second << " done" << endl;
+    } else {
+        cout << "Sweep variant " << i->second << " failed, status " << status << endl;
+        failures++;
+    }
+    running.erase(i);
+}
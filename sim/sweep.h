@@ -0,0 +1,58 @@
+// -*- c-basic-offset: 4; indent-tabs-mode: nil -*-
+#ifndef SWEEP_H
+#define SWEEP_H
+
+/*
+ * A Sweep runs several variants of one simulation that share a common
+ * prefix.  The simulation runs once up to the branch time, then forks
+ * one child process per variant.  Each child applies its variant's
+ * overrides through the hooks the program registered, and runs on to
+ * the end with its own logfile and stdout.  Setup and warm-up are paid
+ * for once per sweep instead of once per point.
+ *
+ * The sweep file has one variant per line, a name and then key=value
+ * overrides; # starts a comment:
+ *
+ *   ecn_low   ecn_thresh=0.2
+ *   ecn_high  ecn_thresh=0.8 ar_method=queue
+ *
+ * A child logs to <logfile>.<name> and writes its stdout to
+ * <logfile>.<name>.out.  The log holds the whole run, warm-up
+ * included.  The parent waits for all the children and then exits.
+ */
+
+#include <functional>
+#include <map>
+#include "config.h"
+#include "eventlist.h"
+#include "logfile.h"
+
+class Sweep : public EventSource {
+ public:
+    typedef function<void(const string& value)> Hook;
+
+    Sweep(const string& filename, EventList& eventlist, Logfile& logfile);
+    // call before start(); a variant using a key with no hook is an error
+    void addHook(const string& key, Hook hook);
+    // branch at time when, running at most jobs children at once
+    void start(simtime_picosec when, uint32_t jobs);
+    virtual void doNextEvent();
+    // in a child, the variant it is running; empty before the branch
+    const string& variant() const {return _variant;}
+
+ private:
+    struct Variant {
+        string name;
+        vector<pair<string, string> > overrides;
+    };
+    void runChild(const Variant& v);
+    void waitChild(map<pid_t, string>& running, int& failures);
+
+    vector<Variant> _variants;
+    map<string, Hook> _hooks;
+    Logfile& _logfile;
+    uint32_t _jobs;
+    string _variant;
+};
+
+#endif
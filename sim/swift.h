@@ -14,6 +14,7 @@
 #include "swift_scheduler.h"
 #include "eventlist.h"
 #include "sent_packets.h"
+#include "reorder_scoreboard.h"
 
 //#define MODEL_RECEIVE_WINDOW 1
 
@@ -77,7 +78,7 @@ protected:
     bool _in_fast_recovery;
 
     // remember the default cwnd
-    static uint32_t _default_cwnd;
+    static thread_local uint32_t _default_cwnd;
     uint32_t _swift_cwnd;  // congestion window controlled by swift algorithm
     uint32_t _prev_cwnd;
     uint64_t _packets_sent;
@@ -246,8 +247,8 @@ public:
     uint32_t _drops;
     uint32_t drops();
 
-    list<SwiftAck::seq_t> _received; /* list of packets above a hole, that 
-                                        we've received */
+    ReorderScoreboard _received; /* packets above a hole, that
+                                    we've received */
 private:
     // Connectivity
     void connect(SwiftSubflowSrc& src, const Route& route);
@@ -15,29 +15,77 @@
 // queue, but only generates the data to send using DMA when the
 // network can send.
 
+const uint32_t BaseScheduler::NO_SLOT;
+
 BaseScheduler::BaseScheduler(linkspeed_bps bitrate, EventList &eventlist, QueueLogger* logger)
     : BaseQueue(bitrate, eventlist, logger), _pkt_count(0) {
+    _slot_index.resize(16, NO_SLOT);
+}
+
+static inline uint32_t
+slot_hash(flowid_t flow_id, size_t size) {
+    return (uint32_t)((flow_id * 2654435761u) & (size - 1));
+}
+
+uint32_t
+BaseScheduler::find_slot(flowid_t flow_id) const {
+    size_t mask = _slot_index.size() - 1;
+    for (uint32_t h = slot_hash(flow_id, _slot_index.size()); ; h = (h + 1) & mask) {
+        uint32_t slot = _slot_index[h];
+        if (slot == NO_SLOT || _slots[slot].flow_id == flow_id)
+            return slot;
+    }
+}
+
+uint32_t
+BaseScheduler::get_slot(flowid_t flow_id) {
+    uint32_t slot = find_slot(flow_id);
+    if (slot != NO_SLOT)
+        return slot;
+    slot = _slots.size();
+    _slots.push_back(FlowSlot(flow_id, NULL));
+    if (_slots.size() * 2 > _slot_index.size()) {
+        // keep the index at most half full
+        _slot_index.assign(_slot_index.size() * 2, NO_SLOT);
+        for (uint32_t i = 0; i < _slots.size(); i++) {
+            uint32_t h = slot_hash(_slots[i].flow_id, _slot_index.size());
+            while (_slot_index[h] != NO_SLOT)
+                h = (h + 1) & (_slot_index.size() - 1);
+            _slot_index[h] = i;
+        }
+    } else {
+        uint32_t h = slot_hash(flow_id, _slot_index.size());
+        while (_slot_index[h] != NO_SLOT)
+            h = (h + 1) & (_slot_index.size() - 1);
+        _slot_index[h] = slot;
+    }
+    return slot;
 }
 
 void
 BaseScheduler::add_src(int32_t flow_id, ScheduledSrc* src) {
     //cout << "add_subflow " << flow_id << " src " << src << endl;
     // make sure we don't add the same flow_id more than once
-    assert(_queue_counts.find(flow_id) == _queue_counts.end());
+    assert(find_slot(flow_id) == NO_SLOT);
     
-    _queue_counts[flow_id] = 0;
-    _srcs[flow_id] = src;
+    _slots[get_slot(flow_id)].src = src;
+}
+
+int
+BaseScheduler::src_queuesize(int32_t flow_id) {
+    uint32_t slot = find_slot(flow_id);
+    return slot == NO_SLOT ? 0 : _slots[slot].count;
 }
 
 void
 BaseScheduler::receivePacket(Packet & pkt) {
-    int flow_id = pkt.flow_id();
-    //cout << "recv_packet " << this << " flow_id " << flow_id << " count " << _pkt_count << " flow_count " << _queue_counts[flow_id] << endl;
+    uint32_t slot = get_slot(pkt.flow_id());
+    //cout << "recv_packet " << this << " flow_id " << pkt.flow_id() << " count " << _pkt_count << " flow_count " << _slots[slot].count << endl;
     if (pkt.type() == SWIFT) {
-      assert(_srcs.find(flow_id) != _srcs.end());
-      _queue_counts[flow_id]++;
+      assert(_slots[slot].src);
+      _slots[slot].count++;
     }
-    enqueue(pkt);
+    enqueue_slot(pkt, slot);
     //cout << "recv_packet2 " << this << " count " << _pkt_count << endl;
     if (_pkt_count == 1) {
         beginService();
@@ -86,8 +134,9 @@ BaseScheduler::completeService()
 
     // request more packets
     if (ptype == SWIFT) {
-      _queue_counts[flow_id]--;
-      _srcs[flow_id]->send_callback();
+      FlowSlot& slot = _slots[find_slot(flow_id)];
+      slot.count--;
+      slot.src->send_callback();
     }
 }
 
@@ -102,46 +151,61 @@ FifoScheduler::FifoScheduler(linkspeed_bps bitrate, EventList &eventlist, QueueL
 
 void
 FifoScheduler::enqueue(Packet& pkt) {
-    _queue.push_front(&pkt);
+    enqueue_slot(pkt, NO_SLOT);
+}
+
+void
+FifoScheduler::enqueue_slot(Packet& pkt, uint32_t /*slot*/) {
+    Packet* pkt_p = &pkt;
+    _queue.push(pkt_p);
     _pkt_count++;
-    assert(_pkt_count == _queue.size());
+    assert(_pkt_count == (uint32_t)_queue.size());
 }
 
 Packet*
 FifoScheduler::next_packet() {
-    return _queue.back();
+    return _queue.next_to_pop();
 }
 
 Packet*
 FifoScheduler::dequeue() {
     assert (_pkt_count > 0);
-    Packet* packet = _queue.back();
-    _queue.pop_back();
+    Packet* packet = _queue.pop();
     _pkt_count--;
-    assert(_pkt_count == _queue.size());
+    assert(_pkt_count == (uint32_t)_queue.size());
     return packet;
 }
 
 
 FairScheduler::FairScheduler(linkspeed_bps bitrate, EventList &eventlist, QueueLogger* logger)
     : BaseScheduler(bitrate, eventlist, logger)  {
-    _current_queue = _queue_map.begin();
     _next_packet = NULL;
+    _head = _tail = NO_SLOT;
 }
 
 
 void
 FairScheduler::enqueue(Packet& pkt) {
+    enqueue_slot(pkt, get_slot(pkt.flow_id()));
+}
+
+void
+FairScheduler::enqueue_slot(Packet& pkt, uint32_t slot) {
     // cout << "enqueue " << this << endl;
-    list <Packet*>* pkt_queue;
-    if (queue_exists(pkt)) {
-        pkt_queue = find_queue(pkt);
-    }  else {
-        pkt_queue = create_queue(pkt);
-    }
-    //we add packets to the front,remove them from the back
-    pkt_queue->push_front(&pkt);
+    FlowSlot& flow = _slots[slot];
+    Packet* pkt_p = &pkt;
+    flow.queue.push(pkt_p);
     _pkt_count++;
+    if (!flow.active) {
+        // join the back of the ring
+        flow.active = true;
+        flow.next = NO_SLOT;
+        if (_tail == NO_SLOT)
+            _head = slot;
+        else
+            _slots[_tail].next = slot;
+        _tail = slot;
+    }
 }
 
 Packet*
@@ -149,21 +213,24 @@ FairScheduler::next_packet() {
     // cout << "next_packet " << this << endl;
     assert(_pkt_count > 0);
     assert(!_next_packet);
-    while (1) {
-        if (_current_queue == _queue_map.end())
-            _current_queue = _queue_map.begin();
-        list <Packet*>* pkt_queue = _current_queue->second;
-        _current_queue++;
-        if (!pkt_queue->empty()) {
-            //we add packets to the front,remove them from the back
-            Packet* packet = pkt_queue->back();
-            pkt_queue->pop_back();
-            _next_packet = packet; 
-            return packet;
-        }
-        // there are packets queued, so we'll eventually find a queue
-        // that lets this terminate
+    uint32_t slot = _head;
+    FlowSlot& flow = _slots[slot];
+    Packet* packet = flow.queue.pop();
+    // one packet per turn, then to the back of the ring (or out of
+    // it, if that was the flow's last packet)
+    if (flow.queue.empty()) {
+        flow.active = false;
+        _head = flow.next;
+        if (_head == NO_SLOT)
+            _tail = NO_SLOT;
+    } else if (slot != _tail) {
+        _head = flow.next;
+        _slots[_tail].next = slot;
+        _tail = slot;
     }
+    flow.next = NO_SLOT;
+    _next_packet = packet; 
+    return packet;
 }
 
 Packet* 
@@ -176,30 +243,3 @@ FairScheduler::dequeue() {
     _pkt_count--;
     return p;
 }
-
-bool 
-FairScheduler::queue_exists(const Packet& pkt) {
-    typename map <flowid_t, list<Packet*>*>::iterator i;
-    i = _queue_map.find(pkt.flow_id());
-    if (i == _queue_map.end())
-        return false;
-    return true;
-}
-
-list<Packet*>* 
-FairScheduler::find_queue(const Packet& pkt) {
-    typename map <flowid_t, list<Packet*>*>::iterator i;
-    i = _queue_map.find(pkt.flow_id());
-    if (i == _queue_map.end())
-        return 0;
-    return i->second;
-}
-
-list<Packet*>* 
-FairScheduler::create_queue(const Packet& pkt) {
-    list<Packet*>* new_queue = new(list<Packet*>);
-    _queue_map.insert(pair<int32_t, list<Packet*>*>(pkt.flow_id(), new_queue));
-    return new_queue;
-}
-
-
@@ -11,6 +11,7 @@
 #include "eventlist.h"
 #include "network.h"
 #include "queue.h"
+#include "circular_buffer.h"
 //#include "swift.h"
 
 class ScheduledSrc {
@@ -40,11 +41,31 @@ class BaseScheduler : public BaseQueue {
         return (simtime_picosec)(pkt->size() * _ps_per_byte); 
     }
     void add_src(int32_t flowid, ScheduledSrc* src);
-    int src_queuesize(int32_t flowid) {return _queue_counts[flowid];}
+    int src_queuesize(int32_t flowid);
  protected:
+    static const uint32_t NO_SLOT = UINT32_MAX;
+
+    // Per-flow state, kept in a flat array.  Sources get a slot when
+    // they connect (add_src); any other flow gets one the first time
+    // we see a packet from it.
+    struct FlowSlot {
+        FlowSlot(flowid_t id, ScheduledSrc* s) : flow_id(id), src(s), count(0), active(false), next(NO_SLOT) {}
+        flowid_t flow_id;
+        ScheduledSrc* src;      // for callbacks
+        int32_t count;          // packets from src queued here
+        CircularBuffer<Packet*> queue; // only used by FairScheduler
+        bool active;            // in FairScheduler's ring
+        uint32_t next;          // next slot in the ring
+    };
+
+    // queue a packet from the flow in slot
+    virtual void enqueue_slot(Packet& pkt, uint32_t slot) = 0;
+    uint32_t find_slot(flowid_t flow_id) const;
+    uint32_t get_slot(flowid_t flow_id); // creates the slot if needed
+
     uint32_t _pkt_count;
-    map <flowid_t, int32_t> _queue_counts;  // map from flow id to packet count
-    map <flowid_t, ScheduledSrc*> _srcs; // map from flow id to SubflowSrc for callbacks
+    vector<FlowSlot> _slots;
+    vector<uint32_t> _slot_index; // open addressed hash from flow id to slot
 };
 
 class FifoScheduler : public BaseScheduler {
@@ -54,10 +75,13 @@ class FifoScheduler : public BaseScheduler {
     virtual Packet* next_packet();
     virtual Packet* dequeue();
  protected:
-    list<Packet*> _queue;
+    virtual void enqueue_slot(Packet& pkt, uint32_t slot);
+    CircularBuffer<Packet*> _queue;
 };
 
 
+// Round robin between the flows that have packets queued, which wait
+// in a ring threaded through their slots.
 class FairScheduler : public BaseScheduler{
  public:
     FairScheduler(linkspeed_bps bitrate, EventList &eventlist, QueueLogger* logger);
@@ -65,14 +89,11 @@ class FairScheduler : public BaseScheduler{
     virtual Packet* next_packet();
     virtual Packet* dequeue();
  protected:
-    map<flowid_t, list<Packet*>*> _queue_map;  // map flow id to pull queue
+    virtual void enqueue_slot(Packet& pkt, uint32_t slot);
     Packet *_next_packet; // when we start dequeuing a packet, it must
                           // not be able to change, so we store it in
-                          // _next_packet rather than the map
-    bool queue_exists(const Packet& pkt);
-    list<Packet*>* find_queue(const Packet& pkt);
-    list<Packet*>* create_queue(const Packet& pkt);
-    map<flowid_t, list<Packet*>*>::iterator _current_queue;
+                          // _next_packet rather than the flow's queue
+    uint32_t _head, _tail; // ring of slots with packets queued
 };
 
 #endif
@@ -47,7 +47,7 @@ protected:
     seq_t _dsn;
     bool _syn;
     simtime_picosec _ts;
-    static PacketDB<SwiftPacket> _packetdb;
+    static thread_local PacketDB<SwiftPacket> _packetdb;
 };
 
 class SwiftAck : public Packet {
@@ -81,7 +81,7 @@ protected:
     seq_t _ackno;
     seq_t _ds_ackno;
     simtime_picosec _ts_echo;
-    static PacketDB<SwiftAck> _packetdb;
+    static thread_local PacketDB<SwiftAck> _packetdb;
 };
 
 #endif
@@ -7,7 +7,7 @@
 #include "queue_lossless_input.h"
 #include "loggers.h"
 
-uint32_t Switch::id = 0;
+thread_local uint32_t Switch::id = 0;
 
 int Switch::addPort(BaseQueue* q){
     _ports.push_back(q);
@@ -16,8 +16,19 @@ int Switch::addPort(BaseQueue* q){
     
 }
 
-void Switch::sendPause(LosslessQueue* problem, unsigned int wait){
-    cout << "Switch " << _name << " link " << problem->_name << " blocked, sending pause " << wait << endl;
+void Switch::sendPause(LosslessQueue* problem, uint32_t pclass, unsigned int wait){
+    //the peer on a port stays paused for pclass while any of our other
+    //ports is over its threshold, so only the first XOFF and the last
+    //XON for a class reach it.  rest counts the requests from ports
+    //other than problem.
+    assert(pclass < _pause_requests.size());
+    uint32_t rest;
+    if (wait > 0)
+        rest = _pause_requests[pclass]++;
+    else {
+        assert(_pause_requests[pclass] > 0);
+        rest = --_pause_requests[pclass];
+    }
 
     for (size_t i = 0;i < _ports.size();i++){
         LosslessQueue* q = (LosslessQueue*)_ports.at(i);
@@ -25,18 +36,53 @@ void Switch::sendPause(LosslessQueue* problem, unsigned int wait){
         if (q==problem || !(q->getRemoteEndpoint()))
             continue;
 
-        cout << "Informing " << q->_name << endl;
-        EthPausePacket* pkt = EthPausePacket::newpkt(wait,_id);
+        if (rest != (q->pause_requested(pclass) ? 1u : 0u))
+            continue;
+
+        EthPausePacket* pkt = EthPausePacket::newpkt(pclass,wait,_id);
+        pkt->set_port(_peer_port[i]);
         q->getRemoteEndpoint()->receivePacket(*pkt);
     }
 };
 
+void Switch::receivePause(Packet& pkt){
+    EthPausePacket* p = (EthPausePacket*)&pkt;
+    assert(p->port() < _ports.size());
+    _ports[p->port()]->receivePacket(pkt);
+}
+
 void Switch::configureLossless(){
     for (size_t i = 0;i < _ports.size();i++){
         LosslessQueue* q = (LosslessQueue*)_ports.at(i);    
-        q->setSwitch(this);
+        if (q->getSwitch() != this)
+            q->setSwitch(this);
         q->initThresholds();
     }
+
+    _pause_requests.assign(EthPausePacket::_classes, 0);
+
+    //the k-th of our ports to a peer pairs with the k-th of the peer's
+    //ports back to us; PAUSE frames carry the peer's port index so it
+    //doesn't have to search for it.
+    _peer_port.assign(_ports.size(), UINT32_MAX);
+    for (size_t i = 0;i < _ports.size();i++){
+        Switch* peer = dynamic_cast<Switch*>(_ports[i]->getRemoteEndpoint());
+        if (!peer)
+            continue;
+
+        uint32_t k = 0;
+        for (size_t j = 0;j < i;j++)
+            if (_ports[j]->getRemoteEndpoint() == peer)
+                k++;
+
+        for (size_t j = 0;j < peer->_ports.size();j++){
+            if (peer->_ports[j]->getRemoteEndpoint() == this && k-- == 0){
+                _peer_port[i] = j;
+                break;
+            }
+        }
+        assert(_peer_port[i] != UINT32_MAX);
+    }
 };
 /*Switch::configureLosslessInput(){
   for (list<Queue*>::iterator it=_ports.begin(); it != _ports.end(); ++it){
@@ -51,8 +51,10 @@ class Switch : public EventSource, public Drawable, public PacketSink {
 
     unsigned int portCount(){ return _ports.size();}
 
-    void sendPause(LosslessQueue* problem, unsigned int wait);
+    void sendPause(LosslessQueue* problem, uint32_t pclass, unsigned int wait);
     void sendPause(LosslessInputQueue* problem, unsigned int wait);
+    // hand a PAUSE frame from a peer to the port it names
+    void receivePause(Packet& pkt);
 
     void configureLossless();
     void configureLosslessInput();
@@ -67,7 +69,14 @@ protected:
     string _name;
 
     RouteTable* _fib;
+
+    // lossless operation: for each port, the index of the port on the
+    // switch at its far end that sends back to us, and for each PFC
+    // class, how many of our ports have asked for their inputs to be
+    // paused.  Set up by configureLossless().
+    vector<uint32_t> _peer_port;
+    vector<uint32_t> _pause_requests;
  
-    static uint32_t id;
+    static thread_local uint32_t id;
 };
 #endif
@@ -658,28 +658,14 @@ TcpSink::receivePacket(Packet& pkt) {
         _cumulative_ack = seqno + size - 1;
         //cout << "New cumulative ack is " << _cumulative_ack << endl;
         // are there any additional received packets we can now ack?
-        while (!_received.empty() && (_received.front() == _cumulative_ack+1) ) {
-            _received.pop_front();
-            _cumulative_ack+= size;
-        }
+        _cumulative_ack += _received.advance(_cumulative_ack+1) * size;
     } else if (seqno < _cumulative_ack+1) {
     } else { // it's not the next expected sequence number
         if (_received.empty()) {
-            _received.push_front(seqno);
             //it's a drop in this simulator there are no reorderings.
             _drops += (1000 + seqno-_cumulative_ack-1)/1000;
-        } else if (seqno > _received.back()) { // likely case
-            _received.push_back(seqno);
-        } else { // uncommon case - it fills a hole
-            list<uint64_t>::iterator i;
-            for (i = _received.begin(); i != _received.end(); i++) {
-                if (seqno == *i) break; // it's a bad retransmit
-                if (seqno < (*i)) {
-                    _received.insert(i, seqno);
-                    break;
-                }
-            }
         }
+        _received.insert(seqno, size); // fails harmlessly on a bad retransmit
     }
     send_ack(ts,marked);
 }
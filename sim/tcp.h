@@ -12,6 +12,7 @@
 #include "tcppacket.h"
 #include "eventlist.h"
 #include "sent_packets.h"
+#include "reorder_scoreboard.h"
 
 //#define MODEL_RECEIVE_WINDOW 1
 
@@ -158,8 +159,8 @@ public:
     virtual const string& nodename() { return _nodename; }
 
     MultipathTcpSink* _mSink;
-    list<TcpAck::seq_t> _received; /* list of packets above a hole, that 
-                                      we've received */
+    ReorderScoreboard _received; /* packets above a hole, that
+                                    we've received */
 
 #ifdef PACKET_SCATTER
     vector<const Route*>* _paths;
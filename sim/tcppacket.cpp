@@ -1,4 +1,4 @@
 #include "tcppacket.h"
 
-PacketDB<TcpPacket> TcpPacket::_packetdb;
-PacketDB<TcpAck> TcpAck::_packetdb;
+thread_local PacketDB<TcpPacket> TcpPacket::_packetdb;
+thread_local PacketDB<TcpAck> TcpAck::_packetdb;
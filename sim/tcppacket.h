@@ -50,7 +50,7 @@ protected:
     seq_t _seqno,_data_seqno;
     bool _syn;
     simtime_picosec _ts;
-    static PacketDB<TcpPacket> _packetdb;
+    static thread_local PacketDB<TcpPacket> _packetdb;
 };
 
 class TcpAck : public Packet {
@@ -88,7 +88,7 @@ protected:
     seq_t _seqno;
     seq_t _ackno, _data_ackno;
     simtime_picosec _ts;
-    static PacketDB<TcpAck> _packetdb;
+    static thread_local PacketDB<TcpAck> _packetdb;
 };
 
 #endif